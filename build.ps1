@@ -1,6 +1,7 @@
 param (
   [switch]$run = $false,
   [switch]$test = $false,
+  [switch]$bench = $false,
   [switch]$publish = $false,
   [switch]$clean = $false)
 
@@ -34,6 +35,16 @@ if (-not (Test-Path -Path "tcc\include\winapi\mmsystem.h")) {
   }
 }
 
+if ($bench) {
+  Write-Host "Compiling lurds2_benchApp.exe"
+  & tcc\tcc.exe -g -o lurds2_benchApp.exe src\lurds2_benchApp.c
+  if (-not $?) { exit 1 }
+
+  Write-Host "Running lurds2_benchApp.exe"
+  & .\lurds2_benchApp.exe
+  exit $LASTEXITCODE
+}
+
 if (-not (Test-Path -Path "lua-5.4.2\src\lapi.h")) {
   Write-Host "Extracting lua"
   Expand-Archive -LiteralPath "deps\lua-5.4.2.zip" -DestinationPath "." -Force
@@ -84,6 +95,13 @@ else {
     Write-Host "Copying files to 'publish' directory"
     $unused = [System.IO.Directory]::CreateDirectory("publish")
     Copy-Item -LiteralPath "lurds2.exe" -Destination "publish"
-    Copy-Item -LiteralPath "res" -Destination "publish" -Recurse
+
+    # resources ship as one archive (mounted at startup) instead of loose files
+    Write-Host "Compiling lurds2_pakTool.exe"
+    & tcc\tcc.exe -g -o lurds2_pakTool.exe src\lurds2_pakTool.c
+    if (-not $?) { exit 1 }
+    $unused = [System.IO.Directory]::CreateDirectory("publish\res")
+    & .\lurds2_pakTool.exe publish\res\lurds2.lpak res=res looa=res/looa
+    if (-not $?) { exit 1 }
   }
 }
\ No newline at end of file
@@ -0,0 +1,262 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_arena.h"
+
+#include "lurds2_errors.h"
+
+#define DIAGNOSTIC_ARENA_ERROR(message) DIAGNOSTIC_ERROR(message);
+#define DIAGNOSTIC_ARENA_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
+#define DIAGNOSTIC_ARENA_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3));
+#define DIAGNOSTIC_ARENA_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_FRAME_BLOCK_SIZE (1024 * 1024)
+// Arena_Reset() doesn't merge blocks into one bigger than this (or than the arena's blockSize)
+#define ARENA_MAX_MERGED_BLOCK_SIZE (16 * 1024 * 1024)
+
+typedef struct ArenaBlock {
+  struct ArenaBlock* next; // blocks stay chained (in the order they were first used) until the arena is released
+  int32_t capacity; // bytes available after the header
+  int32_t used;
+} ArenaBlock;
+
+// (keeps the memory after the header aligned)
+#define ARENA_BLOCK_HEADER_SIZE ((sizeof(ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+#define ARENA_BLOCK_MEMORY(block) ((int8_t*)(block) + ARENA_BLOCK_HEADER_SIZE)
+
+typedef struct ArenaData {
+  ArenaBlock* first;
+  ArenaBlock* current; // the block being pushed into
+  ArenaBlock* furthest; // the last block in the chain that pushes reached since the last reset
+  int32_t blockSize; // capacity of new blocks (unless a push needs more)
+} ArenaData;
+
+static Arena gFrameArena;
+
+static ArenaBlock* Arena_CreateBlock(int32_t capacity)
+{
+  ArenaBlock* block = malloc(ARENA_BLOCK_HEADER_SIZE + (size_t)capacity);
+  if (block == 0)
+  {
+    DIAGNOSTIC_ARENA_ERROR("failed to allocate memory for arena block");
+    return 0;
+  }
+  block->next = 0;
+  block->capacity = capacity;
+  block->used = 0;
+  return block;
+}
+
+Arena Arena_Create(int32_t blockSize)
+{
+  if (blockSize < ARENA_ALIGNMENT || blockSize > 0x40000000)
+  {
+    DIAGNOSTIC_ARENA_ERROR("invalid blockSize arg");
+    return 0;
+  }
+
+  ArenaData* data = malloc(sizeof(ArenaData));
+  if (data == 0)
+  {
+    DIAGNOSTIC_ARENA_ERROR("failed to allocate memory for ArenaData");
+    return 0;
+  }
+  memset(data, 0, sizeof(ArenaData));
+  data->blockSize = blockSize;
+  return data;
+}
+
+static void Arena_FreeBlocks(ArenaData* data)
+{
+  ArenaBlock* block = data->first;
+  while (block)
+  {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  data->first = 0;
+  data->current = 0;
+  data->furthest = 0;
+}
+
+void Arena_Release(Arena arena)
+{
+  ArenaData* data = (ArenaData*)arena;
+  if (data == 0)
+  {
+    DIAGNOSTIC_ARENA_ERROR("invalid null arg");
+    return;
+  }
+
+  if (arena == gFrameArena) gFrameArena = 0;
+  Arena_FreeBlocks(data);
+  free(data);
+}
+
+void* Arena_Push(Arena arena, int32_t size)
+{
+  ArenaData* data = (ArenaData*)arena;
+  if (data == 0)
+  {
+    DIAGNOSTIC_ARENA_ERROR("invalid null arg");
+    return 0;
+  }
+
+  if (size < 0 || size > 0x40000000)
+  {
+    DIAGNOSTIC_ARENA_ERROR("invalid size arg");
+    return 0;
+  }
+
+  int32_t alignedSize = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+  ArenaBlock* block = data->current;
+  if (block == 0 || block->capacity - block->used < alignedSize)
+  {
+    // move on to the next block (reused from before the last reset), or chain in a new one where it doesn't fit
+    ArenaBlock* next = block ? block->next : data->first;
+    if (next == 0 || next->capacity < alignedSize)
+    {
+      ArenaBlock* newBlock = Arena_CreateBlock(alignedSize > data->blockSize ? alignedSize : data->blockSize);
+      if (newBlock == 0)
+      {
+        return 0;
+      }
+      newBlock->next = next;
+      if (block) block->next = newBlock;
+      else data->first = newBlock;
+      if (data->furthest == block) data->furthest = newBlock; // (else it went in before the furthest one)
+      next = newBlock;
+    }
+    else if (data->furthest == block)
+    {
+      data->furthest = next;
+    }
+    next->used = 0;
+    block = next;
+    data->current = block;
+  }
+
+  void* result = ARENA_BLOCK_MEMORY(block) + block->used;
+  block->used += alignedSize;
+  return result;
+}
+
+void* Arena_PushZero(Arena arena, int32_t size)
+{
+  void* result = Arena_Push(arena, size);
+  if (result) memset(result, 0, size);
+  return result;
+}
+
+ArenaMark Arena_Mark(Arena arena)
+{
+  ArenaMark mark;
+  mark.block = 0;
+  mark.used = 0;
+
+  ArenaData* data = (ArenaData*)arena;
+  if (data == 0)
+  {
+    DIAGNOSTIC_ARENA_ERROR("invalid null arg");
+    return mark;
+  }
+
+  if (data->current)
+  {
+    mark.block = data->current;
+    mark.used = data->current->used;
+  }
+  return mark;
+}
+
+void Arena_ResetToMark(Arena arena, ArenaMark mark)
+{
+  ArenaData* data = (ArenaData*)arena;
+  if (data == 0)
+  {
+    DIAGNOSTIC_ARENA_ERROR("invalid null arg");
+    return;
+  }
+
+  // (blocks after the marked one get their 'used' reset as pushes move back into them)
+  data->current = (ArenaBlock*)mark.block;
+  if (data->current)
+  {
+    data->current->used = mark.used;
+  }
+}
+
+void Arena_Reset(Arena arena)
+{
+  ArenaData* data = (ArenaData*)arena;
+  if (data == 0)
+  {
+    DIAGNOSTIC_ARENA_ERROR("invalid null arg");
+    return;
+  }
+
+  // free the blocks past the furthest one the last round reached (so one big round doesn't pin its memory)
+  ArenaBlock* furthest = data->furthest;
+  if (furthest)
+  {
+    ArenaBlock* block = furthest->next;
+    while (block)
+    {
+      ArenaBlock* next = block->next;
+      free(block);
+      block = next;
+    }
+    furthest->next = 0;
+  }
+
+  // if the last round needed several blocks, swap them for one block that holds it all (so after a few rounds
+  // the arena settles into one block and pushes never leave it). A round too big for one block of at most
+  // ARENA_MAX_MERGED_BLOCK_SIZE keeps its blocks as they are instead, rather than merging every reset.
+  if (data->first && data->first->next)
+  {
+    int64_t total = 0;
+    ArenaBlock* block;
+    for (block = data->first; block; block = block->next) total += block->capacity;
+    int64_t maxMerged = data->blockSize > ARENA_MAX_MERGED_BLOCK_SIZE ? data->blockSize : ARENA_MAX_MERGED_BLOCK_SIZE;
+
+    ArenaBlock* merged = total <= maxMerged ? Arena_CreateBlock((int32_t)total) : 0;
+    if (merged != 0)
+    {
+      Arena_FreeBlocks(data);
+      data->first = merged;
+    }
+  }
+
+  data->current = data->first;
+  data->furthest = data->first;
+  if (data->current)
+  {
+    data->current->used = 0;
+  }
+}
+
+Arena Arena_GetFrameArena()
+{
+  if (gFrameArena == 0)
+  {
+    gFrameArena = Arena_Create(ARENA_FRAME_BLOCK_SIZE);
+    if (gFrameArena == 0)
+    {
+      FATAL_ERROR("failed to create the frame arena");
+    }
+  }
+  return gFrameArena;
+}
+
+void Arena_BeginFrame()
+{
+  if (gFrameArena)
+  {
+    Arena_Reset(gFrameArena);
+  }
+}
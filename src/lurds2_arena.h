@@ -0,0 +1,39 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_ARENA
+#define LURDS2_ARENA
+
+typedef void* Arena;
+
+// a position in an arena to roll back to (everything pushed after it gets released at once)
+typedef struct ArenaMark {
+  void* block;
+  int32_t used;
+} ArenaMark;
+
+// An Arena hands out scratch memory by bumping a pointer through big blocks. Nothing is freed individually;
+// instead Arena_ResetToMark()/Arena_Reset() release everything pushed since, and the blocks get reused.
+Arena     Arena_Create(int32_t blockSize);
+void      Arena_Release(Arena arena);
+
+// returns 'size' bytes (16-byte aligned, uninitialized), or 0 on failure
+void*     Arena_Push(Arena arena, int32_t size);
+// like Arena_Push() but zeroed
+void*     Arena_PushZero(Arena arena, int32_t size);
+ArenaMark Arena_Mark(Arena arena);
+void      Arena_ResetToMark(Arena arena, ArenaMark mark);
+// releases everything (and, if the arena spilled into several blocks, merges them into one for next time, up to
+// a limit; blocks past the furthest one used since the last reset get freed)
+void      Arena_Reset(Arena arena);
+
+// The frame arena is scratch memory for the main (window) thread that lives until the next frame starts,
+// so a temporary can just be pushed and forgotten. Longer-running code (loaders) should still mark and reset.
+Arena     Arena_GetFrameArena();
+// resets the frame arena; the main loop calls this once per iteration
+void      Arena_BeginFrame();
+
+#endif
@@ -0,0 +1,227 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_atlas.h"
+
+#include "lurds2_errors.h"
+
+#define DIAGNOSTIC_ATLAS_ERROR(message) DIAGNOSTIC_ERROR(message)
+#define DIAGNOSTIC_ATLAS_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2))
+#define DIAGNOSTIC_ATLAS_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3))
+#define DIAGNOSTIC_ATLAS_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4))
+
+// a stretch of the skyline: everything below 'y' from 'x' to 'x + width' is taken
+typedef struct AtlasSegment {
+  int x;
+  int y;
+  int width;
+} AtlasSegment;
+
+// the segments run left to right and cover the whole page width (each is at least 1 wide, so there are at most
+// pageWidth of them)
+typedef struct AtlasPage {
+  AtlasSegment* segments;
+  int segmentCount;
+} AtlasPage;
+
+typedef struct AtlasItem {
+  int width;
+  int height;
+  int index;
+} AtlasItem;
+
+// tallest first (then widest, then in the order given, so packing is repeatable)
+static int Atlas_CompareItems(const void* a, const void* b)
+{
+  const AtlasItem* first = a;
+  const AtlasItem* second = b;
+  if (first->height != second->height) return second->height - first->height;
+  if (first->width != second->width) return second->width - first->width;
+  return first->index - second->index;
+}
+
+// returns the y a rectangle 'width' wide would rest at with its left edge on segment 'first'
+static int Atlas_RestingY(const AtlasPage* page, int first, int width)
+{
+  int y = 0;
+  int i;
+  for (i = first; width > 0; i++)
+  {
+    if (page->segments[i].y > y) y = page->segments[i].y;
+    width -= page->segments[i].width;
+  }
+  return y;
+}
+
+// finds where the rectangle sits lowest (then leftmost); returns the segment its left edge goes on, or -1 if it
+// doesn't fit on the page
+static int Atlas_FindSpot(const AtlasPage* page, int width, int height, int pageWidth, int pageHeight, int* y)
+{
+  int best = -1;
+  int bestTop = pageHeight + 1;
+  int i;
+  for (i = 0; i < page->segmentCount; i++)
+  {
+    if (page->segments[i].x + width > pageWidth) break;
+    int restingY = Atlas_RestingY(page, i, width);
+    if (restingY + height < bestTop)
+    {
+      best = i;
+      bestTop = restingY + height;
+      *y = restingY;
+    }
+  }
+  return bestTop <= pageHeight ? best : -1;
+}
+
+// raises the skyline to 'top' from the start of segment 'first' for 'width'
+static void Atlas_Place(AtlasPage* page, int first, int width, int top)
+{
+  AtlasSegment* segments = page->segments;
+  int x = segments[first].x;
+  int end = x + width;
+
+  // segments [first, last) end up completely under the rectangle, and segment 'last' may be partly under it
+  int last = first;
+  while (last < page->segmentCount && segments[last].x + segments[last].width <= end) last++;
+  if (last < page->segmentCount && segments[last].x < end)
+  {
+    segments[last].width -= end - segments[last].x;
+    segments[last].x = end;
+  }
+
+  // replace them with one segment along the rectangle's top
+  int removed = last - first;
+  memmove(&segments[first + 1], &segments[last], sizeof(AtlasSegment) * (page->segmentCount - last));
+  page->segmentCount += 1 - removed;
+  segments[first].x = x;
+  segments[first].y = top;
+  segments[first].width = width;
+
+  // merge with neighbors at the same height
+  if (first + 1 < page->segmentCount && segments[first + 1].y == top)
+  {
+    segments[first].width += segments[first + 1].width;
+    memmove(&segments[first + 1], &segments[first + 2], sizeof(AtlasSegment) * (page->segmentCount - first - 2));
+    page->segmentCount--;
+  }
+  if (first > 0 && segments[first - 1].y == top)
+  {
+    segments[first - 1].width += segments[first].width;
+    memmove(&segments[first], &segments[first + 1], sizeof(AtlasSegment) * (page->segmentCount - first - 1));
+    page->segmentCount--;
+  }
+}
+
+static int Atlas_AddPage(AtlasPage** pages, int* count, int* capacity, int pageWidth)
+{
+  if (*count == *capacity)
+  {
+    int newCapacity = *capacity ? *capacity * 2 : 4;
+    AtlasPage* newPages = realloc(*pages, sizeof(AtlasPage) * newCapacity);
+    if (newPages == 0)
+    {
+      DIAGNOSTIC_ATLAS_ERROR("failed to allocate memory for atlas pages");
+      return 0;
+    }
+    *pages = newPages;
+    *capacity = newCapacity;
+  }
+
+  AtlasPage* page = &(*pages)[*count];
+  page->segments = malloc(sizeof(AtlasSegment) * pageWidth);
+  if (page->segments == 0)
+  {
+    DIAGNOSTIC_ATLAS_ERROR("failed to allocate memory for an atlas skyline");
+    return 0;
+  }
+  page->segments[0].x = 0;
+  page->segments[0].y = 0;
+  page->segments[0].width = pageWidth;
+  page->segmentCount = 1;
+  (*count)++;
+  return 1;
+}
+
+int Atlas_Pack(const int* widths, const int* heights, int count, int pageWidth, int pageHeight,
+               int* pages, int* xs, int* ys, int* pageCount)
+{
+  if (widths == 0 || heights == 0 || count < 0 || pageWidth <= 0 || pageHeight <= 0 || pages == 0 || xs == 0 || ys == 0 || pageCount == 0)
+  {
+    DIAGNOSTIC_ATLAS_ERROR("invalid arg");
+    return 0;
+  }
+
+  AtlasPage* atlasPages = 0;
+  int atlasPageCount = 0;
+  int atlasPageCapacity = 0;
+  int i;
+  AtlasItem* items = malloc(sizeof(AtlasItem) * (count + 1));
+  if (items == 0)
+  {
+    DIAGNOSTIC_ATLAS_ERROR("failed to allocate memory for atlas items");
+    goto error;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    if (widths[i] <= 0 || heights[i] <= 0)
+    {
+      DIAGNOSTIC_ATLAS_ERROR("invalid non-positive rectangle size");
+      goto error;
+    }
+    items[i].width = widths[i];
+    items[i].height = heights[i];
+    items[i].index = i;
+  }
+  qsort(items, count, sizeof(AtlasItem), Atlas_CompareItems);
+
+  for (i = 0; i < count; i++)
+  {
+    AtlasItem* item = &items[i];
+    if (item->width > pageWidth || item->height > pageHeight)
+    {
+      pages[item->index] = -1;
+      xs[item->index] = 0;
+      ys[item->index] = 0;
+      continue;
+    }
+
+    // first fit over the pages so far, else a new page (where it always fits)
+    int page;
+    int segment = -1;
+    int y = 0;
+    for (page = 0; page < atlasPageCount; page++)
+    {
+      segment = Atlas_FindSpot(&atlasPages[page], item->width, item->height, pageWidth, pageHeight, &y);
+      if (segment >= 0) break;
+    }
+    if (segment < 0)
+    {
+      if (!Atlas_AddPage(&atlasPages, &atlasPageCount, &atlasPageCapacity, pageWidth)) goto error;
+      page = atlasPageCount - 1;
+      segment = 0;
+      y = 0;
+    }
+
+    pages[item->index] = page;
+    xs[item->index] = atlasPages[page].segments[segment].x;
+    ys[item->index] = y;
+    Atlas_Place(&atlasPages[page], segment, item->width, y + item->height);
+  }
+
+  for (i = 0; i < atlasPageCount; i++) free(atlasPages[i].segments);
+  free(atlasPages);
+  free(items);
+  *pageCount = atlasPageCount;
+  return 1;
+
+error:
+  for (i = 0; i < atlasPageCount; i++) free(atlasPages[i].segments);
+  if (atlasPages != 0) free(atlasPages);
+  if (items != 0) free(items);
+  return 0;
+}
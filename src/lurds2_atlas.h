@@ -0,0 +1,20 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_ATLAS
+#define LURDS2_ATLAS
+
+// An atlas packs lots of little images onto a few big "pages", so they can share one texture each.
+// Atlas_Pack() places rectangles with a skyline packer: the tallest go first, each at the lowest spot along
+// the page's top edge (the skyline) where it fits, trying the pages already started before starting a new one.
+
+// places the 'count' rectangles (widths[i] x heights[i]) on pages of pageWidth x pageHeight and writes each one's
+// page and top-left corner; a rectangle too big for an empty page gets page -1 (so the caller can give it a page
+// of its own). Writes how many pages were used to 'pageCount'. Returns 0 on failure.
+int Atlas_Pack(const int* widths, const int* heights, int count, int pageWidth, int pageHeight,
+               int* pages, int* xs, int* ys, int* pageCount);
+
+#endif
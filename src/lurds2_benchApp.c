@@ -0,0 +1,1022 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+// Headless benchmark + fuzzer for the engine's parsers and thread plumbing. No window, so it also builds and runs on Linux:
+//   cc -O2 -o lurds2_benchApp src/lurds2_benchApp.c -lm -lpthread
+//   lurds2_benchApp                  times JsonStream over generated corpora (and reports MB/s, tokens/s)
+//   lurds2_benchApp a.json b.json    ... and over the given files
+//   lurds2_benchApp -fuzz 100000     mutates small corpora and checks every way of parsing them against a plain reference tokenizer
+//   lurds2_benchApp -rings           stress tests the Ring queues across threads, then times them
+//   lurds2_benchApp -vfs [lords2Dir] times mounting the resource files, then finding/mapping them mounted vs. not
+// For coverage-guided fuzzing, build the same file as a libFuzzer target instead:
+//   clang -g -O1 -fsanitize=fuzzer,address -DLURDS2_FUZZ src/lurds2_benchApp.c
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "lurds2_errors.c"
+#include "lurds2_performanceCounter.c"
+#include "lurds2_stringutils.c"
+#include "lurds2_resourceFile.c"
+#include "lurds2_jsonstream.c"
+#include "lurds2_hash.c"
+#include "lurds2_pak.c"
+#include "lurds2_ring.c"
+#include "lurds2_arena.c"
+#include "lurds2_hashmap.c"
+#include "lurds2_vfs.c"
+#include "lurds2_watch.c"
+
+// a growable text buffer for generating corpora and token signatures
+typedef struct BenchText {
+  char* data;
+  int32_t length;
+  int32_t capacity;
+} BenchText;
+
+static void BenchText_Append(BenchText* text, const char* bytes, int32_t length)
+{
+  if (text->length + length + 1 > text->capacity)
+  {
+    int32_t newCapacity = text->capacity ? text->capacity : 4096;
+    while (text->length + length + 1 > newCapacity) newCapacity *= 2;
+    char* newData = realloc(text->data, newCapacity);
+    if (newData == 0)
+    {
+      FATAL_ERROR("failed to allocate memory for bench text");
+    }
+    text->data = newData;
+    text->capacity = newCapacity;
+  }
+  if (length > 0) memcpy(text->data + text->length, bytes, length);
+  text->length += length;
+  text->data[text->length] = 0;
+}
+
+static void BenchText_AppendString(BenchText* text, const char* s)
+{
+  BenchText_Append(text, s, strlen(s));
+}
+
+static void BenchText_Free(BenchText* text)
+{
+  free(text->data);
+  memset(text, 0, sizeof(BenchText));
+}
+
+// xorshift64*, so corpora and fuzz runs are the same on every machine
+static uint64_t Bench_Random(uint64_t* state)
+{
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+static int32_t Bench_RandomRange(uint64_t* state, int32_t count)
+{
+  return (int32_t)((Bench_Random(state) >> 33) % (uint64_t)count);
+}
+
+static void Bench_MakeDeepNesting(BenchText* text, int32_t targetSize, uint64_t* rng)
+{
+  BenchText_AppendString(text, "[");
+  while (text->length < targetSize)
+  {
+    if (text->length > 1) BenchText_AppendString(text, ",");
+    int32_t depth = 16 + Bench_RandomRange(rng, 112);
+    int32_t i;
+    for (i = 0; i < depth; i++) BenchText_AppendString(text, (i & 1) ? "[" : "{\"n\":");
+    BenchText_AppendString(text, "true");
+    for (i = depth - 1; i >= 0; i--) BenchText_AppendString(text, (i & 1) ? "]" : "}");
+  }
+  BenchText_AppendString(text, "]");
+}
+
+static void Bench_MakeLongStrings(BenchText* text, int32_t targetSize, uint64_t* rng)
+{
+  static const char* escapes[] = { "\\n", "\\\"", "\\\\", "\\/", "\\t" }; // (no unicode escapes; JsonStream doesn't support them yet)
+  BenchText_AppendString(text, "[");
+  while (text->length < targetSize)
+  {
+    if (text->length > 1) BenchText_AppendString(text, ",");
+    BenchText_AppendString(text, "\"");
+    int32_t length = 256 + Bench_RandomRange(rng, 4096);
+    int withEscapes = Bench_RandomRange(rng, 4) != 0;
+    int32_t i;
+    for (i = 0; i < length; i++)
+    {
+      if (withEscapes && Bench_RandomRange(rng, 64) == 0)
+      {
+        BenchText_AppendString(text, escapes[Bench_RandomRange(rng, 5)]);
+      }
+      else
+      {
+        char c = (char)('a' + Bench_RandomRange(rng, 26));
+        if (Bench_RandomRange(rng, 8) == 0) c = ' ';
+        BenchText_Append(text, &c, 1);
+      }
+    }
+    BenchText_AppendString(text, "\"");
+  }
+  BenchText_AppendString(text, "]");
+}
+
+static void Bench_MakeNumbers(BenchText* text, int32_t targetSize, uint64_t* rng)
+{
+  char buffer[64];
+  BenchText_AppendString(text, "[");
+  while (text->length < targetSize)
+  {
+    if (text->length > 1) BenchText_AppendString(text, ",");
+    switch (Bench_RandomRange(rng, 4))
+    {
+      case 0: sprintf(buffer, "%d", Bench_RandomRange(rng, 2000) - 1000); break;
+      case 1: sprintf(buffer, "%lld", (long long)(Bench_Random(rng) >> 1) * (Bench_RandomRange(rng, 2) ? 1 : -1)); break;
+      case 2: sprintf(buffer, "%d.%03d", Bench_RandomRange(rng, 100000), Bench_RandomRange(rng, 1000)); break;
+      default: sprintf(buffer, "%.17g", (double)(Bench_Random(rng) >> 11) * 1e-10 * (Bench_RandomRange(rng, 2) ? 1e-20 : 1e20)); break;
+    }
+    BenchText_AppendString(text, buffer);
+  }
+  BenchText_AppendString(text, "]");
+}
+
+static void Bench_MakeComments(BenchText* text, int32_t targetSize, uint64_t* rng)
+{
+  char buffer[64];
+  int32_t count = 0;
+  BenchText_AppendString(text, "// a settings file that is mostly commentary\n{\n");
+  while (text->length < targetSize)
+  {
+    if (count) BenchText_AppendString(text, ",\n");
+    if (Bench_RandomRange(rng, 2))
+    {
+      BenchText_AppendString(text, "  // what this setting does, why it has the value it has, and what else it affects\n");
+    }
+    else
+    {
+      BenchText_AppendString(text, "  /* a longer block comment\n     spanning a few lines, with \"quotes\" and {brackets} in it\n  */\n");
+    }
+    sprintf(buffer, "  \"setting%d\": %d /* default */", count++, Bench_RandomRange(rng, 100));
+    BenchText_AppendString(text, buffer);
+  }
+  BenchText_AppendString(text, "\n}\n");
+}
+
+// the typical consumer: touch every token's value, so lazily-decoded strings and numbers get paid for too
+static int64_t Bench_ConsumeTokens(JsonStream stream)
+{
+  int64_t count = 0;
+  JsonStreamTokenType t;
+  while ((t = JsonStream_MoveNext(stream)) != JsonStreamEnd && t != JsonStreamError && t != JsonStreamNeedMoreData)
+  {
+    if (t == JsonStreamString || t == JsonStreamPropertyName) JsonStream_GetString(stream, 0);
+    else if (t == JsonStreamNumber) JsonStream_GetNumberDouble(stream);
+    count++;
+  }
+  return t == JsonStreamError ? -1 : count;
+}
+
+typedef enum BenchMode {
+  BenchMode_Parse,
+  BenchMode_ParseRange,
+  BenchMode_Incremental,
+  BenchMode_COUNT
+} BenchMode;
+
+static const char* BenchModeNames[BenchMode_COUNT] = { "Parse", "ParseRange", "Feed 4K" };
+
+// one full pass; returns the token count (or -1 on a parse error)
+static int64_t Bench_ParseOnce(const char* json, int32_t length, BenchMode mode)
+{
+  JsonStream stream;
+  int64_t count;
+  if (mode == BenchMode_Parse)
+  {
+    stream = JsonStream_Parse(json, "bench");
+    count = Bench_ConsumeTokens(stream);
+  }
+  else if (mode == BenchMode_ParseRange)
+  {
+    stream = JsonStream_ParseRange(json, json + length, "bench");
+    count = Bench_ConsumeTokens(stream);
+  }
+  else
+  {
+    stream = JsonStream_CreateIncremental("bench");
+    int32_t position = 0;
+    count = 0;
+    while (1)
+    {
+      int64_t more = Bench_ConsumeTokens(stream);
+      if (more < 0) { count = -1; break; }
+      count += more;
+      if (JsonStream_GetTokenType(stream) != JsonStreamNeedMoreData) break;
+      if (position == length)
+      {
+        JsonStream_FeedEnd(stream);
+        continue;
+      }
+      int32_t chunkLength = length - position < 4096 ? length - position : 4096;
+      JsonStream_Feed(stream, json + position, chunkLength);
+      position += chunkLength;
+    }
+  }
+  JsonStream_Release(stream);
+  return count;
+}
+
+static void Bench_Report(const char* name, const char* json, int32_t length)
+{
+  int mode;
+  for (mode = 0; mode < BenchMode_COUNT; mode++)
+  {
+    // best of several passes (at least 3, for at least half a second) to keep the numbers steady
+    double bestSeconds = 0;
+    double totalSeconds = 0;
+    int64_t tokens = 0;
+    int passes = 0;
+    while (passes < 3 || totalSeconds < 0.5)
+    {
+      PerformanceCounter start = PerformanceCounter_Start();
+      tokens = Bench_ParseOnce(json, length, (BenchMode)mode);
+      double seconds = PerformanceCounter_MeasureSeconds(start);
+      if (tokens < 0) break;
+      if (passes == 0 || seconds < bestSeconds) bestSeconds = seconds;
+      totalSeconds += seconds;
+      passes++;
+    }
+    if (tokens < 0)
+    {
+      printf("%-14s %-10s parse error\n", name, BenchModeNames[mode]);
+      return;
+    }
+    if (bestSeconds <= 0) bestSeconds = 1e-9;
+    printf("%-14s %-10s %8.2f MB %10.1f MB/s %10.2f Mtokens/s\n", name, BenchModeNames[mode],
+      length / 1e6, length / 1e6 / bestSeconds, tokens / 1e6 / bestSeconds);
+  }
+}
+
+static int Bench_ReportFile(const char* fileName)
+{
+  FILE* f = fopen(fileName, "rb");
+  if (f == 0)
+  {
+    printf("couldn't open %s\n", fileName);
+    return 0;
+  }
+  BenchText text;
+  memset(&text, 0, sizeof(text));
+  char buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) BenchText_Append(&text, buffer, (int32_t)n);
+  fclose(f);
+  if (text.length == 0) BenchText_Append(&text, "", 0);
+  Bench_Report(fileName, text.data, text.length);
+  BenchText_Free(&text);
+  return 1;
+}
+
+// writes everything a consumer could observe about a token, so two parses can be compared byte for byte
+static void Bench_AppendSignature(BenchText* signature, JsonStreamTokenType t, const char* s, int32_t length, int64_t i, double d)
+{
+  char c = (char)('A' + t);
+  BenchText_Append(signature, &c, 1);
+  if (t == JsonStreamString || t == JsonStreamPropertyName || t == JsonStreamNumber)
+  {
+    BenchText_Append(signature, (const char*)&length, sizeof(length));
+    BenchText_Append(signature, s, length);
+  }
+  if (t == JsonStreamNumber)
+  {
+    BenchText_Append(signature, (const char*)&i, sizeof(i));
+    BenchText_Append(signature, (const char*)&d, sizeof(d));
+  }
+}
+
+static void Bench_Signature(JsonStream stream, JsonStreamTokenType t, BenchText* signature)
+{
+  int32_t length = 0;
+  const char* s = 0;
+  int64_t i = 0;
+  double d = 0;
+  if (t == JsonStreamString || t == JsonStreamPropertyName || t == JsonStreamNumber) s = JsonStream_GetString(stream, &length);
+  if (t == JsonStreamNumber)
+  {
+    i = JsonStream_GetNumberInt(stream);
+    d = JsonStream_GetNumberDouble(stream);
+  }
+  Bench_AppendSignature(signature, t, s, length, i, d);
+}
+
+static void Bench_SignatureOfStream(JsonStream stream, BenchText* signature, BenchText* types)
+{
+  JsonStreamTokenType t;
+  do
+  {
+    t = JsonStream_MoveNext(stream);
+    Bench_Signature(stream, t, signature);
+    if (types) { char c = (char)t; BenchText_Append(types, &c, 1); }
+  } while (t != JsonStreamEnd && t != JsonStreamError);
+}
+
+static void Bench_SignatureOfChunks(const char* json, int32_t length, uint64_t seed, BenchText* signature)
+{
+  JsonStream stream = JsonStream_CreateIncremental("fuzz");
+  int32_t position = 0;
+  JsonStreamTokenType t;
+  while (1)
+  {
+    t = JsonStream_MoveNext(stream);
+    if (t == JsonStreamNeedMoreData)
+    {
+      if (position == length)
+      {
+        JsonStream_FeedEnd(stream);
+        continue;
+      }
+      // mostly tiny chunks, so plenty of tokens straddle them
+      int32_t chunkLength = 1 + Bench_RandomRange(&seed, Bench_RandomRange(&seed, 4) ? 8 : 256);
+      if (chunkLength > length - position) chunkLength = length - position;
+      JsonStream_Feed(stream, json + position, chunkLength);
+      position += chunkLength;
+      continue;
+    }
+    Bench_Signature(stream, t, signature);
+    if (t == JsonStreamEnd || t == JsonStreamError) break;
+  }
+  JsonStream_Release(stream);
+}
+
+// ---- Reference tokenizer ----
+
+// A plain byte-at-a-time tokenizer for the dialect JsonStream accepts (commas count as whitespace, // and /* */
+// comments, no \u escapes). It shares none of JsonStream's scanning code, so a bug in that code can't hide by
+// showing up the same way in every mode of parsing.
+
+static const char* Bench_ReferenceSkipFiller(const char* p, const char* end)
+{
+  while (p < end)
+  {
+    if (*p == ' ' || *p == '\r' || *p == '\n' || *p == '\t' || *p == ',')
+    {
+      p++;
+    }
+    else if (*p == '/' && p + 1 < end && p[1] == '/')
+    {
+      p += 2;
+      while (p < end && *p != '\r' && *p != '\n') p++;
+    }
+    else if (*p == '/' && p + 1 < end && p[1] == '*')
+    {
+      // (an unterminated comment runs to the end)
+      p += 2;
+      while (p < end && !(*p == '*' && p + 1 < end && p[1] == '/')) p++;
+      p = p < end ? p + 2 : end;
+    }
+    else
+    {
+      break;
+    }
+  }
+  return p;
+}
+
+// returns the end of the number at 'p', or 0 if it's malformed
+static const char* Bench_ReferenceNumberEnd(const char* p, const char* end)
+{
+  if (p < end && *p == '-') p++;
+  if (p == end || *p < '0' || *p > '9') return 0;
+  if (*p == '0')
+  {
+    p++;
+    if (p < end && *p >= '0' && *p <= '9') return 0;
+  }
+  while (p < end && *p >= '0' && *p <= '9') p++;
+  if (p < end && *p == '.')
+  {
+    p++;
+    if (p == end || *p < '0' || *p > '9') return 0;
+    while (p < end && *p >= '0' && *p <= '9') p++;
+  }
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    p++;
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    if (p == end || *p < '0' || *p > '9') return 0;
+    while (p < end && *p >= '0' && *p <= '9') p++;
+  }
+  return p;
+}
+
+// what JsonStream_GetNumberInt() promises: integers that fit are exact, anything else is the double truncated
+// (and clamped to int64)
+static int64_t Bench_ReferenceNumberInt(const char* text, double d)
+{
+  const char* p = text;
+  int negative = (*p == '-');
+  if (negative) p++;
+  uint64_t magnitude = 0;
+  int fits = 1;
+  for (; *p >= '0' && *p <= '9'; p++)
+  {
+    if (magnitude > (UINT64_MAX - 9) / 10) fits = 0;
+    magnitude = magnitude * 10 + (*p - '0');
+  }
+  if (*p == 0 && fits && magnitude <= (uint64_t)INT64_MAX + negative)
+  {
+    return negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+  }
+  if (d >= 9223372036854775807.0) return INT64_MAX;
+  if (d <= -9223372036854775808.0) return INT64_MIN;
+  if (d != d) return 0;
+  return (int64_t)d;
+}
+
+static void Bench_SignatureOfReference(const char* json, int32_t length, BenchText* signature)
+{
+  const char* p = json;
+  const char* end = json + length;
+  BenchText text;
+  memset(&text, 0, sizeof(text));
+  JsonStreamTokenType t;
+  do
+  {
+    p = Bench_ReferenceSkipFiller(p, end);
+    const char* tokenStart = p;
+    int64_t i = 0;
+    double d = 0;
+    text.length = 0;
+    BenchText_Append(&text, "", 0);
+
+    if (p == end)
+    {
+      t = JsonStreamEnd;
+    }
+    else if (*p == '{' || *p == '}' || *p == '[' || *p == ']')
+    {
+      t = *p == '{' ? JsonStreamObjectStart : *p == '}' ? JsonStreamObjectEnd : *p == '[' ? JsonStreamArrayStart : JsonStreamArrayEnd;
+      p++;
+    }
+    else if (end - p >= 4 && memcmp(p, "true", 4) == 0)
+    {
+      t = JsonStreamTrue;
+      p += 4;
+    }
+    else if (end - p >= 5 && memcmp(p, "false", 5) == 0)
+    {
+      t = JsonStreamFalse;
+      p += 5;
+    }
+    else if (end - p >= 4 && memcmp(p, "null", 4) == 0)
+    {
+      t = JsonStreamNull;
+      p += 4;
+    }
+    else if (*p == '"')
+    {
+      t = JsonStreamError;
+      for (p++; p < end; p++)
+      {
+        char c = *p;
+        if (c == '"')
+        {
+          p++;
+          t = JsonStreamString;
+          break;
+        }
+        if (c == '\\')
+        {
+          if (++p == end) break;
+          switch (*p)
+          {
+            case '"': case '\\': case '/': c = *p; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            default: p = end; break; // (including \u, which JsonStream doesn't support)
+          }
+          if (p == end) break;
+        }
+        BenchText_Append(&text, &c, 1);
+      }
+      if (t == JsonStreamString)
+      {
+        // a string followed by ':' (past any filler) is a property name
+        p = Bench_ReferenceSkipFiller(p, end);
+        if (p < end && *p == ':')
+        {
+          p++;
+          t = JsonStreamPropertyName;
+        }
+      }
+    }
+    else if (*p == '-' || (*p >= '0' && *p <= '9'))
+    {
+      const char* numberEnd = Bench_ReferenceNumberEnd(p, end);
+      t = numberEnd ? JsonStreamNumber : JsonStreamError;
+      if (numberEnd)
+      {
+        BenchText_Append(&text, tokenStart, (int32_t)(numberEnd - tokenStart));
+        d = strtod(text.data, 0);
+        i = Bench_ReferenceNumberInt(text.data, d);
+        p = numberEnd;
+      }
+    }
+    else
+    {
+      t = JsonStreamError;
+    }
+
+    Bench_AppendSignature(signature, t, text.data, text.length, i, d);
+  } while (t != JsonStreamEnd && t != JsonStreamError);
+  BenchText_Free(&text);
+}
+
+// parses the input every way JsonStream offers and returns 0 if any of them disagrees with the reference tokenizer
+// (memory errors are left for the sanitizers to catch)
+static int Bench_CrossCheck(const uint8_t* bytes, size_t size, uint64_t seed)
+{
+  int ok = 1;
+  if (seed == 0) seed = 1;
+  if (size > 1 << 20) size = 1 << 20;
+
+  // (JsonStream_Parse stops at the first null, so everything looks at the same prefix)
+  int32_t length = 0;
+  while ((size_t)length < size && bytes[length] != 0) length++;
+  char* json = malloc(length + 1);
+  if (json == 0) FATAL_ERROR("failed to allocate memory for fuzz input");
+  if (length > 0) memcpy(json, bytes, length);
+  json[length] = 0;
+
+  BenchText expected, actual, types;
+  memset(&expected, 0, sizeof(expected));
+  memset(&actual, 0, sizeof(actual));
+  memset(&types, 0, sizeof(types));
+  Bench_SignatureOfReference(json, length, &expected);
+
+  JsonStream stream = JsonStream_ParseRange(json, json + length, "fuzz");
+  Bench_SignatureOfStream(stream, &actual, &types);
+  JsonStream_Release(stream);
+  if (actual.length != expected.length || memcmp(actual.data, expected.data, expected.length) != 0)
+  {
+    printf("JsonStream_ParseRange() disagrees with the reference tokenizer\n");
+    ok = 0;
+  }
+
+  actual.length = 0;
+  stream = JsonStream_Parse(json, "fuzz");
+  Bench_SignatureOfStream(stream, &actual, 0);
+  JsonStream_Release(stream);
+  if (actual.length != expected.length || memcmp(actual.data, expected.data, expected.length) != 0)
+  {
+    printf("JsonStream_Parse() disagrees with the reference tokenizer\n");
+    ok = 0;
+  }
+
+  actual.length = 0;
+  Bench_SignatureOfChunks(json, length, seed, &actual);
+  if (actual.length != expected.length || memcmp(actual.data, expected.data, expected.length) != 0)
+  {
+    printf("incremental parsing disagrees with the reference tokenizer\n");
+    ok = 0;
+  }
+
+  // skipping the root container must land where the full parse closed it (if the full parse got that far)
+  if (types.length > 0 && ((JsonStreamTokenType)types.data[0] == JsonStreamObjectStart || (JsonStreamTokenType)types.data[0] == JsonStreamArrayStart))
+  {
+    int32_t i, depth = 0;
+    for (i = 0; i < types.length; i++)
+    {
+      JsonStreamTokenType t = (JsonStreamTokenType)types.data[i];
+      if (t == JsonStreamError || t == JsonStreamEnd) break;
+      if (t == JsonStreamObjectStart || t == JsonStreamArrayStart) depth++;
+      if (t == JsonStreamObjectEnd || t == JsonStreamArrayEnd) depth--;
+      if (depth == 0) break;
+    }
+    if (i + 1 < types.length && depth == 0)
+    {
+      stream = JsonStream_ParseRange(json, json + length, "fuzz");
+      JsonStream_MoveNext(stream);
+      if (seed & 1) JsonStream_BuildStructuralIndex(stream);
+      JsonStreamTokenType skipped = JsonStream_SkipValue(stream);
+      JsonStreamTokenType next = JsonStream_MoveNext(stream);
+      if (skipped != (JsonStreamTokenType)types.data[i] || next != (JsonStreamTokenType)types.data[i + 1])
+      {
+        printf("JsonStream_SkipValue() disagrees with the full parse\n");
+        ok = 0;
+      }
+      JsonStream_Release(stream);
+    }
+  }
+
+  BenchText_Free(&expected);
+  BenchText_Free(&actual);
+  BenchText_Free(&types);
+  free(json);
+  return ok;
+}
+
+// ---- Ring stress test and throughput ----
+
+#ifdef _WIN32
+typedef HANDLE BenchThread;
+typedef LPTHREAD_START_ROUTINE BenchThreadProc;
+#define BENCH_THREAD_PROC(name) DWORD WINAPI name(LPVOID arg)
+#else
+typedef pthread_t BenchThread;
+typedef void* (*BenchThreadProc)(void* arg);
+#define BENCH_THREAD_PROC(name) void* name(void* arg)
+#endif
+
+static BenchThread Bench_StartThread(BenchThreadProc proc, void* arg)
+{
+  BenchThread thread;
+#ifdef _WIN32
+  thread = CreateThread(0, 0, proc, arg, 0, 0);
+  if (thread == 0)
+#else
+  if (pthread_create(&thread, 0, proc, arg) != 0)
+#endif
+  {
+    FATAL_ERROR("failed to start bench thread");
+  }
+  return thread;
+}
+
+static void Bench_JoinThread(BenchThread thread)
+{
+#ifdef _WIN32
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+#else
+  pthread_join(thread, 0);
+#endif
+}
+
+static void Bench_Yield()
+{
+#ifdef _WIN32
+  SwitchToThread();
+#else
+  sched_yield();
+#endif
+}
+
+#define BENCH_RING_MAX_PRODUCERS 8
+#define BENCH_RING_MAX_BATCH 256
+
+// (the check field catches torn or misplaced copies)
+typedef struct BenchRingItem {
+  uint64_t value; // producer index in the top 8 bits, sequence number below
+  uint64_t check;
+} BenchRingItem;
+
+#define BENCH_RING_CHECK(value) ((value) * 0x9E3779B97F4A7C15ULL ^ 0x5555)
+
+typedef struct BenchRingProducer {
+  Ring ring;
+  uint64_t index;
+  int64_t count;
+  int32_t maxBatch;
+  int randomBatch; // 1 to vary batch sizes (1..maxBatch), 0 to always offer maxBatch
+  uint64_t rng;
+} BenchRingProducer;
+
+static BENCH_THREAD_PROC(Bench_RingProducerProc)
+{
+  BenchRingProducer* producer = (BenchRingProducer*)arg;
+  BenchRingItem items[BENCH_RING_MAX_BATCH];
+  int64_t sent = 0;
+  while (sent < producer->count)
+  {
+    int32_t batch = producer->randomBatch ? 1 + Bench_RandomRange(&producer->rng, producer->maxBatch) : producer->maxBatch;
+    if (batch > producer->count - sent) batch = (int32_t)(producer->count - sent);
+    int32_t i;
+    for (i = 0; i < batch; i++)
+    {
+      items[i].value = (producer->index << 56) | (uint64_t)(sent + i);
+      items[i].check = BENCH_RING_CHECK(items[i].value);
+    }
+    int32_t n = Ring_Enqueue(producer->ring, items, batch);
+    if (n == 0) Bench_Yield();
+    sent += n;
+  }
+  return 0;
+}
+
+// pushes 'count' items from each producer thread through the ring and checks each producer's items
+// arrive intact and in order; returns the number of errors, and the seconds it took in 'seconds'
+static int64_t Bench_RunRing(int32_t capacity, int producers, int64_t count, int32_t maxBatch, int randomBatch, double* seconds)
+{
+  Ring ring = Ring_Create(sizeof(BenchRingItem), capacity, producers > 1);
+  if (ring == 0) return 1;
+
+  BenchRingProducer args[BENCH_RING_MAX_PRODUCERS];
+  BenchThread threads[BENCH_RING_MAX_PRODUCERS];
+  int64_t expected[BENCH_RING_MAX_PRODUCERS];
+  int i;
+  PerformanceCounter start = PerformanceCounter_Start();
+  for (i = 0; i < producers; i++)
+  {
+    args[i].ring = ring;
+    args[i].index = i;
+    args[i].count = count;
+    args[i].maxBatch = maxBatch;
+    args[i].randomBatch = randomBatch;
+    args[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+    expected[i] = 0;
+    threads[i] = Bench_StartThread(Bench_RingProducerProc, &args[i]);
+  }
+
+  uint64_t rng = 0xC0FFEEULL + capacity;
+  BenchRingItem items[BENCH_RING_MAX_BATCH];
+  int64_t errors = 0;
+  int64_t received = 0;
+  while (received < count * producers)
+  {
+    int32_t batch = randomBatch ? 1 + Bench_RandomRange(&rng, maxBatch) : maxBatch;
+    int32_t n = Ring_Dequeue(ring, items, batch);
+    if (n == 0) Bench_Yield();
+    for (i = 0; i < n; i++)
+    {
+      uint64_t producer = items[i].value >> 56;
+      int64_t sequence = (int64_t)(items[i].value & 0x00FFFFFFFFFFFFFFULL);
+      if (items[i].check != BENCH_RING_CHECK(items[i].value) || producer >= (uint64_t)producers || sequence != expected[producer])
+      {
+        if (errors < 5) printf("  ring item %lld out of order or corrupt\n", (long long)received + i);
+        errors++;
+        if (producer < (uint64_t)producers) expected[producer] = sequence;
+      }
+      if (producer < (uint64_t)producers) expected[producer]++;
+    }
+    received += n;
+  }
+
+  for (i = 0; i < producers; i++) Bench_JoinThread(threads[i]);
+  *seconds = PerformanceCounter_MeasureSeconds(start);
+  if (Ring_Count(ring) != 0) errors++;
+  Ring_Release(ring);
+  return errors;
+}
+
+static int Bench_Rings()
+{
+  // small capacities and odd batch sizes so the positions wrap constantly and producers race for the last slots
+  static const struct { int32_t capacity; int producers; int32_t maxBatch; } stress[] = {
+    { 2, 1, 3 }, { 64, 1, 37 }, { 1024, 1, 256 },
+    { 2, 2, 3 }, { 64, 4, 37 }, { 1024, 8, 256 },
+  };
+  int ok = 1;
+  int i;
+  for (i = 0; i < (int)(sizeof(stress) / sizeof(stress[0])); i++)
+  {
+    double seconds;
+    int64_t errors = Bench_RunRing(stress[i].capacity, stress[i].producers, 1000000, stress[i].maxBatch, 1, &seconds);
+    printf("stress %-4s capacity %-5d producers %d  %s\n", stress[i].producers > 1 ? "MPSC" : "SPSC",
+      stress[i].capacity, stress[i].producers, errors ? "FAILED" : "ok");
+    if (errors) ok = 0;
+  }
+
+  static const struct { int producers; int32_t batch; } timed[] = {
+    { 1, 1 }, { 1, 64 }, { 4, 1 }, { 4, 64 },
+  };
+  for (i = 0; i < (int)(sizeof(timed) / sizeof(timed[0])); i++)
+  {
+    double seconds;
+    int64_t total = 1 << 24;
+    int64_t errors = Bench_RunRing(4096, timed[i].producers, total / timed[i].producers, timed[i].batch, 0, &seconds);
+    if (errors) ok = 0;
+    if (seconds <= 0) seconds = 1e-9;
+    printf("%-4s producers %d batch %-3d %10.1f Mitems/s %10.1f MB/s%s\n", timed[i].producers > 1 ? "MPSC" : "SPSC",
+      timed[i].producers, timed[i].batch, total / 1e6 / seconds, total * sizeof(BenchRingItem) / 1e6 / seconds,
+      errors ? "  FAILED" : "");
+  }
+  return ok;
+}
+
+// maps (and unmaps) each file 'rounds' times, plus as many missing files; returns the seconds it took
+static double Bench_MapLords2Files(wchar_t** names, int32_t count, int rounds, int32_t* failures)
+{
+  wchar_t missing[64];
+  PerformanceCounter start = PerformanceCounter_Start();
+  int round;
+  int32_t i;
+  for (round = 0; round < rounds; round++)
+  {
+    for (i = 0; i < count; i++)
+    {
+      const void* view = ResourceFile_MapLords2File(names[i], 0);
+      if (view == 0) (*failures)++;
+      else ResourceFile_Unmap(view);
+
+      swprintf(missing, 64, L"missing%d.256", (int)i);
+      if (ResourceFile_MapLords2File(missing, 0) != 0) (*failures)++;
+    }
+  }
+  return PerformanceCounter_MeasureSeconds(start);
+}
+
+static int Bench_Vfs(const wchar_t* lords2Dir)
+{
+  PerformanceCounter start = PerformanceCounter_Start();
+  if (!ResourceFile_MountAll(lords2Dir)) return 0;
+  double mountSeconds = PerformanceCounter_MeasureSeconds(start);
+  printf("mounted %d files in %.3f ms\n", (int)Vfs_GetFileCount(), mountSeconds * 1000);
+  ResourceFile_UnmountAll();
+
+  // just the Lords2 folder from here on, so both ways find the same files (named as they are on disk)
+  wchar_t dirPath[PathBufferSize];
+  if (!ResourceFile_GetLords2FilePath(dirPath, PathBufferSize, L"") || !Vfs_MountDirectory("lords2/", dirPath)) return 0;
+
+  int32_t count = 0;
+  int32_t i;
+  wchar_t** names = malloc(sizeof(wchar_t*) * (Vfs_GetFileCount() + 1));
+  if (names == 0) return 0;
+  for (i = 0; i < Vfs_GetFileCount(); i++)
+  {
+    VfsFile file;
+    wchar_t* name = StringUtils_MakeWideString(Vfs_GetFileName(i));
+    if (name != 0 && Vfs_Find("", name, &file))
+    {
+      names[count] = malloc((wcslen(file.relativePath) + 1) * sizeof(wchar_t));
+      if (names[count] != 0) wcscpy(names[count++], file.relativePath);
+    }
+    free(name);
+  }
+  if (count == 0)
+  {
+    printf("no Lords2 files found (pass the install folder, or set LURDS2_LORDS2_DIR)\n");
+    free(names);
+    return 0;
+  }
+
+  SuppressDiagnosticErrors(1); // (the missing files)
+  int rounds = 20;
+  int32_t failures = 0;
+  double vfsSeconds = Bench_MapLords2Files(names, count, rounds, &failures);
+  ResourceFile_UnmountAll();
+  double pathSeconds = Bench_MapLords2Files(names, count, rounds, &failures);
+  SuppressDiagnosticErrors(0);
+
+  printf("%d Lords2 files + %d missing, %d rounds: indexed %.3f ms, plain paths %.3f ms%s\n", (int)count, (int)count,
+    rounds, vfsSeconds * 1000, pathSeconds * 1000, failures ? "  FAILED" : "");
+  for (i = 0; i < count; i++) free(names[i]);
+  free(names);
+  return failures == 0;
+}
+
+#ifdef LURDS2_FUZZ
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  SuppressDiagnosticErrors(1);
+  if (!Bench_CrossCheck(data, size, size * 0x9E3779B97F4A7C15ULL)) abort();
+  return 0;
+}
+#else
+static void Bench_Mutate(BenchText* text, uint64_t* rng)
+{
+  static const char interesting[] = "{}[]\":,\\/*-+.eE019 \ntfnu";
+  int32_t edits = 1 + Bench_RandomRange(rng, 8);
+  while (edits-- > 0 && text->length > 0)
+  {
+    int32_t at = Bench_RandomRange(rng, text->length);
+    int32_t span = 1 + Bench_RandomRange(rng, text->length - at < 16 ? text->length - at : 16);
+    switch (Bench_RandomRange(rng, 4))
+    {
+      case 0:
+        text->data[at] = interesting[Bench_RandomRange(rng, sizeof(interesting) - 1)];
+        break;
+      case 1:
+        memmove(text->data + at, text->data + at + span, text->length - at - span + 1);
+        text->length -= span;
+        break;
+      case 2:
+        if (text->length + span < (1 << 16))
+        {
+          char copy[16];
+          memcpy(copy, text->data + at, span);
+          BenchText_Append(text, copy, span);
+          memmove(text->data + at + span, text->data + at, text->length - span - at);
+          memcpy(text->data + at, copy, span);
+        }
+        break;
+      default:
+        text->length = at;
+        text->data[at] = 0;
+        break;
+    }
+  }
+}
+
+static int Bench_Fuzz(int64_t iterations)
+{
+  static const char* seeds[] = {
+    "{\"a\":1,\"b\":[true,false,null,\"x\\\"y\"],\"c\":{\"d\":-1.5e-3}}",
+    "// c\r\n{ /* block */ \"k\" : -123 , \"q\": \"s\\\\\\n\\u00e9\" }  // end",
+    "[1.5e3,-0.25,12345678901234567890123,7,0.1,1e400,-0]",
+    "[[[[{\"a\":[{}]}]]],[],{}]",
+  };
+  const int seedCount = sizeof(seeds) / sizeof(seeds[0]);
+  uint64_t rng = 0x1234567887654321ULL;
+  BenchText corpus[8];
+  memset(corpus, 0, sizeof(corpus));
+  int i;
+  for (i = 0; i < seedCount; i++) BenchText_AppendString(&corpus[i], seeds[i]);
+  Bench_MakeDeepNesting(&corpus[4], 600, &rng);
+  Bench_MakeLongStrings(&corpus[5], 600, &rng);
+  Bench_MakeNumbers(&corpus[6], 600, &rng);
+  Bench_MakeComments(&corpus[7], 600, &rng);
+
+  SuppressDiagnosticErrors(1);
+  BenchText input;
+  memset(&input, 0, sizeof(input));
+  int64_t n;
+  int ok = 1;
+  for (n = 0; n < iterations && ok; n++)
+  {
+    BenchText* source = &corpus[Bench_RandomRange(&rng, 8)];
+    input.length = 0;
+    BenchText_Append(&input, source->data, source->length);
+    Bench_Mutate(&input, &rng);
+    if (!Bench_CrossCheck((const uint8_t*)input.data, input.length, Bench_Random(&rng)))
+    {
+      FILE* f = fopen("fuzz_failure.json", "wb");
+      if (f) { fwrite(input.data, 1, input.length, f); fclose(f); }
+      printf("fuzz iteration %lld failed; input saved to fuzz_failure.json\n", (long long)n);
+      ok = 0;
+    }
+  }
+  SuppressDiagnosticErrors(0);
+  if (ok) printf("fuzz: %lld iterations ok\n", (long long)iterations);
+
+  BenchText_Free(&input);
+  for (i = 0; i < 8; i++) BenchText_Free(&corpus[i]);
+  return ok;
+}
+
+int main(int argc, char** argv)
+{
+  int i;
+  if (argc >= 2 && strcmp(argv[1], "-fuzz") == 0)
+  {
+    return Bench_Fuzz(argc >= 3 ? atoll(argv[2]) : 10000) ? 0 : 1;
+  }
+
+  if (argc >= 2 && strcmp(argv[1], "-rings") == 0)
+  {
+    return Bench_Rings() ? 0 : 1;
+  }
+
+  if (argc >= 2 && strcmp(argv[1], "-vfs") == 0)
+  {
+    wchar_t* lords2Dir = argc >= 3 ? StringUtils_MakeWideString(argv[2]) : 0;
+    int ok = Bench_Vfs(lords2Dir);
+    free(lords2Dir);
+    return ok ? 0 : 1;
+  }
+
+  if (argc >= 2)
+  {
+    int ok = 1;
+    for (i = 1; i < argc; i++) ok &= Bench_ReportFile(argv[i]);
+    return ok ? 0 : 1;
+  }
+
+  static const struct {
+    const char* name;
+    void (*make)(BenchText* text, int32_t targetSize, uint64_t* rng);
+  } corpora[] = {
+    { "deep nesting", Bench_MakeDeepNesting },
+    { "long strings", Bench_MakeLongStrings },
+    { "numbers", Bench_MakeNumbers },
+    { "comments", Bench_MakeComments },
+  };
+  for (i = 0; i < (int)(sizeof(corpora) / sizeof(corpora[0])); i++)
+  {
+    uint64_t rng = 0x9E3779B97F4A7C15ULL + i;
+    BenchText text;
+    memset(&text, 0, sizeof(text));
+    corpora[i].make(&text, 8 << 20, &rng);
+    Bench_Report(corpora[i].name, text.data, text.length);
+    BenchText_Free(&text);
+  }
+  return 0;
+}
+#endif
@@ -7,6 +7,9 @@ Please refer to <http://unlicense.org/>
 #include "lurds2_bmp.h"
 
 #include "lurds2_errors.h"
+#include "lurds2_arena.h"
+#include "lurds2_atlas.h"
+#include "lurds2_pool.h"
 #include <wingdi.h>
 #include <GL/GL.h>
 
@@ -64,26 +67,81 @@ typedef struct BmpData {
   unsigned int glTextureId;
   int pixelPerfect;
   int isMaskingBitmap;
+  float u0, v0, u1, v1; // the part of the texture this draws (all of it, unless it's on an atlas page)
+  Bmp page; // the atlas page whose texture this draws from, or 0 when this owns its texture
+  int32_t pageRefCount; // (atlas pages) how many Bmps draw from this one's texture
 } BmpData;
 
+// atlas pages are at most this big, and images on them are this far apart (the gap gets filled by stretching
+// each image's edge pixels out, so GL_LINEAR doesn't blend in the neighbors)
+#define BMP_ATLAS_PAGE_SIZE 1024
+#define BMP_ATLAS_PADDING 1
+
+// every live BmpData sits in here; a Bmp is a PoolHandle to one
+static Pool BmpPool;
+
 static int Bmp_LoadToOpenGLTexture(BmpData* bitmap, uint8_t* rgbaData);
 
-static Bmp Bmp_LoadFromResourceFile_Internal(const wchar_t * fileName, int isMaskingBitmap)
+// returns a new zeroed BmpData (and its handle in 'bmp'), or 0 on failure
+static BmpData* Bmp_New(Bmp* bmp)
 {
-  BmpData* bmp;
-  bmp = malloc(sizeof(BmpData));
-  if (bmp == 0)
+  if (BmpPool == 0 && (BmpPool = Pool_Create(sizeof(BmpData))) == 0)
   {
-    DIAGNOSTIC_BMP_ERROR("failed to allocate memory for BmpData");
+    // diagnostic error already reported by Pool_Create()
     return 0;
   }
-  memset(bmp, 0, sizeof(BmpData));
 
-  BmpHeader* data = 0;
-  int fileLength = 0;
+  PoolHandle handle;
+  BmpData* bitmap = Pool_Add(BmpPool, &handle);
+  if (bitmap == 0)
+  {
+    // diagnostic error already reported by Pool_Add()
+    return 0;
+  }
+  *bmp = POOL_HANDLE_TO_PTR(handle);
+  bitmap->u1 = 1;
+  bitmap->v1 = 1;
+  return bitmap;
+}
 
-  data = (BmpHeader*)ResourceFile_Load(fileName, &fileLength);
-  if (data == 0) goto error;
+// returns the bmp's data, or 0 (with a diagnostic) when 'bmp' is null or already released
+static BmpData* Bmp_Resolve(Bmp bmp)
+{
+  if (!bmp)
+  {
+    DIAGNOSTIC_BMP_ERROR("bmp arg is null");
+    return 0;
+  }
+
+  BmpData* bitmap = BmpPool ? Pool_Get(BmpPool, POOL_PTR_TO_HANDLE(bmp)) : 0;
+  if (!bitmap)
+  {
+    DIAGNOSTIC_BMP_ERROR("bmp arg is stale (already released) or invalid");
+    return 0;
+  }
+  return bitmap;
+}
+
+// returns one decoded RGBA pixel (as a little-endian uint32: red in the low byte) for the BGR color at 'bgr'
+static uint32_t Bmp_DecodePixel(const uint8_t* bgr, int isMaskingBitmap)
+{
+  uint32_t rgb = bgr[2] | ((uint32_t)bgr[1] << 8) | ((uint32_t)bgr[0] << 16);
+  if (isMaskingBitmap)
+  {
+    // pure white is "transparent" (a color that does not render), and everything else is opaque white
+    // so it's convenient to GL_MODULATE with a runtime-specified glColor4f() later
+    // FUTURE: there's opportunity for neat specular effect here if we would let
+    // the bitmap's color data contribute to the GL_MODULATE
+    return rgb == 0x00FFFFFF ? 0x00FFFFFF : 0xFFFFFFFF;
+  }
+  return rgb | 0xFF000000; // make it opaque
+}
+
+// decodes the bmp file in 'data' (read-only, e.g. a mapped view) to top-row-first RGBA pixels in one pass.
+// returns the pixels (malloc'd, so free() them), or 0 on failure
+static uint8_t* Bmp_DecodeFileData(const BmpHeader* data, int fileLength, int isMaskingBitmap, int* width, int* height)
+{
+  uint32_t* rgbaData = 0;
 
   if (fileLength < sizeof(BmpHeader)) {
     DIAGNOSTIC_BMP_ERROR("unexpected too-small size of bmp file");
@@ -110,7 +168,7 @@ static Bmp Bmp_LoadFromResourceFile_Internal(const wchar_t * fileName, int isMas
     goto error;
   }
 
-  if (data->infoHeader.biWidth < 0) {
+  if (data->infoHeader.biWidth <= 0) {
     DIAGNOSTIC_BMP_ERROR("unexpected non-positive biWidth in bmp file");
     goto error;
   }
@@ -120,12 +178,18 @@ static Bmp Bmp_LoadFromResourceFile_Internal(const wchar_t * fileName, int isMas
     goto error;
   }
 
-  if (data->infoHeader.biHeight < 0) {
-    DIAGNOSTIC_BMP_ERROR("unexpected non-positive biHeight in bmp file");
+  // a negative biHeight means the rows are stored top row first
+  // (checked before negating it, so the most negative height can't overflow)
+  if (data->infoHeader.biHeight == 0 || data->infoHeader.biHeight < -2000) {
+    DIAGNOSTIC_BMP_ERROR("unexpected zero or < -2000 biHeight in bmp file");
     goto error;
   }
 
-  if (data->infoHeader.biHeight > 2000) {
+  int rowCount;
+  int isTopDown;
+  isTopDown = data->infoHeader.biHeight < 0;
+  rowCount = isTopDown ? -data->infoHeader.biHeight : data->infoHeader.biHeight;
+  if (rowCount > 2000) {
     DIAGNOSTIC_BMP_ERROR("unexpected > 2000 biHeight in bmp file");
     goto error;
   }
@@ -135,8 +199,10 @@ static Bmp Bmp_LoadFromResourceFile_Internal(const wchar_t * fileName, int isMas
     goto error;
   }
 
-  if (data->infoHeader.biBitCount != 24) {
-    DIAGNOSTIC_BMP_ERROR("unexpected biBitCount != 24 in bmp file");
+  int bitCount;
+  bitCount = data->infoHeader.biBitCount;
+  if (bitCount != 8 && bitCount != 24 && bitCount != 32) {
+    DIAGNOSTIC_BMP_ERROR("unexpected biBitCount (not 8, 24 or 32) in bmp file");
     goto error;
   }
 
@@ -145,121 +211,161 @@ static Bmp Bmp_LoadFromResourceFile_Internal(const wchar_t * fileName, int isMas
     goto error;
   }
 
-  if (data->infoHeader.biClrUsed != 0) {
-    DIAGNOSTIC_BMP_ERROR("unexpected biClrUsed != 0 in bmp file");
+  // an 8-bit bitmap has a color table of BGRX entries after the header (256 of them, when biClrUsed is 0)
+  int colorCount;
+  colorCount = bitCount == 8 ? (data->infoHeader.biClrUsed == 0 ? 256 : data->infoHeader.biClrUsed) : 0;
+  if (colorCount > 256 || (bitCount != 8 && data->infoHeader.biClrUsed != 0)) {
+    DIAGNOSTIC_BMP_ERROR("unexpected biClrUsed in bmp file");
+    goto error;
+  }
+
+  if (sizeof(BmpHeader) + colorCount * 4 > data->pixelDataOffset) {
+    DIAGNOSTIC_BMP_ERROR("bmp color table overlaps the pixel data");
     goto error;
   }
 
   int rowStride;
   rowStride = LURDS2_BMP_PIXEL_ROW_STRIDE(data->infoHeader);
-  if (data->pixelDataOffset + rowStride * data->infoHeader.biHeight > fileLength) {
+  if (data->pixelDataOffset + rowStride * rowCount > fileLength) {
     DIAGNOSTIC_BMP_ERROR("bmp file is not long enough to hold advertised pixel data");
     goto error;
   }
 
-  // bitmaps store pixels in order Blue-Green-Red
-  // but opengl needs Red-Green-Blue, so swap them
-  char* start = (char*)data + data->pixelDataOffset;
-  int rowCount = data->infoHeader.biHeight;
-  int columnCount = data->infoHeader.biWidth;
-  int bytesPerElement = data->infoHeader.biBitCount / 8;
-  for (int row = 0; row < rowCount; row++)
-  {
-    char* rowStart = start + row * rowStride;
-    for (int column = 0; column < columnCount; column++)
-    {
-      char* c = rowStart + column * bytesPerElement;
-      char t = c[0];
-      c[0] = c[2];
-      c[2] = t;
-    }
+  // both are 1..2000 by now, so this can't overflow an int
+  int columnCount;
+  columnCount = data->infoHeader.biWidth;
+  rgbaData = malloc(columnCount * rowCount * 4);
+  if (rgbaData == 0) {
+    DIAGNOSTIC_BMP_ERROR("failed to allocate memory for RGBA pixels");
+    goto error;
   }
 
-  // bitmaps are 24-bit RGB but I want 32-bit RGBA so I can fake in my own transparency
-  // so relloc and shift the bytes
-  int oldBytesPerElement = bytesPerElement; // 3
-  bytesPerElement += 1;
-  int oldRowStride = rowStride; // biWidth * 3 plus some alignment fudging;
-  rowStride = data->infoHeader.biWidth * bytesPerElement;
-  fileLength = fileLength + (rowStride * rowCount) - (oldRowStride * rowCount);
-  void* newData = realloc(data, fileLength);
-  if (newData == 0) {
-    DIAGNOSTIC_BMP_ERROR("failed to reallocate for RGB to RGBA expansion");
-    goto error;
+  // decode the color table up front, so 8-bit pixels are just a lookup
+  uint32_t palette[256];
+  const uint8_t* colors;
+  colors = (const uint8_t*)data + sizeof(BmpHeader);
+  int i;
+  for (i = 0; i < colorCount; i++)
+  {
+    palette[i] = Bmp_DecodePixel(colors + i * 4, isMaskingBitmap);
   }
-  data = newData;
-  start = (char*)data + data->pixelDataOffset;
-  for (int row = rowCount - 1; row >= 0; row--)
+  for (i = colorCount; i < 256 && bitCount == 8; i++)
   {
-    char* oldRowStart = start + row * oldRowStride;
-    char* rowStart = start + row * rowStride;
-    for (int column = columnCount - 1; column >= 0; column--)
+    palette[i] = isMaskingBitmap ? 0xFFFFFFFF : 0xFF000000; // (out-of-range indexes are black)
+  }
+
+  // bitmaps store pixels in order Blue-Green-Red (and usually "last row first")
+  // but opengl needs Red-Green-Blue-Alpha, and I want "top row first" because that helps my opengl commands
+  // make sense without melting the mind, so each source row is written straight to where it belongs
+  const uint8_t* start;
+  start = (const uint8_t*)data + data->pixelDataOffset;
+  int row;
+  for (row = 0; row < rowCount; row++)
+  {
+    const uint8_t* source = start + (isTopDown ? row : rowCount - row - 1) * rowStride;
+    uint32_t* destination = rgbaData + row * columnCount;
+    if (bitCount == 8)
     {
-      char* oldPixel = oldRowStart + column * oldBytesPerElement;
-      char* newPixel = rowStart + column * bytesPerElement;
-      newPixel[0] = oldPixel[0];
-      newPixel[1] = oldPixel[1];
-      newPixel[2] = oldPixel[2];
-      newPixel[3] = 255; // make it opaque
-      if (isMaskingBitmap)
+      int column;
+      for (column = 0; column < columnCount; column++)
       {
-        // is the pixel pure white?
-        if (*newPixel == 0xFFFFFFFF)
-        {
-          // pick a color that does not render
-          *(DWORD*)newPixel = 0x00FFFFFF; // transparent white
-        }
-        else // pick a color that is convenient to GL_MODULATE with later runtime-specified glColor4f()
-        {
-          // FUTURE: there's opportunity for neat specular effect here if we would let
-          // the bitmap's color data contribute to the GL_MODULATE
-          *(DWORD*)newPixel = 0xFFFFFFFF; // opaque white
-        }
+        destination[column] = palette[source[column]];
+      }
+    }
+    else if (bitCount == 24 && !isMaskingBitmap)
+    {
+      // 4 pixels at a time: three little-endian words hold BGRB GRBG RBGR
+      int column = 0;
+      for (; column + 4 <= columnCount; column += 4, source += 12)
+      {
+        uint32_t w0, w1, w2;
+        memcpy(&w0, source, 4);
+        memcpy(&w1, source + 4, 4);
+        memcpy(&w2, source + 8, 4);
+        uint32_t p0 = w0 & 0x00FFFFFF;
+        uint32_t p1 = (w0 >> 24) | ((w1 & 0xFFFF) << 8);
+        uint32_t p2 = (w1 >> 16) | ((w2 & 0xFF) << 16);
+        uint32_t p3 = w2 >> 8;
+        // swap blue and red: keep green, move the outer bytes across
+        destination[column] = (p0 & 0x00FF00) | ((p0 >> 16) & 0xFF) | ((p0 & 0xFF) << 16) | 0xFF000000;
+        destination[column + 1] = (p1 & 0x00FF00) | ((p1 >> 16) & 0xFF) | ((p1 & 0xFF) << 16) | 0xFF000000;
+        destination[column + 2] = (p2 & 0x00FF00) | ((p2 >> 16) & 0xFF) | ((p2 & 0xFF) << 16) | 0xFF000000;
+        destination[column + 3] = (p3 & 0x00FF00) | ((p3 >> 16) & 0xFF) | ((p3 & 0xFF) << 16) | 0xFF000000;
+      }
+      for (; column < columnCount; column++, source += 3)
+      {
+        destination[column] = Bmp_DecodePixel(source, 0);
+      }
+    }
+    else
+    {
+      // 32-bit BI_RGB pixels are BGRX (the 4th byte isn't alpha), so they decode like 24-bit ones
+      int bytesPerPixel = bitCount / 8;
+      int column;
+      for (column = 0; column < columnCount; column++)
+      {
+        destination[column] = Bmp_DecodePixel(source + column * bytesPerPixel, isMaskingBitmap);
       }
     }
   }
 
-  // bitmaps store pixel data "last row first"
-  // but I want the "top row first" because that helps my opengl commands make sense without melting the mind
-  // so swap them
-  char * temp = malloc(rowStride);
-  if (temp == 0)
-  {
-    DIAGNOSTIC_BMP_ERROR("failed to allocate memory for bitmap row shuffling");
-    goto error;
+  *width = columnCount;
+  *height = rowCount;
+  return (uint8_t*)rgbaData;
+
+error:
+  if (rgbaData != 0) free(rgbaData);
+  return 0;
+}
+
+uint8_t* Bmp_DecodeToRgba(const void* fileData, int fileLength, int isMaskingBitmap, int* width, int* height)
+{
+  if (fileData == 0 || fileLength <= 0 || width == 0 || height == 0) {
+    DIAGNOSTIC_BMP_ERROR("invalid fileData/fileLength/width/height param");
+    return 0;
   }
-  for (int row = 0; row < rowCount / 2; row++)
+
+  return Bmp_DecodeFileData((const BmpHeader*)fileData, fileLength, isMaskingBitmap, width, height);
+}
+
+static Bmp Bmp_LoadFromResourceFile_Internal(const wchar_t * fileName, int isMaskingBitmap)
+{
+  Bmp result;
+  BmpData* bmp = Bmp_New(&result);
+  if (bmp == 0)
   {
-    int otherRow = rowCount - row - 1;
-    char* rowStart = start + row * rowStride;
-    char* otherRowStart = start + otherRow * rowStride;
-    
-    memcpy(temp, rowStart, rowStride);
-    memcpy(rowStart, otherRowStart, rowStride);
-    memcpy(otherRowStart, temp, rowStride);
-  }
-  free(temp);
-
-  bmp->width = data->infoHeader.biWidth;
-  bmp->height = data->infoHeader.biHeight;
+    return 0;
+  }
+
+  uint8_t* rgbaData = 0;
+  int fileLength = 0;
+
+  // decode straight out of the mapped file, without copying it first
+  const BmpHeader* data = (const BmpHeader*)ResourceFile_Map(fileName, &fileLength);
+  if (data == 0) goto error;
+
+  rgbaData = Bmp_DecodeFileData(data, fileLength, isMaskingBitmap, &bmp->width, &bmp->height);
+  ResourceFile_Unmap(data);
+  if (rgbaData == 0) goto error;
+
   bmp->isMaskingBitmap = isMaskingBitmap;
   bmp->pixelPerfect = 1;
   
-  if (!Bmp_LoadToOpenGLTexture(bmp, (uint8_t*)data + data->pixelDataOffset))
+  if (!Bmp_LoadToOpenGLTexture(bmp, rgbaData))
   {
     goto error;
   }
 
-  free(data);
-  return bmp;
+  free(rgbaData);
+  return result;
 
 error:
-  if (data != 0) free(data);
-  free(bmp);
+  if (rgbaData != 0) free(rgbaData);
+  Pool_Remove(BmpPool, POOL_PTR_TO_HANDLE(result));
   return 0;
 }
 
-Bmp Bmp_LoadFromRgba(uint8_t* rgbaData, int width, int height)
+static Bmp Bmp_LoadFromRgba_Internal(uint8_t* rgbaData, int width, int height, int isMaskingBitmap)
 {
   if (rgbaData == 0) {
     DIAGNOSTIC_BMP_ERROR("invalid null rgbaData param");
@@ -272,39 +378,205 @@ Bmp Bmp_LoadFromRgba(uint8_t* rgbaData, int width, int height)
     return 0;
   }
   
-  BmpData* bmp = malloc(sizeof(BmpData));
+  Bmp result;
+  BmpData* bmp = Bmp_New(&result);
   if (bmp == 0)
   {
-    DIAGNOSTIC_BMP_ERROR("failed to allocate memory for BmpData");
     return 0;
   }
-  memset(bmp, 0, sizeof(BmpData));
   bmp->width = width;
   bmp->height = height;
+  bmp->isMaskingBitmap = isMaskingBitmap;
   bmp->pixelPerfect = 1;
 
   if (!Bmp_LoadToOpenGLTexture(bmp, rgbaData))
   {
-    free(bmp);
+    Pool_Remove(BmpPool, POOL_PTR_TO_HANDLE(result));
     return 0;
   }
 
-  return bmp;
+  return result;
 }
 
-void Bmp_Release(Bmp bmp)
+Bmp Bmp_LoadFromRgba(uint8_t* rgbaData, int width, int height)
 {
-  BmpData* bitmap;
-  bitmap = (BmpData*)bmp;
+  return Bmp_LoadFromRgba_Internal(rgbaData, width, height, 0);
+}
 
+Bmp Bmp_LoadMaskingBitmapFromRgba(uint8_t* rgbaData, int width, int height)
+{
+  return Bmp_LoadFromRgba_Internal(rgbaData, width, height, 1);
+}
+
+// copies an image onto an atlas page at x, y, stretching its edge pixels out over the padding around it
+static void Bmp_BlitToPage(uint32_t* pagePixels, int pageWidth, const uint8_t* rgbaData, int width, int height, int x, int y)
+{
+  int row;
+  for (row = -BMP_ATLAS_PADDING; row < height + BMP_ATLAS_PADDING; row++)
+  {
+    int sourceRow = row < 0 ? 0 : row >= height ? height - 1 : row;
+    const uint32_t* source = (const uint32_t*)rgbaData + sourceRow * width;
+    uint32_t* destination = pagePixels + (y + row) * pageWidth + x;
+    memcpy(destination, source, width * 4);
+    int i;
+    for (i = 1; i <= BMP_ATLAS_PADDING; i++)
+    {
+      destination[-i] = source[0];
+      destination[width - 1 + i] = source[width - 1];
+    }
+  }
+}
+
+int Bmp_LoadAtlas(uint8_t** rgbaDatas, const int* widths, const int* heights, int count, Bmp* bitmaps)
+{
+  if (rgbaDatas == 0 || widths == 0 || heights == 0 || count < 0 || bitmaps == 0) {
+    DIAGNOSTIC_BMP_ERROR("invalid rgbaDatas/widths/heights/count/bitmaps param");
+    return 0;
+  }
+
+  memset(bitmaps, 0, sizeof(Bmp) * count);
+  Bmp page = 0;
+  BmpData* unusedPage = 0;
+  Arena scratch = Arena_GetFrameArena();
+  ArenaMark scratchMark = Arena_Mark(scratch);
+
+  // pack them with room for the padding
+  int* paddedWidths = Arena_Push(scratch, sizeof(int) * (count + 1) * 5);
+  if (paddedWidths == 0) {
+    DIAGNOSTIC_BMP_ERROR("failed to allocate memory for atlas packing");
+    goto error;
+  }
+  int* paddedHeights = paddedWidths + count + 1;
+  int* pages = paddedHeights + count + 1;
+  int* xs = pages + count + 1;
+  int* ys = xs + count + 1;
+  int i;
+  for (i = 0; i < count; i++)
+  {
+    if (rgbaDatas[i] == 0 || widths[i] <= 0 || heights[i] <= 0) {
+      DIAGNOSTIC_BMP_ERROR("invalid null rgbaData or non-positive width/height in atlas");
+      goto error;
+    }
+    paddedWidths[i] = widths[i] + BMP_ATLAS_PADDING * 2;
+    paddedHeights[i] = heights[i] + BMP_ATLAS_PADDING * 2;
+  }
+
+  int pageCount;
+  if (!Atlas_Pack(paddedWidths, paddedHeights, count, BMP_ATLAS_PAGE_SIZE, BMP_ATLAS_PAGE_SIZE, pages, xs, ys, &pageCount))
+  {
+    // diagnostic error already reported by Atlas_Pack()
+    goto error;
+  }
+
+  // images too big for a page get a texture of their own
+  for (i = 0; i < count; i++)
+  {
+    if (pages[i] >= 0) continue;
+    bitmaps[i] = Bmp_LoadFromRgba(rgbaDatas[i], widths[i], heights[i]);
+    if (bitmaps[i] == 0) goto error;
+  }
+
+  int p;
+  for (p = 0; p < pageCount; p++)
+  {
+    // pages are only as big as what's on them
+    int pageWidth = 0;
+    int pageHeight = 0;
+    for (i = 0; i < count; i++)
+    {
+      if (pages[i] != p) continue;
+      if (xs[i] + paddedWidths[i] > pageWidth) pageWidth = xs[i] + paddedWidths[i];
+      if (ys[i] + paddedHeights[i] > pageHeight) pageHeight = ys[i] + paddedHeights[i];
+    }
+
+    ArenaMark pageMark = Arena_Mark(scratch);
+    uint32_t* pagePixels = Arena_PushZero(scratch, pageWidth * pageHeight * 4);
+    if (pagePixels == 0) {
+      DIAGNOSTIC_BMP_ERROR("failed to allocate memory for atlas page pixels");
+      goto error;
+    }
+    for (i = 0; i < count; i++)
+    {
+      if (pages[i] != p) continue;
+      Bmp_BlitToPage(pagePixels, pageWidth, rgbaDatas[i], widths[i], heights[i], xs[i] + BMP_ATLAS_PADDING, ys[i] + BMP_ATLAS_PADDING);
+    }
+
+    page = Bmp_LoadFromRgba((uint8_t*)pagePixels, pageWidth, pageHeight);
+    Arena_ResetToMark(scratch, pageMark);
+    if (page == 0) goto error;
+    BmpData* pageData = Bmp_Resolve(page);
+
+    for (i = 0; i < count; i++)
+    {
+      if (pages[i] != p) continue;
+      BmpData* bitmap = Bmp_New(&bitmaps[i]);
+      if (bitmap == 0)
+      {
+        bitmaps[i] = 0;
+        goto error;
+      }
+      bitmap->width = widths[i];
+      bitmap->height = heights[i];
+      bitmap->glTextureId = pageData->glTextureId;
+      bitmap->pixelPerfect = 1;
+      bitmap->u0 = (float)(xs[i] + BMP_ATLAS_PADDING) / pageWidth;
+      bitmap->v0 = (float)(ys[i] + BMP_ATLAS_PADDING) / pageHeight;
+      bitmap->u1 = (float)(xs[i] + BMP_ATLAS_PADDING + widths[i]) / pageWidth;
+      bitmap->v1 = (float)(ys[i] + BMP_ATLAS_PADDING + heights[i]) / pageHeight;
+      bitmap->page = page;
+      pageData->pageRefCount++;
+    }
+    page = 0;
+  }
+
+  Arena_ResetToMark(scratch, scratchMark);
+  return 1;
+
+error:
+  // (a page nothing draws from yet is released here; releasing the last Bmp on any other page releases it)
+  unusedPage = page ? Bmp_Resolve(page) : 0;
+  if (unusedPage != 0 && unusedPage->pageRefCount == 0) Bmp_Release(page);
+  for (i = 0; i < count; i++)
+  {
+    if (bitmaps[i] != 0) Bmp_Release(bitmaps[i]);
+    bitmaps[i] = 0;
+  }
+  Arena_ResetToMark(scratch, scratchMark);
+  return 0;
+}
+
+void Bmp_Release(Bmp bmp)
+{
+  BmpData* bitmap = Bmp_Resolve(bmp);
   if (!bitmap)
   {
-    DIAGNOSTIC_BMP_ERROR("bmp arg is null");
     return;
   }
   
-  if (bitmap->glTextureId != 0) glDeleteTextures(1, &bitmap->glTextureId);
-  free(bitmap);
+  Bmp page = bitmap->page;
+  if (page == 0 && bitmap->glTextureId != 0) glDeleteTextures(1, &bitmap->glTextureId);
+  Pool_Remove(BmpPool, POOL_PTR_TO_HANDLE(bmp));
+
+  // the atlas page goes once nothing draws from it anymore
+  BmpData* pageData = page ? Bmp_Resolve(page) : 0;
+  if (pageData != 0 && --pageData->pageRefCount == 0)
+  {
+    Bmp_Release(page);
+  }
+}
+
+void Bmp_Swap(Bmp a, Bmp b)
+{
+  BmpData* first = Bmp_Resolve(a);
+  BmpData* second = Bmp_Resolve(b);
+  if (!first || !second)
+  {
+    return;
+  }
+
+  BmpData temp = *first;
+  *first = *second;
+  *second = temp;
 }
 
 Bmp Bmp_LoadMaskingBitmapFromResourceFile(const wchar_t * fileName)
@@ -365,10 +637,8 @@ static int Bmp_LoadToOpenGLTexture(BmpData* bitmap, uint8_t* rgbaData)
 
 void Bmp_SetPixelPerfect(Bmp bmp, int newValue)
 {
-  BmpData* bitmap = (BmpData*)bmp;
-
+  BmpData* bitmap = Bmp_Resolve(bmp);
   if (!bitmap) {
-    DIAGNOSTIC_BMP_ERROR("bmp arg is null");
     return;
   }
 
@@ -377,10 +647,8 @@ void Bmp_SetPixelPerfect(Bmp bmp, int newValue)
 
 static BmpData* Bmp_DrawStart(Bmp bmp, int* oldTexEnv)
 {
-  BmpData* bitmap = (BmpData*)bmp;
-
+  BmpData* bitmap = Bmp_Resolve(bmp);
   if (!bitmap) {
-    DIAGNOSTIC_BMP_ERROR("bmp arg is null");
     return 0;
   }
 
@@ -430,16 +698,16 @@ void Bmp_Draw(Bmp bmp)
   if (bitmap == 0) return;
 
   glBegin(GL_QUADS);
-    glTexCoord2d(0, 0);
+    glTexCoord2f(bitmap->u0, bitmap->v0);
     glVertex2d(0, 0);
 
-    glTexCoord2d(1, 0);
+    glTexCoord2f(bitmap->u1, bitmap->v0);
     glVertex2d(bitmap->width, 0);
 
-    glTexCoord2d(1, 1);
+    glTexCoord2f(bitmap->u1, bitmap->v1);
     glVertex2d(bitmap->width, bitmap->height);
 
-    glTexCoord2d(0, 1);
+    glTexCoord2f(bitmap->u0, bitmap->v1);
     glVertex2d(0, bitmap->height);
   glEnd();
 
@@ -453,10 +721,12 @@ void Bmp_DrawPortion(Bmp bmp, int x, int y, int width, int height)
   if (bitmap == 0) return;
 
   glBegin(GL_QUADS);
-    float u = (float)x / (float)bitmap->width;
-    float v = (float)y / (float)bitmap->height;
-    float uWidth = (float)width / (float)bitmap->width;
-    float vHeight = (float)height / (float)bitmap->height;
+    float uScale = (bitmap->u1 - bitmap->u0) / (float)bitmap->width;
+    float vScale = (bitmap->v1 - bitmap->v0) / (float)bitmap->height;
+    float u = bitmap->u0 + x * uScale;
+    float v = bitmap->v0 + y * vScale;
+    float uWidth = width * uScale;
+    float vHeight = height * vScale;
 
     glTexCoord2f(u, v);
     glVertex2d(0, 0);
@@ -474,12 +744,39 @@ void Bmp_DrawPortion(Bmp bmp, int x, int y, int width, int height)
   Bmp_DrawEnd(&oldTexEnv);
 }
 
-int Bmp_GetWidth(Bmp bmp)
+int Bmp_GetTexture(Bmp bmp, BmpTexture* texture)
 {
-  BmpData* bitmap = (BmpData*)bmp;
+  if (texture == 0) {
+    DIAGNOSTIC_BMP_ERROR("invalid null texture arg");
+    return 0;
+  }
 
+  BmpData* bitmap = Bmp_Resolve(bmp);
+  if (!bitmap) {
+    return 0;
+  }
+
+  if (bitmap->glTextureId == 0) {
+    DIAGNOSTIC_BMP_ERROR("bmp has not yet been loaded to opengl");
+    return 0;
+  }
+
+  texture->glTextureId = bitmap->glTextureId;
+  texture->u0 = bitmap->u0;
+  texture->v0 = bitmap->v0;
+  texture->u1 = bitmap->u1;
+  texture->v1 = bitmap->v1;
+  texture->width = bitmap->width;
+  texture->height = bitmap->height;
+  texture->pixelPerfect = bitmap->pixelPerfect;
+  texture->isMaskingBitmap = bitmap->isMaskingBitmap;
+  return 1;
+}
+
+int Bmp_GetWidth(Bmp bmp)
+{
+  BmpData* bitmap = Bmp_Resolve(bmp);
   if (!bitmap) {
-    DIAGNOSTIC_BMP_ERROR("bmp arg is null");
     return 0;
   }
   
@@ -488,12 +785,33 @@ int Bmp_GetWidth(Bmp bmp)
 
 int Bmp_GetHeight(Bmp bmp)
 {
-  BmpData* bitmap = (BmpData*)bmp;
-
+  BmpData* bitmap = Bmp_Resolve(bmp);
   if (!bitmap) {
-    DIAGNOSTIC_BMP_ERROR("bmp arg is null");
     return 0;
   }
   
   return bitmap->height;
-}
\ No newline at end of file
+}
+
+int Bmp_Next(int32_t* position, Bmp* bmp)
+{
+  if (position == 0 || bmp == 0)
+  {
+    DIAGNOSTIC_BMP_ERROR("invalid null position/bmp arg");
+    return 0;
+  }
+
+  PoolHandle handle;
+  if (BmpPool == 0 || Pool_Next(BmpPool, position, &handle) == 0)
+  {
+    *bmp = 0;
+    return 0;
+  }
+  *bmp = POOL_HANDLE_TO_PTR(handle);
+  return 1;
+}
+
+int32_t Bmp_GetLiveCount()
+{
+  return BmpPool ? Pool_Count(BmpPool) : 0;
+}
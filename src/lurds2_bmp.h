@@ -7,19 +7,44 @@ Please refer to <http://unlicense.org/>
 #ifndef LURDS2_BMP
 #define LURDS2_BMP
 
-typedef void* Bmp;
+typedef void* Bmp; // (a PoolHandle; released ones are detected instead of dereferenced)
 
-// A Bmp holds the bitmap data for MS Paint image loaded from file.
+// A Bmp holds the bitmap data for MS Paint image loaded from file (uncompressed 8-bit paletted, 24-bit or 32-bit).
 Bmp   Bmp_LoadFromResourceFile(const wchar_t * fileName);
 // a Masking Bitmap interprets pure white as "transparent" and interprets all other colors as pure white
 // so color can be added at render time, or it can be used to make a stencil
 Bmp   Bmp_LoadMaskingBitmapFromResourceFile(const wchar_t * fileName);
 Bmp   Bmp_LoadFromRgba(uint8_t* rgbaData, int width, int height);
+// packs the images onto as few shared textures ("atlas pages") as it can, so drawing them binds fewer textures;
+// each Bmp made in 'bitmaps' draws its own part of a page (the page goes when the last of them is released).
+// Returns 0 on failure, in which case no Bmps are made.
+int   Bmp_LoadAtlas(uint8_t** rgbaDatas, const int* widths, const int* heights, int count, Bmp* bitmaps);
+// takes pixels already decoded for masking (i.e. from Bmp_DecodeToRgba() with isMaskingBitmap = 1)
+Bmp   Bmp_LoadMaskingBitmapFromRgba(uint8_t* rgbaData, int width, int height);
+// decodes bmp file data to top-row-first RGBA pixels without creating a texture; free() the result
+uint8_t* Bmp_DecodeToRgba(const void* fileData, int fileLength, int isMaskingBitmap, int* width, int* height);
 void  Bmp_SetPixelPerfect(Bmp bmp, int newValue); // 1 to render using GL_NEAREST, 0 to render using GL_LINEAR (blend of 4 nearest pixels)
 void  Bmp_Draw(Bmp bmp);
 void  Bmp_DrawPortion(Bmp bmp, int x, int y, int width, int height);
+// what drawing a Bmp takes, for drawing it some other way (e.g. in a SpriteBatch)
+typedef struct BmpTexture {
+  unsigned int glTextureId;
+  float u0, v0, u1, v1; // the part of the texture the Bmp covers
+  int width; // in pixels
+  int height; // in pixels
+  int pixelPerfect;
+  int isMaskingBitmap;
+} BmpTexture;
+// returns 0 (with a diagnostic) when 'bmp' is stale or has no texture
+int   Bmp_GetTexture(Bmp bmp, BmpTexture* texture);
 int   Bmp_GetWidth(Bmp bmp);
 int   Bmp_GetHeight(Bmp bmp);
 void  Bmp_Release(Bmp bmp);
+// swaps what two Bmps hold (texture, size...), e.g. so everyone holding 'a' draws a reloaded image made as 'b'
+void  Bmp_Swap(Bmp a, Bmp b);
+
+// visits every live Bmp (e.g. to find leaked textures): start with *position = 0 and call until it returns 0
+int     Bmp_Next(int32_t* position, Bmp* bmp);
+int32_t Bmp_GetLiveCount();
 
 #endif
\ No newline at end of file
@@ -6,11 +6,26 @@ Please refer to <http://unlicense.org/>
 
 #include "lurds2_errors.h"
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#endif
 #include <wchar.h>
 
 #define ERROR_MESSAGE_BUFFER_SIZE 2048
 
+static int gDiagnosticErrorsSuppressed;
+
+void SuppressDiagnosticErrors(int suppress)
+{
+  gDiagnosticErrorsSuppressed = suppress;
+}
+
+#ifdef _WIN32
 char* GetLastErrorMessage()
 {
   //Get the error message ID, if any.
@@ -41,6 +56,45 @@ static DWORD WINAPI ShowFatalErrorThenKillProcessProc(LPVOID lpParameter)
   MessageBox(0, (char*)lpParameter, "lurds2 fatal error", 0);
 }
 
+static DWORD WINAPI ShowDiagnosticErrorProc(LPVOID lpParameter)
+{
+  MessageBox(0, (char*)lpParameter, "lurds2 diagnostic error", 0);
+}
+
+static void ShowErrorText(int isFatal, char* text)
+{
+  HANDLE t;
+  t = CreateThread(0, 0, (LPTHREAD_START_ROUTINE)(isFatal ? ShowFatalErrorThenKillProcessProc : ShowDiagnosticErrorProc), text, 0, 0);
+  if (t != 0)
+  {
+    WaitForSingleObject(t, INFINITE);
+  }
+  if (isFatal) ExitProcess(1);
+}
+#else
+// (headless builds: there are no message boxes, so errors go to stderr)
+char* GetLastErrorMessage()
+{
+  static char buffer[ERROR_MESSAGE_BUFFER_SIZE];
+  memset(buffer, 0, sizeof(buffer));
+  if (errno == 0)
+  {
+    strcpy(buffer, "no error");
+  }
+  else
+  {
+    strncat(buffer, strerror(errno), sizeof(buffer) - 1);
+  }
+  return buffer;
+}
+
+static void ShowErrorText(int isFatal, char* text)
+{
+  fprintf(stderr, "lurds2 %s error %s\n", isFatal ? "fatal" : "diagnostic", text);
+  if (isFatal) exit(1);
+}
+#endif
+
 void ShowFatalErrorThenKillProcess4(const char* file, const char* function, int line, const char* message, const char* message2, const char* message3, const char* message4)
 {
   char buffer[ERROR_MESSAGE_BUFFER_SIZE];
@@ -59,13 +113,7 @@ void ShowFatalErrorThenKillProcess4(const char* file, const char* function, int
   if (message3) strncat(buffer, message3, sizeof(buffer) - strlen(buffer) - 1);
   if (message4) strncat(buffer, message4, sizeof(buffer) - strlen(buffer) - 1);
 
-  HANDLE t;
-  t = CreateThread(0, 0, (LPTHREAD_START_ROUTINE)ShowFatalErrorThenKillProcessProc, buffer, 0, 0);
-  if (t != 0)
-  {
-    WaitForSingleObject(t, INFINITE);
-  }
-  ExitProcess(1);
+  ShowErrorText(1, buffer);
 }
 
 void ShowFatalErrorThenKillProcess3(const char* file, const char* function, int line, const char* message, const char* message2, const char* message3)
@@ -83,13 +131,10 @@ void ShowFatalErrorThenKillProcess(const char* file, const char* function, int l
   ShowFatalErrorThenKillProcess4(file, function, line, message, 0, 0, 0);
 }
 
-static DWORD WINAPI ShowDiagnosticErrorProc(LPVOID lpParameter)
-{
-  MessageBox(0, (char*)lpParameter, "lurds2 diagnostic error", 0);
-}
-
 void ShowDiagnosticError4(const char* file, const char* function, int line, const char* message, const char* message2, const char* message3, const char* message4)
 {
+  if (gDiagnosticErrorsSuppressed) return;
+
   char buffer[ERROR_MESSAGE_BUFFER_SIZE];
   memset(buffer, 0, sizeof(buffer));
 
@@ -106,12 +151,7 @@ void ShowDiagnosticError4(const char* file, const char* function, int line, cons
   if (message3) strncat(buffer, message3, sizeof(buffer) - strlen(buffer) - 1);
   if (message4) strncat(buffer, message4, sizeof(buffer) - strlen(buffer) - 1);
 
-  HANDLE t;
-  t = CreateThread(0, 0, (LPTHREAD_START_ROUTINE)ShowDiagnosticErrorProc, buffer, 0, 0);
-  if (t != 0)
-  {
-    WaitForSingleObject(t, INFINITE);
-  }
+  ShowErrorText(0, buffer);
 }
 
 void ShowDiagnosticError3(const char* file, const char* function, int line, const char* message, const char* message2, const char* message3)
@@ -147,10 +187,5 @@ void DebugShowInteger(const char* file, const char* function, int line, const ch
   sprintf(numBuffer, "%d", value);
   strncat(buffer, numBuffer, sizeof(buffer) - strlen(numBuffer) - 1);
 
-  HANDLE t;
-  t = CreateThread(0, 0, (LPTHREAD_START_ROUTINE)ShowDiagnosticErrorProc, buffer, 0, 0);
-  if (t != 0)
-  {
-    WaitForSingleObject(t, INFINITE);
-  }
+  ShowErrorText(0, buffer);
 }
\ No newline at end of file
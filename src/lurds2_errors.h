@@ -30,6 +30,8 @@ void ShowDiagnosticError(const char* file, const char* function, int line, const
 void ShowDiagnosticError2(const char* file, const char* function, int line, const char* message, const char* message2);
 void ShowDiagnosticError3(const char* file, const char* function, int line, const char* message, const char* message2, const char* message3);
 void ShowDiagnosticError4(const char* file, const char* function, int line, const char* message, const char* message2, const char* message3, const char* message4);
+// while suppressed, diagnostic errors are silently dropped (fatal errors still show); for fuzzing and benchmarks
+void SuppressDiagnosticErrors(int suppress);
 void DebugShowInteger(const char* file, const char* function, int line, const char* message, int value);
 
 #endif
\ No newline at end of file
@@ -9,7 +9,12 @@ Please refer to <http://unlicense.org/>
 #include "lurds2_errors.h"
 #include "lurds2_jsonstream.h"
 #include "lurds2_bmp.h"
+#include "lurds2_spriteBatch.h"
 #include "lurds2_stringutils.h"
+#include "lurds2_resourceFile.h"
+#include "lurds2_hash.h"
+#include "lurds2_pool.h"
+#include "lurds2_pak.h"
 
 #include <string.h>
 
@@ -29,29 +34,327 @@ typedef struct FontCharacter {
 static FontCharacter EmptyFontCharacter = { 0, 0, 0, 0, 0 };
 
 #define FONTDATA_MAXCHARACTERS 128
+#define FONTDATA_MAXNAME 128
 typedef struct FontData {
   FontCharacter characters[FONTDATA_MAXCHARACTERS];
   Bmp bitmap;
   uint32_t universalHeightUp;
+  // what it was loaded from, as vfs names (e.g. "res/old_timey_font.json"), to reload it when they change
+  char jsonName[FONTDATA_MAXNAME];
+  char bitmapName[FONTDATA_MAXNAME];
 } FontData;
 
+// every live FontData sits in here; a Font is a PoolHandle to one
+static Pool FontPool;
+
+static void Font_FileChanged(void* userData, const char* name);
+
+// returns a new zeroed FontData (and its handle in 'font'), or 0 on failure
+static FontData* Font_New(Font* font)
+{
+  if (FontPool == 0)
+  {
+    if ((FontPool = Pool_Create(sizeof(FontData))) == 0)
+    {
+      // diagnostic error already reported by Pool_Create()
+      return 0;
+    }
+    ResourceFile_AddChangeListener(Font_FileChanged, 0);
+  }
+
+  PoolHandle handle;
+  FontData* data = Pool_Add(FontPool, &handle);
+  if (data == 0)
+  {
+    // diagnostic error already reported by Pool_Add()
+    return 0;
+  }
+  *font = POOL_HANDLE_TO_PTR(handle);
+  return data;
+}
+
+// returns the font's data, or 0 (with a diagnostic) when 'font' is null or already released
+static FontData* Font_Resolve(Font font)
+{
+  if (!font)
+  {
+    DIAGNOSTIC_FONT_ERROR("invalid null 'font' arg");
+    return 0;
+  }
+
+  FontData* data = FontPool ? Pool_Get(FontPool, POOL_PTR_TO_HANDLE(font)) : 0;
+  if (!data)
+  {
+    DIAGNOSTIC_FONT_ERROR("font arg is stale (already released) or invalid");
+    return 0;
+  }
+  return data;
+}
+
+// The compiled form of a font, written next to its json file (as "<json file name>.cache") the first time it loads.
+// Later loads map it and hand the pixels straight to opengl, skipping the json parse and bmp decode entirely,
+// as long as the hashes show the json and bmp files haven't changed since.
+#define FONTCACHE_VERSION 2 // (2: masking bitmaps only treat pure white as transparent)
+#define FONTCACHE_MAXFILENAME 256
+typedef struct FontCacheHeader {
+  char magic[8]; // "LRD2FONT"
+  uint32_t version;
+  uint32_t fileSize;
+  uint64_t jsonHash;
+  uint64_t bitmapHash;
+  char bitmapFileName[FONTCACHE_MAXFILENAME]; // null terminated
+  uint32_t universalHeightUp;
+  uint32_t bitmapWidth;
+  uint32_t bitmapHeight;
+  uint32_t pixelDataOffset; // RGBA pixels, already decoded for masking
+  FontCharacter characters[FONTDATA_MAXCHARACTERS];
+} FontCacheHeader;
+
+// the top-level keys of a font json file (in the same order as FontKeyNames)
+typedef enum FontKey {
+  FontKey_Characters,
+  FontKey_BitmapFileName,
+  FontKey_UniversalHeightUp,
+  FontKey_COUNT
+} FontKey;
+static const char* FontKeyNames[FontKey_COUNT] = { "characters", "bitmapFileName", "universalHeightUp" };
+static JsonKeySet FontKeys; // created on first use, then kept for good
+
+static wchar_t* Font_MakeCacheFileName(const wchar_t* fileName)
+{
+  int fileNameLength = wcslen(fileName);
+  wchar_t* cacheFileName = malloc((fileNameLength + 7) * sizeof(wchar_t));
+  if (cacheFileName == 0)
+  {
+    DIAGNOSTIC_FONT_ERROR("Failed to allocate memory for font cache file name");
+    return 0;
+  }
+  wcscpy(cacheFileName, fileName);
+  wcscat(cacheFileName, L".cache");
+  return cacheFileName;
+}
+
+static int Font_HashResourceFile(const wchar_t* fileName, uint64_t* hash)
+{
+  int fileLength;
+  const void* view = ResourceFile_Map(fileName, &fileLength);
+  if (view == 0)
+  {
+    // diagnostic error already reported by ResourceFile_Map()
+    return 0;
+  }
+  *hash = Hash_Bytes(view, fileLength, 0);
+  ResourceFile_Unmap(view);
+  return 1;
+}
+
+// returns 0 (quietly) when there's no usable cache
+static Font Font_LoadFromCache(const wchar_t* cacheFileName, uint64_t jsonHash)
+{
+  if (!ResourceFile_Exists(cacheFileName))
+  {
+    return 0;
+  }
+
+  int cacheLength;
+  const FontCacheHeader* cache = ResourceFile_Map(cacheFileName, &cacheLength);
+  if (cache == 0)
+  {
+    return 0;
+  }
+
+  Font font = 0;
+  if (cacheLength < (int)sizeof(FontCacheHeader)
+    || memcmp(cache->magic, "LRD2FONT", 8) != 0
+    || cache->version != FONTCACHE_VERSION
+    || cache->fileSize != (uint32_t)cacheLength
+    || cache->jsonHash != jsonHash
+    || memchr(cache->bitmapFileName, 0, FONTCACHE_MAXFILENAME) == 0
+    || cache->bitmapWidth == 0 || cache->bitmapWidth >= 5000
+    || cache->bitmapHeight == 0 || cache->bitmapHeight >= 5000
+    || cache->pixelDataOffset < sizeof(FontCacheHeader)
+    || cache->pixelDataOffset + (int64_t)cache->bitmapWidth * cache->bitmapHeight * 4 != cacheLength)
+  {
+    goto done; // stale or foreign
+  }
+
+  // the bmp has to be unchanged too
+  uint64_t bitmapHash;
+  wchar_t* wBitmapFileName = StringUtils_MakeWideString(cache->bitmapFileName);
+  if (wBitmapFileName == 0)
+  {
+    DIAGNOSTIC_FONT_ERROR("failed to StringUtils_MakeWideString() for cached bitmap file name");
+    goto done;
+  }
+  char bitmapName[FONTDATA_MAXNAME];
+  int hashed = Font_HashResourceFile(wBitmapFileName, &bitmapHash);
+  if (Pak_NormalizeName(bitmapName, FONTDATA_MAXNAME, "res/", wBitmapFileName) == 0) bitmapName[0] = 0;
+  free(wBitmapFileName);
+  if (!hashed || bitmapHash != cache->bitmapHash)
+  {
+    goto done;
+  }
+
+  FontData* data = Font_New(&font);
+  if (data == 0)
+  {
+    goto done;
+  }
+  strcpy(data->bitmapName, bitmapName);
+  memcpy(data->characters, cache->characters, sizeof(data->characters));
+  data->universalHeightUp = cache->universalHeightUp;
+  data->bitmap = Bmp_LoadMaskingBitmapFromRgba((uint8_t*)cache + cache->pixelDataOffset, cache->bitmapWidth, cache->bitmapHeight);
+  if (data->bitmap == 0)
+  {
+    // diagnostic error already reported by Bmp_LoadMaskingBitmapFromRgba()
+    Pool_Remove(FontPool, POOL_PTR_TO_HANDLE(font));
+    font = 0;
+  }
+
+done:
+  ResourceFile_Unmap(cache);
+  return font;
+}
+
+static void Font_SaveCache(const wchar_t* cacheFileName, FontData* data, const char* bitmapFileName, uint64_t jsonHash, uint64_t bitmapHash, uint8_t* rgbaData, int width, int height)
+{
+  uint32_t pixelDataOffset = (sizeof(FontCacheHeader) + 15) & ~15;
+  int64_t cacheLength = pixelDataOffset + (int64_t)width * height * 4;
+  if (cacheLength > 0x7FFFFFFF)
+  {
+    DIAGNOSTIC_FONT_ERROR("font bitmap too large to cache");
+    return;
+  }
+
+  FontCacheHeader* cache = malloc(cacheLength);
+  if (cache == 0)
+  {
+    DIAGNOSTIC_FONT_ERROR("Failed to allocate memory for font cache");
+    return;
+  }
+  memset(cache, 0, pixelDataOffset);
+
+  memcpy(cache->magic, "LRD2FONT", 8);
+  cache->version = FONTCACHE_VERSION;
+  cache->fileSize = (uint32_t)cacheLength;
+  cache->jsonHash = jsonHash;
+  cache->bitmapHash = bitmapHash;
+  strcpy(cache->bitmapFileName, bitmapFileName);
+  cache->universalHeightUp = data->universalHeightUp;
+  cache->bitmapWidth = width;
+  cache->bitmapHeight = height;
+  cache->pixelDataOffset = pixelDataOffset;
+  memcpy(cache->characters, data->characters, sizeof(cache->characters));
+  memcpy((uint8_t*)cache + pixelDataOffset, rgbaData, (size_t)width * height * 4);
+
+  // (a cache that can't be written just means the slow path again next time)
+  ResourceFile_Save(cacheFileName, cache, (int)cacheLength);
+  free(cache);
+}
+
+// decodes the font's bmp, turns it into a texture, and saves the font cache for next time
+static int Font_LoadBitmap(FontData* data, const char* bitmapFileName, const wchar_t* cacheFileName, uint64_t jsonHash)
+{
+  wchar_t* wBitmapFileName = StringUtils_MakeWideString(bitmapFileName);
+  if (wBitmapFileName == 0)
+  {
+    DIAGNOSTIC_FONT_ERROR("failed to StringUtils_MakeWideString() for \"bitmapFileName\" element");
+    return 0;
+  }
+
+  int fileLength;
+  const void* view = ResourceFile_Map(wBitmapFileName, &fileLength);
+  if (Pak_NormalizeName(data->bitmapName, FONTDATA_MAXNAME, "res/", wBitmapFileName) == 0) data->bitmapName[0] = 0;
+  free(wBitmapFileName);
+  if (view == 0)
+  {
+    // diagnostic error already reported by ResourceFile_Map()
+    return 0;
+  }
+
+  int width;
+  int height;
+  uint64_t bitmapHash = Hash_Bytes(view, fileLength, 0);
+  uint8_t* rgbaData = Bmp_DecodeToRgba(view, fileLength, 1, &width, &height);
+  ResourceFile_Unmap(view);
+  if (rgbaData == 0)
+  {
+    // diagnostic error already reported by Bmp_DecodeToRgba()
+    return 0;
+  }
+
+  data->bitmap = Bmp_LoadMaskingBitmapFromRgba(rgbaData, width, height);
+  if (data->bitmap != 0 && cacheFileName != 0)
+  {
+    Font_SaveCache(cacheFileName, data, bitmapFileName, jsonHash, bitmapHash, rgbaData, width, height);
+  }
+  free(rgbaData);
+  return data->bitmap != 0;
+}
+
 Font Font_LoadFromResourceFile(const wchar_t * fileName)
 {
-  JsonStream stream = JsonStream_LoadFromResourceFile(fileName);
+  if (fileName == 0)
+  {
+    DIAGNOSTIC_FONT_ERROR("invalid null 'fileName' arg");
+    return 0;
+  }
+
+  int jsonLength;
+  const char* json = ResourceFile_Map(fileName, &jsonLength);
+  if (json == 0)
+  {
+    // diagnostic error already reported by ResourceFile_Map()
+    return 0;
+  }
+
+  // use the compiled cache if it's still good
+  uint64_t jsonHash = Hash_Bytes(json, jsonLength, 0);
+  wchar_t* cacheFileName = Font_MakeCacheFileName(fileName);
+  if (cacheFileName != 0)
+  {
+    Font cached = Font_LoadFromCache(cacheFileName, jsonHash);
+    if (cached != 0)
+    {
+      FontData* data = Pool_Get(FontPool, POOL_PTR_TO_HANDLE(cached));
+      if (Pak_NormalizeName(data->jsonName, FONTDATA_MAXNAME, "res/", fileName) == 0) data->jsonName[0] = 0;
+      free(cacheFileName);
+      ResourceFile_Unmap(json);
+      return cached;
+    }
+  }
+
+  if (FontKeys == 0 && (FontKeys = JsonKeySet_Create(FontKeyNames, FontKey_COUNT)) == 0)
+  {
+    // diagnostic error already reported by JsonKeySet_Create()
+    free(cacheFileName);
+    ResourceFile_Unmap(json);
+    return 0;
+  }
+
+  char* debugIdentifier = StringUtils_MakeNarrowString(fileName);
+  JsonStream stream = JsonStream_ParseRange(json, json + jsonLength, debugIdentifier);
+  free(debugIdentifier);
   if (stream == 0)
   {
     // diagnostic error already reported by JsonStream constructor
+    free(cacheFileName);
+    ResourceFile_Unmap(json);
     return 0;
   }
   
-  FontData * data = malloc(sizeof(FontData));
+  Font font;
+  FontData * data = Font_New(&font);
   if (data == 0)
   {
-    DIAGNOSTIC_FONT_ERROR("Failed to allocate memory for FontData");
     JsonStream_Release(stream);
+    free(cacheFileName);
+    ResourceFile_Unmap(json);
     return 0;
   }
-  memset(data, 0, sizeof(FontData));
+  JsonStream_SetKeySet(stream, FontKeys);
+  char bitmapFileName[FONTCACHE_MAXFILENAME];
+  bitmapFileName[0] = 0;
 
   // walk through JsonStream data to determine bmp file name and character points
   int done = 0;
@@ -123,56 +426,61 @@ Font Font_LoadFromResourceFile(const wchar_t * fileName)
             (void)1;
           }
         }
-        else if (strcmp("characters", propName) == 0)
+        else switch (JsonStream_GetKeyId(stream))
         {
-          inCharacterMap = 1;
-        }
-        else if (strcmp("bitmapFileName", propName) == 0)
-        {
-          const char* bitmapFileName;
-          int32_t bitmapFileNameLength;
-          wchar_t* wBitmapFileName;
+          case FontKey_Characters:
+            inCharacterMap = 1;
+            break;
 
-          if (data->bitmap != 0)
-          {
-            DIAGNOSTIC_FONT_ERROR2("unexpected multiple \"bitmapFileName\" elements in ", JsonStream_GetDebugIdentifier(stream));
-            goto die;
-          }
-          else if (JsonStream_MoveNext(stream) != JsonStreamString)
+          case FontKey_BitmapFileName:
           {
-            DIAGNOSTIC_FONT_ERROR2("invalid \"bitmapFileName\" element; needs to be string, in ", JsonStream_GetDebugIdentifier(stream));
-            goto die;
-          }
-          else if (0 == (bitmapFileName = JsonStream_GetString(stream, &bitmapFileNameLength)))
-          {
-            DIAGNOSTIC_FONT_ERROR2("failed to GetString() for \"bitmapFileName\" element in ", JsonStream_GetDebugIdentifier(stream));
-            goto die;
-          }
-          // copy the bitmapFileName
-          else if (0 == (wBitmapFileName = StringUtils_MakeWideString(bitmapFileName)))
-          {
-            DIAGNOSTIC_FONT_ERROR2("failed to StringUtils_MakeWideString() for \"bitmapFileName\" element in ", JsonStream_GetDebugIdentifier(stream));
-            goto die;
-          }
-          else
-          {
-            data->bitmap = Bmp_LoadMaskingBitmapFromResourceFile(wBitmapFileName);
-            free(wBitmapFileName);
-            if (data->bitmap == 0)
+            const char* bitmapFileNameValue;
+            int32_t bitmapFileNameLength;
+
+            if (bitmapFileName[0] != 0)
             {
-              // diagnostic error already reported by Bmp_LoadFromResourceFile()
+              DIAGNOSTIC_FONT_ERROR2("unexpected multiple \"bitmapFileName\" elements in ", JsonStream_GetDebugIdentifier(stream));
               goto die;
             }
+            else if (JsonStream_MoveNext(stream) != JsonStreamString)
+            {
+              DIAGNOSTIC_FONT_ERROR2("invalid \"bitmapFileName\" element; needs to be string, in ", JsonStream_GetDebugIdentifier(stream));
+              goto die;
+            }
+            else if (0 == (bitmapFileNameValue = JsonStream_GetString(stream, &bitmapFileNameLength)))
+            {
+              DIAGNOSTIC_FONT_ERROR2("failed to GetString() for \"bitmapFileName\" element in ", JsonStream_GetDebugIdentifier(stream));
+              goto die;
+            }
+            else if (bitmapFileNameLength == 0 || bitmapFileNameLength >= FONTCACHE_MAXFILENAME)
+            {
+              DIAGNOSTIC_FONT_ERROR2("invalid \"bitmapFileName\" element; empty or too long, in ", JsonStream_GetDebugIdentifier(stream));
+              goto die;
+            }
+            else
+            {
+              // (the bitmap gets loaded once the whole file has been read)
+              memcpy(bitmapFileName, bitmapFileNameValue, bitmapFileNameLength + 1);
+            }
+            break;
           }
-        }
-        else if (strcmp("universalHeightUp", propName) == 0)
-        {
-          if (JsonStream_MoveNext(stream) != JsonStreamNumber)
-          {
-            DIAGNOSTIC_FONT_ERROR2("invalid \"universalHeightUp\" element; needs to be number, in ", JsonStream_GetDebugIdentifier(stream));
-            goto die;
-          }
-          data->universalHeightUp = JsonStream_GetNumberInt(stream);
+
+          case FontKey_UniversalHeightUp:
+            if (JsonStream_MoveNext(stream) != JsonStreamNumber)
+            {
+              DIAGNOSTIC_FONT_ERROR2("invalid \"universalHeightUp\" element; needs to be number, in ", JsonStream_GetDebugIdentifier(stream));
+              goto die;
+            }
+            data->universalHeightUp = JsonStream_GetNumberInt(stream);
+            break;
+
+          default:
+            // unrecognized element; its value (however big) gets skipped in one go
+            if (JsonStream_SkipValue(stream) == JsonStreamError)
+            {
+              goto die;
+            }
+            break;
         }
         break;
       }
@@ -185,7 +493,7 @@ Font Font_LoadFromResourceFile(const wchar_t * fileName)
     }
   }
 
-  if (data->bitmap == 0)
+  if (bitmapFileName[0] == 0)
   {
     DIAGNOSTIC_FONT_ERROR2("missing \"bitmapFileName\" element in ", JsonStream_GetDebugIdentifier(stream));
     goto die;
@@ -214,27 +522,63 @@ Font Font_LoadFromResourceFile(const wchar_t * fileName)
     }
   }
   
+  if (!Font_LoadBitmap(data, bitmapFileName, cacheFileName, jsonHash))
+  {
+    // diagnostic error already reported by Font_LoadBitmap()
+    goto die;
+  }
+  
+  if (Pak_NormalizeName(data->jsonName, FONTDATA_MAXNAME, "res/", fileName) == 0) data->jsonName[0] = 0;
   JsonStream_Release(stream);
-  return data;
+  free(cacheFileName);
+  ResourceFile_Unmap(json);
+  return font;
 
 die:
   JsonStream_Release(stream);
+  free(cacheFileName);
+  ResourceFile_Unmap(json);
   if (data->bitmap) Bmp_Release(data->bitmap);
-  free(data);
+  Pool_Remove(FontPool, POOL_PTR_TO_HANDLE(font));
   return 0;
 }
 
 void Font_Release(Font font)
 {
-  FontData* data = (FontData*)font;
+  FontData* data = Font_Resolve(font);
   if (!data)
   {
-    DIAGNOSTIC_FONT_ERROR("font arg is null");
     return;
   }
   
   Bmp_Release(data->bitmap);
-  free(data);
+  Pool_Remove(FontPool, POOL_PTR_TO_HANDLE(font));
+}
+
+// (a ResourceFileChangedFunc) reloads the fonts loaded from a changed json or bmp into the Fonts already handed out
+static void Font_FileChanged(void* userData, const char* name)
+{
+  PoolHandle handle;
+  int32_t position = 0;
+  FontData* data;
+  while ((data = Pool_Next(FontPool, &position, &handle)) != 0)
+  {
+    if (data->jsonName[0] == 0 || (strcmp(data->jsonName, name) != 0 && strcmp(data->bitmapName, name) != 0)) continue;
+
+    wchar_t* fileName = StringUtils_MakeWideString(data->jsonName + 4); // (without "res/")
+    if (fileName == 0) continue;
+    Font reloaded = Font_LoadFromResourceFile(fileName); // (which can move the pool's FontData)
+    free(fileName);
+    if (reloaded == 0) continue; // (diagnostic already reported; it keeps the old one)
+
+    // swap them, so the reloaded one gets released with the old bitmap
+    FontData* oldData = Pool_Get(FontPool, handle);
+    FontData* newData = Pool_Get(FontPool, POOL_PTR_TO_HANDLE(reloaded));
+    FontData temp = *oldData;
+    *oldData = *newData;
+    *newData = temp;
+    Font_Release(reloaded);
+  }
 }
 
 static FontMeasurement Font_DoSingleLine(Font font, const char * text, int render)
@@ -247,13 +591,24 @@ static FontMeasurement Font_DoSingleLine(Font font, const char * text, int rende
     return result;
   }
 
-  FontData* data = (FontData*)font;
-  if (font == 0)
+  FontData* data = Font_Resolve(font);
+  if (data == 0)
   {
-    DIAGNOSTIC_FONT_ERROR("invalid null 'font' arg");
     return result;
   }
   
+  // the glyphs all go in one sprite batch, drawn in the current color
+  // (unless the caller is already batching, since batches don't nest)
+  int batched = render && !SpriteBatch_IsActive();
+  uint32_t color = SPRITEBATCH_WHITE;
+  if (batched)
+  {
+    GLfloat currentColor[4];
+    glGetFloatv(GL_CURRENT_COLOR, currentColor);
+    color = SPRITEBATCH_RGBA(currentColor[0] * 255.0f + 0.5f, currentColor[1] * 255.0f + 0.5f, currentColor[2] * 255.0f + 0.5f, currentColor[3] * 255.0f + 0.5f);
+    SpriteBatch_Begin(0);
+  }
+
   GLenum oldMode;
   glGetIntegerv(GL_MATRIX_MODE, &oldMode);
   glMatrixMode(GL_MODELVIEW);
@@ -270,7 +625,12 @@ static FontMeasurement Font_DoSingleLine(Font font, const char * text, int rende
       c = &data->characters[' '];
     }
 
-    if (render)
+    if (batched)
+    {
+      SpriteRect source = { c->xOrigin, c->yOrigin - c->heightUp, c->width, c->heightUp + c->heightDown };
+      SpriteBatch_Add(data->bitmap, (float)result.width, (float)(data->universalHeightUp - c->heightUp), &source, color);
+    }
+    else if (render)
     {
       int heightBoost = data->universalHeightUp - c->heightUp;
       glTranslated(result.width, heightBoost, 0);
@@ -290,6 +650,7 @@ static FontMeasurement Font_DoSingleLine(Font font, const char * text, int rende
 
     text++;
   }
+  if (batched) SpriteBatch_End();
   glPopMatrix();
   glMatrixMode(oldMode);
 
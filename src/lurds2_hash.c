@@ -0,0 +1,58 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_hash.h"
+
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3 0x165667B19E3779F9ULL
+
+static uint64_t Hash_RotateLeft(uint64_t x, int bits)
+{
+  return (x << bits) | (x >> (64 - bits));
+}
+
+// scrambles one 8-byte word into the running hash
+static uint64_t Hash_MixWord(uint64_t hash, uint64_t word)
+{
+  word *= HASH_PRIME2;
+  word = Hash_RotateLeft(word, 31);
+  word *= HASH_PRIME1;
+  hash ^= word;
+  return Hash_RotateLeft(hash, 27) * HASH_PRIME1 + HASH_PRIME3;
+}
+
+uint64_t Hash_Bytes(const void* data, int64_t length, uint64_t seed)
+{
+  const uint8_t* p = (const uint8_t*)data;
+  uint64_t hash = seed ^ HASH_PRIME3 ^ ((uint64_t)length * HASH_PRIME1);
+
+  while (length >= 8)
+  {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    hash = Hash_MixWord(hash, word);
+    p += 8;
+    length -= 8;
+  }
+
+  // the last 0-7 bytes, packed into one more word
+  uint64_t tail = 0;
+  int i;
+  for (i = 0; i < length; i++)
+  {
+    tail |= (uint64_t)p[i] << (i * 8);
+  }
+  hash = Hash_MixWord(hash, tail);
+
+  // final avalanche, so every input bit affects every output bit
+  hash ^= hash >> 33;
+  hash *= HASH_PRIME2;
+  hash ^= hash >> 29;
+  hash *= HASH_PRIME3;
+  hash ^= hash >> 32;
+  return hash;
+}
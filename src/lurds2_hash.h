@@ -0,0 +1,14 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_HASH
+#define LURDS2_HASH
+
+// A fast, well-mixed (but not cryptographic) 64-bit hash of arbitrary bytes; it reads 8 bytes per step.
+// Different seeds give unrelated hashes of the same bytes.
+uint64_t Hash_Bytes(const void* data, int64_t length, uint64_t seed);
+
+#endif
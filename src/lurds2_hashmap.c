@@ -0,0 +1,379 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_hashmap.h"
+
+#include "lurds2_errors.h"
+#include "lurds2_hash.h"
+
+#define DIAGNOSTIC_HASHMAP_ERROR(message) DIAGNOSTIC_ERROR(message);
+#define DIAGNOSTIC_HASHMAP_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
+#define DIAGNOSTIC_HASHMAP_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3));
+#define DIAGNOSTIC_HASHMAP_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
+
+#define HASHMAP_SEED 0x6C75726473324D61ULL
+#define HASHMAP_MIN_CAPACITY 8
+
+// Each slot is a HashMapSlot header followed by the key and then the value (each padded to 8 bytes).
+typedef struct HashMapSlot {
+  uint32_t distance; // 0 = empty slot, otherwise 1 + how far the entry sits from its home slot
+  uint32_t hash; // the key's hash (its low bits pick the home slot); saves rehashing and most key compares
+} HashMapSlot;
+
+typedef struct HashMapData {
+  int32_t keySize;
+  int32_t valueSize;
+  int32_t valueOffset; // from the start of a slot
+  int32_t slotSize;
+  int32_t count; // number of entries
+  int32_t capacity; // number of slots (a power of 2, or 0 before the first add)
+  int8_t* slots;
+  int8_t* scratch; // room for two slots, for swapping entries during Robin Hood inserts
+} HashMapData;
+
+#define HASHMAP_SLOT(data, index) ((HashMapSlot*)((data)->slots + (int64_t)(index) * (data)->slotSize))
+#define HASHMAP_SLOT_KEY(slot) ((int8_t*)(slot) + sizeof(HashMapSlot))
+
+HashMap HashMap_Create(int32_t keySize, int32_t valueSize)
+{
+  if (keySize < 1 || keySize > 0x10000)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid keySize arg");
+    return 0;
+  }
+
+  if (valueSize < 0 || valueSize > 0x10000)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid valueSize arg");
+    return 0;
+  }
+
+  HashMapData* data = malloc(sizeof(HashMapData));
+  if (data == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("failed to allocate memory for HashMapData");
+    return 0;
+  }
+  memset(data, 0, sizeof(HashMapData));
+  data->keySize = keySize;
+  data->valueSize = valueSize;
+  data->valueOffset = sizeof(HashMapSlot) + ((keySize + 7) & ~7);
+  data->slotSize = data->valueOffset + ((valueSize + 7) & ~7);
+
+  data->scratch = malloc(data->slotSize * 2);
+  if (data->scratch == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("failed to allocate memory for HashMapData scratch");
+    free(data);
+    return 0;
+  }
+  return data;
+}
+
+void HashMap_Release(HashMap map)
+{
+  HashMapData* data = (HashMapData*)map;
+  if (data == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid null arg");
+    return;
+  }
+
+  if (data->slots) free(data->slots);
+  free(data->scratch);
+  free(data);
+}
+
+static uint32_t HashMap_Hash(HashMapData* data, const void* key)
+{
+  uint64_t hash = Hash_Bytes(key, data->keySize, HASHMAP_SEED);
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// Robin Hood insert of a whole slot (header already filled in, distance = 1) that's known not to be in the table;
+// entries closer to their home slot give way to ones further from theirs, which keeps every probe sequence short.
+// Returns the slot where 'entry' itself ended up. The table must have a free slot.
+static HashMapSlot* HashMap_PlaceEntry(HashMapData* data, int8_t* entry)
+{
+  uint32_t mask = (uint32_t)data->capacity - 1;
+  uint32_t index = ((HashMapSlot*)entry)->hash & mask;
+  int8_t* carried = entry;
+  int8_t* spare = carried == data->scratch ? data->scratch + data->slotSize : data->scratch;
+  HashMapSlot* result = 0;
+  while (1)
+  {
+    HashMapSlot* slot = HASHMAP_SLOT(data, index);
+    if (slot->distance == 0)
+    {
+      memcpy(slot, carried, data->slotSize);
+      return result ? result : slot;
+    }
+    if (slot->distance < ((HashMapSlot*)carried)->distance)
+    {
+      // take this slot; the entry that was here moves on
+      memcpy(spare, slot, data->slotSize);
+      memcpy(slot, carried, data->slotSize);
+      if (result == 0) result = slot;
+      carried = spare;
+      spare = spare == data->scratch ? data->scratch + data->slotSize : data->scratch;
+    }
+    ((HashMapSlot*)carried)->distance++;
+    index = (index + 1) & mask;
+  }
+}
+
+// rehashes into a table of exactly 'newCapacity' slots (a power of 2 with room for every entry)
+static int HashMap_Resize(HashMapData* data, int32_t newCapacity)
+{
+  int8_t* oldSlots = data->slots;
+  int32_t oldCapacity = data->capacity;
+
+  int64_t newSpace64 = (int64_t)newCapacity * data->slotSize;
+  if (newSpace64 > 0x7FFFFFFF)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("can't grow hash map; too large");
+    return 0;
+  }
+
+  int8_t* newSlots = malloc((size_t)newSpace64);
+  if (newSlots == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("can't grow hash map; out of memory");
+    return 0;
+  }
+
+  // (only the slot headers need clearing)
+  int32_t i;
+  for (i = 0; i < newCapacity; i++)
+  {
+    ((HashMapSlot*)(newSlots + (int64_t)i * data->slotSize))->distance = 0;
+  }
+
+  data->slots = newSlots;
+  data->capacity = newCapacity;
+  for (i = 0; i < oldCapacity; i++)
+  {
+    HashMapSlot* slot = (HashMapSlot*)(oldSlots + (int64_t)i * data->slotSize);
+    if (slot->distance != 0)
+    {
+      slot->distance = 1;
+      HashMap_PlaceEntry(data, (int8_t*)slot);
+    }
+  }
+  if (oldSlots) free(oldSlots);
+  return 1;
+}
+
+// keeps the table at most 7/8 full (Robin Hood probing stays fast well past that, but not forever)
+static int HashMap_MakeRoom(HashMapData* data, int64_t count)
+{
+  if (count * 8 <= (int64_t)data->capacity * 7)
+  {
+    return 1;
+  }
+
+  int64_t newCapacity = data->capacity ? (int64_t)data->capacity * 2 : HASHMAP_MIN_CAPACITY;
+  while (count * 8 > newCapacity * 7) newCapacity *= 2;
+  if (newCapacity > 0x40000000)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("can't grow hash map; too many entries");
+    return 0;
+  }
+  return HashMap_Resize(data, (int32_t)newCapacity);
+}
+
+static HashMapSlot* HashMap_Find(HashMapData* data, const void* key, uint32_t hash)
+{
+  if (data->count == 0)
+  {
+    return 0;
+  }
+
+  uint32_t mask = (uint32_t)data->capacity - 1;
+  uint32_t index = hash & mask;
+  uint32_t distance = 1;
+  while (1)
+  {
+    HashMapSlot* slot = HASHMAP_SLOT(data, index);
+    // (an entry closer to its home than we are to ours means our key would have been placed before it)
+    if (slot->distance < distance)
+    {
+      return 0;
+    }
+    if (slot->hash == hash && memcmp(HASHMAP_SLOT_KEY(slot), key, data->keySize) == 0)
+    {
+      return slot;
+    }
+    distance++;
+    index = (index + 1) & mask;
+  }
+}
+
+int HashMap_Reserve(HashMap map, int32_t count)
+{
+  HashMapData* data = (HashMapData*)map;
+  if (data == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid null arg");
+    return 0;
+  }
+
+  if (count < 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid count arg");
+    return 0;
+  }
+  return HashMap_MakeRoom(data, count);
+}
+
+void* HashMap_Get(HashMap map, const void* key)
+{
+  HashMapData* data = (HashMapData*)map;
+  if (data == 0 || key == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid null arg");
+    return 0;
+  }
+
+  HashMapSlot* slot = HashMap_Find(data, key, HashMap_Hash(data, key));
+  return slot ? (int8_t*)slot + data->valueOffset : 0;
+}
+
+void* HashMap_GetOrAdd(HashMap map, const void* key, int* wasAdded)
+{
+  HashMapData* data = (HashMapData*)map;
+  if (wasAdded) *wasAdded = 0;
+  if (data == 0 || key == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid null arg");
+    return 0;
+  }
+
+  uint32_t hash = HashMap_Hash(data, key);
+  HashMapSlot* slot = HashMap_Find(data, key, hash);
+  if (slot)
+  {
+    return (int8_t*)slot + data->valueOffset;
+  }
+
+  if (!HashMap_MakeRoom(data, (int64_t)data->count + 1))
+  {
+    return 0;
+  }
+
+  HashMapSlot* entry = (HashMapSlot*)data->scratch;
+  entry->distance = 1;
+  entry->hash = hash;
+  memcpy(HASHMAP_SLOT_KEY(entry), key, data->keySize);
+  memset(data->scratch + data->valueOffset, 0, data->slotSize - data->valueOffset);
+  slot = HashMap_PlaceEntry(data, data->scratch);
+  data->count++;
+  if (wasAdded) *wasAdded = 1;
+  return (int8_t*)slot + data->valueOffset;
+}
+
+void* HashMap_Set(HashMap map, const void* key, const void* value)
+{
+  HashMapData* data = (HashMapData*)map;
+  if (data != 0 && value == 0 && data->valueSize > 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid null value arg");
+    return 0;
+  }
+
+  void* result = HashMap_GetOrAdd(map, key, 0);
+  if (result && data->valueSize > 0)
+  {
+    memcpy(result, value, data->valueSize);
+  }
+  return result;
+}
+
+int HashMap_Remove(HashMap map, const void* key)
+{
+  HashMapData* data = (HashMapData*)map;
+  if (data == 0 || key == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid null arg");
+    return 0;
+  }
+
+  HashMapSlot* slot = HashMap_Find(data, key, HashMap_Hash(data, key));
+  if (slot == 0)
+  {
+    return 0;
+  }
+
+  // shift the entries after it back one slot (no tombstones, so probes never get longer from removals)
+  uint32_t mask = (uint32_t)data->capacity - 1;
+  uint32_t index = (uint32_t)(((int8_t*)slot - data->slots) / data->slotSize);
+  while (1)
+  {
+    uint32_t nextIndex = (index + 1) & mask;
+    HashMapSlot* next = HASHMAP_SLOT(data, nextIndex);
+    if (next->distance <= 1)
+    {
+      break;
+    }
+    memcpy(HASHMAP_SLOT(data, index), next, data->slotSize);
+    HASHMAP_SLOT(data, index)->distance--;
+    index = nextIndex;
+  }
+  HASHMAP_SLOT(data, index)->distance = 0;
+  data->count--;
+  return 1;
+}
+
+void HashMap_Clear(HashMap map)
+{
+  HashMapData* data = (HashMapData*)map;
+  if (data == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid null arg");
+    return;
+  }
+
+  int32_t i;
+  for (i = 0; i < data->capacity; i++)
+  {
+    HASHMAP_SLOT(data, i)->distance = 0;
+  }
+  data->count = 0;
+}
+
+int32_t HashMap_Count(HashMap map)
+{
+  HashMapData* data = (HashMapData*)map;
+  if (data == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid null arg");
+    return 0;
+  }
+  return data->count;
+}
+
+int HashMap_Next(HashMap map, int32_t* position, const void** key, void** value)
+{
+  HashMapData* data = (HashMapData*)map;
+  if (data == 0 || position == 0)
+  {
+    DIAGNOSTIC_HASHMAP_ERROR("invalid null arg");
+    return 0;
+  }
+
+  while (*position >= 0 && *position < data->capacity)
+  {
+    HashMapSlot* slot = HASHMAP_SLOT(data, *position);
+    (*position)++;
+    if (slot->distance != 0)
+    {
+      if (key) *key = HASHMAP_SLOT_KEY(slot);
+      if (value) *value = (int8_t*)slot + data->valueOffset;
+      return 1;
+    }
+  }
+  return 0;
+}
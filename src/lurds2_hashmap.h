@@ -0,0 +1,36 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_HASHMAP
+#define LURDS2_HASHMAP
+
+typedef void* HashMap;
+
+// A HashMap maps fixed-size keys (compared byte for byte) to fixed-size values. Entries live directly in one
+// open-addressed table (Robin Hood probing), so there's no allocation per entry and lookups stay O(1) when full.
+// Value pointers handed out are only good until the next add or remove, which may move entries around.
+HashMap HashMap_Create(int32_t keySize, int32_t valueSize);
+void    HashMap_Release(HashMap map);
+
+// makes room for 'count' entries up front, so adding up to that many never rehashes; returns 0 on failure
+int     HashMap_Reserve(HashMap map, int32_t count);
+// returns the key's value, or 0 when the key isn't in the map
+void*   HashMap_Get(HashMap map, const void* key);
+// returns the key's value, adding the key with a zeroed value first when it's missing (0 on failure);
+// 'wasAdded' (optional) tells which happened
+void*   HashMap_GetOrAdd(HashMap map, const void* key, int* wasAdded);
+// adds or overwrites the key's value (copied from 'value'); returns the stored value (0 on failure)
+void*   HashMap_Set(HashMap map, const void* key, const void* value);
+// returns 1 if the key was there (and is now gone)
+int     HashMap_Remove(HashMap map, const void* key);
+void    HashMap_Clear(HashMap map);
+int32_t HashMap_Count(HashMap map);
+
+// visits every entry (in no particular order): start with *position = 0 and call until it returns 0.
+// Don't add or remove entries while iterating.
+int     HashMap_Next(HashMap map, int32_t* position, const void** key, void** value);
+
+#endif
@@ -7,6 +7,9 @@ Please refer to <http://unlicense.org/>
 #include "lurds2_jsonstream.h"
 
 #include "lurds2_errors.h"
+#include "lurds2_hash.h"
+#include "lurds2_resourceFile.h"
+#include "lurds2_stringutils.h"
 
 #define DIAGNOSTIC_JSON_ERROR(message) DIAGNOSTIC_ERROR(message);
 #define DIAGNOSTIC_JSON_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
@@ -15,15 +18,370 @@ Please refer to <http://unlicense.org/>
 
 typedef struct JsonStreamData {
   char* identifierForDebugMessages;
+  int ownsSource; // 1 when 'start' is our own writable copy (freed on release); 0 when borrowed via JsonStream_ParseRange()
+  const void* mappedView; // the resource file 'start' points into, when loaded via JsonStream_LoadFromResourceFile() (unmapped on release)
   char* start;
   char* current;
   char* end;
   JsonStreamTokenType tokenType;
-  char* stringBuffer;
+  char* string; // the current token's string content (points into the source when possible, else at stringBuffer)
+  int32_t stringLength;
+  int stringIsTerminated; // 0 when 'string' is a slice of a borrowed source that we can't null-terminate
+  char* stringBuffer; // scratch space for strings that had to be decoded (because they contain escapes)
   int32_t stringBufferLength;
+  int32_t stringBufferCapacity; // not counting the null terminator
   int64_t numBuffer;
+  double numDouble;
+
+  // incremental (push) mode state; see JsonStream_CreateIncremental()
+  int isIncremental;
+  int isInputComplete; // set by JsonStream_FeedEnd(); until then, running out of data mid-token means "need more data"
+  char* carry; // holds only the unfinished token that straddled a chunk boundary
+  int32_t carryLength;
+  int32_t carryCapacity;
+  const char* chunkCurrent; // the part of the caller's latest chunk that hasn't been handed to the parser yet
+  const char* chunkEnd;
+
+  // optional index of matching bracket offsets (relative to 'start'); see JsonStream_BuildStructuralIndex()
+  int32_t* structuralIndex; // pairs of (open, close) offsets, sorted by open offset; close is -1 if never closed
+  int32_t structuralIndexCount; // number of pairs
+
+  struct JsonKeySetData* keySet; // borrowed; see JsonStream_SetKeySet()
+  int32_t keyId; // the current property name's index in 'keySet', or -1
 } JsonStreamData;
 
+// A perfect hash of the keys a consumer expects ("hash and displace"): a key's hash picks a bucket, and each bucket
+// has a displacement chosen so its keys land in otherwise-empty slots. Looking up a property name is then one hash
+// plus one compare, and the table only needs about 2 slots per key.
+typedef struct JsonKeySetData {
+  uint64_t seed;
+  uint32_t bucketMask; // bucket count - 1 (a power of 2)
+  uint32_t slotMask; // slot count - 1 (a power of 2)
+  uint32_t* displacements; // per bucket
+  int32_t* slots; // key index per slot, or -1
+  int32_t keyCount;
+  const char** keys; // copies, all in one allocation with the struct
+  int32_t* keyLengths;
+} JsonKeySetData;
+
+// SWAR ("SIMD within a register") helpers for scanning 8 bytes per step.
+// (TCC doesn't offer SSE/AVX intrinsics, so a plain 64-bit integer is the widest register we can portably use)
+#define JSONSTREAM_SWAR_ONES  0x0101010101010101ULL
+#define JSONSTREAM_SWAR_LOWS  0x7F7F7F7F7F7F7F7FULL
+#define JSONSTREAM_SWAR_HIGHS 0x8080808080808080ULL
+
+static uint64_t JsonStream_LoadBlock(const char* p)
+{
+  uint64_t block;
+  memcpy(&block, p, sizeof(block)); // (no alignment requirement, and compilers turn this into a single load)
+  return block;
+}
+
+// returns a mask with the high bit set in every byte of 'block' that equals 'c', and all other bits clear
+// (exact per byte - unlike the classic "has zero byte" trick, no carries leak between neighboring bytes)
+static uint64_t JsonStream_MatchBytes(uint64_t block, uint8_t c)
+{
+  uint64_t x = block ^ (JSONSTREAM_SWAR_ONES * c);
+  return ~(((x & JSONSTREAM_SWAR_LOWS) + JSONSTREAM_SWAR_LOWS) | x) & JSONSTREAM_SWAR_HIGHS;
+}
+
+// returns 'p' advanced past whole 8-byte blocks of whitespace and commas
+// (stops at the first block that holds anything else; the caller finishes that block one byte at a time)
+static char* JsonStream_SkipFillerBlocks(char* p, char* end)
+{
+  while (end - p >= 8)
+  {
+    uint64_t block = JsonStream_LoadBlock(p);
+    uint64_t filler = JsonStream_MatchBytes(block, ' ')
+                    | JsonStream_MatchBytes(block, '\n')
+                    | JsonStream_MatchBytes(block, '\r')
+                    | JsonStream_MatchBytes(block, '\t')
+                    | JsonStream_MatchBytes(block, ',');
+    if (filler != JSONSTREAM_SWAR_HIGHS) break;
+    p += 8;
+  }
+  return p;
+}
+
+// returns the first '"' or '\\' at or after 'p', or 'end' when there isn't one
+static char* JsonStream_FindQuoteOrBackslash(char* p, char* end)
+{
+  while (end - p >= 8)
+  {
+    uint64_t block = JsonStream_LoadBlock(p);
+    if (JsonStream_MatchBytes(block, '"') | JsonStream_MatchBytes(block, '\\')) break;
+    p += 8;
+  }
+  while (p < end && *p != '"' && *p != '\\') p++;
+  return p;
+}
+
+// returns the first '\r' or '\n' at or after 'p', or 'end' when there isn't one
+static char* JsonStream_FindLineEnd(char* p, char* end)
+{
+  while (end - p >= 8)
+  {
+    uint64_t block = JsonStream_LoadBlock(p);
+    if (JsonStream_MatchBytes(block, '\r') | JsonStream_MatchBytes(block, '\n')) break;
+    p += 8;
+  }
+  while (p < end && *p != '\r' && *p != '\n') p++;
+  return p;
+}
+
+// returns the first '*' at or after 'p', or 'end' when there isn't one
+static char* JsonStream_FindStar(char* p, char* end)
+{
+  while (end - p >= 8)
+  {
+    if (JsonStream_MatchBytes(JsonStream_LoadBlock(p), '*')) break;
+    p += 8;
+  }
+  while (p < end && *p != '*') p++;
+  return p;
+}
+
+// returns the first '{', '}', '[', ']', '"' or '/' at or after 'p', or 'end' when there isn't one
+static char* JsonStream_FindStructural(char* p, char* end)
+{
+  while (end - p >= 8)
+  {
+    uint64_t block = JsonStream_LoadBlock(p);
+    if (JsonStream_MatchBytes(block, '{') | JsonStream_MatchBytes(block, '}') |
+        JsonStream_MatchBytes(block, '[') | JsonStream_MatchBytes(block, ']') |
+        JsonStream_MatchBytes(block, '"') | JsonStream_MatchBytes(block, '/')) break;
+    p += 8;
+  }
+  while (p < end && *p != '{' && *p != '}' && *p != '[' && *p != ']' && *p != '"' && *p != '/') p++;
+  return p;
+}
+
+// given 'p' at a '"' or '/' found by JsonStream_FindStructural(), returns 'p' advanced past the string or comment
+// (or just past the '/' when it doesn't start a comment)
+static char* JsonStream_SkipStringOrComment(char* p, char* end)
+{
+  if (*p == '"')
+  {
+    p++;
+    while (1)
+    {
+      p = JsonStream_FindQuoteOrBackslash(p, end);
+      if (p == end) return end;
+      if (*p == '"') return p + 1;
+      p += 2; // (backslash and whatever it escapes)
+      if (p >= end) return end;
+    }
+  }
+
+  p++;
+  if (p < end && *p == '/')
+  {
+    return JsonStream_FindLineEnd(p + 1, end);
+  }
+  if (p < end && *p == '*')
+  {
+    p++;
+    while (1)
+    {
+      p = JsonStream_FindStar(p, end);
+      if (p == end) return end;
+      p++;
+      if (p < end && *p == '/') return p + 1;
+    }
+  }
+  return p;
+}
+
+// a key's slot, given its hash and its bucket's displacement
+// (the high half of the hash picks where to start and the low half, made odd, the stride)
+static uint32_t JsonKeySet_Slot(JsonKeySetData* data, uint64_t hash, uint32_t displacement)
+{
+  return ((uint32_t)(hash >> 32) + displacement * ((uint32_t)hash | 1)) & data->slotMask;
+}
+
+JsonKeySet JsonKeySet_Create(const char* const* keys, int32_t keyCount)
+{
+  if (keys == 0 || keyCount <= 0 || keyCount > 0x10000)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid keys/keyCount args");
+    return 0;
+  }
+
+  // one allocation for the struct, key pointers, lengths, and the characters themselves
+  int64_t textLength = 0;
+  int32_t i;
+  for (i = 0; i < keyCount; i++)
+  {
+    if (keys[i] == 0)
+    {
+      DIAGNOSTIC_JSON_ERROR("invalid null key");
+      return 0;
+    }
+    textLength += strlen(keys[i]) + 1;
+  }
+  JsonKeySetData* data = malloc(sizeof(JsonKeySetData) + keyCount * (sizeof(char*) + sizeof(int32_t)) + textLength);
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("failed to allocate memory for JsonKeySetData");
+    return 0;
+  }
+  memset(data, 0, sizeof(JsonKeySetData));
+  data->keyCount = keyCount;
+  data->keys = (const char**)(data + 1);
+  data->keyLengths = (int32_t*)(data->keys + keyCount);
+  char* text = (char*)(data->keyLengths + keyCount);
+  for (i = 0; i < keyCount; i++)
+  {
+    int32_t length = (int32_t)strlen(keys[i]);
+    memcpy(text, keys[i], length + 1);
+    data->keys[i] = text;
+    data->keyLengths[i] = length;
+    text += length + 1;
+  }
+
+  uint32_t bucketCount = 1;
+  while (bucketCount * 2 < (uint32_t)keyCount) bucketCount *= 2;
+  uint32_t slotCount = 4;
+  while (slotCount < (uint32_t)keyCount * 2) slotCount *= 2;
+  data->bucketMask = bucketCount - 1;
+  data->slotMask = slotCount - 1;
+  data->displacements = malloc(bucketCount * sizeof(uint32_t));
+  data->slots = malloc(slotCount * sizeof(int32_t));
+  uint64_t* hashes = malloc(keyCount * sizeof(uint64_t));
+  int32_t* order = malloc(keyCount * sizeof(int32_t)); // key indexes grouped by bucket, biggest buckets first
+  int32_t* bucketSizes = malloc(bucketCount * sizeof(int32_t));
+  int32_t* bucketOrder = malloc(bucketCount * sizeof(int32_t));
+  if (data->displacements == 0 || data->slots == 0 || hashes == 0 || order == 0 || bucketSizes == 0 || bucketOrder == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("failed to allocate memory for JsonKeySet tables");
+    goto error;
+  }
+
+  uint64_t seed;
+  for (seed = 1; seed <= 16; seed++)
+  {
+    memset(data->slots, 0xFF, slotCount * sizeof(int32_t));
+    memset(bucketSizes, 0, bucketCount * sizeof(int32_t));
+    for (i = 0; i < keyCount; i++)
+    {
+      hashes[i] = Hash_Bytes(data->keys[i], data->keyLengths[i], seed);
+      bucketSizes[hashes[i] & data->bucketMask]++;
+    }
+
+    // place the crowded buckets first, while there's the most room (a simple selection by size; sets are small)
+    uint32_t b;
+    for (b = 0; b < bucketCount; b++) bucketOrder[b] = b;
+    for (b = 0; b < bucketCount; b++)
+    {
+      uint32_t biggest = b;
+      uint32_t c;
+      for (c = b + 1; c < bucketCount; c++)
+      {
+        if (bucketSizes[bucketOrder[c]] > bucketSizes[bucketOrder[biggest]]) biggest = c;
+      }
+      int32_t temp = bucketOrder[b]; bucketOrder[b] = bucketOrder[biggest]; bucketOrder[biggest] = temp;
+      if (bucketSizes[bucketOrder[b]] == 0) break;
+    }
+
+    int placedAll = 1;
+    for (b = 0; b < bucketCount && placedAll; b++)
+    {
+      uint32_t bucket = bucketOrder[b];
+      int32_t size = 0;
+      for (i = 0; i < keyCount; i++)
+      {
+        if ((hashes[i] & data->bucketMask) == bucket) order[size++] = i;
+      }
+      if (size == 0) break;
+
+      // try displacements until all of this bucket's keys land in distinct empty slots
+      uint32_t displacement;
+      for (displacement = 0; displacement < slotCount * 4; displacement++)
+      {
+        int32_t k;
+        for (k = 0; k < size; k++)
+        {
+          uint32_t slot = JsonKeySet_Slot(data, hashes[order[k]], displacement);
+          if (data->slots[slot] != -1) break;
+          data->slots[slot] = order[k];
+        }
+        if (k == size) break;
+
+        // undo the partial placement
+        while (--k >= 0) data->slots[JsonKeySet_Slot(data, hashes[order[k]], displacement)] = -1;
+      }
+      if (displacement == slotCount * 4)
+      {
+        placedAll = 0;
+      }
+      data->displacements[bucket] = displacement;
+    }
+
+    if (placedAll)
+    {
+      for (b = 0; b < bucketCount; b++)
+      {
+        if (bucketSizes[b] == 0) data->displacements[b] = 0;
+      }
+      data->seed = seed;
+      free(hashes);
+      free(order);
+      free(bucketSizes);
+      free(bucketOrder);
+      return data;
+    }
+  }
+
+  DIAGNOSTIC_JSON_ERROR("failed to find a perfect hash for JsonKeySet keys (duplicate keys?)");
+
+error:
+  free(hashes);
+  free(order);
+  free(bucketSizes);
+  free(bucketOrder);
+  free(data->displacements);
+  free(data->slots);
+  free(data);
+  return 0;
+}
+
+void JsonKeySet_Release(JsonKeySet keySet)
+{
+  JsonKeySetData* data = (JsonKeySetData*)keySet;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null keySet arg");
+    return;
+  }
+
+  free(data->displacements);
+  free(data->slots);
+  free(data);
+}
+
+static int32_t JsonKeySet_FindInternal(JsonKeySetData* data, const char* key, int32_t length)
+{
+  uint64_t hash = Hash_Bytes(key, length, data->seed);
+  int32_t i = data->slots[JsonKeySet_Slot(data, hash, data->displacements[hash & data->bucketMask])];
+  if (i >= 0 && data->keyLengths[i] == length && memcmp(data->keys[i], key, length) == 0)
+  {
+    return i;
+  }
+  return -1;
+}
+
+int32_t JsonKeySet_Find(JsonKeySet keySet, const char* key, int32_t length)
+{
+  JsonKeySetData* data = (JsonKeySetData*)keySet;
+  if (data == 0 || key == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null keySet/key arg");
+    return -1;
+  }
+  if (length < 0) length = (int32_t)strlen(key);
+  return JsonKeySet_FindInternal(data, key, length);
+}
+
 JsonStream JsonStream_Parse(const char* jsonData, const char* debugIdentifier)
 {
   JsonStreamData* data;
@@ -44,11 +402,9 @@ JsonStream JsonStream_Parse(const char* jsonData, const char* debugIdentifier)
     return 0;
   }
   
-  for (int i = 0; i <= fileLength; i++)
-  {
-    data->start[i] = jsonData[i];
-  }
+  memcpy(data->start, jsonData, fileLength + 1);
 
+  data->ownsSource = 1;
   data->tokenType = JsonStreamStart;
   data->end = data->start + fileLength;
   data->current = data->start;
@@ -72,8 +428,14 @@ JsonStream JsonStream_Parse(const char* jsonData, const char* debugIdentifier)
   return data;
 }
 
-JsonStream JsonStream_LoadFromResourceFile(const wchar_t * fileName)
+JsonStream JsonStream_ParseRange(const char* begin, const char* end, const char* debugIdentifier)
 {
+  if (begin == 0 || end < begin)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid begin/end args");
+    return 0;
+  }
+
   JsonStreamData* data;
   data = malloc(sizeof(JsonStreamData));
   if (data == 0)
@@ -83,33 +445,152 @@ JsonStream JsonStream_LoadFromResourceFile(const wchar_t * fileName)
   }
   memset(data, 0, sizeof(JsonStreamData));
 
-  int fileLength = 0;
-  data->start = (char*)ResourceFile_Load(fileName, &fileLength);
-  if (data->start == 0)
+  // NOTE: the source is borrowed, so it's never written to (despite the non-const pointers) and never freed
+  data->ownsSource = 0;
+  data->tokenType = JsonStreamStart;
+  data->start = (char*)begin;
+  data->end = (char*)end;
+  data->current = data->start;
+  
+  // allocate 'identifierForDebugMessages' and copy filename into it
+  if (debugIdentifier == 0) debugIdentifier = "unknown";
+  int fileNameLength = strlen(debugIdentifier);
+  data->identifierForDebugMessages = malloc(fileNameLength + 1);
+  if (data->identifierForDebugMessages == 0)
   {
+    DIAGNOSTIC_JSON_ERROR("failed to allocate memory for JsonStreamData debugIdentifier");
     free(data);
     return 0;
   }
+  memcpy(data->identifierForDebugMessages, debugIdentifier, fileNameLength + 1);
+
+  return data;
+}
 
+JsonStream JsonStream_CreateIncremental(const char* debugIdentifier)
+{
+  JsonStreamData* data;
+  data = malloc(sizeof(JsonStreamData));
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("failed to allocate memory for JsonStreamData");
+    return 0;
+  }
+  memset(data, 0, sizeof(JsonStreamData));
+
+  // NOTE: fed chunks are borrowed just like JsonStream_ParseRange() sources; the parse window starts out empty
+  data->ownsSource = 0;
+  data->isIncremental = 1;
   data->tokenType = JsonStreamStart;
-  data->end = data->start + fileLength;
-  data->current = data->start;
   
   // allocate 'identifierForDebugMessages' and copy filename into it
-  int fileNameLength = wcslen(fileName);
+  if (debugIdentifier == 0) debugIdentifier = "unknown";
+  int fileNameLength = strlen(debugIdentifier);
   data->identifierForDebugMessages = malloc(fileNameLength + 1);
   if (data->identifierForDebugMessages == 0)
   {
-    DIAGNOSTIC_JSON_ERROR("failed to allocate memory for JsonStreamData filename");
-    free(data->start);
+    DIAGNOSTIC_JSON_ERROR("failed to allocate memory for JsonStreamData debugIdentifier");
     free(data);
     return 0;
   }
-  for (int i = 0; i <= fileNameLength; i++)
+  memcpy(data->identifierForDebugMessages, debugIdentifier, fileNameLength + 1);
+
+  return data;
+}
+
+int JsonStream_Feed(JsonStream stream, const char* bytes, int32_t length)
+{
+  JsonStreamData* data = (JsonStreamData*)stream;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null stream arg");
+    return 0;
+  }
+  if (!data->isIncremental)
+  {
+    DIAGNOSTIC_JSON_ERROR2("cannot feed a stream that wasn't created incremental: ", data->identifierForDebugMessages);
+    return 0;
+  }
+  if (data->isInputComplete)
+  {
+    DIAGNOSTIC_JSON_ERROR2("cannot feed a stream after JsonStream_FeedEnd(): ", data->identifierForDebugMessages);
+    return 0;
+  }
+  if ((data->tokenType != JsonStreamStart && data->tokenType != JsonStreamNeedMoreData) || data->chunkCurrent < data->chunkEnd)
+  {
+    DIAGNOSTIC_JSON_ERROR2("cannot feed until the stream needs more data: ", data->identifierForDebugMessages);
+    return 0;
+  }
+  if (bytes == 0 || length < 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid bytes/length args");
+    return 0;
+  }
+
+  if (data->current == data->end)
   {
-    data->identifierForDebugMessages[i] = (char)fileName[i];
+    // nothing carried over; parse the chunk directly
+    data->carryLength = 0;
+    data->start = (char*)bytes;
+    data->current = data->start;
+    data->end = data->start + length;
+    data->chunkCurrent = data->end;
+    data->chunkEnd = data->end;
   }
+  else
+  {
+    // MoveNext() pulls from the chunk into 'carry' until the unfinished token is complete
+    data->chunkCurrent = bytes;
+    data->chunkEnd = bytes + length;
+  }
+  return 1;
+}
 
+int JsonStream_FeedEnd(JsonStream stream)
+{
+  JsonStreamData* data = (JsonStreamData*)stream;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null stream arg");
+    return 0;
+  }
+  if (!data->isIncremental)
+  {
+    DIAGNOSTIC_JSON_ERROR2("cannot end a stream that wasn't created incremental: ", data->identifierForDebugMessages);
+    return 0;
+  }
+
+  data->isInputComplete = 1;
+  return 1;
+}
+
+JsonStream JsonStream_LoadFromResourceFile(const wchar_t * fileName)
+{
+  if (fileName == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null fileName arg");
+    return 0;
+  }
+
+  // parse straight out of the mapped file rather than a heap copy of it
+  int fileLength = 0;
+  const char* view = ResourceFile_Map(fileName, &fileLength);
+  if (view == 0)
+  {
+    // diagnostic error already reported by ResourceFile_Map()
+    return 0;
+  }
+
+  char* debugIdentifier = StringUtils_MakeNarrowString(fileName);
+  JsonStreamData* data = (JsonStreamData*)JsonStream_ParseRange(view, view + fileLength, debugIdentifier);
+  free(debugIdentifier);
+  if (data == 0)
+  {
+    ResourceFile_Unmap(view);
+    return 0;
+  }
+
+  data->mappedView = view;
   return data;
 }
 
@@ -124,58 +605,275 @@ const char* JsonStream_GetDebugIdentifier(JsonStream stream)
   return data->identifierForDebugMessages;
 }
 
-static void ConsumeCommentsCommasAndWhitespace(JsonStreamData* data)
+// in incremental mode, running out of data only means the end of the JSON once the caller has fed everything
+static int JsonStream_MoreDataMayCome(JsonStreamData* data)
+{
+  return data->isIncremental && (!data->isInputComplete || data->chunkCurrent < data->chunkEnd);
+}
+
+// returns 0 (with data->current left on the comment) only in incremental mode, when a comment runs past the available data
+static int ConsumeCommentsCommasAndWhitespace(JsonStreamData* data)
 {
   while (data->current < data->end)
   {
     char c = *(data->current);
     
     // advance past whitespace
-    if (c == ' ' || c == '\r' || c == '\n' || c == '\t')
+    // (NOTE: I'm deciding I don't care if accepting commas anywhere means I accept a technically invalid JSON file. This is simple.)
+    if (c == ' ' || c == '\r' || c == '\n' || c == '\t' || c == ',')
     {
-      data->current++;
+      // indentation makes long runs of these, so take them a block at a time when possible
+      data->current = JsonStream_SkipFillerBlocks(data->current + 1, data->end);
       continue;
     }
     
     // advance past single-line comments
-    // (NOTE: data is null terminated beyond 'end' so accessing next character without guard is ok)
-    if (c == '/' && *(data->current + 1) == '/')
+    // (NOTE: borrowed data isn't null terminated beyond 'end', so the next character needs a guard)
+    char next = data->current + 1 < data->end ? *(data->current + 1) : 0;
+    if (c == '/' && data->current + 1 == data->end && JsonStream_MoreDataMayCome(data))
+    {
+      return 0; // can't tell yet whether this starts a comment
+    }
+
+    if (c == '/' && next == '/')
     {
-      while (data->current < data->end && c != '\r' && c != '\n')
+      char* lineEnd = JsonStream_FindLineEnd(data->current + 2, data->end);
+      if (lineEnd == data->end && JsonStream_MoreDataMayCome(data))
       {
-        data->current++;
-        c = *(data->current);
+        return 0;
       }
+      data->current = lineEnd;
       continue;
     }
     
     // advance past multi-line comments
-    if (c == '/' && *(data->current + 1) == '*')
+    if (c == '/' && next == '*')
+    {
+      char* star = data->current + 2;
+      while ((star = JsonStream_FindStar(star, data->end)) < data->end && !(star + 1 < data->end && *(star + 1) == '/'))
+      {
+        star++;
+      }
+      
+      if (star == data->end && JsonStream_MoreDataMayCome(data))
+      {
+        return 0;
+      }
+
+      // (an unterminated comment just runs to the end of the data)
+      data->current = star < data->end ? star + 2 : data->end;
+      continue;
+    }
+    
+    break;
+  }
+  return 1;
+}
+
+// in incremental mode, rewinds to the start of a token that ran past the available data and reports "need more data"
+// (returns 0 when the stream isn't waiting on more data, in which case the caller reports its usual error)
+static int JsonStream_WaitForMoreData(JsonStreamData* data, char* tokenStart)
+{
+  if (!JsonStream_MoreDataMayCome(data))
+  {
+    return 0;
+  }
+  data->current = tokenStart;
+  data->tokenType = JsonStreamNeedMoreData;
+  return 1;
+}
+
+// makes room for 'length' more characters (plus null terminator) in data->stringBuffer
+static int JsonStream_ReserveStringBuffer(JsonStreamData* data, int32_t length)
+{
+  int64_t needed = (int64_t)data->stringBufferLength + length;
+  if (needed > data->stringBufferCapacity || data->stringBuffer == 0)
+  {
+    int64_t capacity = (data->stringBufferCapacity + 1) * 2;
+    if (capacity < needed) capacity = needed;
+    if (capacity > 0x7FFFFFFE)
+    {
+      DIAGNOSTIC_JSON_ERROR2("string too large while parsing ", data->identifierForDebugMessages);
+      return 0;
+    }
+
+    char * newContent = realloc(data->stringBuffer, capacity + 1); // plus 1 for null terminator
+    if (newContent == 0)
+    {
+      DIAGNOSTIC_JSON_ERROR2("failed to allocate more memory for string while parsing ", data->identifierForDebugMessages);
+      return 0;
+    }
+    data->stringBuffer = newContent;
+    data->stringBufferCapacity = (int32_t)capacity;
+  }
+  return 1;
+}
+
+// returns nonzero if all 8 bytes of 'block' are ASCII digits
+static int JsonStream_IsEightDigits(uint64_t block)
+{
+  return (((block & 0xF0F0F0F0F0F0F0F0ULL) | (((block + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL);
+}
+
+// converts 8 ASCII digits (first digit in the lowest byte, i.e. loaded little-endian like every target we build for) to their value
+// (three multiplies instead of eight multiply-adds)
+static uint32_t JsonStream_ParseEightDigits(uint64_t block)
+{
+  uint64_t val = block - 0x3030303030303030ULL;
+  val = (val * 10) + (val >> 8); // pairs of digits
+  val = (((val & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+         (((val >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+  return (uint32_t)val;
+}
+
+// powers of ten that doubles represent exactly
+static const double JsonStream_ExactPowersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// parses the JSON number at 'p' into data->numBuffer and data->numDouble without copying it anywhere.
+// returns the end of the number, or 0 if it's malformed
+static char* JsonStream_ParseNumber(JsonStreamData* data, char* p)
+{
+  char* begin = p;
+  char* end = data->end;
+  int negative = 0;
+  uint64_t mantissa = 0;
+  int digitCount = 0; // significant digits accumulated into 'mantissa' (at most 19, which can't overflow it)
+  int droppedDigits = 0; // significant digits past those 19
+  int64_t exponent = 0; // power of ten to apply to 'mantissa'
+  int isIntegral = 1;
+
+  if (p < end && *p == '-')
+  {
+    negative = 1;
+    p++;
+  }
+  if (p == end || (unsigned)(*p - '0') > 9)
+  {
+    return (p == end && JsonStream_MoreDataMayCome(data)) ? end : 0; // (the digits might just not have arrived yet)
+  }
+
+  // integer part
+  if (*p == '0' && p + 1 < end && (unsigned)(p[1] - '0') <= 9) return 0; // (JSON doesn't allow leading zeros)
+  while (digitCount <= 11 && end - p >= 8 && JsonStream_IsEightDigits(JsonStream_LoadBlock(p)))
+  {
+    mantissa = mantissa * 100000000 + JsonStream_ParseEightDigits(JsonStream_LoadBlock(p));
+    digitCount += 8; // (the first digit is nonzero, since a leading zero can't be followed by more digits)
+    p += 8;
+  }
+  while (p < end && (unsigned)(*p - '0') <= 9)
+  {
+    if (digitCount < 19)
+    {
+      mantissa = mantissa * 10 + (*p - '0');
+      digitCount += (mantissa != 0);
+    }
+    else
+    {
+      droppedDigits++;
+    }
+    p++;
+  }
+  exponent = droppedDigits; // (the integer digits that didn't fit still scale the value)
+
+  // fraction
+  if (p < end && *p == '.')
+  {
+    isIntegral = 0;
+    p++;
+    char* fractionStart = p;
+    while (p < end && (unsigned)(*p - '0') <= 9)
+    {
+      if (digitCount < 19)
+      {
+        mantissa = mantissa * 10 + (*p - '0');
+        digitCount += (mantissa != 0);
+        exponent--;
+      }
+      else
+      {
+        droppedDigits++;
+      }
+      p++;
+    }
+    if (p == fractionStart)
+    {
+      return (p == end && JsonStream_MoreDataMayCome(data)) ? end : 0;
+    }
+  }
+
+  // exponent
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    isIntegral = 0;
+    p++;
+    int exponentNegative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+      exponentNegative = (*p == '-');
+      p++;
+    }
+    char* exponentStart = p;
+    int64_t explicitExponent = 0;
+    while (p < end && (unsigned)(*p - '0') <= 9)
+    {
+      if (explicitExponent < 100000) explicitExponent = explicitExponent * 10 + (*p - '0'); // (saturates well past any double's range)
+      p++;
+    }
+    if (p == exponentStart)
+    {
+      return (p == end && JsonStream_MoreDataMayCome(data)) ? end : 0;
+    }
+    exponent += exponentNegative ? -explicitExponent : explicitExponent;
+  }
+
+  // integers that fit in an int64 are exact
+  if (isIntegral && droppedDigits == 0 && mantissa <= (uint64_t)INT64_MAX + negative)
+  {
+    data->numBuffer = negative ? (int64_t)(0 - mantissa) : (int64_t)mantissa;
+    data->numDouble = negative ? -(double)mantissa : (double)mantissa;
+    return p;
+  }
+
+  // Clinger's fast path: when both the mantissa and the power of ten are exact doubles, one IEEE multiply or divide
+  // rounds correctly. That covers the everyday "12.5" / "0.075" / "3e5" numbers that game data is full of.
+  double value;
+  if (mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22 && droppedDigits == 0)
+  {
+    value = (double)mantissa;
+    if (exponent < 0) value /= JsonStream_ExactPowersOfTen[-exponent];
+    else value *= JsonStream_ExactPowersOfTen[exponent];
+    if (negative) value = -value;
+  }
+  else
+  {
+    // everything else (long mantissas, extreme exponents) goes to the C library for correct rounding
+    char buffer[64];
+    char* text = buffer;
+    int64_t length = p - begin;
+    if (length >= (int64_t)sizeof(buffer))
     {
-      while (data->current < data->end && !(c == '*' && *(data->current + 1) == '/'))
-      {
-        data->current++;
-        c = *(data->current);
-      }
-      
-      if (data->current < data->end && c == '*' && *(data->current + 1) == '/')
+      data->stringBufferLength = 0;
+      if (length > 0x7FFFFFF0 || !JsonStream_ReserveStringBuffer(data, (int32_t)length))
       {
-        data->current += 2;
+        return 0;
       }
-      
-      continue;
-    }
-    
-    // advance past commas
-    // (NOTE: I'm deciding I don't care if this means I accept a technically invalid JSON file. This is simple.)
-    if (c == ',')
-    {
-      data->current++;
-      continue;
+      text = data->stringBuffer;
     }
-    
-    break;
+    memcpy(text, begin, length);
+    text[length] = 0;
+    value = strtod(text, 0);
   }
+  data->numDouble = value;
+
+  // (non-integral or out of range numbers still give GetNumberInt() something sensible: truncated, and clamped to int64)
+  if (value >= 9223372036854775807.0) data->numBuffer = INT64_MAX;
+  else if (value <= -9223372036854775808.0) data->numBuffer = INT64_MIN;
+  else if (value != value) data->numBuffer = 0;
+  else data->numBuffer = (int64_t)value;
+  return p;
 }
 
 static void ConsumeNextJsonToken(JsonStreamData* data)
@@ -185,7 +883,12 @@ static void ConsumeNextJsonToken(JsonStreamData* data)
     return;
   }
   
-  ConsumeCommentsCommasAndWhitespace(data);
+  if (!ConsumeCommentsCommasAndWhitespace(data))
+  {
+    JsonStream_WaitForMoreData(data, data->current);
+    return;
+  }
+  char* tokenStart = data->current;
   
   while (data->current < data->end)
   {
@@ -215,11 +918,15 @@ static void ConsumeNextJsonToken(JsonStreamData* data)
       {
         // check that it says "true"
         char * c = data->current;
-        if (c[0] == 't' && c[1] == 'r' && c[2] == 'u' && c[3] == 'e')
+        if (data->end - c >= 4 && c[0] == 't' && c[1] == 'r' && c[2] == 'u' && c[3] == 'e')
         {
           data->tokenType = JsonStreamTrue;
           data->current += 4; // move past literal
         }
+        else if (data->end - c < 4 && memcmp(c, "true", data->end - c) == 0 && JsonStream_WaitForMoreData(data, tokenStart))
+        {
+          // the rest of the literal is in the next chunk
+        }
         else
         {
           DIAGNOSTIC_JSON_ERROR2("invalid JSON content in ", data->identifierForDebugMessages);
@@ -232,11 +939,15 @@ static void ConsumeNextJsonToken(JsonStreamData* data)
       {
         // check that it says "false"
         char * c = data->current;
-        if (c[0] == 'f' && c[1] == 'a' && c[2] == 'l' && c[3] == 's' && c[4] == 'e')
+        if (data->end - c >= 5 && c[0] == 'f' && c[1] == 'a' && c[2] == 'l' && c[3] == 's' && c[4] == 'e')
         {
           data->tokenType = JsonStreamFalse;
           data->current += 5; // move past literal
         }
+        else if (data->end - c < 5 && memcmp(c, "false", data->end - c) == 0 && JsonStream_WaitForMoreData(data, tokenStart))
+        {
+          // the rest of the literal is in the next chunk
+        }
         else
         {
           DIAGNOSTIC_JSON_ERROR2("invalid JSON content in ", data->identifierForDebugMessages);
@@ -249,11 +960,15 @@ static void ConsumeNextJsonToken(JsonStreamData* data)
       {
         // check that it says "null"
         char * c = data->current;
-        if (c[0] == 'n' && c[1] == 'u' && c[2] == 'l' && c[3] == 'l')
+        if (data->end - c >= 4 && c[0] == 'n' && c[1] == 'u' && c[2] == 'l' && c[3] == 'l')
         {
           data->tokenType = JsonStreamNull;
           data->current += 4; // move past literal
         }
+        else if (data->end - c < 4 && memcmp(c, "null", data->end - c) == 0 && JsonStream_WaitForMoreData(data, tokenStart))
+        {
+          // the rest of the literal is in the next chunk
+        }
         else
         {
           DIAGNOSTIC_JSON_ERROR2("invalid JSON content in ", data->identifierForDebugMessages);
@@ -267,41 +982,64 @@ static void ConsumeNextJsonToken(JsonStreamData* data)
         // move past quote
         data->current++;
 
-        data->stringBufferLength = 0;
-        int capacity = 0;
-
-        // consume the string content
         int foundEndQuote = 0;
-        while (data->current < data->end)
+        char* runEnd = JsonStream_FindQuoteOrBackslash(data->current, data->end);
+        if (runEnd == data->end && JsonStream_WaitForMoreData(data, tokenStart))
+        {
+          return;
+        }
+        else if (runEnd < data->end && *runEnd == '"')
+        {
+          // the common case: no escapes, so hand out the characters right where they sit in the source
+          // (when the source is our own copy, the closing quote can become the null terminator)
+          if (data->ownsSource)
+          {
+            *runEnd = 0;
+          }
+          data->string = data->current;
+          data->stringLength = (int32_t)(runEnd - data->current);
+          data->stringIsTerminated = data->ownsSource;
+          data->current = runEnd + 1;
+          foundEndQuote = 1;
+        }
+        else
         {
-          // increase buffer when full
-          if (data->stringBufferLength == capacity)
+          // otherwise decode the string content into stringBuffer, copying each run of plain characters between escapes in one go
+          data->stringBufferLength = 0;
+          while (data->current < data->end)
           {
-            capacity = (capacity + 1) * 2;
-            char * newContent = realloc(data->stringBuffer, capacity + 1); // plus 1 for null terminator
-            if (newContent == 0)
+            int32_t runLength = (int32_t)(runEnd - data->current);
+
+            // (reserve 1 extra for the character an escape sequence might produce)
+            if (!JsonStream_ReserveStringBuffer(data, runLength + 1))
             {
-              DIAGNOSTIC_JSON_ERROR2("failed to allocate more memory for string while parsing ", data->identifierForDebugMessages);
               data->tokenType = JsonStreamError;
               return;
             }
-            data->stringBuffer = newContent;
-            memset(data->stringBuffer + data->stringBufferLength, 0, capacity - data->stringBufferLength + 1); // plus 1 for null terminator
-          }
+            memcpy(data->stringBuffer + data->stringBufferLength, data->current, runLength);
+            data->stringBufferLength += runLength;
+            data->current = runEnd;
+
+            if (data->current == data->end)
+            {
+              break;
+            }
 
-          // consume current character (whatever it is)
-          char c = *(data->current);
-          data->current++;
+            // consume the quote or slash
+            char c = *(data->current);
+            data->current++;
           
-          if (c == '"')
-          {
-            foundEndQuote = 1;
-            break;
-          }
+            if (c == '"')
+            {
+              foundEndQuote = 1;
+              break;
+            }
 
-          if (c == '\\')
-          {
             // consume character after slash (whatever it is)
+            if (data->current == data->end)
+            {
+              break;
+            }
             c = *(data->current);
             data->current++;
 
@@ -337,31 +1075,50 @@ static void ConsumeNextJsonToken(JsonStreamData* data)
                 DIAGNOSTIC_JSON_ERROR2("unicode escapes like \u4403 aren't supported by this json parser yet, while parsing ", data->identifierForDebugMessages);
                 data->tokenType = JsonStreamError;
                 return;
-              
+            
               default:
                 DIAGNOSTIC_JSON_ERROR2("invalid slash-escaped string data in ", data->identifierForDebugMessages);
                 data->tokenType = JsonStreamError;
                 return;
             }
-          }
           
-          data->stringBuffer[data->stringBufferLength] = c;
-          data->stringBufferLength++;
+            data->stringBuffer[data->stringBufferLength] = c;
+            data->stringBufferLength++;
+
+            runEnd = JsonStream_FindQuoteOrBackslash(data->current, data->end);
+          }
+
+          if (foundEndQuote)
+          {
+            data->stringBuffer[data->stringBufferLength] = 0;
+            data->string = data->stringBuffer;
+            data->stringLength = data->stringBufferLength;
+            data->stringIsTerminated = 1;
+          }
         }
 
         if (foundEndQuote)
         {
-          ConsumeCommentsCommasAndWhitespace(data);
-          if (*data->current == ':')
+          // (whether it's a property name depends on the next token, so that has to be available too)
+          if ((!ConsumeCommentsCommasAndWhitespace(data) || data->current == data->end) && JsonStream_WaitForMoreData(data, tokenStart))
+          {
+            return;
+          }
+          else if (data->current < data->end && *data->current == ':')
           {
             data->current++;
             data->tokenType = JsonStreamPropertyName;
+            data->keyId = data->keySet ? JsonKeySet_FindInternal(data->keySet, data->string, data->stringLength) : -1;
           }
           else
           {
             data->tokenType = JsonStreamString;
           }
         }
+        else if (JsonStream_WaitForMoreData(data, tokenStart))
+        {
+          // the rest of the string is in the next chunk
+        }
         else
         {
           // got to end of string literal without encountering quote
@@ -383,34 +1140,23 @@ static void ConsumeNextJsonToken(JsonStreamData* data)
       case '8':
       case '9':
       {
-        // look ahead to see how many number characters are present
-        // (NOTE: for now, decimals and exponents are not supported)
-        char * end = data->current;
-        while (*end == '-' || (*end >= '0' && *end <= '9')) end++;
-        if (*end == '.' || *end == 'e' || *end == 'E')
+        char* end = JsonStream_ParseNumber(data, data->current);
+        if (end == data->end && JsonStream_WaitForMoreData(data, tokenStart))
         {
-          DIAGNOSTIC_JSON_ERROR2("decimals and exponents are not yet supported by this json parser, while parsing ", data->identifierForDebugMessages);
-          data->tokenType = JsonStreamError;
+          // the number might continue in the next chunk
           return;
         }
-        
-        // capture the number into the string buffer
-        // (re)allocate a buffer to hold the parsed string content
-        int size = end - data->current;
-        char * newContent = realloc(data->stringBuffer, size + 1); // plus 1 for null terminator
-        if (newContent == 0)
+        if (end == 0)
         {
-          DIAGNOSTIC_JSON_ERROR2("failed to allocate memory for number string while parsing ", data->identifierForDebugMessages);
+          DIAGNOSTIC_JSON_ERROR2("invalid number while parsing ", data->identifierForDebugMessages);
           data->tokenType = JsonStreamError;
           return;
         }
-        data->stringBuffer = newContent;
-        data->stringBufferLength = size;
-        strncpy(data->stringBuffer, data->current, size);
-        data->stringBuffer[size] = 0;
 
-        // use strtol to try to interpret the number as an integer
-        data->numBuffer = strtol(data->current, 0, 0);
+        // the number's text is handed out as a slice of the source (JsonStream_GetString() copies it on demand)
+        data->string = data->current;
+        data->stringLength = (int32_t)(end - data->current);
+        data->stringIsTerminated = 0;
         data->tokenType = JsonStreamNumber;
         data->current = end;
         return;
@@ -427,9 +1173,115 @@ static void ConsumeNextJsonToken(JsonStreamData* data)
     }
   }
   
+  if (JsonStream_WaitForMoreData(data, data->current))
+  {
+    return;
+  }
   data->tokenType = JsonStreamEnd;
 }
 
+// appends [begin, end) to data->carry, rebasing the parse window (which must already be in 'carry') to match
+static int JsonStream_AppendToCarry(JsonStreamData* data, const char* begin, const char* end)
+{
+  int64_t needed = (int64_t)data->carryLength + (end - begin);
+  if (needed > data->carryCapacity)
+  {
+    int64_t capacity = (data->carryCapacity + 1) * 2;
+    if (capacity < needed) capacity = needed;
+    if (capacity > 0x7FFFFFFE)
+    {
+      DIAGNOSTIC_JSON_ERROR2("token too large while parsing ", data->identifierForDebugMessages);
+      return 0;
+    }
+
+    char* newCarry = realloc(data->carry, capacity);
+    if (newCarry == 0)
+    {
+      DIAGNOSTIC_JSON_ERROR2("failed to allocate more memory for partial token while parsing ", data->identifierForDebugMessages);
+      return 0;
+    }
+    data->carry = newCarry;
+    data->carryCapacity = (int32_t)capacity;
+  }
+
+  if (end > begin) memcpy(data->carry + data->carryLength, begin, end - begin);
+  data->carryLength += (int32_t)(end - begin);
+  data->start = data->carry;
+  data->current = data->carry;
+  data->end = data->carry + data->carryLength;
+  return 1;
+}
+
+static void ConsumeNextJsonTokenIncrementally(JsonStreamData* data)
+{
+  while (1)
+  {
+    ConsumeNextJsonToken(data);
+
+    if (data->tokenType != JsonStreamNeedMoreData)
+    {
+      // once the carried-over token is done, go back to parsing the caller's chunk directly
+      if (data->start == data->carry && data->current == data->end && data->chunkCurrent < data->chunkEnd)
+      {
+        data->carryLength = 0;
+        data->start = (char*)data->chunkCurrent;
+        data->current = data->start;
+        data->end = (char*)data->chunkEnd;
+        data->chunkCurrent = data->chunkEnd;
+      }
+      return;
+    }
+
+    // keep the unfinished token (and only that) in 'carry'
+    int32_t partialLength = (int32_t)(data->end - data->current);
+    if (partialLength == 0 && data->chunkCurrent < data->chunkEnd)
+    {
+      // stopped cleanly between tokens; just move on to the caller's chunk
+      data->carryLength = 0;
+      data->start = (char*)data->chunkCurrent;
+      data->current = data->start;
+      data->end = (char*)data->chunkEnd;
+      data->chunkCurrent = data->chunkEnd;
+      data->tokenType = JsonStreamStart;
+      continue;
+    }
+    else if (data->start == data->carry)
+    {
+      if (partialLength > 0) memmove(data->carry, data->current, partialLength);
+      data->carryLength = partialLength;
+      data->current = data->carry;
+      data->end = data->carry + partialLength;
+    }
+    else
+    {
+      data->carryLength = 0;
+      if (!JsonStream_AppendToCarry(data, data->current, data->end))
+      {
+        data->tokenType = JsonStreamError;
+        return;
+      }
+    }
+
+    // nothing more to go on until the caller feeds another chunk
+    if (data->chunkCurrent == data->chunkEnd)
+    {
+      return;
+    }
+
+    // pull a little more of the chunk into 'carry' and try the token again
+    // (taking at least as much as is already carried keeps the retries from going quadratic on long tokens)
+    int64_t take = data->chunkEnd - data->chunkCurrent;
+    if (take > data->carryLength + 64) take = data->carryLength + 64;
+    if (!JsonStream_AppendToCarry(data, data->chunkCurrent, data->chunkCurrent + take))
+    {
+      data->tokenType = JsonStreamError;
+      return;
+    }
+    data->chunkCurrent += take;
+    data->tokenType = JsonStreamStart; // (anything that lets ConsumeNextJsonToken proceed)
+  }
+}
+
 JsonStreamTokenType JsonStream_MoveNext(JsonStream stream)
 {
   JsonStreamData* data = (JsonStreamData*)stream;
@@ -450,7 +1302,14 @@ JsonStreamTokenType JsonStream_MoveNext(JsonStream stream)
       return 0;
 
     default:
-      ConsumeNextJsonToken(data);
+      if (data->isIncremental)
+      {
+        ConsumeNextJsonTokenIncrementally(data);
+      }
+      else
+      {
+        ConsumeNextJsonToken(data);
+      }
       return data->tokenType;
   }
 }
@@ -482,8 +1341,47 @@ const char* JsonStream_GetString(JsonStream stream, int32_t* length)
     case JsonStreamPropertyName:
     case JsonStreamString:
     case JsonStreamNumber:
-      if (length) *length = data->stringBufferLength;
-      return data->stringBuffer;
+      if (!data->stringIsTerminated)
+      {
+        // a slice of borrowed source; copy it out so it can be null terminated
+        data->stringBufferLength = 0;
+        if (!JsonStream_ReserveStringBuffer(data, data->stringLength))
+        {
+          if (length) *length = 0;
+          return 0;
+        }
+        memcpy(data->stringBuffer, data->string, data->stringLength);
+        data->stringBuffer[data->stringLength] = 0;
+        data->stringBufferLength = data->stringLength;
+        data->string = data->stringBuffer;
+        data->stringIsTerminated = 1;
+      }
+      if (length) *length = data->stringLength;
+      return data->string;
+
+    default:
+      if (length) *length = 0;
+      return 0;
+  }
+}
+
+const char* JsonStream_GetStringSlice(JsonStream stream, int32_t* length)
+{
+  JsonStreamData* data = (JsonStreamData*)stream;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null stream arg");
+    if (length) *length = 0;
+    return 0;
+  }
+  
+  switch (data->tokenType)
+  {
+    case JsonStreamPropertyName:
+    case JsonStreamString:
+    case JsonStreamNumber:
+      if (length) *length = data->stringLength;
+      return data->string;
 
     default:
       if (length) *length = 0;
@@ -510,6 +1408,233 @@ int64_t JsonStream_GetNumberInt(JsonStream stream)
   }
 }
 
+// returns the index of the pair whose open offset is 'offset', or -1
+static int32_t JsonStream_FindStructuralIndexPair(JsonStreamData* data, int32_t offset)
+{
+  int32_t low = 0;
+  int32_t high = data->structuralIndexCount - 1;
+  while (low <= high)
+  {
+    int32_t middle = low + (high - low) / 2;
+    int32_t open = data->structuralIndex[middle * 2];
+    if (open == offset) return middle;
+    if (open < offset) low = middle + 1;
+    else high = middle - 1;
+  }
+  return -1;
+}
+
+int JsonStream_BuildStructuralIndex(JsonStream stream)
+{
+  JsonStreamData* data = (JsonStreamData*)stream;
+  int32_t* openStack = 0;
+  int32_t openStackCount = 0;
+  int32_t openStackCapacity = 0;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null stream arg");
+    return 0;
+  }
+  if (data->isIncremental)
+  {
+    DIAGNOSTIC_JSON_ERROR2("cannot index an incremental stream: ", data->identifierForDebugMessages);
+    return 0;
+  }
+  if (data->end - data->start > 0x7FFFFFFE)
+  {
+    DIAGNOSTIC_JSON_ERROR2("json data too large to index: ", data->identifierForDebugMessages);
+    return 0;
+  }
+
+  free(data->structuralIndex);
+  data->structuralIndex = 0;
+  data->structuralIndexCount = 0;
+  int32_t capacity = 0;
+
+  // one pass over the part that hasn't been parsed yet
+  // (the part behind 'current' may have had its string quotes overwritten with null terminators)
+  char* p = data->current;
+  while (1)
+  {
+    p = JsonStream_FindStructural(p, data->end);
+    if (p == data->end) break;
+
+    char c = *p;
+    if (c == '"' || c == '/')
+    {
+      p = JsonStream_SkipStringOrComment(p, data->end);
+      continue;
+    }
+
+    int32_t offset = (int32_t)(p - data->start);
+    if (c == '{' || c == '[')
+    {
+      if (data->structuralIndexCount == capacity)
+      {
+        capacity = capacity ? capacity * 2 : 64;
+        int32_t* newIndex = realloc(data->structuralIndex, capacity * 2 * sizeof(int32_t));
+        if (newIndex == 0)
+        {
+          DIAGNOSTIC_JSON_ERROR2("failed to allocate memory for structural index of ", data->identifierForDebugMessages);
+          goto error;
+        }
+        data->structuralIndex = newIndex;
+      }
+      if (openStackCount == openStackCapacity)
+      {
+        openStackCapacity = openStackCapacity ? openStackCapacity * 2 : 16;
+        int32_t* newStack = realloc(openStack, openStackCapacity * sizeof(int32_t));
+        if (newStack == 0)
+        {
+          DIAGNOSTIC_JSON_ERROR2("failed to allocate memory for structural index of ", data->identifierForDebugMessages);
+          goto error;
+        }
+        openStack = newStack;
+      }
+      data->structuralIndex[data->structuralIndexCount * 2] = offset;
+      data->structuralIndex[data->structuralIndexCount * 2 + 1] = -1;
+      openStack[openStackCount++] = data->structuralIndexCount++;
+    }
+    else if (openStackCount > 0) // (a stray close just doesn't get indexed; MoveNext() will complain about it later)
+    {
+      data->structuralIndex[openStack[--openStackCount] * 2 + 1] = offset;
+    }
+    p++;
+  }
+
+  free(openStack);
+  return 1;
+
+error:
+  free(openStack);
+  free(data->structuralIndex);
+  data->structuralIndex = 0;
+  data->structuralIndexCount = 0;
+  return 0;
+}
+
+JsonStreamTokenType JsonStream_SkipValue(JsonStream stream)
+{
+  JsonStreamData* data = (JsonStreamData*)stream;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null stream arg");
+    return JsonStreamError;
+  }
+  if (data->isIncremental)
+  {
+    DIAGNOSTIC_JSON_ERROR2("cannot skip values in an incremental stream: ", data->identifierForDebugMessages);
+    return JsonStreamError;
+  }
+
+  // a property name's value hasn't been read yet
+  if (data->tokenType == JsonStreamPropertyName)
+  {
+    JsonStream_MoveNext(stream);
+  }
+  if (data->tokenType != JsonStreamObjectStart && data->tokenType != JsonStreamArrayStart)
+  {
+    // (a scalar value has already been consumed)
+    return data->tokenType;
+  }
+
+  char* open = data->current - 1;
+  char* close = 0;
+  int32_t pair = data->structuralIndex ? JsonStream_FindStructuralIndexPair(data, (int32_t)(open - data->start)) : -1;
+  if (pair >= 0)
+  {
+    // the index already knows
+    if (data->structuralIndex[pair * 2 + 1] >= 0) close = data->start + data->structuralIndex[pair * 2 + 1];
+  }
+  else
+  {
+    // otherwise scan for it, counting depth and hopping over strings and comments
+    int depth = 1;
+    char* p = data->current;
+    while (1)
+    {
+      p = JsonStream_FindStructural(p, data->end);
+      if (p == data->end) break;
+
+      char c = *p;
+      if (c == '"' || c == '/')
+      {
+        p = JsonStream_SkipStringOrComment(p, data->end);
+      }
+      else if (c == '{' || c == '[')
+      {
+        depth++;
+        p++;
+      }
+      else if (--depth == 0)
+      {
+        close = p;
+        break;
+      }
+      else
+      {
+        p++;
+      }
+    }
+  }
+
+  if (close == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR2("unterminated object or array in ", data->identifierForDebugMessages);
+    data->tokenType = JsonStreamError;
+    return JsonStreamError;
+  }
+
+  // leave the stream on the closing token, as if MoveNext() had walked there
+  data->tokenType = (*close == '}') ? JsonStreamObjectEnd : JsonStreamArrayEnd;
+  data->current = close + 1;
+  return data->tokenType;
+}
+
+void JsonStream_SetKeySet(JsonStream stream, JsonKeySet keySet)
+{
+  JsonStreamData* data = (JsonStreamData*)stream;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null stream arg");
+    return;
+  }
+
+  data->keySet = (JsonKeySetData*)keySet;
+  data->keyId = -1;
+}
+
+int32_t JsonStream_GetKeyId(JsonStream stream)
+{
+  JsonStreamData* data = (JsonStreamData*)stream;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null stream arg");
+    return -1;
+  }
+
+  return data->tokenType == JsonStreamPropertyName ? data->keyId : -1;
+}
+
+double JsonStream_GetNumberDouble(JsonStream stream)
+{
+  JsonStreamData* data = (JsonStreamData*)stream;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSON_ERROR("invalid null stream arg");
+    return -2000000000.0;
+  }
+  
+  switch (data->tokenType)
+  {
+    case JsonStreamNumber:
+      return data->numDouble;
+
+    default:
+      return -2000000000.0;
+  }
+}
+
 void JsonStream_Release(JsonStream stream)
 {
   JsonStreamData* data = (JsonStreamData*)stream;
@@ -521,6 +1646,9 @@ void JsonStream_Release(JsonStream stream)
   
   if (data->stringBuffer) free(data->stringBuffer);
   if (data->identifierForDebugMessages) free(data->identifierForDebugMessages);
-  free(data->start);
+  if (data->ownsSource) free(data->start);
+  if (data->mappedView) ResourceFile_Unmap(data->mappedView);
+  if (data->carry) free(data->carry);
+  if (data->structuralIndex) free(data->structuralIndex);
   free(data);
 }
\ No newline at end of file
@@ -20,13 +20,33 @@ typedef enum JsonStreamTokenType {
   JsonStreamNumber,
   JsonStreamTrue,
   JsonStreamFalse,
-  JsonStreamNull
+  JsonStreamNull,
+  JsonStreamNeedMoreData // (incremental streams only) feed another chunk or call JsonStream_FeedEnd(), then MoveNext() again
 } JsonStreamTokenType;
 
 typedef void* JsonStream;
+typedef void* JsonKeySet;
+
+// A JsonKeySet lets a consumer dispatch on property names with a switch instead of strcmp chains:
+// register the expected keys once, attach the set to a stream, and JsonStream_GetKeyId() gives each property
+// name's index in 'keys' (or -1 for anything else). Lookups are a perfect hash (one hash, one compare).
+JsonKeySet           JsonKeySet_Create(const char* const* keys, int32_t keyCount);
+void                 JsonKeySet_Release(JsonKeySet keySet);
+// 'length' may be -1 for null-terminated keys
+int32_t              JsonKeySet_Find(JsonKeySet keySet, const char* key, int32_t length);
 
 // A JsonStream allows forward iteration through a JSON file's contents (loaded into memory).
 JsonStream           JsonStream_Parse(const char* jsonData, const char* debugIdentifier);
+// parses caller-owned memory in place (no copy, no null terminator needed); [begin, end) must outlive the stream
+JsonStream           JsonStream_ParseRange(const char* begin, const char* end, const char* debugIdentifier);
+// push-style parsing of JSON that arrives in pieces: JsonStream_Feed() a chunk, MoveNext() until it returns
+// JsonStreamNeedMoreData, then feed the next chunk (JsonStream_FeedEnd() after the last one).
+// Chunks are borrowed and parsed in place; each must stay valid until MoveNext() asks for more data.
+// Only a token that straddles two chunks gets copied (into a small buffer owned by the stream).
+JsonStream           JsonStream_CreateIncremental(const char* debugIdentifier);
+int                  JsonStream_Feed(JsonStream stream, const char* bytes, int32_t length);
+int                  JsonStream_FeedEnd(JsonStream stream);
+// parses the resource file in place (it stays mapped until the stream is released)
 JsonStream           JsonStream_LoadFromResourceFile(const wchar_t * fileName);
 void                 JsonStream_Release(JsonStream stream);
 const char*          JsonStream_GetDebugIdentifier(JsonStream stream);
@@ -34,9 +54,28 @@ const char*          JsonStream_GetDebugIdentifier(JsonStream stream);
 JsonStreamTokenType  JsonStream_MoveNext(JsonStream stream);
 JsonStreamTokenType  JsonStream_GetTokenType(JsonStream stream);
 
-// returns borrowed string data; you have to copy it if you want to keep it
+// returns borrowed, null-terminated string data; you have to copy it if you want to keep it
+// (escape-free strings point straight into the parsed JSON; only strings with escapes get decoded into scratch memory)
 const char*          JsonStream_GetString(JsonStream stream, int32_t* length);
+// like JsonStream_GetString() but never copies, so the result is NOT null-terminated when it points into a
+// JsonStream_ParseRange() source; always use 'length'
+const char*          JsonStream_GetStringSlice(JsonStream stream, int32_t* length);
+// skips the current object or array (or, on a property name, its value) in one call, leaving the stream on the
+// matching JsonStreamObjectEnd/JsonStreamArrayEnd; returns the resulting token type (not for incremental streams)
+JsonStreamTokenType  JsonStream_SkipValue(JsonStream stream);
+// optional: indexes every bracket pair ahead of the current position in one pass, so JsonStream_SkipValue() becomes
+// a binary search instead of a scan. Worth it when a big file's unused sections get skipped.
+int                  JsonStream_BuildStructuralIndex(JsonStream stream);
+
+// the key set is borrowed, so it must outlive the stream (pass 0 to detach)
+void                 JsonStream_SetKeySet(JsonStream stream, JsonKeySet keySet);
+// for the current property name: its index in the stream's key set, or -1
+int32_t              JsonStream_GetKeyId(JsonStream stream);
+
+// integers are exact when they fit in an int64; other numbers come back truncated toward zero (and clamped)
 int64_t              JsonStream_GetNumberInt(JsonStream stream);
+// correctly rounded for any JSON number (with decimals and exponents)
+double               JsonStream_GetNumberDouble(JsonStream stream);
 
 
 #endif
\ No newline at end of file
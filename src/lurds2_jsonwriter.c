@@ -0,0 +1,500 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_jsonwriter.h"
+
+#include "lurds2_errors.h"
+
+#define DIAGNOSTIC_JSONWRITER_ERROR(message) DIAGNOSTIC_ERROR(message);
+#define DIAGNOSTIC_JSONWRITER_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
+
+#define JSONWRITER_MAXDEPTH 256
+#define JSONWRITER_DEFAULTCAPACITY 65536
+#define JSONWRITER_MINCAPACITY 64
+#define JSONWRITER_MAXTOKEN 32 // longest number text we ever format (plus punctuation)
+
+typedef struct JsonWriterData {
+  char* buffer;
+  int32_t length;
+  int32_t capacity;
+  int ownsBuffer;
+  JsonWriterFlushFunc flush;
+  void* flushContext;
+  int hasError;
+  int32_t depth;
+  char containers[JSONWRITER_MAXDEPTH]; // '{' or '[' for each open container
+  char needsComma[JSONWRITER_MAXDEPTH + 1]; // per depth (index 0 is the top level)
+  int afterPropertyName; // a property name was just written, so the next thing is its value (no comma)
+} JsonWriterData;
+
+static const char JsonWriter_DigitPairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static JsonWriter JsonWriter_CreateInternal(char* buffer, int32_t capacity, int ownsBuffer, JsonWriterFlushFunc flush, void* context)
+{
+  JsonWriterData* data = malloc(sizeof(JsonWriterData));
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("failed to allocate memory for JsonWriterData");
+    return 0;
+  }
+  memset(data, 0, sizeof(JsonWriterData));
+
+  data->buffer = buffer;
+  data->capacity = capacity;
+  data->ownsBuffer = ownsBuffer;
+  data->flush = flush;
+  data->flushContext = context;
+  return data;
+}
+
+JsonWriter JsonWriter_Create(JsonWriterFlushFunc flush, void* context)
+{
+  char* buffer = malloc(JSONWRITER_DEFAULTCAPACITY);
+  if (buffer == 0)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("failed to allocate memory for JsonWriter buffer");
+    return 0;
+  }
+
+  JsonWriter writer = JsonWriter_CreateInternal(buffer, JSONWRITER_DEFAULTCAPACITY, 1, flush, context);
+  if (writer == 0)
+  {
+    free(buffer);
+  }
+  return writer;
+}
+
+JsonWriter JsonWriter_CreateWithBuffer(char* buffer, int32_t capacity, JsonWriterFlushFunc flush, void* context)
+{
+  if (buffer == 0 || capacity < JSONWRITER_MINCAPACITY)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("invalid buffer/capacity args");
+    return 0;
+  }
+
+  return JsonWriter_CreateInternal(buffer, capacity, 0, flush, context);
+}
+
+void JsonWriter_Release(JsonWriter writer)
+{
+  JsonWriterData* data = (JsonWriterData*)writer;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("invalid null writer arg");
+    return;
+  }
+
+  if (data->ownsBuffer) free(data->buffer);
+  free(data);
+}
+
+static int JsonWriter_FlushInternal(JsonWriterData* data)
+{
+  if (data->length > 0)
+  {
+    if (!data->flush(data->flushContext, data->buffer, data->length))
+    {
+      DIAGNOSTIC_JSONWRITER_ERROR("JsonWriter flush func failed");
+      data->hasError = 1;
+      return 0;
+    }
+    data->length = 0;
+  }
+  return 1;
+}
+
+// makes room for 'count' more bytes in the buffer, flushing or growing it as needed
+// ('count' is at most JSONWRITER_MAXTOKEN unless the buffer can grow)
+static int JsonWriter_Reserve(JsonWriterData* data, int32_t count)
+{
+  if (data->capacity - data->length >= count)
+  {
+    return 1;
+  }
+
+  if (data->flush)
+  {
+    return JsonWriter_FlushInternal(data);
+  }
+
+  if (!data->ownsBuffer)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("JsonWriter ran out of room in caller's buffer");
+    data->hasError = 1;
+    return 0;
+  }
+
+  int64_t newCapacity = (int64_t)data->capacity * 2;
+  if (newCapacity < (int64_t)data->length + count) newCapacity = (int64_t)data->length + count;
+  if (newCapacity > 0x7FFFFFFF)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("JsonWriter output too large");
+    data->hasError = 1;
+    return 0;
+  }
+  char* newBuffer = realloc(data->buffer, newCapacity);
+  if (newBuffer == 0)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("failed to allocate more memory for JsonWriter buffer");
+    data->hasError = 1;
+    return 0;
+  }
+  data->buffer = newBuffer;
+  data->capacity = (int32_t)newCapacity;
+  return 1;
+}
+
+// appends any amount of text, handing it to the flush func a buffer-full at a time if need be
+static int JsonWriter_Append(JsonWriterData* data, const char* bytes, int32_t count)
+{
+  while (count > 0)
+  {
+    int32_t room = data->capacity - data->length;
+    if (room == 0 || (!data->flush && room < count))
+    {
+      if (!JsonWriter_Reserve(data, data->flush ? 1 : count)) return 0;
+      room = data->capacity - data->length;
+    }
+    int32_t n = count < room ? count : room;
+    memcpy(data->buffer + data->length, bytes, n);
+    data->length += n;
+    bytes += n;
+    count -= n;
+  }
+  return 1;
+}
+
+// common bookkeeping before any value (or property name): validity, then the separating comma
+static JsonWriterData* JsonWriter_BeginToken(JsonWriter writer, int isPropertyName)
+{
+  JsonWriterData* data = (JsonWriterData*)writer;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("invalid null writer arg");
+    return 0;
+  }
+  if (data->hasError)
+  {
+    return 0;
+  }
+
+  int inObject = data->depth > 0 && data->containers[data->depth - 1] == '{';
+  if (isPropertyName ? (!inObject || data->afterPropertyName) : (inObject && !data->afterPropertyName))
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR(isPropertyName ? "JsonWriter property name must be inside an object" : "JsonWriter value inside an object needs a property name first");
+    data->hasError = 1;
+    return 0;
+  }
+
+  if (!JsonWriter_Reserve(data, JSONWRITER_MAXTOKEN)) return 0;
+  if (data->afterPropertyName)
+  {
+    data->afterPropertyName = 0;
+  }
+  else if (data->needsComma[data->depth])
+  {
+    data->buffer[data->length++] = ',';
+  }
+  data->needsComma[data->depth] = 1;
+  return data;
+}
+
+static int JsonWriter_BeginContainer(JsonWriter writer, char c)
+{
+  JsonWriterData* data = JsonWriter_BeginToken(writer, 0);
+  if (data == 0) return 0;
+
+  if (data->depth == JSONWRITER_MAXDEPTH)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("JsonWriter nesting too deep");
+    data->hasError = 1;
+    return 0;
+  }
+  data->containers[data->depth++] = c;
+  data->needsComma[data->depth] = 0;
+  data->buffer[data->length++] = c;
+  return 1;
+}
+
+static int JsonWriter_EndContainer(JsonWriter writer, char c)
+{
+  JsonWriterData* data = (JsonWriterData*)writer;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("invalid null writer arg");
+    return 0;
+  }
+  if (data->hasError)
+  {
+    return 0;
+  }
+
+  if (data->depth == 0 || data->containers[data->depth - 1] != (c == '}' ? '{' : '[') || data->afterPropertyName)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("JsonWriter end doesn't match begin");
+    data->hasError = 1;
+    return 0;
+  }
+  if (!JsonWriter_Reserve(data, 1)) return 0;
+  data->depth--;
+  data->buffer[data->length++] = c;
+  return 1;
+}
+
+int JsonWriter_BeginObject(JsonWriter writer) { return JsonWriter_BeginContainer(writer, '{'); }
+int JsonWriter_EndObject(JsonWriter writer) { return JsonWriter_EndContainer(writer, '}'); }
+int JsonWriter_BeginArray(JsonWriter writer) { return JsonWriter_BeginContainer(writer, '['); }
+int JsonWriter_EndArray(JsonWriter writer) { return JsonWriter_EndContainer(writer, ']'); }
+
+// returns nonzero if any byte of 'block' is '"', '\\' or a control character (below 0x20)
+static int JsonWriter_BlockNeedsEscaping(uint64_t block)
+{
+  // (same exact per-byte matching as JsonStream's SWAR helpers; the control character test can flag extra bytes
+  // after a real match, but never flags a block that has none)
+  uint64_t quote = block ^ 0x2222222222222222ULL;
+  uint64_t slash = block ^ 0x5C5C5C5C5C5C5C5CULL;
+  uint64_t matches = ~(((quote & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | quote)
+                   | ~(((slash & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | slash)
+                   | ((block - 0x2020202020202020ULL) & ~block);
+  return (matches & 0x8080808080808080ULL) != 0;
+}
+
+static int JsonWriter_WriteQuotedString(JsonWriterData* data, const char* value, int32_t length)
+{
+  if (value == 0)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("invalid null string arg");
+    data->hasError = 1;
+    return 0;
+  }
+  if (length < 0) length = (int32_t)strlen(value);
+
+  data->buffer[data->length++] = '"'; // (room was reserved by JsonWriter_BeginToken)
+
+  const char* p = value;
+  const char* end = value + length;
+  while (p < end)
+  {
+    // copy the longest run that needs no escaping in one go
+    const char* run = p;
+    while (end - p >= 8)
+    {
+      uint64_t block;
+      memcpy(&block, p, sizeof(block));
+      if (JsonWriter_BlockNeedsEscaping(block)) break;
+      p += 8;
+    }
+    while (p < end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) p++;
+    if (!JsonWriter_Append(data, run, (int32_t)(p - run))) return 0;
+    if (p == end) break;
+
+    char escape[6] = { '\\', 0, '0', '0', 0, 0 };
+    int32_t escapeLength = 2;
+    unsigned char c = (unsigned char)*p++;
+    switch (c)
+    {
+      case '"': escape[1] = '"'; break;
+      case '\\': escape[1] = '\\'; break;
+      case '\b': escape[1] = 'b'; break;
+      case '\f': escape[1] = 'f'; break;
+      case '\n': escape[1] = 'n'; break;
+      case '\r': escape[1] = 'r'; break;
+      case '\t': escape[1] = 't'; break;
+      default:
+        escape[1] = 'u';
+        escape[4] = "0123456789abcdef"[c >> 4];
+        escape[5] = "0123456789abcdef"[c & 15];
+        escapeLength = 6;
+        break;
+    }
+    if (!JsonWriter_Append(data, escape, escapeLength)) return 0;
+  }
+
+  if (!JsonWriter_Reserve(data, JSONWRITER_MAXTOKEN)) return 0;
+  data->buffer[data->length++] = '"';
+  return 1;
+}
+
+int JsonWriter_PropertyName(JsonWriter writer, const char* name, int32_t length)
+{
+  JsonWriterData* data = JsonWriter_BeginToken(writer, 1);
+  if (data == 0) return 0;
+  if (!JsonWriter_WriteQuotedString(data, name, length)) return 0;
+  data->buffer[data->length++] = ':';
+  data->afterPropertyName = 1;
+  return 1;
+}
+
+int JsonWriter_String(JsonWriter writer, const char* value, int32_t length)
+{
+  JsonWriterData* data = JsonWriter_BeginToken(writer, 0);
+  if (data == 0) return 0;
+  return JsonWriter_WriteQuotedString(data, value, length);
+}
+
+// writes the decimal digits of 'value' (two at a time) ending just before 'end'; returns where they start
+static char* JsonWriter_FormatDigits(uint64_t value, char* end)
+{
+  while (value >= 100)
+  {
+    const char* pair = JsonWriter_DigitPairs + (value % 100) * 2;
+    value /= 100;
+    *--end = pair[1];
+    *--end = pair[0];
+  }
+  if (value >= 10)
+  {
+    const char* pair = JsonWriter_DigitPairs + value * 2;
+    *--end = pair[1];
+    *--end = pair[0];
+  }
+  else
+  {
+    *--end = (char)('0' + value);
+  }
+  return end;
+}
+
+int JsonWriter_Int(JsonWriter writer, int64_t value)
+{
+  JsonWriterData* data = JsonWriter_BeginToken(writer, 0);
+  if (data == 0) return 0;
+
+  char text[24];
+  char* end = text + sizeof(text);
+  char* start = JsonWriter_FormatDigits(value < 0 ? 0 - (uint64_t)value : (uint64_t)value, end);
+  if (value < 0) *--start = '-';
+  memcpy(data->buffer + data->length, start, end - start);
+  data->length += (int32_t)(end - start);
+  return 1;
+}
+
+static const double JsonWriter_PowersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+int JsonWriter_Double(JsonWriter writer, double value)
+{
+  JsonWriterData* data = JsonWriter_BeginToken(writer, 0);
+  if (data == 0) return 0;
+
+  if (value != value || value - value != 0)
+  {
+    // JSON has no NaN or infinity
+    memcpy(data->buffer + data->length, "null", 4);
+    data->length += 4;
+    return 1;
+  }
+
+  // find the fewest decimals that give back exactly 'value' when read as (integer / 10^decimals). Both of those are
+  // exact doubles, so that's also exactly what JsonStream (and any correct parser) computes when reading it back.
+  int negative = value < 0 || (value == 0 && 1 / value < 0); // (keeps the sign of -0)
+  double magnitude = negative ? -value : value;
+  int decimals;
+  for (decimals = 0; decimals <= 9; decimals++)
+  {
+    double scaled = magnitude * JsonWriter_PowersOfTen[decimals];
+    if (scaled >= 9007199254740992.0) break; // (past 2^53 the integer part alone isn't exact)
+
+    uint64_t digits = (uint64_t)(scaled + 0.5);
+    if ((double)digits / JsonWriter_PowersOfTen[decimals] != magnitude) continue;
+
+    char text[JSONWRITER_MAXTOKEN];
+    char* end = text + sizeof(text);
+    char* start = JsonWriter_FormatDigits(digits, end);
+    if (decimals > 0)
+    {
+      // pad with leading zeros so there's at least one integer digit, then slide the fraction over for the point
+      while (end - start <= decimals) *--start = '0';
+      memmove(start - 1, start, (end - start) - decimals);
+      start--;
+      *(end - decimals - 1) = '.';
+    }
+    if (negative) *--start = '-';
+    memcpy(data->buffer + data->length, start, end - start);
+    data->length += (int32_t)(end - start);
+    return 1;
+  }
+
+  // huge, tiny, or many-digit values: rare enough to leave to the C library, with enough precision to round trip
+  char text[64];
+  int written = sprintf(text, "%.17g", value);
+  if (written <= 0 || written >= JSONWRITER_MAXTOKEN)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("failed to format double");
+    data->hasError = 1;
+    return 0;
+  }
+  memcpy(data->buffer + data->length, text, written);
+  data->length += written;
+  return 1;
+}
+
+int JsonWriter_Bool(JsonWriter writer, int value)
+{
+  JsonWriterData* data = JsonWriter_BeginToken(writer, 0);
+  if (data == 0) return 0;
+  if (value)
+  {
+    memcpy(data->buffer + data->length, "true", 4);
+    data->length += 4;
+  }
+  else
+  {
+    memcpy(data->buffer + data->length, "false", 5);
+    data->length += 5;
+  }
+  return 1;
+}
+
+int JsonWriter_Null(JsonWriter writer)
+{
+  JsonWriterData* data = JsonWriter_BeginToken(writer, 0);
+  if (data == 0) return 0;
+  memcpy(data->buffer + data->length, "null", 4);
+  data->length += 4;
+  return 1;
+}
+
+int JsonWriter_Flush(JsonWriter writer)
+{
+  JsonWriterData* data = (JsonWriterData*)writer;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("invalid null writer arg");
+    return 0;
+  }
+  if (data->hasError)
+  {
+    return 0;
+  }
+  if (data->flush == 0)
+  {
+    return 1; // (nothing to flush to; the text stays in the buffer)
+  }
+  return JsonWriter_FlushInternal(data);
+}
+
+const char* JsonWriter_GetData(JsonWriter writer, int32_t* length)
+{
+  JsonWriterData* data = (JsonWriterData*)writer;
+  if (data == 0)
+  {
+    DIAGNOSTIC_JSONWRITER_ERROR("invalid null writer arg");
+    if (length) *length = 0;
+    return 0;
+  }
+  if (length) *length = data->length;
+  return data->buffer;
+}
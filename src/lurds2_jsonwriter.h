@@ -0,0 +1,42 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_JSONWRITER
+#define LURDS2_JSONWRITER
+
+// receives a block of finished JSON text; return 0 to fail the write (the writer then stays error'd)
+typedef int (*JsonWriterFlushFunc)(void* context, const char* bytes, int32_t length);
+
+typedef void* JsonWriter;
+
+// A JsonWriter produces compact JSON text (the counterpart of JsonStream). Commas are inserted automatically.
+// With a flush func, text is handed over in large blocks as the buffer fills; without one, the buffer just grows
+// and JsonWriter_GetData() returns everything written.
+JsonWriter  JsonWriter_Create(JsonWriterFlushFunc flush, void* context);
+// writes into caller-owned memory (at least 64 bytes); without a flush func, running out of room is an error
+JsonWriter  JsonWriter_CreateWithBuffer(char* buffer, int32_t capacity, JsonWriterFlushFunc flush, void* context);
+void        JsonWriter_Release(JsonWriter writer);
+
+// all of these return 0 on failure (after which the writer refuses further writes)
+int         JsonWriter_BeginObject(JsonWriter writer);
+int         JsonWriter_EndObject(JsonWriter writer);
+int         JsonWriter_BeginArray(JsonWriter writer);
+int         JsonWriter_EndArray(JsonWriter writer);
+// 'length' may be -1 for null-terminated strings
+int         JsonWriter_PropertyName(JsonWriter writer, const char* name, int32_t length);
+int         JsonWriter_String(JsonWriter writer, const char* value, int32_t length);
+int         JsonWriter_Int(JsonWriter writer, int64_t value);
+// written with the fewest decimals (up to 9) that read back exactly, else with full precision; NaN/infinity become null
+int         JsonWriter_Double(JsonWriter writer, double value);
+int         JsonWriter_Bool(JsonWriter writer, int value);
+int         JsonWriter_Null(JsonWriter writer);
+
+// hands any buffered text to the flush func (call once after the last write)
+int         JsonWriter_Flush(JsonWriter writer);
+// returns the buffered text (not null-terminated); with no flush func, that's everything written so far
+const char* JsonWriter_GetData(JsonWriter writer, int32_t* length);
+
+#endif
@@ -10,6 +10,7 @@ Please refer to <http://unlicense.org/>
 #include "lauxlib.h"
 #include "lualib.h"
 #include "lurds2_errors.h"
+#include "lurds2_resourceFile.h"
 #include "lurds2_stringutils.h"
 
 #define DIAGNOSTIC_LUA_ERROR(message) DIAGNOSTIC_ERROR(message);
@@ -27,6 +28,23 @@ int MyLuaPanic(lua_State * luaState);
 void MyLuaWarn(void *ud, const char *msg, int tocont);
 void MyLoadStandardWhitelistedLibraries(lua_State * luaState);
 void MyLoadAndRunLuaFile(lua_State* luaState, const wchar_t* luaFileName);
+int MyReloadLuaFile(lua_State* luaState, const wchar_t* luaFileName);
+
+// the live Looas, so their script can be rerun in them when it changes
+#define LOOA_MAX_LIVE 16
+static lua_State* LiveLooas[LOOA_MAX_LIVE];
+static int LiveLooaCount;
+
+// (a ResourceFileChangedFunc) reruns the changed script in every live Looa, keeping whatever state it already has
+static void Looa_FileChanged(void* userData, const char* name)
+{
+  if (strcmp(name, "res/looa/lurds2.lua") != 0) return;
+  int i;
+  for (i = 0; i < LiveLooaCount; i++)
+  {
+    MyReloadLuaFile(LiveLooas[i], L"looa\\lurds2.lua");
+  }
+}
 
 Looa Looa_Create()
 {
@@ -56,6 +74,13 @@ Looa Looa_Create()
   // finally add the exported C methods
   // (this timing is clever - MainApp.lua didn't get to use the C methods when it was first loaded+executed)
   //LuaExports_PublishCMethods(luaState);
+
+  if (LiveLooaCount < LOOA_MAX_LIVE)
+  {
+    static int listening;
+    if (!listening) listening = ResourceFile_AddChangeListener(Looa_FileChanged, 0);
+    LiveLooas[LiveLooaCount++] = luaState;
+  }
   
   return luaState;
   
@@ -63,6 +88,26 @@ error:
   if (luaState) lua_close(luaState);
 }
 
+void Looa_Release(Looa looa)
+{
+  if (looa == 0)
+  {
+    DIAGNOSTIC_LUA_ERROR("invalid null looa arg");
+    return;
+  }
+
+  int i;
+  for (i = 0; i < LiveLooaCount; i++)
+  {
+    if (LiveLooas[i] == looa)
+    {
+      LiveLooas[i] = LiveLooas[--LiveLooaCount];
+      break;
+    }
+  }
+  lua_close(looa);
+}
+
 void MyLoadStandardWhitelistedLibraries(lua_State * luaState)
 {
 #define MY_WHITELISTED_GLOBALS_LEN sizeof(MyWhitelistedGlobals) / sizeof(char*)
@@ -222,6 +267,34 @@ void MyLoadAndRunLuaFile(lua_State* luaState, const wchar_t* luaFileName)
   free(cLuaFileName);
 }
 
+// like MyLoadAndRunLuaFile(), but a broken script (e.g. saved halfway through an edit) is only reported,
+// and the state keeps running whatever it had; returns 0 on failure
+int MyReloadLuaFile(lua_State* luaState, const wchar_t* luaFileName)
+{
+  int luaFileDataLength;
+  int result = 0;
+  char* cLuaFileName = StringUtils_MakeNarrowString(luaFileName);
+  char* luaFileData = ResourceFile_Load(luaFileName, &luaFileDataLength);
+  if (cLuaFileName == 0 || luaFileData == 0)
+  {
+    // diagnostic error already reported
+  }
+  else if (LUA_OK != luaL_loadbufferx(luaState, luaFileData, luaFileDataLength, cLuaFileName, "t")
+    || LUA_OK != lua_pcall(luaState, 0, 0, 0))
+  {
+    DIAGNOSTIC_LUA_ERROR3(cLuaFileName, " failed to reload: ", lua_tolstring(luaState, -1, 0));
+    lua_pop(luaState, 1);
+  }
+  else
+  {
+    result = 1;
+  }
+
+  free(luaFileData);
+  free(cLuaFileName);
+  return result;
+}
+
 /*
 The lua allocator function must provide a functionality similar to realloc, 
 but not exactly the same. Its arguments are 
@@ -10,6 +10,7 @@ Please refer to <http://unlicense.org/>
 typedef void* Looa;
 
 // A Looa is a combination of a Lua_State and C hosting data structures for interacting with it
+// (only the test app builds with Lua so far, so script hot-reload only happens there; main.c doesn't include this yet)
 Looa Looa_Create(/* TODO: stuff to add:
    path of lua script to load
    screen drawing hook
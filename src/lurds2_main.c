@@ -13,10 +13,20 @@ Please refer to <http://unlicense.org/>
 //#include "lurds2_performanceCounter.c"
 #include "lurds2_resourceFile.c"
 //#include "lurds2_looa.c"
+#include "lurds2_atlas.c"
 #include "lurds2_bmp.c"
+#include "lurds2_spriteBatch.c"
 #include "lurds2_jsonstream.c"
 //#include "lurds2_stack.c"
 #include "lurds2_stringutils.c"
+#include "lurds2_hash.c"
+#include "lurds2_pak.c"
+#include "lurds2_hashmap.c"
+#include "lurds2_vfs.c"
+#include "lurds2_watch.c"
+#include "lurds2_arena.c"
+#include "lurds2_pool.c"
+#include "lurds2_ring.c"
 #include "lurds2_font.c"
 
 static char mainWindowClassName[] = "LURDS2";
@@ -70,6 +80,12 @@ int APIENTRY WinMain(
   MSG msg;
   WNDCLASS wc;
 
+  // index the resource files, Lords2 files, mods and archives once, up front
+  ResourceFile_MountAll(0);
+
+  // reload resources in place when their files are edited (see ResourceFile_DispatchChanged() below)
+  ResourceFile_StartWatching();
+
   ZeroMemory(&wc, sizeof wc);
   wc.hInstance     = hInstance;
   wc.lpszClassName = mainWindowClassName;
@@ -159,8 +175,11 @@ int APIENTRY WinMain(
   // Main message loop:
   while (GetMessage(&msg, NULL, 0, 0) > 0)
   {
+    Arena_BeginFrame();
     TranslateMessage(&msg);
     DispatchMessage(&msg);
+    ResourceFile_DispatchLoaded();
+    ResourceFile_DispatchChanged();
   }
 
   return msg.wParam;
@@ -0,0 +1,337 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_pak.h"
+
+#include "lurds2_errors.h"
+#include "lurds2_hash.h"
+#include "lurds2_resourceFile.h"
+
+#define DIAGNOSTIC_PAK_ERROR(message) DIAGNOSTIC_ERROR(message);
+#define DIAGNOSTIC_PAK_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
+#define DIAGNOSTIC_PAK_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3));
+#define DIAGNOSTIC_PAK_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
+
+#define PAK_MAGIC 0x4B41504C // "LPAK"
+#define PAK_VERSION 1
+#define PAK_SEED 0x6C75726473325061ULL
+#define PAK_MAX_NAME 1024
+
+typedef struct PakHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount; // the PakEntry table follows the header
+  uint32_t namesOffset; // from the start of the archive
+  uint32_t namesSize;
+  uint32_t reserved[3];
+} PakHeader;
+
+typedef struct PakEntry {
+  uint64_t nameHash; // Hash_Bytes() of the name with PAK_SEED; entries are sorted by it
+  uint32_t nameOffset; // from the start of the names (each name is null terminated)
+  uint32_t nameLength;
+  uint32_t dataOffset; // from the start of the archive, a multiple of PAK_ALIGNMENT
+  uint32_t dataSize;
+} PakEntry;
+
+BUILD_ASSERT(sizeof(PakHeader) == 32);
+BUILD_ASSERT(sizeof(PakEntry) == 24);
+
+typedef struct PakData {
+  const uint8_t* view;
+  int size;
+  int32_t entryCount;
+  const PakEntry* entries;
+  const char* names;
+} PakData;
+
+Pak Pak_Open(const wchar_t* filePath)
+{
+  int size;
+  const uint8_t* view = ResourceFile_MapPath(filePath, &size);
+  if (view == 0) return 0;
+
+  PakData* data = 0;
+  const PakHeader* header = (const PakHeader*)view;
+  if (size < (int)sizeof(PakHeader) || header->magic != PAK_MAGIC || header->version != PAK_VERSION)
+  {
+    DIAGNOSTIC_PAK_ERROR("not an lpak archive (or an unsupported version)");
+    goto error;
+  }
+
+  int64_t tocEnd = sizeof(PakHeader) + (int64_t)header->entryCount * sizeof(PakEntry);
+  if (tocEnd > header->namesOffset || (int64_t)header->namesOffset + header->namesSize > size)
+  {
+    DIAGNOSTIC_PAK_ERROR("invalid lpak table of contents");
+    goto error;
+  }
+
+  data = malloc(sizeof(PakData));
+  if (data == 0)
+  {
+    DIAGNOSTIC_PAK_ERROR("failed to allocate memory for PakData");
+    goto error;
+  }
+  data->view = view;
+  data->size = size;
+  data->entryCount = header->entryCount;
+  data->entries = (const PakEntry*)(view + sizeof(PakHeader));
+  data->names = (const char*)view + header->namesOffset;
+
+  // check every entry once here, so lookups can trust them
+  int32_t i;
+  for (i = 0; i < data->entryCount; i++)
+  {
+    const PakEntry* e = &data->entries[i];
+    if ((int64_t)e->nameOffset + e->nameLength >= header->namesSize || data->names[e->nameOffset + e->nameLength] != 0
+      || (int64_t)e->dataOffset + e->dataSize > size || (e->dataOffset % PAK_ALIGNMENT) != 0
+      || (i > 0 && e->nameHash < data->entries[i - 1].nameHash))
+    {
+      DIAGNOSTIC_PAK_ERROR("invalid lpak table of contents entry");
+      goto error;
+    }
+  }
+
+  return data;
+
+error:
+  if (data != 0) free(data);
+  ResourceFile_UnmapPath(view);
+  return 0;
+}
+
+void Pak_Close(Pak pak)
+{
+  PakData* data = pak;
+  if (data == 0)
+  {
+    DIAGNOSTIC_PAK_ERROR("invalid null pak arg");
+    return;
+  }
+
+  ResourceFile_UnmapPath(data->view);
+  free(data);
+}
+
+const void* Pak_Find(Pak pak, const char* name, int* size)
+{
+  PakData* data = pak;
+  if (data == 0 || name == 0)
+  {
+    DIAGNOSTIC_PAK_ERROR("invalid null pak/name arg");
+    return 0;
+  }
+
+  int nameLength = strlen(name);
+  uint64_t hash = Hash_Bytes(name, nameLength, PAK_SEED);
+
+  // find the first entry with this hash
+  int32_t low = 0;
+  int32_t high = data->entryCount;
+  while (low < high)
+  {
+    int32_t middle = low + (high - low) / 2;
+    if (data->entries[middle].nameHash < hash) low = middle + 1;
+    else high = middle;
+  }
+
+  for (; low < data->entryCount && data->entries[low].nameHash == hash; low++)
+  {
+    const PakEntry* e = &data->entries[low];
+    if (e->nameLength == (uint32_t)nameLength && memcmp(data->names + e->nameOffset, name, nameLength) == 0)
+    {
+      if (size) *size = e->dataSize;
+      return data->view + e->dataOffset;
+    }
+  }
+  return 0;
+}
+
+const void* Pak_FindW(Pak pak, const char* prefix, const wchar_t* name, int* size)
+{
+  char normalized[PAK_MAX_NAME];
+  if (Pak_NormalizeName(normalized, PAK_MAX_NAME, prefix, name) == 0) return 0;
+  return Pak_Find(pak, normalized, size);
+}
+
+int Pak_Contains(Pak pak, const void* view)
+{
+  PakData* data = pak;
+  if (data == 0)
+  {
+    DIAGNOSTIC_PAK_ERROR("invalid null pak arg");
+    return 0;
+  }
+
+  return (const uint8_t*)view >= data->view && (const uint8_t*)view <= data->view + data->size;
+}
+
+int32_t Pak_GetCount(Pak pak)
+{
+  PakData* data = pak;
+  if (data == 0)
+  {
+    DIAGNOSTIC_PAK_ERROR("invalid null pak arg");
+    return 0;
+  }
+
+  return data->entryCount;
+}
+
+const char* Pak_GetEntry(Pak pak, int32_t index, const void** view, int* size)
+{
+  PakData* data = pak;
+  if (data == 0 || index < 0 || index >= data->entryCount)
+  {
+    DIAGNOSTIC_PAK_ERROR("invalid null pak arg or index out of range");
+    return 0;
+  }
+
+  const PakEntry* e = &data->entries[index];
+  if (view) *view = data->view + e->dataOffset;
+  if (size) *size = e->dataSize;
+  return data->names + e->nameOffset;
+}
+
+int Pak_NormalizeName(char* buffer, int bufferSize, const char* prefix, const wchar_t* name)
+{
+  if (buffer == 0 || name == 0 || bufferSize <= 0)
+  {
+    DIAGNOSTIC_PAK_ERROR("invalid null buffer/name arg");
+    return 0;
+  }
+
+  int length = 0;
+  if (prefix != 0)
+  {
+    for (; *prefix != 0; prefix++)
+    {
+      if (length + 1 >= bufferSize) return 0;
+      buffer[length++] = *prefix;
+    }
+  }
+
+  for (; *name != 0; name++)
+  {
+    wchar_t c = *name;
+    if (c < 0x20 || c >= 0x80 || length + 1 >= bufferSize) return 0;
+    if (c == '\\') c = '/';
+    if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    buffer[length++] = (char)c;
+  }
+  buffer[length] = 0;
+  return length;
+}
+
+typedef struct PakBuildEntry {
+  uint64_t hash;
+  const char* name;
+  int32_t index;
+} PakBuildEntry;
+
+static int Pak_CompareBuildEntries(const void* a, const void* b)
+{
+  const PakBuildEntry* x = a;
+  const PakBuildEntry* y = b;
+  if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+  return strcmp(x->name, y->name);
+}
+
+void* Pak_Build(const char** names, const void** datas, const int* sizes, int32_t count, int* pakSize)
+{
+  if (names == 0 || datas == 0 || sizes == 0 || count < 0)
+  {
+    DIAGNOSTIC_PAK_ERROR("invalid null names/datas/sizes arg");
+    return 0;
+  }
+
+  PakBuildEntry* sorted = 0;
+  uint8_t* pak = 0;
+
+  sorted = malloc(sizeof(PakBuildEntry) * (count + 1));
+  if (sorted == 0)
+  {
+    DIAGNOSTIC_PAK_ERROR("failed to allocate memory for sorted entries");
+    goto error;
+  }
+
+  // lay it out first: header, table of contents, names, then the aligned data
+  int64_t namesSize = 0;
+  int32_t i;
+  for (i = 0; i < count; i++)
+  {
+    int nameLength = strlen(names[i]);
+    if (sizes[i] < 0 || (sizes[i] > 0 && datas[i] == 0))
+    {
+      DIAGNOSTIC_PAK_ERROR2("invalid data for ", names[i]);
+      goto error;
+    }
+    sorted[i].hash = Hash_Bytes(names[i], nameLength, PAK_SEED);
+    sorted[i].name = names[i];
+    sorted[i].index = i;
+    namesSize += nameLength + 1;
+  }
+  qsort(sorted, count, sizeof(PakBuildEntry), Pak_CompareBuildEntries);
+
+  int64_t namesOffset = sizeof(PakHeader) + (int64_t)count * sizeof(PakEntry);
+  int64_t size = (namesOffset + namesSize + PAK_ALIGNMENT - 1) & ~(int64_t)(PAK_ALIGNMENT - 1);
+  for (i = 0; i < count; i++)
+  {
+    if (i > 0 && strcmp(sorted[i].name, sorted[i - 1].name) == 0)
+    {
+      DIAGNOSTIC_PAK_ERROR2("duplicate lpak entry ", sorted[i].name);
+      goto error;
+    }
+    size += (sizes[sorted[i].index] + PAK_ALIGNMENT - 1) & ~(PAK_ALIGNMENT - 1);
+  }
+  if (size > 0x7FFFFFFF)
+  {
+    DIAGNOSTIC_PAK_ERROR("lpak archive would be too big (2GB max)");
+    goto error;
+  }
+
+  pak = malloc(size);
+  if (pak == 0)
+  {
+    DIAGNOSTIC_PAK_ERROR("failed to allocate memory for lpak archive");
+    goto error;
+  }
+  memset(pak, 0, size);
+
+  PakHeader* header = (PakHeader*)pak;
+  header->magic = PAK_MAGIC;
+  header->version = PAK_VERSION;
+  header->entryCount = count;
+  header->namesOffset = (uint32_t)namesOffset;
+  header->namesSize = (uint32_t)namesSize;
+
+  PakEntry* entries = (PakEntry*)(pak + sizeof(PakHeader));
+  uint32_t nameOffset = 0;
+  uint32_t dataOffset = (uint32_t)((namesOffset + namesSize + PAK_ALIGNMENT - 1) & ~(int64_t)(PAK_ALIGNMENT - 1));
+  for (i = 0; i < count; i++)
+  {
+    int32_t index = sorted[i].index;
+    int nameLength = strlen(names[index]);
+    entries[i].nameHash = sorted[i].hash;
+    entries[i].nameOffset = nameOffset;
+    entries[i].nameLength = nameLength;
+    entries[i].dataOffset = dataOffset;
+    entries[i].dataSize = sizes[index];
+    memcpy(pak + namesOffset + nameOffset, names[index], nameLength + 1);
+    if (sizes[index] > 0) memcpy(pak + dataOffset, datas[index], sizes[index]);
+    nameOffset += nameLength + 1;
+    dataOffset += (sizes[index] + PAK_ALIGNMENT - 1) & ~(PAK_ALIGNMENT - 1);
+  }
+
+  free(sorted);
+  if (pakSize) *pakSize = (int)size;
+  return pak;
+
+error:
+  if (sorted != 0) free(sorted);
+  if (pak != 0) free(pak);
+  return 0;
+}
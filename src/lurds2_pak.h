@@ -0,0 +1,40 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_PAK
+#define LURDS2_PAK
+
+typedef void* Pak;
+
+// A Pak (*.lpak) packs many files into one, so loading them costs one mapping instead of an open/read/close each.
+// Layout (little-endian): a PakHeader, then the table of contents sorted by name hash (binary searched),
+// then the names, then each file's data aligned to PAK_ALIGNMENT. Nothing is compressed, so files are used
+// straight out of the mapping.
+// Names are relative paths like "res/old_timey_font.json": ASCII, lowercase, with '/' separators.
+#define PAK_ALIGNMENT 64
+
+// maps the archive (read-only) and checks its table of contents; returns 0 on failure
+Pak         Pak_Open(const wchar_t* filePath);
+void        Pak_Close(Pak pak);
+
+// returns the file's data (inside the mapping, valid until Pak_Close()), or 0 when it isn't in the archive
+const void* Pak_Find(Pak pak, const char* name, int* size);
+// like Pak_Find(), for prefix + name where name is a resource file name like L"looa\\lurds2.lua" (normalized first)
+const void* Pak_FindW(Pak pak, const char* prefix, const wchar_t* name, int* size);
+// returns 1 if 'view' points into the archive's mapping
+int         Pak_Contains(Pak pak, const void* view);
+
+int32_t     Pak_GetCount(Pak pak);
+// returns the name of the index'th file (in table of contents order) and optionally its data, or 0 on failure
+const char* Pak_GetEntry(Pak pak, int32_t index, const void** data, int* size);
+
+// writes 'name' (a file name relative to the archive root) to 'buffer' normalized as a pak name;
+// returns its length, or 0 when it doesn't fit or isn't ASCII
+int         Pak_NormalizeName(char* buffer, int bufferSize, const char* prefix, const wchar_t* name);
+// builds a whole archive in memory from already-normalized names; returns it malloc'd (0 on failure)
+void*       Pak_Build(const char** names, const void** datas, const int* sizes, int32_t count, int* pakSize);
+
+#endif
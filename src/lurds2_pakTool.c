@@ -0,0 +1,207 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+// Packs directories into an .lpak archive (see lurds2_pak.h). Headless, so it also builds and runs on Linux:
+//   cc -O2 -o lurds2_pakTool src/lurds2_pakTool.c -lpthread
+//   lurds2_pakTool out.lpak dir=prefix [dir=prefix...]
+// Every file under each dir is stored as prefix/relative/path (normalized), e.g.
+//   lurds2_pakTool publish/res/lurds2.lpak res=res looa=res/looa "C:\games\Lords of the Realm II=lords2"
+// (which is what ResourceFile_MountAll() mounts: resource files under "res/", Lords2 files under "lords2/").
+// The archive is read back and checked against the files before the tool exits.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "lurds2_errors.c"
+#include "lurds2_stringutils.c"
+#include "lurds2_ring.c"
+#include "lurds2_resourceFile.c"
+#include "lurds2_hash.c"
+#include "lurds2_pak.c"
+#include "lurds2_arena.c"
+#include "lurds2_hashmap.c"
+#include "lurds2_vfs.c"
+#include "lurds2_watch.c"
+
+#define PAKTOOL_MAX_PATH 1024
+
+typedef struct PakToolFiles {
+  char** names;
+  void** datas;
+  int* sizes;
+  int32_t count;
+  int32_t capacity;
+} PakToolFiles;
+
+static void PakTool_AddFile(PakToolFiles* files, const char* path, const char* name)
+{
+  FILE* f = fopen(path, "rb");
+  if (f == 0)
+  {
+    FATAL_ERROR2("failed to open ", path);
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (size < 0 || size > 0x7FFFFFFF)
+  {
+    FATAL_ERROR2("file too big to pack: ", path);
+  }
+
+  void* data = malloc(size > 0 ? size : 1);
+  if (data == 0 || (long)fread(data, 1, size, f) != size)
+  {
+    FATAL_ERROR2("failed to read ", path);
+  }
+  fclose(f);
+
+  if (files->count == files->capacity)
+  {
+    files->capacity = files->capacity ? files->capacity * 2 : 256;
+    files->names = realloc(files->names, sizeof(char*) * files->capacity);
+    files->datas = realloc(files->datas, sizeof(void*) * files->capacity);
+    files->sizes = realloc(files->sizes, sizeof(int) * files->capacity);
+    if (files->names == 0 || files->datas == 0 || files->sizes == 0)
+    {
+      FATAL_ERROR("failed to allocate memory for file list");
+    }
+  }
+
+  // pak names are normalized (lowercase, '/' separators)
+  wchar_t* wideName = StringUtils_MakeWideString(name);
+  char* normalized = malloc(PAKTOOL_MAX_PATH);
+  if (wideName == 0 || normalized == 0 || Pak_NormalizeName(normalized, PAKTOOL_MAX_PATH, 0, wideName) == 0)
+  {
+    FATAL_ERROR2("can't make a pak name (too long, or not ASCII?) for ", path);
+  }
+  free(wideName);
+
+  files->names[files->count] = normalized;
+  files->datas[files->count] = data;
+  files->sizes[files->count] = (int)size;
+  files->count++;
+}
+
+// adds every file under 'dir' (recursively), named 'prefix' + its path relative to 'dir'
+static void PakTool_AddDirectory(PakToolFiles* files, const char* dir, const char* prefix)
+{
+  char path[PAKTOOL_MAX_PATH];
+  char name[PAKTOOL_MAX_PATH];
+
+#ifdef _WIN32
+  WIN32_FIND_DATAA found;
+  snprintf(path, sizeof(path), "%.*s\\*", PAKTOOL_MAX_PATH - 3, dir);
+  HANDLE find = FindFirstFileA(path, &found);
+  if (find == INVALID_HANDLE_VALUE)
+  {
+    FATAL_ERROR2("failed to list directory ", dir);
+  }
+  do
+  {
+    const char* entry = found.cFileName;
+    int isDirectory = (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+  DIR* d = opendir(dir);
+  if (d == 0)
+  {
+    FATAL_ERROR2("failed to list directory ", dir);
+  }
+  struct dirent* found;
+  while ((found = readdir(d)) != 0)
+  {
+    const char* entry = found->d_name;
+    struct stat info;
+#endif
+    if (strcmp(entry, ".") == 0 || strcmp(entry, "..") == 0) continue;
+    int pathLength = snprintf(path, sizeof(path), "%s/%s", dir, entry);
+    int nameLength = snprintf(name, sizeof(name), prefix[0] ? "%s/%s" : "%s%s", prefix, entry);
+    if (pathLength < 0 || pathLength >= PAKTOOL_MAX_PATH || nameLength < 0 || nameLength >= PAKTOOL_MAX_PATH)
+    {
+      FATAL_ERROR2("path too long under ", dir);
+    }
+#ifndef _WIN32
+    if (stat(path, &info) != 0) continue;
+    int isDirectory = S_ISDIR(info.st_mode);
+#endif
+    if (isDirectory) PakTool_AddDirectory(files, path, name);
+    else PakTool_AddFile(files, path, name);
+#ifdef _WIN32
+  } while (FindNextFileA(find, &found));
+  FindClose(find);
+#else
+  }
+  closedir(d);
+#endif
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    printf("usage: lurds2_pakTool out.lpak dir=prefix [dir=prefix...]\n");
+    return 1;
+  }
+
+  PakToolFiles files;
+  memset(&files, 0, sizeof(files));
+  int i;
+  for (i = 2; i < argc; i++)
+  {
+    char dir[PAKTOOL_MAX_PATH];
+    const char* equals = strrchr(argv[i], '=');
+    if (equals == 0 || equals == argv[i] || equals - argv[i] >= PAKTOOL_MAX_PATH)
+    {
+      FATAL_ERROR2("expected dir=prefix, not ", argv[i]);
+    }
+    memcpy(dir, argv[i], equals - argv[i]);
+    dir[equals - argv[i]] = 0;
+    int before = files.count;
+    PakTool_AddDirectory(&files, dir, equals + 1);
+    printf("%s: %d files\n", dir, files.count - before);
+  }
+
+  int pakSize;
+  void* pak = Pak_Build((const char**)files.names, (const void**)files.datas, files.sizes, files.count, &pakSize);
+  if (pak == 0) return 1;
+
+  FILE* f = fopen(argv[1], "wb");
+  if (f == 0 || fwrite(pak, 1, pakSize, f) != (size_t)pakSize || fclose(f) != 0)
+  {
+    FATAL_ERROR2("failed to write ", argv[1]);
+  }
+  free(pak);
+
+  // read it back the way the game will
+  wchar_t* widePath = StringUtils_MakeWideString(argv[1]);
+  Pak check = Pak_Open(widePath);
+  if (check == 0 || Pak_GetCount(check) != files.count) return 1;
+  int32_t i;
+  for (i = 0; i < files.count; i++)
+  {
+    int size;
+    const void* data = Pak_Find(check, files.names[i], &size);
+    if (data == 0 || size != files.sizes[i] || memcmp(data, files.datas[i], size) != 0 || ((uintptr_t)data % PAK_ALIGNMENT) != 0)
+    {
+      FATAL_ERROR2("archive doesn't match the packed file ", files.names[i]);
+    }
+    free(files.names[i]);
+    free(files.datas[i]);
+  }
+  Pak_Close(check);
+  free(widePath);
+
+  printf("wrote %s: %d files, %d bytes\n", argv[1], files.count, pakSize);
+  return 0;
+}
@@ -6,12 +6,13 @@ Please refer to <http://unlicense.org/>
 
 #include "lurds2_performanceCounter.h"
 
+#ifdef _WIN32
 #include <Windows.h>
 
 // frequency = ticks per second
 static LARGE_INTEGER PerformanceCounter_Frequency;
 
-static PerformanceCounter_RecordFrequency()
+static void PerformanceCounter_RecordFrequency()
 {
   if (PerformanceCounter_Frequency.QuadPart == 0)
   {
@@ -19,17 +20,38 @@ static PerformanceCounter_RecordFrequency()
   }
 }
 
+static void PerformanceCounter_Query(PerformanceCounter* now)
+{
+  QueryPerformanceCounter(now);
+}
+#else
+#include <time.h>
+
+static PerformanceCounter PerformanceCounter_Frequency = { 1000000000LL };
+
+static void PerformanceCounter_RecordFrequency()
+{
+}
+
+static void PerformanceCounter_Query(PerformanceCounter* now)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  now->QuadPart = (LONGLONG)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+#endif
+
 PerformanceCounter PerformanceCounter_Start()
 {
-  LARGE_INTEGER now;
-  QueryPerformanceCounter(&now);
+  PerformanceCounter now;
+  PerformanceCounter_Query(&now);
   return now;
 }
 
 LONGLONG PerformanceCounter_MeasureTicks(PerformanceCounter start)
 {
-  LARGE_INTEGER now;
-  QueryPerformanceCounter(&now);
+  PerformanceCounter now;
+  PerformanceCounter_Query(&now);
   return now.QuadPart - start.QuadPart;
 }
 
@@ -7,7 +7,13 @@ Please refer to <http://unlicense.org/>
 #ifndef LURDS2_PERFORMANCE_COUNTER
 #define LURDS2_PERFORMANCE_COUNTER
 
+#ifdef _WIN32
 typedef LARGE_INTEGER PerformanceCounter;
+#else
+// (headless builds: same shape as LARGE_INTEGER, counting nanoseconds)
+typedef long long LONGLONG;
+typedef struct PerformanceCounter { LONGLONG QuadPart; } PerformanceCounter;
+#endif
 
 PerformanceCounter PerformanceCounter_Start();
 LONGLONG           PerformanceCounter_MeasureTicks(PerformanceCounter start);
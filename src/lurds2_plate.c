@@ -7,6 +7,8 @@ Please refer to <http://unlicense.org/>
 #include "lurds2_plate.h"
 
 #include "lurds2_errors.h"
+#include "lurds2_arena.h"
+#include "lurds2_resourceCache.h"
 #include <wingdi.h>
 #include <GL/GL.h>
 
@@ -15,41 +17,44 @@ Please refer to <http://unlicense.org/>
 #define DIAGNOSTIC_PLATE_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3))
 #define DIAGNOSTIC_PLATE_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4))
 
+#define PLATE_CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define PLATE_ASYNC_ARENA_BLOCK_SIZE (1024 * 1024)
+#define PLATE_MAX_RELOADS 64
+
 typedef struct PaletteFile {
   PaletteFileId id;
   const wchar_t* fileName_w;
   const char* fileName;
-  const uint8_t* data;
 } PaletteFile;
 
 PaletteFile KnownPaletteFiles[] = {
-  { PaletteFileId_ARMITEMS, L"ARMITEMS.256", "ARMITEMS.256", 0 },
-  { PaletteFileId_ARMOURY, L"ARMOURY.256", "ARMOURY.256", 0 },
-  { PaletteFileId_BACKGRND, L"BACKGRND.256", "BACKGRND.256", 0 },
-  { PaletteFileId_BASE01, L"BASE01.256", "BASE01.256", 0 },
-  { PaletteFileId_BASE1A, L"BASE1A.256", "BASE1A.256", 0 },
-  { PaletteFileId_CAS_BACK, L"CAS_BACK.256", "CAS_BACK.256", 0 },
-  { PaletteFileId_CASTLE1, L"CASTLE1.256", "CASTLE1.256", 0 },
-  { PaletteFileId_CUSTOM, L"CUSTOM.256", "CUSTOM.256", 0 },
-  { PaletteFileId_DEMO, L"DEMO.256", "DEMO.256", 0 },
-  { PaletteFileId_DEMO1, L"DEMO1.256", "DEMO1.256", 0 },
-  { PaletteFileId_DEMO2, L"DEMO2.256", "DEMO2.256", 0 },
-  { PaletteFileId_GATEWAY, L"GATEWAY.256", "GATEWAY.256", 0 },
-  { PaletteFileId_GRTNOBLE, L"GRTNOBLE.256", "GRTNOBLE.256", 0 },
-  { PaletteFileId_LORDS2, L"LORDS2.256", "LORDS2.256", 0 },
-  { PaletteFileId_MERCHANT, L"MERCHANT.256", "MERCHANT.256", 0 },
-  { PaletteFileId_MISC_SEL, L"MISC_SEL.256", "MISC_SEL.256", 0 },
-  { PaletteFileId_SCORE1, L"SCORE1.256", "SCORE1.256", 0 },
-  { PaletteFileId_SCORE2, L"SCORE2.256", "SCORE2.256", 0 },
-  { PaletteFileId_SKIRCUST, L"SKIRCUST.256", "SKIRCUST.256", 0 },
-  { PaletteFileId_SKIRMISH, L"SKIRMISH.256", "SKIRMISH.256", 0 },
-  { PaletteFileId_SPRITE01, L"SPRITE01.256", "SPRITE01.256", 0 },
-  { PaletteFileId_SPRITE1A, L"SPRITE1A.256", "SPRITE1A.256", 0 },
-  { PaletteFileId_START, L"START.256", "START.256", 0 },
-  { PaletteFileId_T32_BAT1, L"T32_BAT1.256", "T32_BAT1.256", 0 },
-  { PaletteFileId_T32_STN1, L"T32_STN1.256", "T32_STN1.256", 0 },
-  { PaletteFileId_TITLE, L"TITLE.256", "TITLE.256", 0 },
-  { PaletteFileId_TREASURY, L"TREASURY.256", "TREASURY.256", 0 },
+  { PaletteFileId_ARMITEMS, L"ARMITEMS.256", "ARMITEMS.256" },
+  { PaletteFileId_ARMOURY, L"ARMOURY.256", "ARMOURY.256" },
+  { PaletteFileId_BACKGRND, L"BACKGRND.256", "BACKGRND.256" },
+  { PaletteFileId_BASE01, L"BASE01.256", "BASE01.256" },
+  { PaletteFileId_BASE1A, L"BASE1A.256", "BASE1A.256" },
+  { PaletteFileId_CAS_BACK, L"CAS_BACK.256", "CAS_BACK.256" },
+  { PaletteFileId_CASTLE1, L"CASTLE1.256", "CASTLE1.256" },
+  { PaletteFileId_CUSTOM, L"CUSTOM.256", "CUSTOM.256" },
+  { PaletteFileId_DEMO, L"DEMO.256", "DEMO.256" },
+  { PaletteFileId_DEMO1, L"DEMO1.256", "DEMO1.256" },
+  { PaletteFileId_DEMO2, L"DEMO2.256", "DEMO2.256" },
+  { PaletteFileId_GATEWAY, L"GATEWAY.256", "GATEWAY.256" },
+  { PaletteFileId_GRTNOBLE, L"GRTNOBLE.256", "GRTNOBLE.256" },
+  { PaletteFileId_LORDS2, L"LORDS2.256", "LORDS2.256" },
+  { PaletteFileId_MERCHANT, L"MERCHANT.256", "MERCHANT.256" },
+  { PaletteFileId_MISC_SEL, L"MISC_SEL.256", "MISC_SEL.256" },
+  { PaletteFileId_SCORE1, L"SCORE1.256", "SCORE1.256" },
+  { PaletteFileId_SCORE2, L"SCORE2.256", "SCORE2.256" },
+  { PaletteFileId_SKIRCUST, L"SKIRCUST.256", "SKIRCUST.256" },
+  { PaletteFileId_SKIRMISH, L"SKIRMISH.256", "SKIRMISH.256" },
+  { PaletteFileId_SPRITE01, L"SPRITE01.256", "SPRITE01.256" },
+  { PaletteFileId_SPRITE1A, L"SPRITE1A.256", "SPRITE1A.256" },
+  { PaletteFileId_START, L"START.256", "START.256" },
+  { PaletteFileId_T32_BAT1, L"T32_BAT1.256", "T32_BAT1.256" },
+  { PaletteFileId_T32_STN1, L"T32_STN1.256", "T32_STN1.256" },
+  { PaletteFileId_TITLE, L"TITLE.256", "TITLE.256" },
+  { PaletteFileId_TREASURY, L"TREASURY.256", "TREASURY.256" },
 };
 
 const char* PaletteFile_GetName(PaletteFileId id)
@@ -109,37 +114,69 @@ static void brightenRgb(uint8_t* rgb)
   rgb[2] = (uint8_t)b;
 }
 
-static const uint8_t* GetPalette(PaletteFileId id)
+// shares decoded plates and palettes; created on first use
+static ResourceCache PlateCache;
+
+static void Plate_FileChanged(void* userData, const char* name);
+
+static ResourceCache GetPlateCache()
+{
+  if (PlateCache == 0)
+  {
+    PlateCache = ResourceCache_Create(PLATE_CACHE_DEFAULT_BUDGET);
+    if (PlateCache != 0) ResourceFile_AddChangeListener(Plate_FileChanged, 0);
+  }
+  return PlateCache;
+}
+
+void Plate_SetCacheBudget(int64_t budgetBytes)
+{
+  ResourceCache cache = GetPlateCache();
+  if (cache == 0) return;
+  ResourceCache_SetBudget(cache, budgetBytes);
+}
+
+// returns the brightened palette with a reference taken; ResourceCache_Unref() it when done
+static const uint8_t* AcquirePalette(PaletteFileId id)
 {
   if (id < 0 || id >= PaletteFileId_END) {
     DIAGNOSTIC_PLATE_ERROR("invalid palette file id");
     return 0;
   }
   
+  ResourceCache cache = GetPlateCache();
+  if (cache == 0) return 0;
+
   PaletteFile* f = &KnownPaletteFiles[id];
-  if (f->data == 0)
+  char key[64];
+  int keyLength = sprintf(key, "palette:%s", f->fileName);
+  uint8_t* data = ResourceCache_Acquire(cache, key, keyLength);
+  if (data != 0) return data;
+
+  int fileLength;
+  data = ResourceFile_LoadLords2File(f->fileName_w, &fileLength);
+  if (data == 0) return 0;
+  
+  if (fileLength != 256 * 3) // one byte for each of R,G,B for each of the 256 palette indexes
   {
-    int fileLength;
-    uint8_t* data = ResourceFile_LoadLords2File(f->fileName_w, &fileLength);
-    if (data == 0) return 0;
-    
-    if (fileLength != 256 * 3) // one byte for each of R,G,B for each of the 256 palette indexes
-    {
-      DIAGNOSTIC_PLATE_ERROR("invalid palette file length");
-      free(data);
-      return 0;
-    }
-    
-    // Lords2 palettes are all oddly dark... so brighten them up some!
-    for (int i = 0; i < 256; i++)
-    {
-      brightenRgb(&data[i * 3]);
-    }
-    
-    f->data = data;
+    DIAGNOSTIC_PLATE_ERROR("invalid palette file length");
+    free(data);
+    return 0;
+  }
+  
+  // Lords2 palettes are all oddly dark... so brighten them up some!
+  int i;
+  for (i = 0; i < 256; i++)
+  {
+    brightenRgb(&data[i * 3]);
   }
 
-  return f->data;
+  if (ResourceCache_Add(cache, key, keyLength, data, fileLength, free) == 0)
+  {
+    free(data);
+    return 0;
+  }
+  return data;
 }
 
 typedef enum TileDataType {
@@ -442,50 +479,90 @@ typedef struct __attribute__((packed)) TileHeader {
   uint8_t unknown2; // always 0 except in FONT3C2.PL8 and FNTL2_22.PL8?
 } TileHeader;
 
-Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPalette)
+// decoded tiles are kept as pixels until they're all done, then packed onto atlas pages together
+// (on the main thread; load workers can't touch GL)
+typedef struct PlateTilePixels {
+  uint8_t* rgba;
+  int width;
+  int height;
+} PlateTilePixels;
+
+typedef struct PlateDecodeOutput {
+  Arena scratch; // where tile pixels are pushed
+  PlateTilePixels* tiles; // room for numTiles
+  int count;
+} PlateDecodeOutput;
+
+// (out->tiles has room for every tile in the file, and each tile is output at most once)
+static void Plate_OutputTile(PlateDecodeOutput* out, uint8_t* rgba, int width, int height)
 {
-  if (id < 0 || id >= PlateFileId_END)
+  out->tiles[out->count].rgba = rgba;
+  out->tiles[out->count].width = width;
+  out->tiles[out->count].height = height;
+  out->count++;
+}
+
+// makes the Bmps for decoded tiles (packed onto as few textures as fit them); returns them with a trailing null
+// pointer, or 0 on failure
+static Bmp* Plate_MakeBitmaps(PlateFileId id, const PlateTilePixels* tiles, int count)
+{
+  Arena scratch = Arena_GetFrameArena();
+  ArenaMark scratchMark = Arena_Mark(scratch);
+  Bmp* bitmaps = malloc(sizeof(Bmp) * (count + 1));
+  uint8_t** rgbaDatas = Arena_Push(scratch, sizeof(uint8_t*) * (count + 1));
+  int* sizes = Arena_Push(scratch, sizeof(int) * (count + 1) * 2);
+  if (bitmaps == 0 || rgbaDatas == 0 || sizes == 0) {
+    DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for bitmaps in plate file ", KnownPlateFiles[id].fileName);
+    goto error;
+  }
+
+  int* widths = sizes;
+  int* heights = sizes + count + 1;
+  int i;
+  for (i = 0; i < count; i++)
   {
-    DIAGNOSTIC_PLATE_ERROR("invalid plate file id");
-    return 0;
+    rgbaDatas[i] = tiles[i].rgba;
+    widths[i] = tiles[i].width;
+    heights[i] = tiles[i].height;
   }
-  
-  if ((customPalette < 0 || customPalette >= PaletteFileId_END) && customPalette != PaletteFileId_NONE)
+  if (!Bmp_LoadAtlas(rgbaDatas, widths, heights, count, bitmaps))
   {
-    DIAGNOSTIC_PLATE_ERROR("invalid customPalette arg");
-    return 0;
+    // diagnostic error already reported by Bmp_LoadAtlas()
+    goto error;
   }
+  bitmaps[count] = 0;
+  Arena_ResetToMark(scratch, scratchMark);
+  return bitmaps;
 
-  Bmp* bitmaps = 0;
-  PlateHeader* data = 0;
-  int fileLength = 0;
-
-  data = (PlateHeader*)ResourceFile_LoadLords2File(KnownPlateFiles[id].fileName_w, &fileLength);
-  if (data == 0) goto error;
+error:
+  if (bitmaps != 0) free(bitmaps);
+  Arena_ResetToMark(scratch, scratchMark);
+  return 0;
+}
 
+// returns the number of tiles in the plate file, or -1 when the file is invalid
+static int Plate_CheckHeader(PlateFileId id, const PlateHeader* data, int fileLength)
+{
   if (fileLength < sizeof(PlateHeader)) {
     DIAGNOSTIC_PLATE_ERROR2("unexpected too-small size of plate file", KnownPlateFiles[id].fileName);
-    goto error;
+    return -1;
   }
   
   if (data->numTiles > 5000) {
     DIAGNOSTIC_PLATE_ERROR2("unexpected too-large numTiles in plate file ", KnownPlateFiles[id].fileName);
-    goto error;
+    return -1;
   }
 
-  bitmaps = malloc(sizeof(Bmp) * (data->numTiles + 1));
-  if (bitmaps == 0) {
-    DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for bitmaps in plate file ", KnownPlateFiles[id].fileName);
-    goto error;
-  }
-  memset(bitmaps, 0, sizeof(Bmp) * (data->numTiles + 1));
+  return data->numTiles;
+}
 
-  // load a Bmp for every tile
-  // (TODO: I might need to be more clever and load them all into a single Bmp, but we'll do that when it becomes obviously necessary)
-  int nextBitmapIndex = 0;
-  uint8_t* start = (uint8_t*)data;
-  uint8_t* current = start + sizeof(PlateHeader);
-  uint8_t* end = start + fileLength;
+// decodes every tile of the (already checked) plate file into 'out'; returns 0 on failure
+static int Plate_DecodeTiles(PlateFileId id, const uint8_t* palette, const uint8_t* start, int fileLength, PlateDecodeOutput* out)
+{
+  // decode every tile
+  const PlateHeader* data = (const PlateHeader*)start;
+  const uint8_t* current = start + sizeof(PlateHeader);
+  const uint8_t* end = start + fileLength;
   for (int i = 0; i < data->numTiles; i++, current += sizeof(TileHeader))
   {
     if (current + sizeof(TileHeader) > end) {
@@ -493,7 +570,7 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
       goto error;
     }
 
-    TileHeader* t = (TileHeader*)current;
+    const TileHeader* t = (const TileHeader*)current;
 
     if (start + t->offset > end) {
       DIAGNOSTIC_PLATE_ERROR2("invalid plate file data in ", KnownPlateFiles[id].fileName);
@@ -505,23 +582,19 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
       continue;
     }
 
-    // the palette contains the RGB values to use for each of the available 256 palette indexes
-    const uint8_t* palette = GetPalette(customPalette == PaletteFileId_NONE ? KnownPlateFiles[id].paletteFileId : customPalette);
-    if (palette == 0) goto error;
-
     switch (KnownPlateFiles[id].tileDataType)
     {
       case TileDataType_BMP:
       {
         // each item in 'paletteNumbers' is a 0-255 index in the palette
-        uint8_t* paletteNumbers = start + t->offset;
+        const uint8_t* paletteNumbers = start + t->offset;
         if (paletteNumbers + t->width * t->height > end) {
           DIAGNOSTIC_PLATE_ERROR2("invalid plate file data in ", KnownPlateFiles[id].fileName);
           goto error;
         }
 
         // allocate space for RGBA for each pixel
-        uint8_t* rgbaData = malloc(t->height * t->width * 4);
+        uint8_t* rgbaData = Arena_Push(out->scratch, t->height * t->width * 4);
         if (rgbaData == 0) {
           DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for rgbaData for plate ", KnownPlateFiles[id].fileName);
           goto error;
@@ -548,31 +621,26 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
           }
         }
 
-        Bmp bitmap = Bmp_LoadFromRgba(rgbaData, t->width, t->height);
-        free(rgbaData);
-        if (bitmap == 0) goto error;
-        bitmaps[nextBitmapIndex++] = bitmap;
+        Plate_OutputTile(out, rgbaData, t->width, t->height);
       }
       break;
 
       case TileDataType_RLE:
       {
         // allocate space for RGBA for each pixel
-        uint8_t* rgbaData = malloc(t->height * t->width * 4);
+        uint8_t* rgbaData = Arena_PushZero(out->scratch, t->height * t->width * 4);
         if (rgbaData == 0) {
           DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for rgbaData for plate ", KnownPlateFiles[id].fileName);
           goto error;
         }
-        memset(rgbaData, 0, t->height * t->width * 4);
         
 #define CHECK_PAST_END(b) \
   if ((b) >= end) { \
     DIAGNOSTIC_PLATE_ERROR2("insufficient/invalid data in plate ", KnownPlateFiles[id].fileName); \
-    free(rgbaData); \
     goto error; \
   }
 
-        uint8_t* b = start + t->offset;
+        const uint8_t* b = start + t->offset;
         for (int h = 0; h < t->height; h++)
         {
           int wStart = h * t->width * 4;
@@ -592,7 +660,6 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
               if (w + numOpaquePixels - 1 >= t->width)
               {
                 DIAGNOSTIC_PLATE_ERROR2("invalid aggregate cell count in a row in RLE plate ", KnownPlateFiles[id].fileName);
-                free(rgbaData);
                 goto error;
               }
               
@@ -611,10 +678,7 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
           }
         }
         
-        Bmp bitmap = Bmp_LoadFromRgba(rgbaData, t->width, t->height);
-        free(rgbaData);
-        if (bitmap == 0) goto error;
-        bitmaps[nextBitmapIndex++] = bitmap;
+        Plate_OutputTile(out, rgbaData, t->width, t->height);
       }
       break;
       
@@ -629,22 +693,19 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
         
         // allocate space for final RGBA data
         int finalRgbaDataLength = 64 * 64 * 4; // I guess these things are always 64 wide, 64 tall
-        uint8_t* finalRgbaData = malloc(finalRgbaDataLength);
+        uint8_t* finalRgbaData = Arena_PushZero(out->scratch, finalRgbaDataLength);
         if (finalRgbaData == 0) {
           DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for finalRgbaData for plate ", KnownPlateFiles[id].fileName);
           goto error;
         }
-        memset(finalRgbaData, 0, finalRgbaDataLength);
 
         // allocate space for first-pass RGBA for each pixel
         int rgbaDataLength = t->height * t->width * 4;
-        uint8_t* rgbaData = malloc(rgbaDataLength);
+        uint8_t* rgbaData = Arena_PushZero(out->scratch, rgbaDataLength);
         if (rgbaData == 0) {
           DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for rgbaData for plate ", KnownPlateFiles[id].fileName);
-          free(finalRgbaData);
           goto error;
         }
-        memset(rgbaData, 0, t->height * t->width * 4);
         
         // this gets used later
         int extraHeight = 0;
@@ -654,13 +715,11 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
 #define CHECK_PAST_RGBA_LENGTH(p) \
   if ((p) >= rgbaDataLength) { \
     DIAGNOSTIC_PLATE_ERROR2("insufficient/invalid data in plate ", KnownPlateFiles[id].fileName); \
-    free(rgbaData); \
-    free(finalRgbaData); \
     goto error; \
   }
         
         // upper part of the tile
-        uint8_t* b = start + t->offset;
+        const uint8_t* b = start + t->offset;
         for (int h = 0; h < 15; h++)
         {
           int wStart = h * t->width * 4;
@@ -715,44 +774,29 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
           int halfWidth = t->width >> 1;
           extraHeight = t->extraRows + halfHeight;
           extraLength = extraHeight * t->width * 4;
-          extra = malloc(extraLength);
+          extra = Arena_PushZero(out->scratch, extraLength);
           if (extra == 0)
           {
             DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for extra for plate ", KnownPlateFiles[id].fileName);
-            free(rgbaData);
-            free(finalRgbaData);
             goto error;
           }
-          memset(extra, 0, extraLength);
           
-          uint8_t * row = malloc(t->width);
+          uint8_t * row = Arena_PushZero(out->scratch, t->width);
           if (row == 0)
           {
             DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for extra row for plate ", KnownPlateFiles[id].fileName);
-            free(rgbaData);
-            free(finalRgbaData);
-            free(extra);
             goto error;
           }
-          memset(row, 0, t->width);
           
 #define CHECK_PAST_EXTRA_END(b) \
   if ((b) >= end) { \
     DIAGNOSTIC_PLATE_ERROR2("insufficient/invalid data in plate ", KnownPlateFiles[id].fileName); \
-    free(rgbaData); \
-    free(finalRgbaData); \
-    free(extra); \
-    free(row); \
     goto error; \
   }
   
 #define CHECK_PAST_EXTRA_LENGTH(p) \
   if ((p) >= extraLength) { \
     DIAGNOSTIC_PLATE_ERROR2("insufficient/invalid data in plate ", KnownPlateFiles[id].fileName); \
-    free(rgbaData); \
-    free(finalRgbaData); \
-    free(extra); \
-    free(row); \
     goto error; \
   }
 
@@ -792,8 +836,6 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
               }
             }
           }
-          
-          free(row);
         }
         
         // remember that finalRgbaData has height=64, width=64
@@ -823,12 +865,7 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
         }
         
         // NOTE: original code added to tileset at t->y - 34
-        free(rgbaData);
-        free(extra);
-        Bmp bitmap = Bmp_LoadFromRgba(finalRgbaData, 64, 64);
-        free(finalRgbaData);
-        if (bitmap == 0) goto error;
-        bitmaps[nextBitmapIndex++] = bitmap;
+        Plate_OutputTile(out, finalRgbaData, 64, 64);
       }
       break;
 
@@ -841,15 +878,66 @@ Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPal
     }
   }
 
-  free(data);
-  return bitmaps;
+  return 1;
 
 error:
-  if (data != 0) free(data);
-  if (bitmaps != 0)
+  return 0;
+}
+
+Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPalette)
+{
+  if (id < 0 || id >= PlateFileId_END)
   {
-    Plate_Release(bitmaps);
+    DIAGNOSTIC_PLATE_ERROR("invalid plate file id");
+    return 0;
+  }
+  
+  if ((customPalette < 0 || customPalette >= PaletteFileId_END) && customPalette != PaletteFileId_NONE)
+  {
+    DIAGNOSTIC_PLATE_ERROR("invalid customPalette arg");
+    return 0;
+  }
+
+  Bmp* bitmaps = 0;
+  const PlateHeader* data = 0;
+  const uint8_t* palette = 0;
+  int fileLength = 0;
+
+  // the tiles' pixels are scratch memory, released again once they're on atlas pages
+  Arena scratch = Arena_GetFrameArena();
+  ArenaMark scratchMark = Arena_Mark(scratch);
+
+  data = (const PlateHeader*)ResourceFile_MapLords2File(KnownPlateFiles[id].fileName_w, &fileLength);
+  if (data == 0) goto error;
+
+  if (Plate_CheckHeader(id, data, fileLength) < 0) goto error;
+
+  // the palette contains the RGB values to use for each of the available 256 palette indexes
+  palette = AcquirePalette(customPalette == PaletteFileId_NONE ? KnownPlateFiles[id].paletteFileId : customPalette);
+  if (palette == 0) goto error;
+
+  PlateDecodeOutput out;
+  out.scratch = scratch;
+  out.tiles = Arena_Push(scratch, sizeof(PlateTilePixels) * (data->numTiles + 1));
+  out.count = 0;
+  if (out.tiles == 0) {
+    DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for tiles for plate ", KnownPlateFiles[id].fileName);
+    goto error;
   }
+  if (!Plate_DecodeTiles(id, palette, (const uint8_t*)data, fileLength, &out)) goto error;
+
+  bitmaps = Plate_MakeBitmaps(id, out.tiles, out.count);
+  if (bitmaps == 0) goto error;
+
+  Arena_ResetToMark(scratch, scratchMark);
+  ResourceCache_Unref(PlateCache, palette);
+  ResourceFile_Unmap(data);
+  return bitmaps;
+
+error:
+  Arena_ResetToMark(scratch, scratchMark);
+  if (palette != 0) ResourceCache_Unref(PlateCache, palette);
+  if (data != 0) ResourceFile_Unmap(data);
   return 0;
 }
 
@@ -858,6 +946,199 @@ Bmp* Plate_LoadFromFile(PlateFileId id)
   return Plate_LoadFromFileWithCustomPalette(id, PaletteFileId_NONE);
 }
 
+static void Plate_ReleaseCached(void* bitmaps)
+{
+  Plate_Release(bitmaps);
+}
+
+// keyed by what was decoded, so asking for a plate's default palette by name shares the same bitmaps
+static int Plate_GetSharedKey(char* key, PlateFileId id, PaletteFileId paletteFileId)
+{
+  return sprintf(key, "plate:%s:%s", KnownPlateFiles[id].fileName, KnownPaletteFiles[paletteFileId].fileName);
+}
+
+// caches freshly loaded bitmaps (releasing them on failure); returns them with a reference taken, or 0
+static Bmp* Plate_AddShared(const char* key, int keyLength, Bmp* bitmaps)
+{
+  // counted by the RGBA texture memory they hold
+  int64_t sizeBytes = 0;
+  Bmp* b;
+  for (b = bitmaps; *b != 0; b++)
+  {
+    sizeBytes += (int64_t)Bmp_GetWidth(*b) * Bmp_GetHeight(*b) * 4;
+  }
+
+  if (ResourceCache_Add(PlateCache, key, keyLength, bitmaps, sizeBytes, Plate_ReleaseCached) == 0)
+  {
+    Plate_Release(bitmaps);
+    return 0;
+  }
+  return bitmaps;
+}
+
+Bmp* Plate_LoadShared(PlateFileId id, PaletteFileId customPalette)
+{
+  if (id < 0 || id >= PlateFileId_END)
+  {
+    DIAGNOSTIC_PLATE_ERROR("invalid plate file id");
+    return 0;
+  }
+  
+  if ((customPalette < 0 || customPalette >= PaletteFileId_END) && customPalette != PaletteFileId_NONE)
+  {
+    DIAGNOSTIC_PLATE_ERROR("invalid customPalette arg");
+    return 0;
+  }
+
+  ResourceCache cache = GetPlateCache();
+  if (cache == 0) return 0;
+
+  PaletteFileId paletteFileId = customPalette == PaletteFileId_NONE ? KnownPlateFiles[id].paletteFileId : customPalette;
+  char key[64];
+  int keyLength = Plate_GetSharedKey(key, id, paletteFileId);
+  Bmp* bitmaps = ResourceCache_Acquire(cache, key, keyLength);
+  if (bitmaps != 0) return bitmaps;
+
+  bitmaps = Plate_LoadFromFileWithCustomPalette(id, paletteFileId);
+  if (bitmaps == 0) return 0;
+
+  return Plate_AddShared(key, keyLength, bitmaps);
+}
+
+typedef struct PlateAsyncLoad {
+  PlateFileId id;
+  const uint8_t* palette; // referenced until the load finishes, since workers can't touch the cache
+  PlateLoadedFunc loaded;
+  void* userData;
+  char key[64];
+  int keyLength;
+  // set by the load worker
+  Arena pixels;
+  PlateTilePixels* tiles;
+  int count;
+} PlateAsyncLoad;
+
+// (runs on a load worker)
+static void* Plate_DecodeAsync(void* userData, const void* fileData, int fileLength)
+{
+  PlateAsyncLoad* load = userData;
+  int numTiles = Plate_CheckHeader(load->id, fileData, fileLength);
+  if (numTiles < 0) return 0;
+
+  load->pixels = Arena_Create(PLATE_ASYNC_ARENA_BLOCK_SIZE);
+  if (load->pixels == 0) return 0;
+
+  PlateDecodeOutput out;
+  out.scratch = load->pixels;
+  out.tiles = Arena_Push(load->pixels, sizeof(PlateTilePixels) * (numTiles + 1));
+  out.count = 0;
+  if (out.tiles == 0) {
+    DIAGNOSTIC_PLATE_ERROR2("failed to allocate memory for tiles for plate ", KnownPlateFiles[load->id].fileName);
+    return 0;
+  }
+  if (!Plate_DecodeTiles(load->id, load->palette, fileData, fileLength, &out)) return 0;
+
+  load->tiles = out.tiles;
+  load->count = out.count;
+  return load;
+}
+
+static void Plate_LoadedAsync(void* userData, void* result, int fileLength)
+{
+  PlateAsyncLoad* load = userData;
+  Bmp* bitmaps = 0;
+  if (result != 0)
+  {
+    // the same plate may have been loaded (and cached) while this one was in flight
+    bitmaps = ResourceCache_Acquire(PlateCache, load->key, load->keyLength);
+    if (bitmaps == 0)
+    {
+      // (runs on the main thread) makes the Bmps from the pixels the worker decoded
+      bitmaps = Plate_MakeBitmaps(load->id, load->tiles, load->count);
+      if (bitmaps != 0) bitmaps = Plate_AddShared(load->key, load->keyLength, bitmaps);
+    }
+  }
+
+  ResourceCache_Unref(PlateCache, load->palette);
+  if (load->pixels != 0) Arena_Release(load->pixels);
+  load->loaded(load->userData, bitmaps);
+  free(load);
+}
+
+int Plate_LoadSharedAsync(PlateFileId id, PaletteFileId customPalette, PlateLoadedFunc loaded, void* userData)
+{
+  if (id < 0 || id >= PlateFileId_END)
+  {
+    DIAGNOSTIC_PLATE_ERROR("invalid plate file id");
+    return 0;
+  }
+  
+  if ((customPalette < 0 || customPalette >= PaletteFileId_END) && customPalette != PaletteFileId_NONE)
+  {
+    DIAGNOSTIC_PLATE_ERROR("invalid customPalette arg");
+    return 0;
+  }
+
+  if (loaded == 0)
+  {
+    DIAGNOSTIC_PLATE_ERROR("invalid null loaded arg");
+    return 0;
+  }
+
+  ResourceCache cache = GetPlateCache();
+  if (cache == 0) return 0;
+
+  PaletteFileId paletteFileId = customPalette == PaletteFileId_NONE ? KnownPlateFiles[id].paletteFileId : customPalette;
+  char key[64];
+  int keyLength = Plate_GetSharedKey(key, id, paletteFileId);
+  Bmp* bitmaps = ResourceCache_Acquire(cache, key, keyLength);
+  if (bitmaps != 0)
+  {
+    loaded(userData, bitmaps);
+    return 1;
+  }
+
+  PlateAsyncLoad* load = malloc(sizeof(PlateAsyncLoad));
+  if (load == 0) {
+    DIAGNOSTIC_PLATE_ERROR("failed to allocate memory for PlateAsyncLoad");
+    return 0;
+  }
+  memset(load, 0, sizeof(PlateAsyncLoad));
+  load->id = id;
+  load->loaded = loaded;
+  load->userData = userData;
+  memcpy(load->key, key, keyLength);
+  load->keyLength = keyLength;
+
+  // (palettes are tiny, so they're still loaded right here)
+  load->palette = AcquirePalette(paletteFileId);
+  if (load->palette == 0) goto error;
+
+  if (!ResourceFile_LoadLords2FileAsync(KnownPlateFiles[id].fileName_w, Plate_DecodeAsync, Plate_LoadedAsync, load)) goto error;
+  return 1;
+
+error:
+  if (load->palette != 0) ResourceCache_Unref(cache, load->palette);
+  free(load);
+  return 0;
+}
+
+void Plate_ReleaseShared(Bmp* bitmaps)
+{
+  if (bitmaps == 0)
+  {
+    DIAGNOSTIC_PLATE_ERROR("invalid null bitmaps arg");
+    return;
+  }
+  if (PlateCache == 0)
+  {
+    DIAGNOSTIC_PLATE_ERROR("bitmaps weren't loaded with Plate_LoadShared()");
+    return;
+  }
+
+  ResourceCache_Unref(PlateCache, bitmaps);
+}
+
 void Plate_Release(Bmp* bitmaps)
 {
   if (bitmaps == 0)
@@ -876,4 +1157,104 @@ void Plate_Release(Bmp* bitmaps)
   
   // then free the bitmaps
   free(bitmaps);
-}
\ No newline at end of file
+}
+
+// finds the plate (and palette) a shared plate's key names; returns 0 when it isn't a plate key
+static int Plate_ParseSharedKey(const char* key, int keyLength, PlateFileId* id, PaletteFileId* paletteFileId)
+{
+  char copy[64];
+  if (keyLength < 6 || keyLength >= sizeof(copy) || memcmp(key, "plate:", 6) != 0) return 0;
+  memcpy(copy, key, keyLength);
+  copy[keyLength] = 0;
+  char* separator = strchr(copy + 6, ':');
+  if (separator == 0) return 0;
+  *separator = 0;
+
+  *id = PlateFileId_END;
+  *paletteFileId = PaletteFileId_END;
+  int i;
+  for (i = 0; i < PlateFileId_END && *id == PlateFileId_END; i++)
+  {
+    if (strcmp(KnownPlateFiles[i].fileName, copy + 6) == 0) *id = i;
+  }
+  for (i = 0; i < PaletteFileId_END && *paletteFileId == PaletteFileId_END; i++)
+  {
+    if (strcmp(KnownPaletteFiles[i].fileName, separator + 1) == 0) *paletteFileId = i;
+  }
+  return *id != PlateFileId_END && *paletteFileId != PaletteFileId_END;
+}
+
+// (a ResourceFileChangedFunc) reloads the shared plates that a changed Lords2 file went into
+static void Plate_FileChanged(void* userData, const char* name)
+{
+  // Known*Files names are uppercase; vfs names are lowercase
+  char fileName[32];
+  int length = strlen(name);
+  if (PlateCache == 0 || length <= 7 || length - 7 >= sizeof(fileName) || memcmp(name, "lords2/", 7) != 0) return;
+  int i;
+  for (i = 7; i <= length; i++)
+  {
+    fileName[i - 7] = (name[i] >= 'a' && name[i] <= 'z') ? name[i] - ('a' - 'A') : name[i];
+  }
+
+  // Unused plates and palettes are just dropped, to be loaded again when they're next asked for. Plates in use are
+  // gathered first (reloading them adds to the cache) and then reloaded into the Bmps their users already hold.
+  Bmp* inUse[PLATE_MAX_RELOADS];
+  char keys[PLATE_MAX_RELOADS][64];
+  int keyLengths[PLATE_MAX_RELOADS];
+  int inUseCount = 0;
+  int32_t position = 0;
+  const void* key;
+  int32_t keyLength;
+  int32_t refCount;
+  void* value;
+  while ((value = ResourceCache_Next(PlateCache, &position, &key, &keyLength, &refCount)) != 0)
+  {
+    PlateFileId id;
+    PaletteFileId paletteFileId;
+    int isPalette = keyLength == 8 + length - 7 && memcmp(key, "palette:", 8) == 0 && memcmp((const char*)key + 8, fileName, length - 7) == 0;
+    int isPlate = !isPalette && Plate_ParseSharedKey(key, keyLength, &id, &paletteFileId)
+      && (strcmp(KnownPlateFiles[id].fileName, fileName) == 0 || strcmp(KnownPaletteFiles[paletteFileId].fileName, fileName) == 0);
+    if (!isPalette && !isPlate) continue;
+
+    if (isPalette || refCount == 0 || inUseCount == PLATE_MAX_RELOADS)
+    {
+      ResourceCache_Invalidate(PlateCache, value);
+    }
+    else
+    {
+      inUse[inUseCount] = value;
+      memcpy(keys[inUseCount], key, keyLength);
+      keyLengths[inUseCount] = keyLength;
+      inUseCount++;
+    }
+  }
+
+  for (i = 0; i < inUseCount; i++)
+  {
+    PlateFileId id;
+    PaletteFileId paletteFileId;
+    Plate_ParseSharedKey(keys[i], keyLengths[i], &id, &paletteFileId);
+    Bmp* reloaded = Plate_LoadFromFileWithCustomPalette(id, paletteFileId);
+    if (reloaded == 0) continue; // (diagnostic already reported; they keep the old ones)
+
+    int oldCount = 0;
+    int newCount = 0;
+    while (inUse[i][oldCount] != 0) oldCount++;
+    while (reloaded[newCount] != 0) newCount++;
+    if (oldCount == newCount)
+    {
+      // same tiles, new pixels: the users' Bmps take the new textures, and the old ones are released
+      int j;
+      for (j = 0; j < oldCount; j++) Bmp_Swap(inUse[i][j], reloaded[j]);
+      Plate_Release(reloaded);
+    }
+    else
+    {
+      // the tiles changed, so the users keep what they have until they release it, and new users get the new ones
+      ResourceCache_Invalidate(PlateCache, inUse[i]);
+      reloaded = Plate_AddShared(keys[i], keyLengths[i], reloaded);
+      if (reloaded != 0) ResourceCache_Unref(PlateCache, reloaded);
+    }
+  }
+}
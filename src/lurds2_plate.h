@@ -304,4 +304,19 @@ Bmp* Plate_LoadFromFile(PlateFileId id);
 Bmp* Plate_LoadFromFileWithCustomPalette(PlateFileId id, PaletteFileId customPalette);
 void Plate_Release(Bmp* bitmaps);
 
+// Like Plate_LoadFromFileWithCustomPalette(), but everyone asking for the same plate+palette shares one set of
+// bitmaps (so don't change or release them individually). Release them with Plate_ReleaseShared(); they stay
+// cached afterwards, so loading them again is instant until the cache budget (64MB by default) needs the room.
+Bmp* Plate_LoadShared(PlateFileId id, PaletteFileId customPalette);
+void Plate_ReleaseShared(Bmp* bitmaps);
+
+// gets the shared bitmaps (0 on failure) once Plate_LoadSharedAsync() finishes; Plate_ReleaseShared() them as usual
+typedef void (*PlateLoadedFunc)(void* userData, Bmp* bitmaps);
+// Like Plate_LoadShared(), but the file is read and decoded on a load worker and only the textures are made on the
+// main thread, from ResourceFile_DispatchLoaded(). When the plate is already cached, 'loaded' is called before
+// this returns. Returns 0 on failure, in which case 'loaded' won't be called.
+int  Plate_LoadSharedAsync(PlateFileId id, PaletteFileId customPalette, PlateLoadedFunc loaded, void* userData);
+// sets how much texture memory unused shared plates (and palettes) may keep; 0 frees all unused ones now
+void Plate_SetCacheBudget(int64_t budgetBytes);
+
 #endif
\ No newline at end of file
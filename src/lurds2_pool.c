@@ -0,0 +1,240 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_pool.h"
+
+#include "lurds2_errors.h"
+
+#define DIAGNOSTIC_POOL_ERROR(message) DIAGNOSTIC_ERROR(message);
+#define DIAGNOSTIC_POOL_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
+#define DIAGNOSTIC_POOL_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3));
+#define DIAGNOSTIC_POOL_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
+
+#define POOL_INDEX_BITS 20
+#define POOL_INDEX_MASK ((1 << POOL_INDEX_BITS) - 1)
+#define POOL_GENERATION_MASK 0xFFF
+#define POOL_PAGE_BYTES (64 * 1024) // pages hold as many elements as fit in this (at least 1)
+
+typedef struct PoolSlot {
+  uint16_t generation; // 1..POOL_GENERATION_MASK
+  uint16_t isAlive;
+  int32_t nextFree; // next slot in the free list (-1 ends it)
+} PoolSlot;
+
+typedef struct PoolData {
+  int32_t elementSize; // rounded up to 8 so elements stay aligned
+  int32_t pageShift; // a page holds (1 << pageShift) elements
+  int32_t count;
+  int32_t capacity; // slots in all pages
+  int32_t firstFree; // -1 when all slots are in use
+  int32_t pageCount;
+  int8_t** pages;
+  PoolSlot* slots;
+} PoolData;
+
+#define POOL_ELEMENT(data, index) ((data)->pages[(index) >> (data)->pageShift] + (size_t)((index) & ((1 << (data)->pageShift) - 1)) * (data)->elementSize)
+
+Pool Pool_Create(int32_t elementSize)
+{
+  if (elementSize <= 0 || elementSize > 0x1000000)
+  {
+    DIAGNOSTIC_POOL_ERROR("invalid elementSize arg");
+    return 0;
+  }
+
+  PoolData* data = malloc(sizeof(PoolData));
+  if (data == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("failed to allocate memory for PoolData");
+    return 0;
+  }
+  memset(data, 0, sizeof(PoolData));
+  data->elementSize = (elementSize + 7) & ~7;
+  while (data->pageShift < 16 && ((int64_t)data->elementSize << (data->pageShift + 1)) <= POOL_PAGE_BYTES)
+  {
+    data->pageShift++;
+  }
+  data->firstFree = -1;
+  return data;
+}
+
+void Pool_Release(Pool pool)
+{
+  PoolData* data = (PoolData*)pool;
+  if (data == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("invalid null arg");
+    return;
+  }
+
+  int32_t i;
+  for (i = 0; i < data->pageCount; i++) free(data->pages[i]);
+  free(data->pages);
+  free(data->slots);
+  free(data);
+}
+
+// adds a page of free slots
+static int Pool_Grow(PoolData* data)
+{
+  int32_t pageElements = 1 << data->pageShift;
+  if (data->capacity + pageElements > POOL_INDEX_MASK + 1)
+  {
+    DIAGNOSTIC_POOL_ERROR("pool is full");
+    return 0;
+  }
+
+  int8_t** pages = realloc(data->pages, (data->pageCount + 1) * sizeof(int8_t*));
+  if (pages == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("failed to allocate memory for pool pages");
+    return 0;
+  }
+  data->pages = pages;
+
+  PoolSlot* slots = realloc(data->slots, (data->capacity + pageElements) * sizeof(PoolSlot));
+  if (slots == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("failed to allocate memory for pool slots");
+    return 0;
+  }
+  data->slots = slots;
+
+  int8_t* page = malloc((size_t)data->elementSize * pageElements);
+  if (page == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("failed to allocate memory for pool page");
+    return 0;
+  }
+  data->pages[data->pageCount++] = page;
+
+  // chain the new slots so the lowest index gets used first
+  int32_t i;
+  for (i = pageElements - 1; i >= 0; i--)
+  {
+    PoolSlot* slot = &data->slots[data->capacity + i];
+    slot->generation = 1;
+    slot->isAlive = 0;
+    slot->nextFree = data->firstFree;
+    data->firstFree = data->capacity + i;
+  }
+  data->capacity += pageElements;
+  return 1;
+}
+
+void* Pool_Add(Pool pool, PoolHandle* handle)
+{
+  PoolData* data = (PoolData*)pool;
+  if (data == 0 || handle == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("invalid null arg");
+    return 0;
+  }
+
+  if (data->firstFree < 0 && !Pool_Grow(data))
+  {
+    return 0;
+  }
+
+  int32_t index = data->firstFree;
+  PoolSlot* slot = &data->slots[index];
+  data->firstFree = slot->nextFree;
+  slot->isAlive = 1;
+  slot->nextFree = -1;
+  data->count++;
+
+  *handle = ((PoolHandle)slot->generation << POOL_INDEX_BITS) | (PoolHandle)index;
+  void* element = POOL_ELEMENT(data, index);
+  memset(element, 0, data->elementSize);
+  return element;
+}
+
+// returns the slot index for a live handle, or -1
+static int32_t Pool_Find(PoolData* data, PoolHandle handle)
+{
+  int32_t index = (int32_t)(handle & POOL_INDEX_MASK);
+  if (index >= data->capacity) return -1;
+  PoolSlot* slot = &data->slots[index];
+  if (!slot->isAlive || slot->generation != (handle >> POOL_INDEX_BITS)) return -1;
+  return index;
+}
+
+void* Pool_Get(Pool pool, PoolHandle handle)
+{
+  PoolData* data = (PoolData*)pool;
+  if (data == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("invalid null arg");
+    return 0;
+  }
+
+  int32_t index = Pool_Find(data, handle);
+  return index < 0 ? 0 : POOL_ELEMENT(data, index);
+}
+
+int Pool_Remove(Pool pool, PoolHandle handle)
+{
+  PoolData* data = (PoolData*)pool;
+  if (data == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("invalid null arg");
+    return 0;
+  }
+
+  int32_t index = Pool_Find(data, handle);
+  if (index < 0) return 0;
+
+  // bump the generation (skipping 0, so no handle is ever 0) to invalidate outstanding handles
+  PoolSlot* slot = &data->slots[index];
+  slot->generation = (slot->generation & POOL_GENERATION_MASK) == POOL_GENERATION_MASK ? 1 : slot->generation + 1;
+  slot->isAlive = 0;
+  slot->nextFree = data->firstFree;
+  data->firstFree = index;
+  data->count--;
+  return 1;
+}
+
+int32_t Pool_Count(Pool pool)
+{
+  PoolData* data = (PoolData*)pool;
+  if (data == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("invalid null arg");
+    return 0;
+  }
+
+  return data->count;
+}
+
+void* Pool_Next(Pool pool, int32_t* position, PoolHandle* handle)
+{
+  PoolData* data = (PoolData*)pool;
+  if (data == 0 || position == 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("invalid null arg");
+    return 0;
+  }
+
+  if (*position < 0)
+  {
+    DIAGNOSTIC_POOL_ERROR("invalid negative position arg");
+    return 0;
+  }
+
+  int32_t index;
+  for (index = *position; index < data->capacity; index++)
+  {
+    PoolSlot* slot = &data->slots[index];
+    if (slot->isAlive)
+    {
+      *position = index + 1;
+      if (handle) *handle = ((PoolHandle)slot->generation << POOL_INDEX_BITS) | (PoolHandle)index;
+      return POOL_ELEMENT(data, index);
+    }
+  }
+  *position = data->capacity;
+  return 0;
+}
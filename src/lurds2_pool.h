@@ -0,0 +1,39 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_POOL
+#define LURDS2_POOL
+
+typedef void* Pool;
+
+// identifies an element in a pool: the slot index in the low 20 bits and the slot's generation in the high 12
+// (bumped every time the slot is freed, so handles to removed elements stop resolving). Never 0.
+typedef uint32_t PoolHandle;
+
+// for modules whose public types are still void* typedefs (Bmp, Font...) but carry a PoolHandle
+#define POOL_HANDLE_TO_PTR(handle) ((void*)(uintptr_t)(handle))
+#define POOL_PTR_TO_HANDLE(ptr) ((PoolHandle)(uintptr_t)(ptr))
+
+// A Pool stores same-sized elements in big pages and hands out generational handles to them.
+// Removed slots are reused, so adding and removing elements doesn't malloc, and a stale handle is
+// detected in O(1) instead of touching freed memory. Element addresses never move while the element lives.
+// Not thread-safe; callers sharing a pool across threads must lock around it.
+Pool    Pool_Create(int32_t elementSize);
+void    Pool_Release(Pool pool);
+
+// returns a new zeroed element and writes its handle to 'handle', or returns 0 on failure
+void*   Pool_Add(Pool pool, PoolHandle* handle);
+// returns the handle's element, or 0 when the handle is stale or was never valid
+void*   Pool_Get(Pool pool, PoolHandle handle);
+// returns 1 if the handle's element was there (and is now gone)
+int     Pool_Remove(Pool pool, PoolHandle handle);
+int32_t Pool_Count(Pool pool);
+
+// visits every live element in slot order: start with *position = 0 and call until it returns 0.
+// 'handle' (optional) receives each element's handle. Removing the visited element while iterating is fine.
+void*   Pool_Next(Pool pool, int32_t* position, PoolHandle* handle);
+
+#endif
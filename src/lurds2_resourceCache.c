@@ -0,0 +1,351 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_resourceCache.h"
+
+#include "lurds2_errors.h"
+#include "lurds2_hash.h"
+#include "lurds2_hashmap.h"
+#include "lurds2_pool.h"
+
+#define DIAGNOSTIC_RESOURCECACHE_ERROR(message) DIAGNOSTIC_ERROR(message);
+#define DIAGNOSTIC_RESOURCECACHE_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
+#define DIAGNOSTIC_RESOURCECACHE_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3));
+#define DIAGNOSTIC_RESOURCECACHE_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
+
+#define RESOURCECACHE_SEED 0x6C75726473324361ULL
+
+typedef struct ResourceCacheEntry {
+  uint64_t keyHash;
+  char* key; // a copy, so hash collisions are caught instead of handing out the wrong value
+  int32_t keyLength;
+  int32_t refCount;
+  int invalidated; // no longer found by key; freed as soon as nobody references it
+  void* value;
+  int64_t sizeBytes;
+  ResourceCacheReleaseFunc release;
+  PoolHandle lruPrev; // unreferenced entries form the LRU list; 0 ends it
+  PoolHandle lruNext;
+} ResourceCacheEntry;
+
+typedef struct ResourceCacheData {
+  Pool entries;
+  HashMap byKey; // keyHash -> PoolHandle
+  HashMap byValue; // value pointer -> PoolHandle
+  PoolHandle lruOldest; // evicted first
+  PoolHandle lruNewest;
+  int64_t budgetBytes;
+  int64_t usedBytes;
+} ResourceCacheData;
+
+ResourceCache ResourceCache_Create(int64_t budgetBytes)
+{
+  if (budgetBytes < 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid budgetBytes arg");
+    return 0;
+  }
+
+  ResourceCacheData* data = malloc(sizeof(ResourceCacheData));
+  if (data == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("failed to allocate memory for ResourceCacheData");
+    return 0;
+  }
+  memset(data, 0, sizeof(ResourceCacheData));
+  data->budgetBytes = budgetBytes;
+
+  data->entries = Pool_Create(sizeof(ResourceCacheEntry));
+  if (data->entries == 0) goto error;
+  data->byKey = HashMap_Create(sizeof(uint64_t), sizeof(PoolHandle));
+  if (data->byKey == 0) goto error;
+  data->byValue = HashMap_Create(sizeof(void*), sizeof(PoolHandle));
+  if (data->byValue == 0) goto error;
+
+  return data;
+
+error:
+  if (data->entries != 0) Pool_Release(data->entries);
+  if (data->byKey != 0) HashMap_Release(data->byKey);
+  free(data);
+  return 0;
+}
+
+static void ResourceCache_LruUnlink(ResourceCacheData* data, ResourceCacheEntry* entry)
+{
+  ResourceCacheEntry* prev = entry->lruPrev ? Pool_Get(data->entries, entry->lruPrev) : 0;
+  ResourceCacheEntry* next = entry->lruNext ? Pool_Get(data->entries, entry->lruNext) : 0;
+  if (prev != 0) prev->lruNext = entry->lruNext;
+  else data->lruOldest = entry->lruNext;
+  if (next != 0) next->lruPrev = entry->lruPrev;
+  else data->lruNewest = entry->lruPrev;
+  entry->lruPrev = 0;
+  entry->lruNext = 0;
+}
+
+static void ResourceCache_LruPushNewest(ResourceCacheData* data, ResourceCacheEntry* entry, PoolHandle handle)
+{
+  entry->lruPrev = data->lruNewest;
+  entry->lruNext = 0;
+  ResourceCacheEntry* newest = data->lruNewest ? Pool_Get(data->entries, data->lruNewest) : 0;
+  if (newest != 0) newest->lruNext = handle;
+  else data->lruOldest = handle;
+  data->lruNewest = handle;
+}
+
+static void ResourceCache_Free(ResourceCacheData* data, ResourceCacheEntry* entry, PoolHandle handle)
+{
+  if (!entry->invalidated) HashMap_Remove(data->byKey, &entry->keyHash); // (else the key may belong to a newer entry)
+  HashMap_Remove(data->byValue, &entry->value);
+  data->usedBytes -= entry->sizeBytes;
+  if (entry->release != 0) entry->release(entry->value);
+  free(entry->key);
+  Pool_Remove(data->entries, handle);
+}
+
+static void ResourceCache_Evict(ResourceCacheData* data)
+{
+  while (data->usedBytes > data->budgetBytes && data->lruOldest != 0)
+  {
+    PoolHandle handle = data->lruOldest;
+    ResourceCacheEntry* entry = Pool_Get(data->entries, handle);
+    ResourceCache_LruUnlink(data, entry);
+    ResourceCache_Free(data, entry, handle);
+  }
+}
+
+void ResourceCache_Release(ResourceCache cache)
+{
+  ResourceCacheData* data = cache;
+  if (data == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid null cache arg");
+    return;
+  }
+
+  PoolHandle handle;
+  int32_t position = 0;
+  ResourceCacheEntry* entry;
+  while ((entry = Pool_Next(data->entries, &position, &handle)) != 0)
+  {
+    if (entry->refCount != 0)
+    {
+      DIAGNOSTIC_RESOURCECACHE_ERROR("releasing cache while a value is still referenced");
+    }
+    ResourceCache_Free(data, entry, handle);
+  }
+
+  Pool_Release(data->entries);
+  HashMap_Release(data->byKey);
+  HashMap_Release(data->byValue);
+  free(data);
+}
+
+void ResourceCache_SetBudget(ResourceCache cache, int64_t budgetBytes)
+{
+  ResourceCacheData* data = cache;
+  if (data == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid null cache arg");
+    return;
+  }
+  if (budgetBytes < 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid budgetBytes arg");
+    return;
+  }
+
+  data->budgetBytes = budgetBytes;
+  ResourceCache_Evict(data);
+}
+
+void* ResourceCache_Acquire(ResourceCache cache, const void* key, int32_t keyLength)
+{
+  ResourceCacheData* data = cache;
+  if (data == 0 || key == 0 || keyLength <= 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid null cache/key arg");
+    return 0;
+  }
+
+  uint64_t keyHash = Hash_Bytes(key, keyLength, RESOURCECACHE_SEED);
+  PoolHandle* handle = HashMap_Get(data->byKey, &keyHash);
+  if (handle == 0) return 0;
+
+  ResourceCacheEntry* entry = Pool_Get(data->entries, *handle);
+  if (entry->keyLength != keyLength || memcmp(entry->key, key, keyLength) != 0) return 0; // a different key with the same hash
+
+  if (entry->refCount == 0) ResourceCache_LruUnlink(data, entry);
+  entry->refCount++;
+  return entry->value;
+}
+
+void* ResourceCache_Add(ResourceCache cache, const void* key, int32_t keyLength, void* value, int64_t sizeBytes, ResourceCacheReleaseFunc release)
+{
+  ResourceCacheData* data = cache;
+  if (data == 0 || key == 0 || keyLength <= 0 || value == 0 || sizeBytes < 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid null cache/key/value arg");
+    return 0;
+  }
+
+  uint64_t keyHash = Hash_Bytes(key, keyLength, RESOURCECACHE_SEED);
+  if (HashMap_Get(data->byKey, &keyHash) != 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("key (or another key with the same hash) is already cached");
+    return 0;
+  }
+  if (HashMap_Get(data->byValue, &value) != 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("value is already cached under another key");
+    return 0;
+  }
+
+  char* keyCopy = malloc(keyLength);
+  if (keyCopy == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("failed to allocate memory for key");
+    return 0;
+  }
+  memcpy(keyCopy, key, keyLength);
+
+  PoolHandle handle;
+  ResourceCacheEntry* entry = Pool_Add(data->entries, &handle);
+  if (entry == 0) goto error;
+  if (HashMap_Set(data->byKey, &keyHash, &handle) == 0) goto error;
+  if (HashMap_Set(data->byValue, &value, &handle) == 0) goto error;
+
+  entry->keyHash = keyHash;
+  entry->key = keyCopy;
+  entry->keyLength = keyLength;
+  entry->refCount = 1;
+  entry->invalidated = 0;
+  entry->value = value;
+  entry->sizeBytes = sizeBytes;
+  entry->release = release;
+  data->usedBytes += sizeBytes;
+
+  // make room for it by dropping values nobody uses any more
+  ResourceCache_Evict(data);
+  return value;
+
+error:
+  HashMap_Remove(data->byKey, &keyHash);
+  HashMap_Remove(data->byValue, &value);
+  if (entry != 0) Pool_Remove(data->entries, handle);
+  free(keyCopy);
+  return 0;
+}
+
+void ResourceCache_Unref(ResourceCache cache, const void* value)
+{
+  ResourceCacheData* data = cache;
+  if (data == 0 || value == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid null cache/value arg");
+    return;
+  }
+
+  PoolHandle* handle = HashMap_Get(data->byValue, &value);
+  if (handle == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("value isn't cached (already evicted?)");
+    return;
+  }
+
+  ResourceCacheEntry* entry = Pool_Get(data->entries, *handle);
+  if (entry->refCount <= 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("value was unreferenced more times than it was referenced");
+    return;
+  }
+
+  entry->refCount--;
+  if (entry->refCount == 0 && entry->invalidated)
+  {
+    ResourceCache_Free(data, entry, *handle);
+  }
+  else if (entry->refCount == 0)
+  {
+    ResourceCache_LruPushNewest(data, entry, *handle);
+    ResourceCache_Evict(data);
+  }
+}
+
+void ResourceCache_Invalidate(ResourceCache cache, const void* value)
+{
+  ResourceCacheData* data = cache;
+  if (data == 0 || value == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid null cache/value arg");
+    return;
+  }
+
+  PoolHandle* handle = HashMap_Get(data->byValue, &value);
+  if (handle == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("value isn't cached (already evicted?)");
+    return;
+  }
+
+  PoolHandle entryHandle = *handle;
+  ResourceCacheEntry* entry = Pool_Get(data->entries, entryHandle);
+  if (entry->invalidated) return;
+
+  if (entry->refCount == 0)
+  {
+    ResourceCache_LruUnlink(data, entry);
+    ResourceCache_Free(data, entry, entryHandle);
+  }
+  else
+  {
+    HashMap_Remove(data->byKey, &entry->keyHash);
+    entry->invalidated = 1;
+  }
+}
+
+void* ResourceCache_Next(ResourceCache cache, int32_t* position, const void** key, int32_t* keyLength, int32_t* refCount)
+{
+  ResourceCacheData* data = cache;
+  if (data == 0 || position == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid null cache/position arg");
+    return 0;
+  }
+
+  ResourceCacheEntry* entry;
+  while ((entry = Pool_Next(data->entries, position, 0)) != 0)
+  {
+    if (entry->invalidated) continue;
+    if (key) *key = entry->key;
+    if (keyLength) *keyLength = entry->keyLength;
+    if (refCount) *refCount = entry->refCount;
+    return entry->value;
+  }
+  return 0;
+}
+
+int32_t ResourceCache_GetCount(ResourceCache cache)
+{
+  ResourceCacheData* data = cache;
+  if (data == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid null cache arg");
+    return 0;
+  }
+  return Pool_Count(data->entries);
+}
+
+int64_t ResourceCache_GetUsedBytes(ResourceCache cache)
+{
+  ResourceCacheData* data = cache;
+  if (data == 0)
+  {
+    DIAGNOSTIC_RESOURCECACHE_ERROR("invalid null cache arg");
+    return 0;
+  }
+  return data->usedBytes;
+}
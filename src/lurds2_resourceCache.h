@@ -0,0 +1,47 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_RESOURCECACHE
+#define LURDS2_RESOURCECACHE
+
+typedef void* ResourceCache;
+
+// frees a cached value once it's evicted (or the cache is released)
+typedef void (*ResourceCacheReleaseFunc)(void* value);
+
+// A ResourceCache shares loaded/decoded values (plates, palettes...) between everyone who asks for the same key,
+// where the key is any bytes describing what was loaded (e.g. a file name plus the decode parameters).
+// Values are refcounted and treated as immutable. When nobody references a value any more it stays cached,
+// and the least recently used ones are freed only once the cache holds more bytes than its budget.
+// Referenced values are never freed, so the budget can be exceeded while they're in use.
+// Not thread-safe; use it from one thread (the main thread).
+ResourceCache ResourceCache_Create(int64_t budgetBytes);
+// frees every cached value; values still referenced are reported and freed anyway
+void    ResourceCache_Release(ResourceCache cache);
+
+// changes the budget, evicting unreferenced values right away if needed (0 evicts all of them)
+void    ResourceCache_SetBudget(ResourceCache cache, int64_t budgetBytes);
+
+// returns the key's value with a new reference taken, or 0 when it isn't cached
+void*   ResourceCache_Acquire(ResourceCache cache, const void* key, int32_t keyLength);
+// caches a freshly loaded value under the key (which must not be cached yet) and takes the caller's first
+// reference on it; 'sizeBytes' is what it counts against the budget. Returns 'value', or 0 on failure
+// (in which case the caller still owns the value)
+void*   ResourceCache_Add(ResourceCache cache, const void* key, int32_t keyLength, void* value, int64_t sizeBytes, ResourceCacheReleaseFunc release);
+// drops one reference taken by Acquire or Add
+void    ResourceCache_Unref(ResourceCache cache, const void* value);
+
+// forgets the value's key (e.g. because the file it was loaded from changed), so the next Acquire misses and it
+// gets loaded again; the value itself is freed now if unreferenced, or else once the last reference is dropped
+void    ResourceCache_Invalidate(ResourceCache cache, const void* value);
+// visits every value that can still be acquired (with its key and how many references it has): start with
+// *position = 0 and call until it returns 0. Invalidating the value just visited is fine; adding values isn't.
+void*   ResourceCache_Next(ResourceCache cache, int32_t* position, const void** key, int32_t* keyLength, int32_t* refCount);
+
+int32_t ResourceCache_GetCount(ResourceCache cache);
+int64_t ResourceCache_GetUsedBytes(ResourceCache cache);
+
+#endif
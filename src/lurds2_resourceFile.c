@@ -6,9 +6,21 @@ Please refer to <http://unlicense.org/>
 
 #include "lurds2_resourceFile.h"
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <stdio.h>
 #include "lurds2_errors.h"
+#include "lurds2_vfs.h"
+#include "lurds2_watch.h"
+#include "lurds2_ring.h"
 #include "lurds2_stringutils.h"
 #include <wchar.h>
 
@@ -18,12 +30,13 @@ Please refer to <http://unlicense.org/>
 #define DIAGNOSTIC_RESOURCE_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
 
 #define PathBufferSize 1024
-BUILD_ASSERT(PathBufferSize >= MAX_PATH);
 static volatile wchar_t gExecutingDir[PathBufferSize];
 static volatile int gExecutingDirLength;
+
+#ifdef _WIN32
+BUILD_ASSERT(PathBufferSize >= MAX_PATH);
 static volatile wchar_t gPathSeparator[2];
 static volatile long gExecutingDirSpinLock;
-
 static void LoadExecutingDir()
 {
   if (gExecutingDir[0] == '\0')
@@ -59,6 +72,37 @@ static void LoadExecutingDir()
     InterlockedExchange(&gExecutingDirSpinLock, 0);
   }
 }
+#else
+static pthread_once_t gExecutingDirOnce = PTHREAD_ONCE_INIT;
+
+static void LoadExecutingDirOnce()
+{
+  char path[PathBufferSize];
+  ssize_t length = readlink("/proc/self/exe", path, PathBufferSize - 1);
+  if (length <= 0)
+  {
+    FATAL_ERROR2("readlink(/proc/self/exe): ", GetLastErrorMessage());
+  }
+  path[length] = 0;
+
+  // keep everything up to and including the last directory separator char
+  while (length > 0 && path[length - 1] != '/') length--;
+  if (length == 0)
+  {
+    FATAL_ERROR("couldn't find directory separator in gExecutingDir");
+  }
+
+  int i;
+  for (i = 0; i < length; i++) gExecutingDir[i] = (unsigned char)path[i];
+  gExecutingDir[length] = 0;
+  gExecutingDirLength = length;
+}
+
+static void LoadExecutingDir()
+{
+  pthread_once(&gExecutingDirOnce, LoadExecutingDirOnce);
+}
+#endif
 
 int ResourceFile_GetPath(wchar_t* buffer, int bufferSize, const wchar_t * fileName)
 {
@@ -92,14 +136,48 @@ int ResourceFile_GetPath(wchar_t* buffer, int bufferSize, const wchar_t * fileNa
   }
 
   wcscpy(buffer, (void*)gExecutingDir);
+#ifdef _WIN32
   wcscat(buffer, L"res\\");
+#else
+  wcscat(buffer, L"res/");
+#endif
   wcscat(buffer, fileName);
   return fileNameLength + gExecutingDirLength;
 }
 
+// where the Lords of the Realm II install is (with a trailing separator)
+static wchar_t gLords2Dir[PathBufferSize] = L"C:\\games\\Lords of the Realm II\\";
+
+int ResourceFile_SetLords2Dir(const wchar_t* dirPath)
+{
+  if (!dirPath)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null dirPath arg");
+    return 0;
+  }
+
+  int length = wcslen(dirPath);
+  if (length == 0 || length + 2 > PathBufferSize)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid (empty or too long) dirPath arg");
+    return 0;
+  }
+
+  wcscpy(gLords2Dir, dirPath);
+  if (dirPath[length - 1] != '\\' && dirPath[length - 1] != '/')
+  {
+#ifdef _WIN32
+    wcscat(gLords2Dir, L"\\");
+#else
+    wcscat(gLords2Dir, L"/");
+#endif
+  }
+  return 1;
+}
+
 int ResourceFile_GetLords2FilePath(wchar_t* buffer, int bufferSize, const wchar_t * fileName)
 {
-  static const wchar_t* Lords2Dir = L"C:\\games\\Lords of the Realm II\\";
+  const wchar_t* Lords2Dir = gLords2Dir;
 
   if (!buffer)
   {
@@ -132,25 +210,247 @@ int ResourceFile_GetLords2FilePath(wchar_t* buffer, int bufferSize, const wchar_
   return fileNameLength + lords2DirLength;
 }
 
-void* ResourceFile_Load(const wchar_t* fileName, int* fileSize)
+// the res/ directory mount, which ResourceFile_Save() adds new files to (0 when nothing is mounted)
+static int32_t gResMount;
+
+int ResourceFile_MountAll(const wchar_t* lords2Dir)
 {
-  wchar_t filePath[PathBufferSize];
+  wchar_t path[PathBufferSize];
 
-  if (!fileName)
+  if (lords2Dir != 0)
   {
-    DIAGNOSTIC_RESOURCE_ERROR("invalid null fileName arg");
+    if (!ResourceFile_SetLords2Dir(lords2Dir)) return 0;
+  }
+  else
+  {
+#ifdef _WIN32
+    const wchar_t* fromEnvironment = _wgetenv(L"LURDS2_LORDS2_DIR");
+    if (fromEnvironment != 0 && fromEnvironment[0] != 0) ResourceFile_SetLords2Dir(fromEnvironment);
+#else
+    const char* fromEnvironment = getenv("LURDS2_LORDS2_DIR");
+    if (fromEnvironment != 0 && fromEnvironment[0] != 0)
+    {
+      wchar_t* wideDir = StringUtils_MakeWideString(fromEnvironment);
+      if (wideDir != 0) ResourceFile_SetLords2Dir(wideDir);
+      free(wideDir);
+    }
+#endif
+  }
+
+  // (later mounts win)
+  if (ResourceFile_GetPath(path, PathBufferSize, L"lurds2.lpak") && ResourceFile_Exists(L"lurds2.lpak"))
+  {
+    Vfs_MountPak(path);
+  }
+
+  if (!ResourceFile_GetPath(path, PathBufferSize, L"")) return 0;
+  gResMount = Vfs_MountDirectory("res/", path);
+  if (gResMount == 0) return 0;
+
+  if (!Vfs_MountDirectory("lords2/", gLords2Dir)) return 0;
+
+  // each folder in mods/ (next to the executable) can have res/ and lords2/ folders overriding those files
+  LoadExecutingDir();
+  if (gExecutingDirLength + 6 > PathBufferSize) return 0;
+  wcscpy(path, (wchar_t*)gExecutingDir);
+  wcscat(path, L"mods");
+  Vfs_MountEachDirectory("", path);
+  return 1;
+}
+
+void ResourceFile_UnmountAll()
+{
+  ResourceFile_StopWatching();
+  Vfs_UnmountAll();
+  gResMount = 0;
+}
+
+#define RESOURCE_MAX_CHANGE_LISTENERS 16
+
+typedef struct ResourceFileChangeListener {
+  ResourceFileChangedFunc changed;
+  void* userData;
+} ResourceFileChangeListener;
+
+static ResourceFileChangeListener gChangeListeners[RESOURCE_MAX_CHANGE_LISTENERS];
+static int gChangeListenerCount;
+static Watch gWatches[VFS_MAX_MOUNTS];
+static int32_t gWatchMounts[VFS_MAX_MOUNTS]; // which vfs mount each watch is for
+static int gWatchCount;
+
+int ResourceFile_AddChangeListener(ResourceFileChangedFunc changed, void* userData)
+{
+  if (!changed)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null changed arg");
     return 0;
   }
 
-  if (!ResourceFile_GetPath(filePath, PathBufferSize, fileName))
+  if (gChangeListenerCount == RESOURCE_MAX_CHANGE_LISTENERS)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("too many change listeners");
+    return 0;
+  }
+
+  gChangeListeners[gChangeListenerCount].changed = changed;
+  gChangeListeners[gChangeListenerCount].userData = userData;
+  gChangeListenerCount++;
+  return 1;
+}
+
+// returns 1 if there's a file (not a folder) at 'filePath'
+static int ResourceFile_IsFile(const wchar_t* filePath)
+{
+#ifdef _WIN32
+  DWORD attributes = GetFileAttributesW(filePath);
+  return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+  char* nFilePath = StringUtils_MakeNarrowString(filePath);
+  struct stat info;
+  int exists = nFilePath != 0 && stat(nFilePath, &info) == 0 && S_ISREG(info.st_mode);
+  free(nFilePath);
+  return exists;
+#endif
+}
+
+int ResourceFile_StartWatching()
+{
+  if (gWatchCount != 0) return 1;
+
+  int32_t mount;
+  for (mount = 1; mount <= Vfs_GetMountCount(); mount++)
+  {
+    const wchar_t* dirPath = Vfs_GetMountDirectory(mount, 0);
+    if (dirPath == 0) continue; // (archives don't change)
+
+    // (mounting a folder that isn't there is fine, e.g. a missing Lords2 install, but there's nothing to watch)
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesW(dirPath);
+    if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0) continue;
+#else
+    struct stat info;
+    char* nDirPath = StringUtils_MakeNarrowString(dirPath);
+    int exists = nDirPath != 0 && stat(nDirPath, &info) == 0 && S_ISDIR(info.st_mode);
+    free(nDirPath);
+    if (!exists) continue;
+#endif
+
+    Watch watch = Watch_Start(dirPath);
+    if (watch == 0) continue;
+    gWatches[gWatchCount] = watch;
+    gWatchMounts[gWatchCount] = mount;
+    gWatchCount++;
+  }
+  return gWatchCount != 0;
+}
+
+void ResourceFile_StopWatching()
+{
+  int i;
+  for (i = 0; i < gWatchCount; i++) Watch_Stop(gWatches[i]);
+  gWatchCount = 0;
+}
+
+int ResourceFile_DispatchChanged()
+{
+  char name[PathBufferSize];
+  wchar_t filePath[PathBufferSize];
+  int count = 0;
+  int i;
+  for (i = 0; i < gWatchCount; i++)
+  {
+    const wchar_t* relativePath;
+    while ((relativePath = Watch_Next(gWatches[i])) != 0)
+    {
+      const char* prefix = 0;
+      const wchar_t* dirPath = Vfs_GetMountDirectory(gWatchMounts[i], &prefix);
+      if (dirPath == 0) continue;
+      if (Pak_NormalizeName(name, PathBufferSize, prefix, relativePath) == 0) continue;
+
+      // files that are already gone (e.g. the temp file ResourceFile_Save() renames into place) aren't news
+      if (wcslen(dirPath) + wcslen(relativePath) >= PathBufferSize) continue;
+      wcscpy(filePath, dirPath);
+      wcscat(filePath, relativePath);
+      if (!ResourceFile_IsFile(filePath)) continue;
+
+      // new files get indexed; files that a later mount (e.g. a mod) overrides didn't change as far as anyone knows
+      VfsFile file;
+      if (!Vfs_Find(prefix, relativePath, &file))
+      {
+        if (!Vfs_AddFile(gWatchMounts[i], prefix, relativePath) || !Vfs_Find(prefix, relativePath, &file)) continue;
+      }
+      if (file.mount != gWatchMounts[i]) continue;
+
+      int j;
+      for (j = 0; j < gChangeListenerCount; j++)
+      {
+        gChangeListeners[j].changed(gChangeListeners[j].userData, name);
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+// Finds the file either as a view into a mounted archive (*view) or a path to map (filePath). Once a prefix is
+// mounted the vfs index has the final say, so a missing file costs no OS call; before that, it's just the plain path.
+static int ResourceFile_Locate(const char* prefix, const wchar_t* fileName, wchar_t* filePath, const void** view, int* viewSize)
+{
+  *view = 0;
+  if (Vfs_IsMounted(prefix))
+  {
+    VfsFile file;
+    if (!Vfs_Find(prefix, fileName, &file))
+    {
+      char* nFileName = StringUtils_MakeNarrowString(fileName);
+      DIAGNOSTIC_RESOURCE_ERROR2("file not found: ", nFileName ? nFileName : "(out of memory)");
+      free(nFileName);
+      return 0;
+    }
+    if (file.pakView != 0)
+    {
+      *view = file.pakView;
+      *viewSize = file.pakSize;
+      return 1;
+    }
+    return Vfs_GetPath(&file, filePath, PathBufferSize);
+  }
+
+  if (prefix[0] == 'r') return ResourceFile_GetPath(filePath, PathBufferSize, fileName);
+  return ResourceFile_GetLords2FilePath(filePath, PathBufferSize, fileName);
+}
+
+// zero-length files can't be mapped, so their "view" is this (never unmapped)
+static const char ResourceFile_EmptyView[2];
+
+#ifndef _WIN32
+// munmap() needs each view's length, which the caller doesn't keep
+typedef struct ResourceFileMapping {
+  const void* view;
+  size_t length;
+} ResourceFileMapping;
+
+static ResourceFileMapping* gMappings;
+static int gMappingCount;
+static int gMappingCapacity;
+static pthread_mutex_t gMappingsLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+const void* ResourceFile_MapPath(const wchar_t* filePath, int* fileSize)
+{
+  if (!filePath)
   {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null filePath arg");
     return 0;
   }
 
+#ifdef _WIN32
   HANDLE h;
-  void* data;
+  HANDLE mapping;
+  void* view;
 
-  data = 0;
+  view = 0;
+  mapping = 0;
   h = INVALID_HANDLE_VALUE;
 
   h = CreateFileW(filePath, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
@@ -171,50 +471,132 @@ void* ResourceFile_Load(const wchar_t* fileName, int* fileSize)
     goto error;
   }
 
-  // max 10 megs resource file supported
-  if (size > 10000000 || sizeHigh > 0)
+  // (nothing is copied, so there's no need for a size limit; 'fileSize' is an int though)
+  if (size > 0x7FFFFFFF || sizeHigh > 0)
   {
     DIAGNOSTIC_RESOURCE_ERROR("resource file too big");
     goto error;
   }
 
-  data = malloc(size + 2);
-  if (data == 0)
+  // (windows refuses to map empty files)
+  if (size == 0)
   {
-    DIAGNOSTIC_RESOURCE_ERROR("failed to allocate memory for file data");
-    goto error;
+    CloseHandle(h);
+    if (fileSize) *fileSize = 0;
+    return ResourceFile_EmptyView;
   }
 
-  DWORD numBytesRead;
-  if (!ReadFile(h, data, size, &numBytesRead, 0))
+  mapping = CreateFileMappingW(h, 0, PAGE_READONLY, 0, 0, 0);
+  if (mapping == 0)
   {
-    DIAGNOSTIC_RESOURCE_ERROR2("ReadFile(): ", GetLastErrorMessage());
+    DIAGNOSTIC_RESOURCE_ERROR2("CreateFileMappingW(): ", GetLastErrorMessage());
     goto error;
   }
 
-  if (numBytesRead != size)
+  view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (view == 0)
   {
-    DIAGNOSTIC_RESOURCE_ERROR("unexpected numByteRead from sound file");
+    DIAGNOSTIC_RESOURCE_ERROR2("MapViewOfFile(): ", GetLastErrorMessage());
     goto error;
   }
 
-  // ding fries are done
+  // the view keeps the file open on its own
+  CloseHandle(mapping);
   CloseHandle(h);
-  
-  // null terminate the data, for convenience if file contains string data
-  ((char*)data)[size] = 0;
-  ((char*)data)[size + 1] = 0;
 
   if (fileSize) *fileSize = size;
-  return data;
-  
+  return view;
+
 error:
+  if (mapping != 0) CloseHandle(mapping);
   if (h != INVALID_HANDLE_VALUE) CloseHandle(h);
-  if (data != 0) free(data);
   return 0;
+#else
+  int fd;
+  void* view;
+  char* nFilePath;
+
+  view = MAP_FAILED;
+  fd = -1;
+  nFilePath = StringUtils_MakeNarrowString(filePath);
+  if (nFilePath == 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("failed to allocate memory for narrow file path");
+    return 0;
+  }
+
+  fd = open(nFilePath, O_RDONLY);
+  if (fd < 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR4("open(): ", GetLastErrorMessage(), " ", nFilePath);
+    goto error;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR2("fstat(): ", GetLastErrorMessage());
+    goto error;
+  }
+
+  // (nothing is copied, so there's no need for a size limit; 'fileSize' is an int though)
+  if (info.st_size > 0x7FFFFFFF)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("resource file too big");
+    goto error;
+  }
+
+  // (mmap refuses empty files too)
+  if (info.st_size == 0)
+  {
+    close(fd);
+    free(nFilePath);
+    if (fileSize) *fileSize = 0;
+    return ResourceFile_EmptyView;
+  }
+
+  view = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (view == MAP_FAILED)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR2("mmap(): ", GetLastErrorMessage());
+    goto error;
+  }
+
+  pthread_mutex_lock(&gMappingsLock);
+  if (gMappingCount == gMappingCapacity)
+  {
+    int newCapacity = gMappingCapacity ? gMappingCapacity * 2 : 16;
+    ResourceFileMapping* newMappings = realloc(gMappings, newCapacity * sizeof(ResourceFileMapping));
+    if (newMappings == 0)
+    {
+      pthread_mutex_unlock(&gMappingsLock);
+      DIAGNOSTIC_RESOURCE_ERROR("failed to allocate memory for mapping list");
+      goto error;
+    }
+    gMappings = newMappings;
+    gMappingCapacity = newCapacity;
+  }
+  gMappings[gMappingCount].view = view;
+  gMappings[gMappingCount].length = (size_t)info.st_size;
+  gMappingCount++;
+  pthread_mutex_unlock(&gMappingsLock);
+
+  // the view keeps the file open on its own
+  close(fd);
+  free(nFilePath);
+
+  if (fileSize) *fileSize = (int)info.st_size;
+  return view;
+
+error:
+  if (view != MAP_FAILED) munmap(view, (size_t)info.st_size);
+  if (fd >= 0) close(fd);
+  free(nFilePath);
+  return 0;
+#endif
 }
 
-void* ResourceFile_LoadLords2File(const wchar_t* fileName, int* fileSize)
+const void* ResourceFile_Map(const wchar_t* fileName, int* fileSize)
 {
   wchar_t filePath[PathBufferSize];
 
@@ -224,74 +606,598 @@ void* ResourceFile_LoadLords2File(const wchar_t* fileName, int* fileSize)
     return 0;
   }
 
-  if (!ResourceFile_GetLords2FilePath(filePath, PathBufferSize, fileName))
+  const void* view;
+  int size;
+  if (!ResourceFile_Locate("res/", fileName, filePath, &view, &size))
   {
     return 0;
   }
 
-  HANDLE h;
-  void* data;
+  if (view != 0)
+  {
+    if (fileSize) *fileSize = size;
+    return view;
+  }
 
-  data = 0;
-  h = INVALID_HANDLE_VALUE;
+  return ResourceFile_MapPath(filePath, fileSize);
+}
 
-  h = CreateFileW(filePath, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-  if (h == INVALID_HANDLE_VALUE)
+const void* ResourceFile_MapLords2File(const wchar_t* fileName, int* fileSize)
+{
+  wchar_t filePath[PathBufferSize];
+
+  if (!fileName)
   {
-    char* nFilePath = StringUtils_MakeNarrowString(filePath);
-    DIAGNOSTIC_RESOURCE_ERROR4("CreateFileW(): ", GetLastErrorMessage(), " ", nFilePath);
-    free(nFilePath);
-    goto error;
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null fileName arg");
+    return 0;
   }
 
-  DWORD size;
-  DWORD sizeHigh;
-  size = GetFileSize(h, &sizeHigh);
-  if (INVALID_FILE_SIZE == size)
+  const void* view;
+  int size;
+  if (!ResourceFile_Locate("lords2/", fileName, filePath, &view, &size))
   {
-    DIAGNOSTIC_RESOURCE_ERROR2("GetFileSize(): ", GetLastErrorMessage());
-    goto error;
+    return 0;
   }
 
-  // max 10 megs resource file supported
-  if (size > 10000000 || sizeHigh > 0)
+  if (view != 0)
   {
-    DIAGNOSTIC_RESOURCE_ERROR("resource file too big");
-    goto error;
+    if (fileSize) *fileSize = size;
+    return view;
   }
 
-  data = malloc(size + 2);
-  if (data == 0)
+  return ResourceFile_MapPath(filePath, fileSize);
+}
+
+void ResourceFile_Unmap(const void* view)
+{
+  if (!view)
   {
-    DIAGNOSTIC_RESOURCE_ERROR("failed to allocate memory for file data");
-    goto error;
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null view arg");
+    return;
   }
 
-  DWORD numBytesRead;
-  if (!ReadFile(h, data, size, &numBytesRead, 0))
+  // (a view into a mounted archive stays mapped as long as the archive does)
+  if (Vfs_ContainsView(view))
   {
-    DIAGNOSTIC_RESOURCE_ERROR2("ReadFile(): ", GetLastErrorMessage());
-    goto error;
+    return;
   }
 
-  if (numBytesRead != size)
+  ResourceFile_UnmapPath(view);
+}
+
+void ResourceFile_UnmapPath(const void* view)
+{
+  if (!view)
   {
-    DIAGNOSTIC_RESOURCE_ERROR("unexpected numByteRead from sound file");
-    goto error;
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null view arg");
+    return;
   }
 
-  // ding fries are done
-  CloseHandle(h);
-  
+  if (view == ResourceFile_EmptyView)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  if (!UnmapViewOfFile(view))
+  {
+    DIAGNOSTIC_RESOURCE_ERROR2("UnmapViewOfFile(): ", GetLastErrorMessage());
+  }
+#else
+  size_t length = 0;
+  int i;
+  pthread_mutex_lock(&gMappingsLock);
+  for (i = 0; i < gMappingCount; i++)
+  {
+    if (gMappings[i].view == view)
+    {
+      length = gMappings[i].length;
+      gMappings[i] = gMappings[--gMappingCount];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&gMappingsLock);
+
+  if (length == 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("view arg is not a mapped resource file");
+    return;
+  }
+
+  if (munmap((void*)view, length) != 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR2("munmap(): ", GetLastErrorMessage());
+  }
+#endif
+}
+
+// copies a mapped file into a malloc'd, double-null-terminated block
+static void* ResourceFile_CopyView(const void* view, int size, int* fileSize)
+{
+  void* data = malloc((size_t)size + 2);
+  if (data == 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("failed to allocate memory for file data");
+    return 0;
+  }
+
+  memcpy(data, view, size);
+
   // null terminate the data, for convenience if file contains string data
   ((char*)data)[size] = 0;
   ((char*)data)[size + 1] = 0;
 
   if (fileSize) *fileSize = size;
   return data;
-  
-error:
-  if (h != INVALID_HANDLE_VALUE) CloseHandle(h);
-  if (data != 0) free(data);
+}
+
+static void* ResourceFile_LoadPath(const wchar_t* filePath, int* fileSize)
+{
+  int size;
+  const void* view = ResourceFile_MapPath(filePath, &size);
+  if (view == 0)
+  {
+    return 0;
+  }
+
+  void* data = ResourceFile_CopyView(view, size, fileSize);
+  ResourceFile_UnmapPath(view);
+  return data;
+}
+
+void* ResourceFile_Load(const wchar_t* fileName, int* fileSize)
+{
+  wchar_t filePath[PathBufferSize];
+
+  if (!fileName)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null fileName arg");
+    return 0;
+  }
+
+  const void* view;
+  int size;
+  if (!ResourceFile_Locate("res/", fileName, filePath, &view, &size))
+  {
+    return 0;
+  }
+
+  if (view != 0) return ResourceFile_CopyView(view, size, fileSize);
+
+  return ResourceFile_LoadPath(filePath, fileSize);
+}
+
+void* ResourceFile_LoadLords2File(const wchar_t* fileName, int* fileSize)
+{
+  wchar_t filePath[PathBufferSize];
+
+  if (!fileName)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null fileName arg");
+    return 0;
+  }
+
+  const void* view;
+  int size;
+  if (!ResourceFile_Locate("lords2/", fileName, filePath, &view, &size))
+  {
+    return 0;
+  }
+
+  if (view != 0) return ResourceFile_CopyView(view, size, fileSize);
+
+  return ResourceFile_LoadPath(filePath, fileSize);
+}
+
+int ResourceFile_Exists(const wchar_t* fileName)
+{
+  wchar_t filePath[PathBufferSize];
+
+  if (!fileName)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null fileName arg");
+    return 0;
+  }
+
+  // (the vfs index knows without asking the OS)
+  if (Vfs_IsMounted("res/"))
+  {
+    return Vfs_Find("res/", fileName, 0);
+  }
+
+  if (!ResourceFile_GetPath(filePath, PathBufferSize, fileName))
+  {
+    return 0;
+  }
+
+  return ResourceFile_IsFile(filePath);
+}
+
+int ResourceFile_Save(const wchar_t* fileName, const void* data, int size)
+{
+  wchar_t filePath[PathBufferSize];
+  wchar_t tempFilePath[PathBufferSize];
+
+  if (!fileName)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null fileName arg");
+    return 0;
+  }
+
+  if (!data && size != 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null data arg");
+    return 0;
+  }
+
+  int pathLength = ResourceFile_GetPath(filePath, PathBufferSize, fileName);
+  if (!pathLength)
+  {
+    return 0;
+  }
+
+  if (pathLength + 5 > PathBufferSize)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("insufficient buffer size to hold temp file path");
+    return 0;
+  }
+  wcscpy(tempFilePath, filePath);
+  wcscat(tempFilePath, L".tmp");
+
+#ifdef _WIN32
+  HANDLE h;
+  h = CreateFileW(tempFilePath, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+  if (h == INVALID_HANDLE_VALUE)
+  {
+    char* nFilePath = StringUtils_MakeNarrowString(tempFilePath);
+    DIAGNOSTIC_RESOURCE_ERROR4("CreateFileW(): ", GetLastErrorMessage(), " ", nFilePath);
+    free(nFilePath);
+    return 0;
+  }
+
+  DWORD numBytesWritten;
+  if (!WriteFile(h, data, size, &numBytesWritten, 0) || numBytesWritten != size)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR2("WriteFile(): ", GetLastErrorMessage());
+    CloseHandle(h);
+    DeleteFileW(tempFilePath);
+    return 0;
+  }
+  CloseHandle(h);
+
+  // swap it into place, so a crash mid-write never leaves a half-written file under the real name
+  if (!MoveFileExW(tempFilePath, filePath, MOVEFILE_REPLACE_EXISTING))
+  {
+    DIAGNOSTIC_RESOURCE_ERROR2("MoveFileExW(): ", GetLastErrorMessage());
+    DeleteFileW(tempFilePath);
+    return 0;
+  }
+#else
+  int result = 0;
+  char* nFilePath = StringUtils_MakeNarrowString(filePath);
+  char* nTempFilePath = StringUtils_MakeNarrowString(tempFilePath);
+  FILE* f = 0;
+  if (nFilePath == 0 || nTempFilePath == 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("failed to allocate memory for narrow file path");
+    goto done;
+  }
+
+  f = fopen(nTempFilePath, "wb");
+  if (f == 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR4("fopen(): ", GetLastErrorMessage(), " ", nTempFilePath);
+    goto done;
+  }
+
+  int written = size == 0 || fwrite(data, size, 1, f) == 1;
+  if (fclose(f) != 0) written = 0;
+  if (!written)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR2("fwrite(): ", GetLastErrorMessage());
+    remove(nTempFilePath);
+    goto done;
+  }
+
+  // swap it into place, so a crash mid-write never leaves a half-written file under the real name
+  if (rename(nTempFilePath, nFilePath) != 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR2("rename(): ", GetLastErrorMessage());
+    remove(nTempFilePath);
+    goto done;
+  }
+  result = 1;
+
+done:
+  free(nFilePath);
+  free(nTempFilePath);
+  if (!result) return 0;
+#endif
+
+  // (so the new file is found, and wins over any archived copy, without rescanning)
+  if (gResMount != 0) Vfs_AddFile(gResMount, "res/", fileName);
+  return 1;
+}
+
+// Async loading: the main thread queues jobs (under gLoadJobsLock), the workers map + decode them and hand the
+// results back through a multi-producer Ring that only the main thread drains.
+#define LOAD_MAX_WORKERS 4
+#define LOAD_COMPLETION_CAPACITY 256 // (workers wait for room when the main thread falls this far behind)
+
+typedef struct ResourceFileLoadJob {
+  struct ResourceFileLoadJob* next;
+  ResourceFileDecodeFunc decode;
+  ResourceFileLoadedFunc loaded;
+  void* userData;
+  const void* pakView; // the file's data when it's in the mounted archive (then there's no filePath)
+  int pakViewSize;
+  wchar_t filePath[PathBufferSize];
+} ResourceFileLoadJob;
+
+typedef struct ResourceFileLoadCompletion {
+  ResourceFileLoadedFunc loaded;
+  void* userData;
+  void* result;
+  int fileSize;
+} ResourceFileLoadCompletion;
+
+static int gLoadWorkerCount; // 0 until the workers are started
+static int gLoadPendingCount; // (main thread only)
+static ResourceFileLoadJob* gLoadJobsFirst;
+static ResourceFileLoadJob* gLoadJobsLast;
+static Ring gLoadCompletions;
+
+#ifdef _WIN32
+static CRITICAL_SECTION gLoadJobsLock;
+static HANDLE gLoadJobsReady; // semaphore counting queued jobs
+static DWORD gLoadMainThreadId;
+#else
+static pthread_mutex_t gLoadJobsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gLoadJobsReady = PTHREAD_COND_INITIALIZER;
+#endif
+
+static ResourceFileLoadJob* ResourceFile_TakeLoadJob()
+{
+  ResourceFileLoadJob* job;
+#ifdef _WIN32
+  WaitForSingleObject(gLoadJobsReady, INFINITE);
+  EnterCriticalSection(&gLoadJobsLock);
+#else
+  pthread_mutex_lock(&gLoadJobsLock);
+  while (gLoadJobsFirst == 0) pthread_cond_wait(&gLoadJobsReady, &gLoadJobsLock);
+#endif
+  job = gLoadJobsFirst;
+  gLoadJobsFirst = job->next;
+  if (gLoadJobsFirst == 0) gLoadJobsLast = 0;
+#ifdef _WIN32
+  LeaveCriticalSection(&gLoadJobsLock);
+#else
+  pthread_mutex_unlock(&gLoadJobsLock);
+#endif
+  return job;
+}
+
+static void ResourceFile_RunLoadJob(ResourceFileLoadJob* job)
+{
+  ResourceFileLoadCompletion completion;
+  completion.loaded = job->loaded;
+  completion.userData = job->userData;
+  completion.result = 0;
+  completion.fileSize = 0;
+
+  if (job->pakView != 0)
+  {
+    completion.fileSize = job->pakViewSize;
+    if (job->decode == 0) completion.result = ResourceFile_CopyView(job->pakView, job->pakViewSize, 0);
+    else completion.result = job->decode(job->userData, job->pakView, job->pakViewSize);
+  }
+  else if (job->decode == 0)
+  {
+    completion.result = ResourceFile_LoadPath(job->filePath, &completion.fileSize);
+  }
+  else
+  {
+    const void* view = ResourceFile_MapPath(job->filePath, &completion.fileSize);
+    if (view != 0)
+    {
+      completion.result = job->decode(job->userData, view, completion.fileSize);
+      ResourceFile_UnmapPath(view);
+    }
+  }
+  if (completion.result == 0) completion.fileSize = 0;
+  free(job);
+
+  while (Ring_Enqueue(gLoadCompletions, &completion, 1) == 0)
+  {
+#ifdef _WIN32
+    Sleep(1);
+#else
+    usleep(1000);
+#endif
+  }
+#ifdef _WIN32
+  // wake the main thread's GetMessage() so it gets around to dispatching this
+  PostThreadMessage(gLoadMainThreadId, WM_NULL, 0, 0);
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI ResourceFile_LoadWorker(LPVOID arg)
+#else
+static void* ResourceFile_LoadWorker(void* arg)
+#endif
+{
+  (void)arg;
+  for (;;)
+  {
+    ResourceFile_RunLoadJob(ResourceFile_TakeLoadJob());
+  }
   return 0;
-}
\ No newline at end of file
+}
+
+static int ResourceFile_StartLoadWorkers()
+{
+  // leave a core for the main thread
+#ifdef _WIN32
+  SYSTEM_INFO systemInfo;
+  GetSystemInfo(&systemInfo);
+  int count = (int)systemInfo.dwNumberOfProcessors - 1;
+#else
+  int count = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+#endif
+  if (count < 1) count = 1;
+  if (count > LOAD_MAX_WORKERS) count = LOAD_MAX_WORKERS;
+
+  gLoadCompletions = Ring_Create(sizeof(ResourceFileLoadCompletion), LOAD_COMPLETION_CAPACITY, 1);
+  if (gLoadCompletions == 0) return 0;
+
+  // (resolved up front so workers never race to do it)
+  LoadExecutingDir();
+
+#ifdef _WIN32
+  gLoadMainThreadId = GetCurrentThreadId();
+  InitializeCriticalSection(&gLoadJobsLock);
+  gLoadJobsReady = CreateSemaphore(0, 0, 0x7FFFFFFF, 0);
+  if (gLoadJobsReady == 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR2("CreateSemaphore(): ", GetLastErrorMessage());
+    return 0;
+  }
+#endif
+
+  int i;
+  for (i = 0; i < count; i++)
+  {
+#ifdef _WIN32
+    HANDLE thread = CreateThread(0, 0, ResourceFile_LoadWorker, 0, 0, 0);
+    if (thread == 0)
+#else
+    pthread_t thread;
+    if (pthread_create(&thread, 0, ResourceFile_LoadWorker, 0) != 0)
+#endif
+    {
+      FATAL_ERROR("failed to start resource loading thread");
+    }
+#ifdef _WIN32
+    CloseHandle(thread);
+#else
+    pthread_detach(thread);
+#endif
+  }
+
+  gLoadWorkerCount = count;
+  return 1;
+}
+
+// queues a load of either filePath or (when it's in the mounted archive) pakView
+static int ResourceFile_LoadPathAsync(const wchar_t* filePath, const void* pakView, int pakViewSize, ResourceFileDecodeFunc decode, ResourceFileLoadedFunc loaded, void* userData)
+{
+  if (gLoadWorkerCount == 0 && !ResourceFile_StartLoadWorkers())
+  {
+    return 0;
+  }
+
+  ResourceFileLoadJob* job = malloc(sizeof(ResourceFileLoadJob));
+  if (job == 0)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("failed to allocate memory for load job");
+    return 0;
+  }
+  job->next = 0;
+  job->decode = decode;
+  job->loaded = loaded;
+  job->userData = userData;
+  job->pakView = pakView;
+  job->pakViewSize = pakViewSize;
+  job->filePath[0] = 0;
+  if (filePath != 0) wcsncpy(job->filePath, filePath, PathBufferSize);
+  job->filePath[PathBufferSize - 1] = 0;
+
+#ifdef _WIN32
+  EnterCriticalSection(&gLoadJobsLock);
+#else
+  pthread_mutex_lock(&gLoadJobsLock);
+#endif
+  if (gLoadJobsLast != 0) gLoadJobsLast->next = job;
+  else gLoadJobsFirst = job;
+  gLoadJobsLast = job;
+#ifdef _WIN32
+  LeaveCriticalSection(&gLoadJobsLock);
+  ReleaseSemaphore(gLoadJobsReady, 1, 0);
+#else
+  pthread_cond_signal(&gLoadJobsReady);
+  pthread_mutex_unlock(&gLoadJobsLock);
+#endif
+
+  gLoadPendingCount++;
+  return 1;
+}
+
+int ResourceFile_LoadAsync(const wchar_t* fileName, ResourceFileDecodeFunc decode, ResourceFileLoadedFunc loaded, void* userData)
+{
+  wchar_t filePath[PathBufferSize];
+
+  if (!fileName || !loaded)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null fileName/loaded arg");
+    return 0;
+  }
+
+  const void* view;
+  int size;
+  if (!ResourceFile_Locate("res/", fileName, filePath, &view, &size))
+  {
+    return 0;
+  }
+
+  if (view != 0) return ResourceFile_LoadPathAsync(0, view, size, decode, loaded, userData);
+
+  return ResourceFile_LoadPathAsync(filePath, 0, 0, decode, loaded, userData);
+}
+
+int ResourceFile_LoadLords2FileAsync(const wchar_t* fileName, ResourceFileDecodeFunc decode, ResourceFileLoadedFunc loaded, void* userData)
+{
+  wchar_t filePath[PathBufferSize];
+
+  if (!fileName || !loaded)
+  {
+    DIAGNOSTIC_RESOURCE_ERROR("invalid null fileName/loaded arg");
+    return 0;
+  }
+
+  const void* view;
+  int size;
+  if (!ResourceFile_Locate("lords2/", fileName, filePath, &view, &size))
+  {
+    return 0;
+  }
+
+  if (view != 0) return ResourceFile_LoadPathAsync(0, view, size, decode, loaded, userData);
+
+  return ResourceFile_LoadPathAsync(filePath, 0, 0, decode, loaded, userData);
+}
+
+int ResourceFile_DispatchLoaded()
+{
+  if (gLoadWorkerCount == 0) return 0;
+
+  ResourceFileLoadCompletion completions[16];
+  int total = 0;
+  int32_t count;
+  while ((count = Ring_Dequeue(gLoadCompletions, completions, 16)) > 0)
+  {
+    int32_t i;
+    for (i = 0; i < count; i++)
+    {
+      gLoadPendingCount--;
+      completions[i].loaded(completions[i].userData, completions[i].result, completions[i].fileSize);
+    }
+    total += count;
+  }
+  return total;
+}
+
+int ResourceFile_GetPendingLoadCount()
+{
+  return gLoadPendingCount;
+}
@@ -12,7 +12,66 @@ Please refer to <http://unlicense.org/>
 int ResourceFile_GetPath(wchar_t* buffer, int bufferSize, const wchar_t* fileName);
 int ResourceFile_GetLords2FilePath(wchar_t* buffer, int bufferSize, const wchar_t * fileName);
 
+// returns a malloc'd copy of the file (with two null bytes after it, for text), or 0 on failure
 void* ResourceFile_Load(const wchar_t* fileName, int* fileSize);
 void* ResourceFile_LoadLords2File(const wchar_t* fileName, int* fileSize);
 
+// returns 1 if the resource file exists (and reports no diagnostic error either way)
+int ResourceFile_Exists(const wchar_t* fileName);
+
+// maps the resource file read-only into memory instead of copying it (NOT null-terminated); returns 0 on failure.
+// Parsers can read straight out of the page cache this way, and there's no size limit (short of 2GB).
+const void* ResourceFile_Map(const wchar_t* fileName, int* fileSize);
+const void* ResourceFile_MapLords2File(const wchar_t* fileName, int* fileSize);
+// (for a full path rather than a resource file name)
+const void* ResourceFile_MapPath(const wchar_t* filePath, int* fileSize);
+// unmaps a view from any of the above (views into mounted archives stay mapped); checks the VFS mounts for those,
+// so call it from the main thread only
+void ResourceFile_Unmap(const void* view);
+// unmaps a view from ResourceFile_MapPath() without looking at the mounts, so it's fine on any thread
+void ResourceFile_UnmapPath(const void* view);
+
+// runs on a load worker thread with the mapped file, and returns whatever it decodes the file into (0 on failure).
+// It must not touch GL, the frame arena or anything else owned by the main thread.
+typedef void* (*ResourceFileDecodeFunc)(void* userData, const void* fileData, int fileSize);
+// runs on the main thread from ResourceFile_DispatchLoaded() with the decoded result (0 and 0 if the load failed)
+typedef void (*ResourceFileLoadedFunc)(void* userData, void* result, int fileSize);
+
+// Loads the resource file on a background worker (starting the workers on first use) so the window thread doesn't
+// block on I/O and decoding. With a null 'decode' the result is a malloc'd copy like ResourceFile_Load() returns.
+// Call these and ResourceFile_DispatchLoaded() from the main thread only. Returns 0 on failure, in which case
+// 'loaded' won't be called.
+int ResourceFile_LoadAsync(const wchar_t* fileName, ResourceFileDecodeFunc decode, ResourceFileLoadedFunc loaded, void* userData);
+int ResourceFile_LoadLords2FileAsync(const wchar_t* fileName, ResourceFileDecodeFunc decode, ResourceFileLoadedFunc loaded, void* userData);
+// calls 'loaded' for every finished async load; the main loop calls this once per iteration. Returns how many.
+// (On Windows, finished loads post a WM_NULL to the main thread so a GetMessage() loop wakes up for them.)
+int ResourceFile_DispatchLoaded();
+// async loads whose 'loaded' hasn't been called yet
+int ResourceFile_GetPendingLoadCount();
+
+// Indexes every resource and Lords2 file once (see lurds2_vfs.h), so loads after this look files up in memory
+// instead of probing the disk. Later mounts win: res/lurds2.lpak, then the res/ folder, then the Lords2 folder,
+// then each folder in mods/ (next to the executable, in name order) with its own res/ and lords2/ folders.
+// The Lords2 folder is 'lords2Dir', or else $LURDS2_LORDS2_DIR, or else C:\games\Lords of the Realm II.
+// Mount at startup before loading anything (and unmount after everything mapped from an archive is unmapped).
+int ResourceFile_MountAll(const wchar_t* lords2Dir);
+void ResourceFile_UnmountAll();
+// sets where Lords of the Realm II is installed (for paths, and for what ResourceFile_MountAll() mounts)
+int ResourceFile_SetLords2Dir(const wchar_t* dirPath);
+
+// Hot reload: once watching, files changed in the mounted folders (not archives) are reported to every listener,
+// by their vfs name, e.g. "res/old_timey_font.json" or "lords2/base01.256", so whatever was loaded from them
+// can be reloaded in place. Modules that cache things add their own listeners; adding one doesn't start watching.
+typedef void (*ResourceFileChangedFunc)(void* userData, const char* name);
+int ResourceFile_AddChangeListener(ResourceFileChangedFunc changed, void* userData);
+// watches every mounted folder (after ResourceFile_MountAll()); returns 0 when nothing could be watched
+int ResourceFile_StartWatching();
+void ResourceFile_StopWatching();
+// tells the listeners about every changed file; the main loop calls this once per iteration. Returns how many.
+// (On Windows, changes post a WM_NULL to the thread that started watching, so a GetMessage() loop wakes up.)
+int ResourceFile_DispatchChanged();
+
+// (re)writes the resource file; the old contents are only replaced once the new ones are fully written
+int ResourceFile_Save(const wchar_t* fileName, const void* data, int size);
+
 #endif
\ No newline at end of file
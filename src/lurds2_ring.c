@@ -0,0 +1,268 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_ring.h"
+
+#include "lurds2_errors.h"
+
+#define DIAGNOSTIC_RING_ERROR(message) DIAGNOSTIC_ERROR(message);
+#define DIAGNOSTIC_RING_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
+#define DIAGNOSTIC_RING_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3));
+#define DIAGNOSTIC_RING_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
+
+#define RING_CACHE_LINE 64
+
+// Positions count up forever (wrapping at 2^32) and are masked to find their slot,
+// so head - tail is always the number of elements in the ring.
+typedef struct RingData {
+  volatile uint32_t head; // next position to write (written by producers)
+  int8_t headPadding[RING_CACHE_LINE - sizeof(uint32_t)]; // (so producers and the consumer don't fight over one cache line)
+  volatile uint32_t tail; // next position to read (written by the consumer)
+  int8_t tailPadding[RING_CACHE_LINE - sizeof(uint32_t)];
+  uint32_t capacity;
+  uint32_t mask;
+  int32_t elementSize;
+  int32_t multiProducer;
+  // multi-producer only: a slot's sequence is set to its position + 1 once that position's element is written,
+  // since producers finish out of order and the consumer must not read past an unfinished one
+  volatile uint32_t* sequences;
+  int8_t* elements;
+  void* allocation; // (what 'elements' was carved from)
+} RingData;
+
+// Acquire/release atomics. TCC has no atomic builtins, so Windows goes through Interlocked* (full barriers).
+#ifdef _WIN32
+static uint32_t Ring_LoadAcquire(volatile uint32_t* p)
+{
+  return (uint32_t)InterlockedCompareExchange((volatile long*)p, 0, 0);
+}
+
+static void Ring_StoreRelease(volatile uint32_t* p, uint32_t value)
+{
+  InterlockedExchange((volatile long*)p, (long)value);
+}
+
+static int Ring_CompareExchange(volatile uint32_t* p, uint32_t expected, uint32_t desired)
+{
+  return (uint32_t)InterlockedCompareExchange((volatile long*)p, (long)desired, (long)expected) == expected;
+}
+#else
+static uint32_t Ring_LoadAcquire(volatile uint32_t* p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void Ring_StoreRelease(volatile uint32_t* p, uint32_t value)
+{
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+static int Ring_CompareExchange(volatile uint32_t* p, uint32_t expected, uint32_t desired)
+{
+  return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+#endif
+
+Ring Ring_Create(int32_t elementSize, int32_t capacity, int multiProducer)
+{
+  if (elementSize <= 0 || elementSize > 0x10000)
+  {
+    DIAGNOSTIC_RING_ERROR("invalid elementSize arg");
+    return 0;
+  }
+
+  if (capacity < 2 || capacity > 0x10000000 || (capacity & (capacity - 1)) != 0)
+  {
+    DIAGNOSTIC_RING_ERROR("invalid capacity arg (must be a power of 2)");
+    return 0;
+  }
+
+  if ((int64_t)elementSize * capacity > 0x40000000)
+  {
+    DIAGNOSTIC_RING_ERROR("ring would be too big");
+    return 0;
+  }
+
+  // the struct is allocated with extra room so it can be cache-line aligned
+  void* allocation = malloc(sizeof(RingData) + RING_CACHE_LINE);
+  if (allocation == 0)
+  {
+    DIAGNOSTIC_RING_ERROR("failed to allocate memory for RingData");
+    return 0;
+  }
+  RingData* data = (RingData*)(((uintptr_t)allocation + RING_CACHE_LINE - 1) & ~(uintptr_t)(RING_CACHE_LINE - 1));
+  memset(data, 0, sizeof(RingData));
+  data->allocation = allocation;
+  data->capacity = capacity;
+  data->mask = capacity - 1;
+  data->elementSize = elementSize;
+  data->multiProducer = multiProducer ? 1 : 0;
+
+  data->elements = malloc((size_t)elementSize * capacity);
+  if (data->elements == 0)
+  {
+    DIAGNOSTIC_RING_ERROR("failed to allocate memory for ring elements");
+    goto error;
+  }
+
+  if (data->multiProducer)
+  {
+    data->sequences = malloc(capacity * sizeof(uint32_t));
+    if (data->sequences == 0)
+    {
+      DIAGNOSTIC_RING_ERROR("failed to allocate memory for ring sequences");
+      goto error;
+    }
+    // (anything but position + 1 for the first lap's positions)
+    uint32_t i;
+    for (i = 0; i < data->capacity; i++) data->sequences[i] = i;
+  }
+
+  return data;
+
+error:
+  if (data->elements) free(data->elements);
+  free(allocation);
+  return 0;
+}
+
+void Ring_Release(Ring ring)
+{
+  RingData* data = (RingData*)ring;
+  if (data == 0)
+  {
+    DIAGNOSTIC_RING_ERROR("invalid null arg");
+    return;
+  }
+
+  free(data->elements);
+  if (data->sequences) free((void*)data->sequences);
+  free(data->allocation);
+}
+
+// copies 'count' elements to/from the ring starting at 'position' (splitting where the slots wrap around)
+static void Ring_CopyIn(RingData* data, uint32_t position, const int8_t* elements, uint32_t count)
+{
+  uint32_t slot = position & data->mask;
+  uint32_t first = data->capacity - slot;
+  if (first > count) first = count;
+  memcpy(data->elements + (size_t)slot * data->elementSize, elements, (size_t)first * data->elementSize);
+  if (count > first)
+  {
+    memcpy(data->elements, elements + (size_t)first * data->elementSize, (size_t)(count - first) * data->elementSize);
+  }
+}
+
+static void Ring_CopyOut(RingData* data, uint32_t position, int8_t* elements, uint32_t count)
+{
+  uint32_t slot = position & data->mask;
+  uint32_t first = data->capacity - slot;
+  if (first > count) first = count;
+  memcpy(elements, data->elements + (size_t)slot * data->elementSize, (size_t)first * data->elementSize);
+  if (count > first)
+  {
+    memcpy(elements + (size_t)first * data->elementSize, data->elements, (size_t)(count - first) * data->elementSize);
+  }
+}
+
+int32_t Ring_Enqueue(Ring ring, const void* elements, int32_t count)
+{
+  RingData* data = (RingData*)ring;
+  if (data == 0 || elements == 0)
+  {
+    DIAGNOSTIC_RING_ERROR("invalid null arg");
+    return 0;
+  }
+
+  if (count <= 0)
+  {
+    return 0;
+  }
+
+  uint32_t head;
+  uint32_t n;
+  if (!data->multiProducer)
+  {
+    head = data->head; // (only this thread writes it)
+    uint32_t space = data->capacity - (head - Ring_LoadAcquire(&data->tail));
+    n = (uint32_t)count < space ? (uint32_t)count : space;
+    if (n == 0) return 0;
+    Ring_CopyIn(data, head, elements, n);
+    Ring_StoreRelease(&data->head, head + n);
+    return n;
+  }
+
+  // claim positions [head, head + n) by moving head past them, then fill them in
+  while (1)
+  {
+    uint32_t tail = Ring_LoadAcquire(&data->tail);
+    head = Ring_LoadAcquire(&data->head);
+    uint32_t used = head - tail;
+    if (used > data->capacity) continue; // (tail moved on between the two loads)
+    n = data->capacity - used;
+    if ((uint32_t)count < n) n = count;
+    if (n == 0) return 0;
+    if (Ring_CompareExchange(&data->head, head, head + n)) break;
+  }
+
+  Ring_CopyIn(data, head, elements, n);
+  uint32_t i;
+  for (i = 0; i < n; i++)
+  {
+    Ring_StoreRelease(&data->sequences[(head + i) & data->mask], head + i + 1);
+  }
+  return n;
+}
+
+int32_t Ring_Dequeue(Ring ring, void* elements, int32_t maxCount)
+{
+  RingData* data = (RingData*)ring;
+  if (data == 0 || elements == 0)
+  {
+    DIAGNOSTIC_RING_ERROR("invalid null arg");
+    return 0;
+  }
+
+  if (maxCount <= 0)
+  {
+    return 0;
+  }
+
+  uint32_t tail = data->tail; // (only this thread writes it)
+  uint32_t n;
+  if (!data->multiProducer)
+  {
+    uint32_t available = Ring_LoadAcquire(&data->head) - tail;
+    n = (uint32_t)maxCount < available ? (uint32_t)maxCount : available;
+  }
+  else
+  {
+    // take the run of finished elements (a claimed but unwritten one ends it)
+    for (n = 0; n < (uint32_t)maxCount; n++)
+    {
+      if (Ring_LoadAcquire(&data->sequences[(tail + n) & data->mask]) != tail + n + 1) break;
+    }
+  }
+
+  if (n == 0) return 0;
+  Ring_CopyOut(data, tail, elements, n);
+  Ring_StoreRelease(&data->tail, tail + n);
+  return n;
+}
+
+int32_t Ring_Count(Ring ring)
+{
+  RingData* data = (RingData*)ring;
+  if (data == 0)
+  {
+    DIAGNOSTIC_RING_ERROR("invalid null arg");
+    return 0;
+  }
+
+  uint32_t tail = Ring_LoadAcquire(&data->tail);
+  uint32_t count = Ring_LoadAcquire(&data->head) - tail;
+  return count > data->capacity ? data->capacity : count;
+}
@@ -0,0 +1,26 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_RING
+#define LURDS2_RING
+
+typedef void* Ring;
+
+// A Ring is a fixed-capacity queue of same-sized elements for handing data from one thread to another
+// without locks. One thread (the consumer) dequeues; either one thread enqueues (multiProducer = 0, the cheapest)
+// or any number of threads do (multiProducer = 1). Elements are copied in and out, in batches where possible.
+// Create and release it while no other thread is using it.
+Ring    Ring_Create(int32_t elementSize, int32_t capacity, int multiProducer); // capacity must be a power of 2
+void    Ring_Release(Ring ring);
+
+// copies up to 'count' elements in, in order; returns how many fit (0 when full)
+int32_t Ring_Enqueue(Ring ring, const void* elements, int32_t count);
+// copies up to 'maxCount' of the oldest elements out; returns how many there were (0 when empty). Consumer only.
+int32_t Ring_Dequeue(Ring ring, void* elements, int32_t maxCount);
+// elements enqueued and not yet dequeued (already out of date if another thread is busy with the ring)
+int32_t Ring_Count(Ring ring);
+
+#endif
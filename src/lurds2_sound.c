@@ -7,6 +7,8 @@ Please refer to <http://unlicense.org/>
 #include "lurds2_sound.h"
 
 #include "lurds2_errors.h"
+#include "lurds2_pool.h"
+#include "lurds2_resourceFile.h"
 
 #define LURDS2_USE_SOUND_MMEAPI
 
@@ -42,12 +44,14 @@ typedef struct __attribute__((packed)) WaveFileHeader {
 
 typedef struct SoundBufferData {
   volatile long refcount;
-  char* data;
+  PoolHandle self; // (so the SoundThread can remove it from SoundBufferPool)
+  const char* data; // the *.wav file, mapped read-only (so the device plays straight from the page cache)
   long length;
 } SoundBufferData;
 
 typedef struct SoundChannelData {
   volatile long refcount;
+  PoolHandle self; // (so the SoundThread can remove it from SoundChannelPool)
 #ifdef LURDS2_USE_SOUND_MMEAPI
   HWAVEOUT handle;
   WAVEHDR header; // data associated with currently-playing sound
@@ -70,6 +74,12 @@ static volatile long SoundThreadInitSpinLock;
 static CRITICAL_SECTION SoundThreadCriticalSection;
 static volatile long SoundThreadCriticalSectionInitialized;
 
+// every live SoundChannelData/SoundBufferData sits in these, and callers hold PoolHandles to them.
+// Only touched inside SoundThreadCriticalSection. (Messages to the SoundThread still carry raw pointers,
+// which is fine because pooled elements never move and the refcount a message holds keeps its element alive.)
+static Pool SoundChannelPool;
+static Pool SoundBufferPool;
+
 #define WM_SOUNDCHANNEL_OPEN (WM_USER + 1)
 #define WM_SOUNDCHANNEL_PLAY (WM_USER + 2)
 #define WM_SOUNDCHANNEL_PLAYLOOP (WM_USER + 3)
@@ -158,6 +168,15 @@ void SoundThreadSetup()
       SoundThreadCriticalSectionInitialized = 1;
     }
 
+    if (SoundChannelPool == 0 && (SoundChannelPool = Pool_Create(sizeof(SoundChannelData))) == 0)
+    {
+      FATAL_ERROR("failed to create SoundChannelPool");
+    }
+    if (SoundBufferPool == 0 && (SoundBufferPool = Pool_Create(sizeof(SoundBufferData))) == 0)
+    {
+      FATAL_ERROR("failed to create SoundBufferPool");
+    }
+
     if (SoundThread == 0)
     {
       HWND handle;
@@ -183,28 +202,84 @@ void SoundThreadSetup()
   }
 }
 
+// resolves the caller's handle and takes a reference on the result (for a message to the SoundThread),
+// or returns 0 (with a diagnostic) when the handle is null, already released, or otherwise invalid
+static SoundChannelData* SoundChannel_Acquire(SoundChannel soundChannel)
+{
+  if (!soundChannel)
+  {
+    DIAGNOSTIC_SOUND_ERROR("null soundChannel arg provided");
+    return 0;
+  }
+
+  EnterCriticalSection(&SoundThreadCriticalSection);
+  SoundChannelData* channel = Pool_Get(SoundChannelPool, POOL_PTR_TO_HANDLE(soundChannel));
+  // (a refcount of 0 means only the SoundThread's pending release still references it)
+  if (channel && 1 >= InterlockedIncrement(&channel->refcount))
+  {
+    InterlockedDecrement(&channel->refcount);
+    channel = 0;
+  }
+  LeaveCriticalSection(&SoundThreadCriticalSection);
+
+  if (!channel)
+  {
+    DIAGNOSTIC_SOUND_ERROR("soundChannel arg is stale (already released) or invalid - won't use");
+  }
+  return channel;
+}
+
+static SoundBufferData* SoundBuffer_Acquire(SoundBuffer soundBuffer)
+{
+  if (!soundBuffer)
+  {
+    DIAGNOSTIC_SOUND_ERROR("null soundBuffer arg provided");
+    return 0;
+  }
+
+  EnterCriticalSection(&SoundThreadCriticalSection);
+  SoundBufferData* buffer = Pool_Get(SoundBufferPool, POOL_PTR_TO_HANDLE(soundBuffer));
+  if (buffer && 1 >= InterlockedIncrement(&buffer->refcount))
+  {
+    InterlockedDecrement(&buffer->refcount);
+    buffer = 0;
+  }
+  LeaveCriticalSection(&SoundThreadCriticalSection);
+
+  if (!buffer)
+  {
+    DIAGNOSTIC_SOUND_ERROR("soundBuffer arg is stale (already released) or invalid - won't use");
+  }
+  return buffer;
+}
+
 SoundChannel SoundChannel_Open()
 {
   SoundThreadSetup();
 
+  PoolHandle handle;
   SoundChannelData* channel;
-  channel = malloc(sizeof(SoundChannelData));
+  EnterCriticalSection(&SoundThreadCriticalSection);
+  channel = Pool_Add(SoundChannelPool, &handle);
+  LeaveCriticalSection(&SoundThreadCriticalSection);
   if (channel == 0)
   {
-    DIAGNOSTIC_SOUND_ERROR("failed to allocate memory for SoundChannelData");
+    // diagnostic error already reported by Pool_Add()
     return 0;
   }
-  memset(channel, 0, sizeof(SoundChannelData));
+  channel->self = handle;
   InterlockedIncrement(&channel->refcount); // 1 for caller holding the reference
   InterlockedIncrement(&channel->refcount); // 1 for SoundThread using it, since we're calling PostThreadMessage next
 
   if (!PostThreadMessage(SoundThreadId, WM_SOUNDCHANNEL_OPEN, *(WPARAM*)&channel, 0))
   {
     DIAGNOSTIC_SOUND_ERROR2("PostThreadMessage: ", GetLastErrorMessage());
-    free(channel);
+    EnterCriticalSection(&SoundThreadCriticalSection);
+    Pool_Remove(SoundChannelPool, handle);
+    LeaveCriticalSection(&SoundThreadCriticalSection);
     return 0;
   }
-  return channel;
+  return POOL_HANDLE_TO_PTR(handle);
 }
 
 void SoundChannel_Open_Handler(SoundChannelData* channel)
@@ -323,7 +398,7 @@ static long SoundChannel_BindToSoundBuffer(SoundChannelData* channel, SoundBuffe
     LPWAVEHDR header;
     header = &channel->header;
     memset(header, 0, sizeof(*header));
-    header->lpData = buffer->data + sizeof(WaveFileHeader);
+    header->lpData = (char*)buffer->data + sizeof(WaveFileHeader);
     header->dwBufferLength = fileHeader->data_bytes;
     header->dwFlags = 0 | (loop ? (WHDR_BEGINLOOP | WHDR_ENDLOOP) : 0);
     header->dwLoops = loop ? 0xffffffff : 0;
@@ -355,32 +430,15 @@ void SoundChannel_Play(SoundChannel soundChannel, SoundBuffer soundBuffer, long
 {
   SoundThreadSetup();
 
-  SoundChannelData* channel = (SoundChannelData*)soundChannel;
-  SoundBufferData* buffer = (SoundBufferData*)soundBuffer;
-
+  SoundChannelData* channel = SoundChannel_Acquire(soundChannel);
   if (!channel)
   {
-    DIAGNOSTIC_SOUND_ERROR("null soundChannel arg provided");
     return;
   }
 
+  SoundBufferData* buffer = SoundBuffer_Acquire(soundBuffer);
   if (!buffer)
   {
-    DIAGNOSTIC_SOUND_ERROR("null soundBuffer arg provided");
-    return;
-  }
-
-  if (1 >= InterlockedIncrement(&channel->refcount))
-  {
-    InterlockedDecrement(&channel->refcount);
-    DIAGNOSTIC_SOUND_ERROR("soundChannel arg has bad refcount - won't use");
-    return;
-  }
-  
-  if (1 >= InterlockedIncrement(&buffer->refcount))
-  {
-    InterlockedDecrement(&buffer->refcount);
-    DIAGNOSTIC_SOUND_ERROR("soundBuffer arg has bad refcount - won't use");
     SoundChannel_Release_Handler(channel);
     return;
   }
@@ -454,18 +512,9 @@ void SoundChannel_Stop(SoundChannel soundChannel)
 {
   SoundThreadSetup();
 
-  SoundChannelData* channel = (SoundChannelData*)soundChannel;
-
+  SoundChannelData* channel = SoundChannel_Acquire(soundChannel);
   if (!channel)
   {
-    DIAGNOSTIC_SOUND_ERROR("null soundChannel arg provided");
-    return;
-  }
-
-  if (1 >= InterlockedIncrement(&channel->refcount))
-  {
-    InterlockedDecrement(&channel->refcount);
-    DIAGNOSTIC_SOUND_ERROR("soundChannel arg has bad refcount - won't use");
     return;
   }
   
@@ -517,18 +566,9 @@ void SoundChannel_Release(SoundChannel soundChannel)
 {
   SoundThreadSetup();
 
-  SoundChannelData* channel = (SoundChannelData*)soundChannel;
-
+  SoundChannelData* channel = SoundChannel_Acquire(soundChannel);
   if (!channel)
   {
-    DIAGNOSTIC_SOUND_ERROR("null soundChannel arg provided");
-    return;
-  }
-  
-  if (1 >= InterlockedIncrement(&channel->refcount))
-  {
-    InterlockedDecrement(&channel->refcount);
-    DIAGNOSTIC_SOUND_ERROR("soundChannel arg has bad refcount - won't use");
     return;
   }
   
@@ -583,8 +623,7 @@ void SoundChannel_Release_Handler(SoundChannelData* channel)
       channel->handle = 0;
     }
 #endif
-
-    free(channel);
+    Pool_Remove(SoundChannelPool, channel->self);
   }
 
   LeaveCriticalSection(&SoundThreadCriticalSection);
@@ -612,16 +651,19 @@ SoundBuffer SoundBuffer_LoadFromFileW(const wchar_t * filePath)
   }
   memcpy(filePathCopy, filePath, (len + 1) * sizeof(wchar_t));
   
+  PoolHandle handle;
   SoundBufferData * buffer;
-  buffer = malloc(sizeof(SoundBufferData));
+  EnterCriticalSection(&SoundThreadCriticalSection);
+  buffer = Pool_Add(SoundBufferPool, &handle);
+  LeaveCriticalSection(&SoundThreadCriticalSection);
   if (buffer == 0)
   {
-    DIAGNOSTIC_SOUND_ERROR("failed to allocate memory SoundBufferData struct");
+    // diagnostic error already reported by Pool_Add()
     free(filePathCopy);
     return 0;
   }
-  memset(buffer, 0, sizeof(SoundBufferData));
-  
+  buffer->self = handle;
+
   InterlockedIncrement(&buffer->refcount); // 1 for caller holding the reference
   InterlockedIncrement(&buffer->refcount); // 1 for SoundThread using it, since we're calling PostThreadMessage next
 
@@ -633,57 +675,18 @@ SoundBuffer SoundBuffer_LoadFromFileW(const wchar_t * filePath)
     SoundBuffer_Release_Handler(buffer);
     free(filePathCopy);
   }
-  return buffer;
+  return POOL_HANDLE_TO_PTR(handle);
 }
 
 void SoundBuffer_LoadFromFileW_Handler(SoundBufferData * buffer, wchar_t * filePathCopy)
 {
-  HANDLE h;
-  char * data;
+  const char * data;
+  int size;
 
-  data = 0;
-  h = INVALID_HANDLE_VALUE;
-  
-  h = CreateFileW(filePathCopy, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-  if (h == INVALID_HANDLE_VALUE)
-  {
-    DIAGNOSTIC_SOUND_ERROR2("CreateFileW: ", GetLastErrorMessage());
-    goto error;
-  }
-
-  DWORD size;
-  DWORD sizeHigh;
-  size = GetFileSize(h, &sizeHigh);
-  if (INVALID_FILE_SIZE == size)
-  {
-    DIAGNOSTIC_SOUND_ERROR2("GetFileSize: ", GetLastErrorMessage());
-    goto error;
-  }
-
-  // max 10 megs sound file supported
-  if (size > 10000000 || sizeHigh > 0)
-  {
-    DIAGNOSTIC_SOUND_ERROR("sound file too big");
-    goto error;
-  }
-
-  data = malloc(size);
+  data = ResourceFile_MapPath(filePathCopy, &size);
   if (data == 0)
   {
-    DIAGNOSTIC_SOUND_ERROR("failed to allocate memory for sound from file");
-    goto error;
-  }
-
-  DWORD numBytesRead;
-  if (!ReadFile(h, data, size, &numBytesRead, 0))
-  {
-    DIAGNOSTIC_SOUND_ERROR2("ReadFile(): ", GetLastErrorMessage());
-    goto error;
-  }
-
-  if (numBytesRead != size)
-  {
-    DIAGNOSTIC_SOUND_ERROR("unexpected numByteRead from sound file");
+    // diagnostic error already reported by ResourceFile_MapPath()
     goto error;
   }
 
@@ -779,7 +782,6 @@ void SoundBuffer_LoadFromFileW_Handler(SoundBufferData * buffer, wchar_t * fileP
   }
 
   // ding fries are done
-  CloseHandle(h);
   free(filePathCopy);
 
   EnterCriticalSection(&SoundThreadCriticalSection);
@@ -789,8 +791,7 @@ void SoundBuffer_LoadFromFileW_Handler(SoundBufferData * buffer, wchar_t * fileP
   return;
   
 error:
-  if (h != INVALID_HANDLE_VALUE) CloseHandle(h);
-  if (data != 0) free(data);
+  if (data != 0) ResourceFile_UnmapPath(data);
   if (filePathCopy != 0) free(filePathCopy);
 }
 
@@ -798,19 +799,9 @@ void SoundBuffer_Release(SoundBuffer soundBuffer)
 {
   SoundThreadSetup();
 
-  SoundBufferData* buffer;
-  buffer = (SoundBufferData*)soundBuffer;
-
+  SoundBufferData* buffer = SoundBuffer_Acquire(soundBuffer);
   if (!buffer)
   {
-    DIAGNOSTIC_SOUND_ERROR("soundBuffer arg is null");
-    return;
-  }
-  
-  if (1 >= InterlockedIncrement(&buffer->refcount))
-  {
-    InterlockedDecrement(&buffer->refcount);
-    DIAGNOSTIC_SOUND_ERROR("soundBuffer arg has bad refcount - won't use");
     return;
   }
   
@@ -840,10 +831,10 @@ void SoundBuffer_Release_Handler(SoundBufferData* buffer)
   {
     if (buffer->data)
     {
-      free(buffer->data);
+      ResourceFile_UnmapPath(buffer->data);
       buffer->data = 0;
     }
-    free(buffer);
+    Pool_Remove(SoundBufferPool, buffer->self);
   }
 
   LeaveCriticalSection(&SoundThreadCriticalSection);
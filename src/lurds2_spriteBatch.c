@@ -0,0 +1,205 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_spriteBatch.h"
+
+#include "lurds2_errors.h"
+#include <GL/GL.h>
+
+#define DIAGNOSTIC_SPRITEBATCH_ERROR(message) DIAGNOSTIC_ERROR(message)
+#define DIAGNOSTIC_SPRITEBATCH_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2))
+#define DIAGNOSTIC_SPRITEBATCH_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3))
+#define DIAGNOSTIC_SPRITEBATCH_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4))
+
+// interleaved, for glVertexPointer()/glTexCoordPointer()/glColorPointer()
+typedef struct SpriteVertex {
+  float x, y;
+  float u, v;
+  uint32_t color; // RGBA bytes
+} SpriteVertex;
+
+// what sprites need to share to be drawn together
+typedef struct SpriteKey {
+  unsigned int glTextureId;
+  int pixelPerfect;
+  int32_t index; // of the sprite's 4 vertices (in order added)
+} SpriteKey;
+
+typedef struct SpriteBatchData {
+  int isActive;
+  int sortByTexture;
+  int32_t count;
+  int32_t capacity;
+  SpriteVertex* vertices; // 4 per sprite, in order added
+  SpriteVertex* sortedVertices; // (with sortByTexture) 4 per sprite, in draw order
+  SpriteKey* keys;
+} SpriteBatchData;
+
+// the arrays stay allocated between batches, so a steady frame doesn't allocate
+static SpriteBatchData gSpriteBatch;
+
+static int SpriteBatch_Grow()
+{
+  int32_t newCapacity = gSpriteBatch.capacity ? gSpriteBatch.capacity * 2 : 256;
+  SpriteVertex* vertices = realloc(gSpriteBatch.vertices, sizeof(SpriteVertex) * 4 * newCapacity);
+  if (vertices == 0) goto error;
+  gSpriteBatch.vertices = vertices;
+  SpriteVertex* sortedVertices = realloc(gSpriteBatch.sortedVertices, sizeof(SpriteVertex) * 4 * newCapacity);
+  if (sortedVertices == 0) goto error;
+  gSpriteBatch.sortedVertices = sortedVertices;
+  SpriteKey* keys = realloc(gSpriteBatch.keys, sizeof(SpriteKey) * newCapacity);
+  if (keys == 0) goto error;
+  gSpriteBatch.keys = keys;
+  gSpriteBatch.capacity = newCapacity;
+  return 1;
+
+error:
+  DIAGNOSTIC_SPRITEBATCH_ERROR("failed to allocate memory for more sprites");
+  return 0;
+}
+
+void SpriteBatch_Begin(int sortByTexture)
+{
+  if (gSpriteBatch.isActive)
+  {
+    DIAGNOSTIC_SPRITEBATCH_ERROR("sprite batch already begun (missing SpriteBatch_End()?)");
+  }
+  gSpriteBatch.isActive = 1;
+  gSpriteBatch.sortByTexture = sortByTexture;
+  gSpriteBatch.count = 0;
+}
+
+int SpriteBatch_IsActive()
+{
+  return gSpriteBatch.isActive;
+}
+
+void SpriteBatch_Add(Bmp bmp, float x, float y, const SpriteRect* source, uint32_t color)
+{
+  if (!gSpriteBatch.isActive)
+  {
+    DIAGNOSTIC_SPRITEBATCH_ERROR("sprite added outside SpriteBatch_Begin()/SpriteBatch_End()");
+    return;
+  }
+
+  BmpTexture texture;
+  if (!Bmp_GetTexture(bmp, &texture))
+  {
+    // diagnostic error already reported by Bmp_GetTexture()
+    return;
+  }
+
+  if (gSpriteBatch.count == gSpriteBatch.capacity && !SpriteBatch_Grow()) return;
+
+  // the source rectangle, in the bmp's texture coordinates
+  float u0 = texture.u0;
+  float v0 = texture.v0;
+  float u1 = texture.u1;
+  float v1 = texture.v1;
+  float width = (float)texture.width;
+  float height = (float)texture.height;
+  if (source != 0)
+  {
+    float uScale = (texture.u1 - texture.u0) / texture.width;
+    float vScale = (texture.v1 - texture.v0) / texture.height;
+    u0 = texture.u0 + source->x * uScale;
+    v0 = texture.v0 + source->y * vScale;
+    u1 = u0 + source->width * uScale;
+    v1 = v0 + source->height * vScale;
+    width = (float)source->width;
+    height = (float)source->height;
+  }
+
+  int32_t index = gSpriteBatch.count++;
+  SpriteVertex* v = &gSpriteBatch.vertices[index * 4];
+  v[0].x = x;         v[0].y = y;          v[0].u = u0; v[0].v = v0; v[0].color = color;
+  v[1].x = x + width; v[1].y = y;          v[1].u = u1; v[1].v = v0; v[1].color = color;
+  v[2].x = x + width; v[2].y = y + height; v[2].u = u1; v[2].v = v1; v[2].color = color;
+  v[3].x = x;         v[3].y = y + height; v[3].u = u0; v[3].v = v1; v[3].color = color;
+
+  SpriteKey* key = &gSpriteBatch.keys[index];
+  key->glTextureId = texture.glTextureId;
+  key->pixelPerfect = texture.pixelPerfect;
+  key->index = index;
+}
+
+// by texture, then filter, then the order they were added in (so it's a stable sort)
+static int SpriteBatch_CompareKeys(const void* a, const void* b)
+{
+  const SpriteKey* first = a;
+  const SpriteKey* second = b;
+  if (first->glTextureId != second->glTextureId) return first->glTextureId < second->glTextureId ? -1 : 1;
+  if (first->pixelPerfect != second->pixelPerfect) return first->pixelPerfect - second->pixelPerfect;
+  return first->index - second->index;
+}
+
+void SpriteBatch_End()
+{
+  if (!gSpriteBatch.isActive)
+  {
+    DIAGNOSTIC_SPRITEBATCH_ERROR("SpriteBatch_End() without SpriteBatch_Begin()");
+    return;
+  }
+  gSpriteBatch.isActive = 0;
+  int32_t count = gSpriteBatch.count;
+  gSpriteBatch.count = 0;
+  if (count == 0) return;
+
+  SpriteVertex* vertices = gSpriteBatch.vertices;
+  SpriteKey* keys = gSpriteBatch.keys;
+  if (gSpriteBatch.sortByTexture)
+  {
+    qsort(keys, count, sizeof(SpriteKey), SpriteBatch_CompareKeys);
+    int32_t i;
+    for (i = 0; i < count; i++)
+    {
+      memcpy(&gSpriteBatch.sortedVertices[i * 4], &vertices[keys[i].index * 4], sizeof(SpriteVertex) * 4);
+    }
+    vertices = gSpriteBatch.sortedVertices;
+  }
+
+  // set up once for every sprite (color comes from the vertices, so GL_MODULATE tints any bmp, and draws masking
+  // bitmaps in that color)
+  GLfloat oldColor[4];
+  glGetFloatv(GL_CURRENT_COLOR, oldColor);
+  int oldTexEnv;
+  glGetTexEnviv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, &oldTexEnv);
+  glEnable(GL_TEXTURE_2D);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(SpriteVertex), &vertices[0].x);
+  glTexCoordPointer(2, GL_FLOAT, sizeof(SpriteVertex), &vertices[0].u);
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(SpriteVertex), &vertices[0].color);
+
+  // one draw per run of sprites that share a texture and filter
+  int32_t first;
+  for (first = 0; first < count; )
+  {
+    int32_t last = first + 1;
+    while (last < count && keys[last].glTextureId == keys[first].glTextureId && keys[last].pixelPerfect == keys[first].pixelPerfect) last++;
+
+    glBindTexture(GL_TEXTURE_2D, keys[first].glTextureId);
+    int filter = keys[first].pixelPerfect ? GL_NEAREST : GL_LINEAR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glDrawArrays(GL_QUADS, first * 4, (last - first) * 4);
+    first = last;
+  }
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisable(GL_BLEND);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, oldTexEnv);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisable(GL_TEXTURE_2D);
+  // (the current color is undefined after drawing with a color array)
+  glColor4fv(oldColor);
+}
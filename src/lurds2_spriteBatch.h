@@ -0,0 +1,40 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_SPRITEBATCH
+#define LURDS2_SPRITEBATCH
+
+#include "lurds2_bmp.h"
+
+// A SpriteBatch collects Bmp quads between SpriteBatch_Begin() and SpriteBatch_End() into vertex arrays, then
+// draws each run of sprites on the same texture with one glDrawArrays() (Bmps on the same atlas page share a
+// texture), instead of setting up and tearing down the GL state for every sprite like Bmp_Draw() does.
+// Positions are in the modelview coordinates that are current when SpriteBatch_End() is called.
+// Use it from the main (window) thread, one batch at a time.
+
+// a color for SpriteBatch_Add(), 0-255 each; white draws a bmp as it is, and is the color a masking bitmap draws in
+#define SPRITEBATCH_RGBA(r, g, b, a) ((uint32_t)(r) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16) | ((uint32_t)(a) << 24))
+#define SPRITEBATCH_WHITE 0xFFFFFFFF
+
+typedef struct SpriteRect {
+  int x;
+  int y;
+  int width;
+  int height;
+} SpriteRect;
+
+// with 'sortByTexture', sprites are grouped by texture regardless of the order they were added in (so a later one
+// may end up underneath an earlier one; fine for sprites that don't overlap). Otherwise they're drawn in order,
+// and only consecutive sprites on the same texture share a draw call.
+void SpriteBatch_Begin(int sortByTexture);
+// queues the 'source' part of 'bmp' (all of it when 0) to draw with its top-left corner at x, y, tinted by 'color'
+void SpriteBatch_Add(Bmp bmp, float x, float y, const SpriteRect* source, uint32_t color);
+// draws everything queued since SpriteBatch_Begin()
+void SpriteBatch_End();
+// returns 1 between SpriteBatch_Begin() and SpriteBatch_End()
+int  SpriteBatch_IsActive();
+
+#endif
@@ -13,13 +13,25 @@ Please refer to <http://unlicense.org/>
 #define DIAGNOSTIC_STACK_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3));
 #define DIAGNOSTIC_STACK_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
 
+// a stack that was cleared this many times in a row without getting past a quarter of its capacity gets shrunk
+#define STACK_SHRINK_AFTER_CLEARS 16
+
 typedef struct StackData {
   int32_t count; // number of elements in stack
   int32_t capacity; // maximum allowed 'count' before stack must be resized
   int8_t* elements; // allocated memory for elements in stack
   int32_t elementSize; // size of each element
+  int32_t shrinkMinCapacity; // capacity never shrinks below this (only used when shrinking is enabled)
+  int32_t peakCount; // highest 'count' since the last Stack_Clear()
+  int8_t shrinkEnabled;
+  int8_t smallClears; // consecutive clears whose 'peakCount' stayed under a quarter of 'capacity'
+  int8_t isCallerStorage; // StackData lives in memory the caller owns (so it isn't freed)
+  int32_t inlineCapacity; // number of elements that fit in 'inlineElements'
+  int8_t* inlineElements; // storage right after the StackData header (or 0); 'elements' points here until it spills
 } StackData;
 
+BUILD_ASSERT(sizeof(StackData) <= STACK_STORAGE_HEADER_SIZE);
+
 Stack Stack_Create(int32_t elementSize)
 {
   if (elementSize < 1)
@@ -39,48 +51,234 @@ Stack Stack_Create(int32_t elementSize)
   return data;
 }
 
-void* Stack_Push(Stack stack)
+// sets up a StackData header at the start of 'memory', with room for 'inlineCapacity' elements after it
+static StackData* Stack_InitStorage(void* memory, int32_t elementSize, int32_t inlineCapacity)
 {
-  StackData* data = (StackData*)stack;
-  if (data == 0)
+  StackData* data = (StackData*)memory;
+  memset(data, 0, sizeof(StackData));
+  data->elementSize = elementSize;
+  data->inlineCapacity = inlineCapacity;
+  if (inlineCapacity > 0)
   {
-    DIAGNOSTIC_STACK_ERROR("invalid null arg");
+    data->inlineElements = (int8_t*)memory + STACK_STORAGE_HEADER_SIZE;
+    data->elements = data->inlineElements;
+    data->capacity = inlineCapacity;
+  }
+  return data;
+}
+
+Stack Stack_CreateWithInlineCapacity(int32_t elementSize, int32_t inlineCapacity)
+{
+  if (elementSize < 1)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid elementSize arg");
     return 0;
   }
-  
-  // grow the stack when needed
-  if (data->count == data->capacity)
+
+  if (inlineCapacity < 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid inlineCapacity arg");
+    return 0;
+  }
+
+  int64_t size64 = STACK_STORAGE_HEADER_SIZE + (int64_t)elementSize * inlineCapacity;
+  if (size64 > 0x7FFFFFFF)
+  {
+    DIAGNOSTIC_STACK_ERROR("inlineCapacity too large");
+    return 0;
+  }
+
+  void* memory = malloc((size_t)size64);
+  if (memory == 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("failed to allocate memory for StackData");
+    return 0;
+  }
+  return Stack_InitStorage(memory, elementSize, inlineCapacity);
+}
+
+Stack Stack_CreateInStorage(int32_t elementSize, void* storage, int32_t storageSize)
+{
+  if (elementSize < 1)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid elementSize arg");
+    return 0;
+  }
+
+  if (storage == 0 || ((uintptr_t)storage & 7) != 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid storage arg; must be non-null and 8-byte aligned");
+    return 0;
+  }
+
+  if (storageSize < STACK_STORAGE_HEADER_SIZE)
   {
-    int64_t newCapacity64 = (data->capacity + 1) * 2;
-    int32_t newCapacity = (int32_t)newCapacity64;
-    if (newCapacity64 > newCapacity)
+    DIAGNOSTIC_STACK_ERROR("invalid storageSize arg; too small for the stack header");
+    return 0;
+  }
+
+  StackData* data = Stack_InitStorage(storage, elementSize, (storageSize - STACK_STORAGE_HEADER_SIZE) / elementSize);
+  data->isCallerStorage = 1;
+  return data;
+}
+
+// moves the elements to exactly 'newCapacity' elements of storage (which must hold 'count'), going back into
+// the inline storage whenever they fit there; returns 0 on failure
+static int Stack_Resize(StackData* data, int32_t newCapacity)
+{
+  int8_t* heapElements = data->elements != data->inlineElements ? data->elements : 0;
+  int32_t usedSpace = data->count * data->elementSize;
+
+  if (newCapacity <= data->inlineCapacity)
+  {
+    if (heapElements)
     {
-      DIAGNOSTIC_STACK_ERROR("can't grow stack; too large");
-      return 0;
+      if (usedSpace > 0) memcpy(data->inlineElements, heapElements, usedSpace);
+      free(heapElements);
     }
+    data->elements = data->inlineElements;
+    data->capacity = data->inlineCapacity;
+    return 1;
+  }
+
+  int64_t newSpace64 = (int64_t)newCapacity * data->elementSize;
+  if (newSpace64 > 0x7FFFFFFF)
+  {
+    DIAGNOSTIC_STACK_ERROR("can't grow stack; too large");
+    return 0;
+  }
 
-    int64_t newSpace64 = newCapacity * data->elementSize;
-    int32_t newSpace = (int32_t)newSpace64;
-    if (newSpace64 > newSpace)
+  int8_t* newData;
+  if (heapElements)
+  {
+    newData = realloc(heapElements, (size_t)newSpace64);
+  }
+  else
+  {
+    // spilling out of the inline storage
+    newData = malloc((size_t)newSpace64);
+    if (newData != 0 && usedSpace > 0) memcpy(newData, data->elements, usedSpace);
+  }
+  if (newData == 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("can't resize stack; out of memory");
+    return 0;
+  }
+  data->elements = newData;
+  data->capacity = newCapacity;
+  return 1;
+}
+
+// makes room for at least 'needed' elements, doubling so repeated pushes stay cheap
+static int Stack_Grow(StackData* data, int64_t needed)
+{
+  if (needed <= data->capacity)
+  {
+    return 1;
+  }
+
+  int64_t newCapacity = ((int64_t)data->capacity + 1) * 2;
+  if (newCapacity < needed) newCapacity = needed;
+  if (newCapacity > 0x7FFFFFFF)
+  {
+    if (needed > 0x7FFFFFFF)
     {
       DIAGNOSTIC_STACK_ERROR("can't grow stack; too large");
       return 0;
     }
-    
-    void* newData = realloc(data->elements, newSpace);
-    if (newData == 0)
-    {
-      DIAGNOSTIC_STACK_ERROR("can't grow stack; out of memory");
-      return 0;
-    }
-    data->elements = newData;
-    data->capacity = newCapacity;
-    int32_t oldSpace = data->elementSize * data->count;
-    memset(data->elements + oldSpace, 0, newSpace - oldSpace);
+    newCapacity = needed;
+  }
+  return Stack_Resize(data, (int32_t)newCapacity);
+}
+
+// gives back memory, down to 'newCapacity' elements (but never below the shrink minimum or 'count')
+static void Stack_Shrink(StackData* data, int32_t newCapacity)
+{
+  if (newCapacity < data->shrinkMinCapacity) newCapacity = data->shrinkMinCapacity;
+  if (newCapacity < data->count) newCapacity = data->count;
+  if (newCapacity >= data->capacity || data->elements == data->inlineElements)
+  {
+    return;
+  }
+  Stack_Resize(data, newCapacity);
+}
+
+int Stack_Reserve(Stack stack, int32_t capacity)
+{
+  StackData* data = (StackData*)stack;
+  if (data == 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid null arg");
+    return 0;
+  }
+
+  if (capacity < 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid capacity arg");
+    return 0;
+  }
+
+  if (capacity <= data->capacity)
+  {
+    return 1;
+  }
+  return Stack_Resize(data, capacity);
+}
+
+void* Stack_Push(Stack stack)
+{
+  StackData* data = (StackData*)stack;
+  if (data == 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid null arg");
+    return 0;
+  }
+  
+  // grow the stack when needed
+  if (data->count == data->capacity && !Stack_Grow(data, (int64_t)data->count + 1))
+  {
+    return 0;
   }
   
+  // (only the new element gets zeroed; the rest of the spare capacity is never looked at)
   void* result = data->elements + data->count * data->elementSize;
+  memset(result, 0, data->elementSize);
   data->count++;
+  if (data->count > data->peakCount) data->peakCount = data->count;
+  return result;
+}
+
+void* Stack_PushMany(Stack stack, const void* elements, int32_t count)
+{
+  StackData* data = (StackData*)stack;
+  if (data == 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid null arg");
+    return 0;
+  }
+
+  if (count < 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid count arg");
+    return 0;
+  }
+
+  if (!Stack_Grow(data, (int64_t)data->count + count))
+  {
+    return 0;
+  }
+
+  void* result = data->elements + data->count * data->elementSize;
+  if (elements)
+  {
+    memcpy(result, elements, (size_t)count * data->elementSize);
+  }
+  else
+  {
+    memset(result, 0, (size_t)count * data->elementSize);
+  }
+  data->count += count;
+  if (data->count > data->peakCount) data->peakCount = data->count;
   return result;
 }
 
@@ -135,10 +333,65 @@ void Stack_Pop(Stack stack)
   else
   {
     data->count--;
-    // TODO: could theoreticall reduce the stack size when it gets small, but meh
+    // growing when full but only halving at a quarter full keeps a stack that hovers around one size
+    // from reallocating over and over
+    if (data->shrinkEnabled && data->count < data->capacity / 4)
+    {
+      Stack_Shrink(data, data->capacity / 2);
+    }
   }
 }
 
+void Stack_Clear(Stack stack)
+{
+  StackData* data = (StackData*)stack;
+  if (data == 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid null arg");
+    return;
+  }
+
+  data->count = 0;
+  if (data->shrinkEnabled)
+  {
+    // a stack that's refilled every frame only shrinks after staying small for a while,
+    // and then only down to what it actually used
+    if (data->peakCount < data->capacity / 4)
+    {
+      if (++data->smallClears >= STACK_SHRINK_AFTER_CLEARS)
+      {
+        Stack_Shrink(data, data->peakCount * 2);
+        data->smallClears = 0;
+      }
+    }
+    else
+    {
+      data->smallClears = 0;
+    }
+  }
+  data->peakCount = 0;
+}
+
+void Stack_EnableShrinking(Stack stack, int32_t minCapacity)
+{
+  StackData* data = (StackData*)stack;
+  if (data == 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid null arg");
+    return;
+  }
+
+  if (minCapacity < 0)
+  {
+    DIAGNOSTIC_STACK_ERROR("invalid minCapacity arg");
+    return;
+  }
+
+  data->shrinkEnabled = 1;
+  data->shrinkMinCapacity = minCapacity;
+  data->smallClears = 0;
+}
+
 int32_t Stack_Count(Stack stack)
 {
   StackData* data = (StackData*)stack;
@@ -159,9 +412,12 @@ void Stack_Release(Stack stack)
     return;
   }
   
-  if (data->elements)
+  if (data->elements && data->elements != data->inlineElements)
   {
     free(data->elements);
   }
-  free(data);
+  if (!data->isCallerStorage)
+  {
+    free(data);
+  }
 }
@@ -9,12 +9,32 @@ Please refer to <http://unlicense.org/>
 
 typedef void* Stack;
 
+// bytes of bookkeeping at the start of a Stack_CreateInStorage() buffer; the elements come after it
+#define STACK_STORAGE_HEADER_SIZE 64
+#define STACK_STORAGE_SIZE(elementSize, inlineCapacity) (STACK_STORAGE_HEADER_SIZE + (elementSize) * (inlineCapacity))
+
 // A Stack allows push/pop of fixed-size elements
 Stack Stack_Create(int32_t elementSize);
+// keeps the first 'inlineCapacity' elements in the same allocation as the stack itself, so small stacks never
+// allocate again; only growing past that spills them to the heap
+Stack Stack_CreateWithInlineCapacity(int32_t elementSize, int32_t inlineCapacity);
+// builds the stack inside caller-owned memory (8-byte aligned, e.g. an int64_t array of STACK_STORAGE_SIZE() bytes),
+// so it costs no allocations at all until it outgrows that; Stack_Release() then frees only the spilled elements
+Stack Stack_CreateInStorage(int32_t elementSize, void* storage, int32_t storageSize);
+// makes room for 'capacity' elements up front, so pushes up to that many never reallocate; returns 0 on failure
+int   Stack_Reserve(Stack stack, int32_t capacity);
+// returns the new (zeroed) element
 void* Stack_Push(Stack stack);
+// appends 'count' elements copied from 'elements' (or zeroed, when 'elements' is null); returns the first of them
+void* Stack_PushMany(Stack stack, const void* elements, int32_t count);
 void* Stack_Peek(Stack stack);
 void* Stack_Get(Stack stack, int32_t index);
 void Stack_Pop(Stack stack);
+// empties the stack but keeps its memory for the next fill
+void Stack_Clear(Stack stack);
+// opt-in: lets the stack give memory back (never below 'minCapacity') once it pops down to a quarter full,
+// or after it has been cleared many times in a row without getting past a quarter full
+void Stack_EnableShrinking(Stack stack, int32_t minCapacity);
 int32_t Stack_Count(Stack stack);
 void Stack_Release(Stack stack);
 
@@ -14,10 +14,22 @@ Please refer to <http://unlicense.org/>
 #include "lurds2_performanceCounter.c"
 #include "lurds2_resourceFile.c"
 #include "lurds2_looa.c"
+#include "lurds2_atlas.c"
 #include "lurds2_bmp.c"
+#include "lurds2_spriteBatch.c"
 #include "lurds2_jsonstream.c"
+#include "lurds2_jsonwriter.c"
 #include "lurds2_stack.c"
+#include "lurds2_hashmap.c"
+#include "lurds2_pool.c"
+#include "lurds2_ring.c"
+#include "lurds2_resourceCache.c"
+#include "lurds2_arena.c"
 #include "lurds2_stringutils.c"
+#include "lurds2_hash.c"
+#include "lurds2_pak.c"
+#include "lurds2_vfs.c"
+#include "lurds2_watch.c"
 #include "lurds2_font.c"
 #include "lurds2_plate.c"
 
@@ -80,6 +92,8 @@ static void DrawSomeGl(HWND hwnd);
 static void HandleGlyphFinderKey(HWND hwnd, int key);
 static void DrawGlyphFinderStats(HDC hdc);
 static void MemoryLeakTimerProc(HWND hwnd, UINT message, UINT_PTR id, DWORD msSinceSystemStart);
+static void RepaintOnResourceChanged(void* userData, const char* name);
+static int WriteTestBmpHeader(uint8_t* file, int width, int height, int bitCount, int colorCount, int pixelDataSize);
 
 int APIENTRY WinMain(
   HINSTANCE hInstance,
@@ -90,6 +104,13 @@ int APIENTRY WinMain(
   MSG msg;
   WNDCLASS wc;
 
+  // index the resource files, Lords2 files, mods and archives once, up front
+  ResourceFile_MountAll(0);
+
+  // reload resources in place when their files are edited (see ResourceFile_DispatchChanged() below)
+  ResourceFile_AddChangeListener(RepaintOnResourceChanged, 0);
+  ResourceFile_StartWatching();
+
   ZeroMemory(&wc, sizeof wc);
   wc.hInstance     = hInstance;
   wc.lpszClassName = mainWindowClassName;
@@ -183,6 +204,11 @@ int APIENTRY WinMain(
   CreateButton(mainWindowHandle, 1353, "FontTests", 75, 85, 65);
   CreateButton(mainWindowHandle, 1354, "PlateTests-1", 100, 160, 65);
   CreateButton(mainWindowHandle, 1355, "Castle", 55, 10, 95);
+  CreateButton(mainWindowHandle, 1356, "HashMapTests", 100, 65, 95);
+  CreateButton(mainWindowHandle, 1357, "PoolTests", 75, 165, 95);
+  CreateButton(mainWindowHandle, 1358, "CacheTests", 80, 10, 125);
+  CreateButton(mainWindowHandle, 1359, "AtlasTests", 80, 90, 125);
+  CreateButton(mainWindowHandle, 1360, "BmpTests", 70, 170, 125);
 
   // Create and populate the palette picker combobox
   palettePickerHandle = CreateWindow(WC_COMBOBOX, TEXT(""), 
@@ -215,13 +241,29 @@ int APIENTRY WinMain(
   // Main message loop:
   while (GetMessage(&msg, NULL, 0, 0) > 0)
   {
+    Arena_BeginFrame();
     TranslateMessage(&msg);
     DispatchMessage(&msg);
+    ResourceFile_DispatchLoaded();
+    ResourceFile_DispatchChanged();
   }
 
   return msg.wParam;
 }
 
+static void RepaintOnResourceChanged(void* userData, const char* name)
+{
+  if (mainWindowHandle != 0) InvalidateRect(mainWindowHandle, 0, 1);
+}
+
+static void CastleLoaded(void* userData, Bmp* bitmaps)
+{
+  if (bitmaps == 0) { DIAGNOSTIC_ERROR("no castles 4 u"); return; }
+  if (castleBitmaps != 0) Plate_ReleaseShared(castleBitmaps);
+  castleBitmaps = bitmaps;
+  InvalidateRect((HWND)userData, 0, 1);
+}
+
 static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
   switch (message) {
@@ -428,11 +470,278 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT message, WPARAM wParam, LPAR
               if (Stack_Count(s) != s2) DIAGNOSTIC_ERROR("stack size should be something here");
             }
             if (Stack_Count(s) != 0) DIAGNOSTIC_ERROR("stack count should finally be 0 here");
+            int many[100];
+            int s2;
+            for (s2 = 0; s2 < 100; s2++) many[s2] = s2 * 3;
+            if (!Stack_Reserve(s, 50)) DIAGNOSTIC_ERROR("reserve failed?");
+            if (Stack_PushMany(s, many, 100) == 0) DIAGNOSTIC_ERROR("push many failed?");
+            if (Stack_Count(s) != 100) DIAGNOSTIC_ERROR("stack size should be 100 after push many");
+            if (*(int*)Stack_Get(s, 99) != 297) DIAGNOSTIC_ERROR("push many copied unexpected values");
+            Stack_EnableShrinking(s, 4);
+            Stack_Clear(s);
+            if (Stack_Count(s) != 0) DIAGNOSTIC_ERROR("stack count should be 0 after clear");
+            int* s6 = Stack_Push(s);
+            if (s6 == 0 || *s6 != 0) DIAGNOSTIC_ERROR("pushed element should be zeroed");
+            Stack_Release(s);
+
+            int64_t storage[STACK_STORAGE_SIZE(sizeof(int), 8) / sizeof(int64_t)];
+            s = Stack_CreateInStorage(sizeof(int), storage, sizeof(storage));
+            if (Stack_PushMany(s, many, 100) == 0) DIAGNOSTIC_ERROR("push many past the inline storage failed?");
+            for (s2 = 0; s2 < 100; s2++)
+            {
+              if (*(int*)Stack_Get(s, s2) != s2 * 3) DIAGNOSTIC_ERROR("spilled stack has unexpected values");
+            }
             Stack_Release(s);
             MessageBox(0, "stack tested ok i guess", 0, 0);
           }
           break;
           
+          case 1356:
+          {
+            HashMap m = HashMap_Create(sizeof(int), sizeof(int));
+            int m2;
+            for (m2 = 0; m2 < 1000; m2++)
+            {
+              int value = m2 * 7;
+              if (HashMap_Set(m, &m2, &value) == 0) DIAGNOSTIC_ERROR("hash map set failed?");
+            }
+            if (HashMap_Count(m) != 1000) DIAGNOSTIC_ERROR("hash map count should be 1000 here");
+            for (m2 = 0; m2 < 1000; m2 += 2)
+            {
+              if (!HashMap_Remove(m, &m2)) DIAGNOSTIC_ERROR("hash map remove failed?");
+            }
+            for (m2 = 0; m2 < 1000; m2++)
+            {
+              int* m3 = HashMap_Get(m, &m2);
+              if ((m2 & 1) == 0 && m3 != 0) DIAGNOSTIC_ERROR("removed key still in hash map");
+              if ((m2 & 1) == 1 && (m3 == 0 || *m3 != m2 * 7)) DIAGNOSTIC_ERROR("hash map lost a key");
+            }
+            int added;
+            int missingKey = -5;
+            int* m4 = HashMap_GetOrAdd(m, &missingKey, &added);
+            if (m4 == 0 || !added || *m4 != 0) DIAGNOSTIC_ERROR("get-or-add should have added a zeroed value");
+            int32_t position = 0;
+            int visited = 0;
+            while (HashMap_Next(m, &position, 0, 0)) visited++;
+            if (visited != 501) DIAGNOSTIC_ERROR("hash map iteration should visit 501 entries");
+            HashMap_Release(m);
+            MessageBox(0, "hash map tested ok i guess", 0, 0);
+          }
+          break;
+
+          case 1357:
+          {
+            Pool p = Pool_Create(sizeof(int));
+            PoolHandle handles[1000];
+            int p2;
+            for (p2 = 0; p2 < 1000; p2++)
+            {
+              int* p3 = Pool_Add(p, &handles[p2]);
+              if (p3 == 0 || *p3 != 0 || handles[p2] == 0) DIAGNOSTIC_ERROR("pool add should give a zeroed element and a nonzero handle");
+              else *p3 = p2 * 7;
+            }
+            for (p2 = 0; p2 < 1000; p2 += 2)
+            {
+              if (!Pool_Remove(p, handles[p2])) DIAGNOSTIC_ERROR("pool remove failed?");
+            }
+            if (Pool_Remove(p, handles[0])) DIAGNOSTIC_ERROR("pool removed the same handle twice");
+            if (Pool_Count(p) != 500) DIAGNOSTIC_ERROR("pool count should be 500 here");
+            for (p2 = 0; p2 < 1000; p2++)
+            {
+              int* p3 = Pool_Get(p, handles[p2]);
+              if ((p2 & 1) == 0 && p3 != 0) DIAGNOSTIC_ERROR("stale pool handle still resolves");
+              if ((p2 & 1) == 1 && (p3 == 0 || *p3 != p2 * 7)) DIAGNOSTIC_ERROR("pool lost an element");
+            }
+            // freed slots get reused, but under a new generation
+            PoolHandle reused;
+            Pool_Add(p, &reused);
+            if (reused == handles[998] || Pool_Get(p, handles[998]) != 0) DIAGNOSTIC_ERROR("reused pool slot should get a new handle");
+            int32_t position = 0;
+            int visited = 0;
+            while (Pool_Next(p, &position, 0)) visited++;
+            if (visited != 501) DIAGNOSTIC_ERROR("pool iteration should visit 501 elements");
+            Pool_Release(p);
+
+            // the engine objects are pooled too, so released ones get caught
+            uint8_t pixels[16];
+            memset(pixels, 255, sizeof(pixels));
+            int32_t liveBmps = Bmp_GetLiveCount();
+            Bmp b = Bmp_LoadFromRgba(pixels, 2, 2);
+            if (Bmp_GetLiveCount() != liveBmps + 1) DIAGNOSTIC_ERROR("new bmp should be live");
+            Bmp_Release(b);
+            if (Bmp_GetLiveCount() != liveBmps) DIAGNOSTIC_ERROR("released bmp should not be live");
+            SuppressDiagnosticErrors(1);
+            int staleWidth = Bmp_GetWidth(b);
+            SuppressDiagnosticErrors(0);
+            if (staleWidth != 0) DIAGNOSTIC_ERROR("released bmp should not resolve");
+            MessageBox(0, "pool tested ok i guess", 0, 0);
+          }
+          break;
+
+          case 1358:
+          {
+            ResourceCache c = ResourceCache_Create(100);
+            int* v1 = malloc(sizeof(int));
+            int* v2 = malloc(sizeof(int));
+            int* v3 = malloc(sizeof(int));
+            if (ResourceCache_Add(c, "one", 3, v1, 60, free) != v1) DIAGNOSTIC_ERROR("cache add failed?");
+            if (ResourceCache_Acquire(c, "one", 3) != v1) DIAGNOSTIC_ERROR("cache should hand out the same value");
+            if (ResourceCache_Acquire(c, "two", 3) != 0) DIAGNOSTIC_ERROR("cache should miss an unknown key");
+            ResourceCache_Unref(c, v1);
+            ResourceCache_Unref(c, v1);
+            if (ResourceCache_GetCount(c) != 1) DIAGNOSTIC_ERROR("unreferenced value under budget should stay cached");
+            // referenced values are never evicted, even over budget
+            ResourceCache_Add(c, "two", 3, v2, 60, free);
+            if (ResourceCache_GetCount(c) != 1 || ResourceCache_Acquire(c, "one", 3) != 0) DIAGNOSTIC_ERROR("least recently used value should have been evicted");
+            ResourceCache_Add(c, "three", 5, v3, 60, free);
+            if (ResourceCache_GetCount(c) != 2 || ResourceCache_GetUsedBytes(c) != 120) DIAGNOSTIC_ERROR("referenced values should stay cached");
+            ResourceCache_Unref(c, v2);
+            if (ResourceCache_GetCount(c) != 1) DIAGNOSTIC_ERROR("unreferenced value over budget should be evicted");
+            ResourceCache_Unref(c, v3);
+            ResourceCache_SetBudget(c, 0);
+            if (ResourceCache_GetCount(c) != 0 || ResourceCache_GetUsedBytes(c) != 0) DIAGNOSTIC_ERROR("budget 0 should evict everything");
+            ResourceCache_Release(c);
+            MessageBox(0, "cache tested ok i guess", 0, 0);
+          }
+          break;
+
+          case 1359:
+          {
+            // a 3x2 red image and a 2x4 blue one
+            uint32_t redPixels[6];
+            uint32_t bluePixels[8];
+            int a2;
+            for (a2 = 0; a2 < 6; a2++) redPixels[a2] = 0xFF0000FF;
+            for (a2 = 0; a2 < 8; a2++) bluePixels[a2] = 0xFFFF0000;
+            uint8_t* atlasPixels[2] = { (uint8_t*)redPixels, (uint8_t*)bluePixels };
+            int atlasWidths[2] = { 3, 2 };
+            int atlasHeights[2] = { 2, 4 };
+            Bmp atlasBmps[2];
+            int32_t liveBmps = Bmp_GetLiveCount();
+            if (!Bmp_LoadAtlas(atlasPixels, atlasWidths, atlasHeights, 2, atlasBmps)) DIAGNOSTIC_ERROR("atlas load failed");
+
+            // each Bmp keeps its own size, but they share one page (which counts as a live Bmp too)
+            if (Bmp_GetWidth(atlasBmps[0]) != 3 || Bmp_GetHeight(atlasBmps[0]) != 2) DIAGNOSTIC_ERROR("atlas bmp 0 has the wrong size");
+            if (Bmp_GetWidth(atlasBmps[1]) != 2 || Bmp_GetHeight(atlasBmps[1]) != 4) DIAGNOSTIC_ERROR("atlas bmp 1 has the wrong size");
+            if (Bmp_GetLiveCount() != liveBmps + 3) DIAGNOSTIC_ERROR("two atlas bmps should share one page");
+            BmpTexture red, blue;
+            if (!Bmp_GetTexture(atlasBmps[0], &red) || !Bmp_GetTexture(atlasBmps[1], &blue)) DIAGNOSTIC_ERROR("atlas bmps should have textures");
+            if (red.glTextureId != blue.glTextureId) DIAGNOSTIC_ERROR("atlas bmps should share a texture");
+            if (red.u0 >= red.u1 || red.v0 >= red.v1 || red.u1 > 1 || red.v1 > 1) DIAGNOSTIC_ERROR("atlas bmp 0 should cover part of the page");
+            if (red.u0 < blue.u1 && blue.u0 < red.u1 && red.v0 < blue.v1 && blue.v0 < red.v1) DIAGNOSTIC_ERROR("atlas bmps should not overlap");
+
+            // the page goes with the last of its Bmps, whichever order they go in
+            Bmp_Release(atlasBmps[1]);
+            if (Bmp_GetLiveCount() != liveBmps + 2) DIAGNOSTIC_ERROR("atlas page should stay while a bmp uses it");
+            Bmp_Release(atlasBmps[0]);
+            if (Bmp_GetLiveCount() != liveBmps) DIAGNOSTIC_ERROR("atlas page should go with its last bmp");
+            MessageBox(0, "atlas tested ok i guess", 0, 0);
+          }
+          break;
+
+          case 1360:
+          {
+            uint8_t bmpFile[256];
+            uint8_t* pixelData;
+            uint32_t* decoded;
+            int fileSize, decodedWidth, decodedHeight;
+            int b2, row, column;
+
+            // 24-bit, bottom-up and top-down, at widths that leave every tail after the 4-pixels-at-a-time part
+            // (each pixel gets its own color, so a pixel or row out of place shows up)
+            static const int widths[] = { 1, 3, 4, 5, 7, 9 };
+            for (b2 = 0; b2 < 12; b2++)
+            {
+              int width = widths[b2 / 2];
+              int isTopDown = b2 & 1;
+              int rowStride = (width * 3 + 3) & ~3;
+              fileSize = WriteTestBmpHeader(bmpFile, width, isTopDown ? -3 : 3, 24, 0, rowStride * 3);
+              pixelData = bmpFile + 54;
+              for (row = 0; row < 3; row++)
+              {
+                for (column = 0; column < width; column++)
+                {
+                  uint8_t* bgr = pixelData + (isTopDown ? row : 2 - row) * rowStride + column * 3;
+                  bgr[0] = (uint8_t)(16 * column + row);
+                  bgr[1] = (uint8_t)(100 + column);
+                  bgr[2] = (uint8_t)(200 + row * 10 + column);
+                }
+              }
+              decoded = (uint32_t*)Bmp_DecodeToRgba(bmpFile, fileSize, 0, &decodedWidth, &decodedHeight);
+              if (decoded == 0 || decodedWidth != width || decodedHeight != 3) DIAGNOSTIC_ERROR("24-bit bmp should decode");
+              for (row = 0; decoded && row < 3; row++)
+              {
+                for (column = 0; column < width; column++)
+                {
+                  uint32_t expected = (200 + row * 10 + column) | ((100 + column) << 8) | ((16 * column + row) << 16) | 0xFF000000;
+                  if (decoded[row * width + column] != expected) DIAGNOSTIC_ERROR("24-bit bmp pixel decoded wrong or out of place");
+                }
+              }
+              free(decoded);
+            }
+
+            // a 2x1 24-bit bmp holding white then pure red; only the white pixel should mask as transparent
+            fileSize = WriteTestBmpHeader(bmpFile, 2, 1, 24, 0, 8);
+            pixelData = bmpFile + 54;
+            memset(pixelData, 255, 3);
+            pixelData[5] = 255;
+            decoded = (uint32_t*)Bmp_DecodeToRgba(bmpFile, fileSize, 1, &decodedWidth, &decodedHeight);
+            if (decoded == 0 || decodedWidth != 2 || decodedHeight != 1 || decoded[0] != 0x00FFFFFF || decoded[1] != 0xFFFFFFFF) DIAGNOSTIC_ERROR("bmp should decode with only pure white masked out");
+            free(decoded);
+
+            // 8-bit paletted, 3x2 bottom-up, with a 3 color table (so index 7 is out of range, and black)
+            fileSize = WriteTestBmpHeader(bmpFile, 3, 2, 8, 3, 8);
+            uint8_t* colors = bmpFile + 54;
+            colors[0] = 10; colors[1] = 20; colors[2] = 30;
+            colors[4] = 255; colors[5] = 255; colors[6] = 255;
+            colors[8] = 0; colors[9] = 0; colors[10] = 255;
+            pixelData = bmpFile + 54 + 3 * 4;
+            pixelData[0] = 2; pixelData[1] = 7; pixelData[2] = 0; // (bottom row)
+            pixelData[4] = 1; pixelData[5] = 0; pixelData[6] = 2;
+            decoded = (uint32_t*)Bmp_DecodeToRgba(bmpFile, fileSize, 0, &decodedWidth, &decodedHeight);
+            if (decoded == 0 || decodedWidth != 3 || decodedHeight != 2 ||
+                decoded[0] != 0xFFFFFFFF || decoded[1] != 0xFF0A141E || decoded[2] != 0xFF0000FF ||
+                decoded[3] != 0xFF0000FF || decoded[4] != 0xFF000000 || decoded[5] != 0xFF0A141E) DIAGNOSTIC_ERROR("8-bit bmp should decode through its color table");
+            free(decoded);
+            decoded = (uint32_t*)Bmp_DecodeToRgba(bmpFile, fileSize, 1, &decodedWidth, &decodedHeight);
+            if (decoded == 0 || decoded[0] != 0x00FFFFFF || decoded[1] != 0xFFFFFFFF || decoded[4] != 0xFFFFFFFF) DIAGNOSTIC_ERROR("8-bit bmp should mask only pure white");
+            free(decoded);
+
+            // 32-bit BGRX, 2x2 top-down; the 4th byte isn't alpha, so it's ignored
+            fileSize = WriteTestBmpHeader(bmpFile, 2, -2, 32, 0, 16);
+            pixelData = bmpFile + 54;
+            for (b2 = 0; b2 < 4; b2++)
+            {
+              pixelData[b2 * 4] = (uint8_t)(b2 + 1);
+              pixelData[b2 * 4 + 1] = (uint8_t)(b2 + 50);
+              pixelData[b2 * 4 + 2] = (uint8_t)(b2 + 100);
+              pixelData[b2 * 4 + 3] = 0x7F;
+            }
+            decoded = (uint32_t*)Bmp_DecodeToRgba(bmpFile, fileSize, 0, &decodedWidth, &decodedHeight);
+            if (decoded == 0 || decodedWidth != 2 || decodedHeight != 2) DIAGNOSTIC_ERROR("32-bit bmp should decode");
+            for (b2 = 0; decoded && b2 < 4; b2++)
+            {
+              if (decoded[b2] != ((b2 + 100) | ((b2 + 50) << 8) | ((b2 + 1) << 16) | 0xFF000000)) DIAGNOSTIC_ERROR("32-bit bmp pixel decoded wrong or out of place");
+            }
+            free(decoded);
+            memset(pixelData, 255, 4);
+            decoded = (uint32_t*)Bmp_DecodeToRgba(bmpFile, fileSize, 1, &decodedWidth, &decodedHeight);
+            if (decoded == 0 || decoded[0] != 0x00FFFFFF || decoded[1] != 0xFFFFFFFF) DIAGNOSTIC_ERROR("32-bit bmp should mask only pure white");
+            free(decoded);
+
+            // headers that mustn't get as far as any size math
+            SuppressDiagnosticErrors(1);
+            fileSize = WriteTestBmpHeader(bmpFile, 0, 1, 24, 0, 0);
+            if (Bmp_DecodeToRgba(bmpFile, fileSize, 0, &decodedWidth, &decodedHeight) != 0) DIAGNOSTIC_ERROR("zero width bmp should be rejected");
+            fileSize = WriteTestBmpHeader(bmpFile, 1, 0, 24, 0, 0);
+            if (Bmp_DecodeToRgba(bmpFile, fileSize, 0, &decodedWidth, &decodedHeight) != 0) DIAGNOSTIC_ERROR("zero height bmp should be rejected");
+            fileSize = WriteTestBmpHeader(bmpFile, 1, INT32_MIN, 24, 0, 4);
+            if (Bmp_DecodeToRgba(bmpFile, fileSize, 0, &decodedWidth, &decodedHeight) != 0) DIAGNOSTIC_ERROR("most negative height bmp should be rejected");
+            SuppressDiagnosticErrors(0);
+            MessageBox(0, "bmp tested ok i guess", 0, 0);
+          }
+          break;
+
           case 1352:
           {
             JsonStream s = JsonStream_Parse("blah", "test1.json");
@@ -508,6 +817,61 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT message, WPARAM wParam, LPAR
             if (t != JsonStreamEnd) DIAGNOSTIC_ERROR("test3 fifteenth step should have been stream end?");
             JsonStream_Release(s);
 
+            // test4: same kind of thing, but fed in pieces that split tokens
+            s = JsonStream_CreateIncremental("test4.json");
+            t = JsonStream_MoveNext(s);
+            if (t != JsonStreamNeedMoreData) DIAGNOSTIC_ERROR("test4 should have needed data before anything was fed?");
+            JsonStream_Feed(s, "{ \"na", 5);
+            t = JsonStream_MoveNext(s);
+            if (t != JsonStreamObjectStart) DIAGNOSTIC_ERROR("test4 first step should have been object start?");
+            t = JsonStream_MoveNext(s);
+            if (t != JsonStreamNeedMoreData) DIAGNOSTIC_ERROR("test4 should have needed data in the middle of a property name?");
+            JsonStream_Feed(s, "me\": tr", 7);
+            t = JsonStream_MoveNext(s);
+            if (t != JsonStreamPropertyName) DIAGNOSTIC_ERROR("test4 second step should have been property name?");
+            v = JsonStream_GetString(s, &u);
+            if (u != 4 || strcmp(v, "name") != 0) DIAGNOSTIC_ERROR("expected test4 property name == name");
+            t = JsonStream_MoveNext(s);
+            if (t != JsonStreamNeedMoreData) DIAGNOSTIC_ERROR("test4 should have needed data in the middle of true?");
+            JsonStream_Feed(s, "ue }", 4);
+            JsonStream_FeedEnd(s);
+            t = JsonStream_MoveNext(s);
+            if (t != JsonStreamTrue) DIAGNOSTIC_ERROR("test4 third step should have been true?");
+            t = JsonStream_MoveNext(s);
+            if (t != JsonStreamObjectEnd) DIAGNOSTIC_ERROR("test4 fourth step should have been object end?");
+            t = JsonStream_MoveNext(s);
+            if (t != JsonStreamEnd) DIAGNOSTIC_ERROR("test4 fifth step should have been stream end?");
+            JsonStream_Release(s);
+
+            // test5: write some json and read it back
+            JsonWriter jw = JsonWriter_Create(0, 0);
+            JsonWriter_BeginObject(jw);
+            JsonWriter_PropertyName(jw, "name", -1);
+            JsonWriter_String(jw, "charley \"the unicorn\"\r\n", -1);
+            JsonWriter_PropertyName(jw, "stats", -1);
+            JsonWriter_BeginArray(jw);
+            JsonWriter_Int(jw, -1234567890123LL);
+            JsonWriter_Double(jw, 0.075);
+            JsonWriter_Null(jw);
+            JsonWriter_EndArray(jw);
+            if (!JsonWriter_EndObject(jw)) DIAGNOSTIC_ERROR("test5 writing should have worked?");
+            const char* jwText = JsonWriter_GetData(jw, &u);
+            if (u != 74 || memcmp(jwText, "{\"name\":\"charley \\\"the unicorn\\\"\\r\\n\",\"stats\":[-1234567890123,0.075,null]}", u) != 0) DIAGNOSTIC_ERROR("test5 wrote unexpected json?");
+            s = JsonStream_ParseRange(jwText, jwText + u, "test5.json");
+            JsonStream_MoveNext(s);
+            JsonStream_MoveNext(s);
+            t = JsonStream_MoveNext(s);
+            v = JsonStream_GetString(s, &u);
+            if (t != JsonStreamString || strcmp(v, "charley \"the unicorn\"\r\n") != 0) DIAGNOSTIC_ERROR("test5 string should have round tripped?");
+            JsonStream_MoveNext(s);
+            JsonStream_MoveNext(s);
+            JsonStream_MoveNext(s);
+            if (JsonStream_GetNumberInt(s) != -1234567890123LL) DIAGNOSTIC_ERROR("test5 int should have round tripped?");
+            JsonStream_MoveNext(s);
+            if (JsonStream_GetNumberDouble(s) != 0.075) DIAGNOSTIC_ERROR("test5 double should have round tripped?");
+            JsonStream_Release(s);
+            JsonWriter_Release(jw);
+
             MessageBox(0, "json tested ok i guess", 0, 0);
           }
           break;
@@ -523,8 +887,8 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT message, WPARAM wParam, LPAR
           
           case 1354:
           {
-            if (plateTestBitmapsOne != 0) Plate_Release(plateTestBitmapsOne);
-            plateTestBitmapsOne = Plate_LoadFromFile(PlateFileId_VILLAGE);
+            if (plateTestBitmapsOne != 0) Plate_ReleaseShared(plateTestBitmapsOne);
+            plateTestBitmapsOne = Plate_LoadShared(PlateFileId_VILLAGE, PaletteFileId_NONE);
             if (plateTestBitmapsOne == 0) { DIAGNOSTIC_ERROR("no plates 4 u"); break; }
             InvalidateRect(hwnd, 0, 1);
           }
@@ -545,10 +909,8 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT message, WPARAM wParam, LPAR
               castleBitmapsColor = 0;
             }
 
-            if (castleBitmaps != 0) Plate_Release(castleBitmaps);
-            castleBitmaps = Plate_LoadFromFile(PlateFileId_CASTLE1A + castleBitmapsColor);
-            if (castleBitmaps == 0) { DIAGNOSTIC_ERROR("no castles 4 u"); break; }
-            InvalidateRect(hwnd, 0, 1);
+            // (decoded in the background; CastleLoaded() swaps it in)
+            Plate_LoadSharedAsync(PlateFileId_CASTLE1A + castleBitmapsColor, PaletteFileId_NONE, CastleLoaded, hwnd);
           }
           break;
 
@@ -571,10 +933,10 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT message, WPARAM wParam, LPAR
 
           if (plateTestBitmapsOne != 0)
           {
-            Plate_Release(plateTestBitmapsOne);
+            Plate_ReleaseShared(plateTestBitmapsOne);
             plateTestBitmapsOne = 0;
           }
-          plateTestBitmapsOne = Plate_LoadFromFileWithCustomPalette(plateFileId, paletteFileId);
+          plateTestBitmapsOne = Plate_LoadShared(plateFileId, paletteFileId);
           if (plateTestBitmapsOne == 0) { DIAGNOSTIC_ERROR("no plates 4 u"); break; }
           InvalidateRect(hwnd, 0, 1);
         }
@@ -989,19 +1351,18 @@ static void DrawSomeGl(HWND hwnd)
     glScaled(2, 2, 1);
     glTranslated(30/2, 170/2, 0);
 
+    // the tiles share an atlas page, so this is one draw call
+    SpriteBatch_Begin(0);
     for (int i = 0; i < 5; i++)
     {
       int tileNumber = i * 4 + castleBitmapsBuildStage * 20;
-      glTranslated(30, -15, 0);
-      Bmp_Draw(castleBitmaps[tileNumber]);
-      glTranslated(-30, 15, 0);
-      Bmp_Draw(castleBitmaps[tileNumber+1]);
-      glTranslated(60, 0, 0);
-      Bmp_Draw(castleBitmaps[tileNumber+2]);
-      glTranslated(-30, 15, 0);
-      Bmp_Draw(castleBitmaps[tileNumber+3]);
-      glTranslated(90, -15, 0);
+      float x = i * 120.0f;
+      SpriteBatch_Add(castleBitmaps[tileNumber], x + 30, -15, 0, SPRITEBATCH_WHITE);
+      SpriteBatch_Add(castleBitmaps[tileNumber+1], x, 0, 0, SPRITEBATCH_WHITE);
+      SpriteBatch_Add(castleBitmaps[tileNumber+2], x + 60, 0, 0, SPRITEBATCH_WHITE);
+      SpriteBatch_Add(castleBitmaps[tileNumber+3], x + 30, 15, 0, SPRITEBATCH_WHITE);
     }
+    SpriteBatch_End();
 
     glPopMatrix();
   }
@@ -1166,4 +1527,18 @@ static void DrawGlyphFinderStats(HDC hdc)
     }
     DrawText(hdc, buffer, -1, &rc, DT_SINGLELINE);
   }
-}
\ No newline at end of file
+}
+
+// writes a BITMAPFILEHEADER + BITMAPINFOHEADER (and leaves room for 'colorCount' color table entries after it)
+// for a BI_RGB bmp; returns the size of the whole file
+static int WriteTestBmpHeader(uint8_t* file, int width, int height, int bitCount, int colorCount, int pixelDataSize)
+{
+  int pixelDataOffset = 54 + colorCount * 4;
+  int fileSize = pixelDataOffset + pixelDataSize;
+  int32_t fields[13] = { fileSize, 0, pixelDataOffset, 40, width, height, 1 | (bitCount << 16), 0, pixelDataSize, 0, 0, colorCount, 0 };
+  memset(file, 0, fileSize);
+  file[0] = 'B';
+  file[1] = 'M';
+  memcpy(file + 2, fields, sizeof(fields)); // (little-endian, like the file format)
+  return fileSize;
+}
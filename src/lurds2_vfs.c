@@ -0,0 +1,595 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_vfs.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include <wchar.h>
+#include "lurds2_arena.h"
+#include "lurds2_errors.h"
+#include "lurds2_hash.h"
+#include "lurds2_hashmap.h"
+#include "lurds2_pak.h"
+#include "lurds2_stringutils.h"
+
+#define DIAGNOSTIC_VFS_ERROR(message) DIAGNOSTIC_ERROR(message);
+#define DIAGNOSTIC_VFS_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
+#define DIAGNOSTIC_VFS_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3));
+#define DIAGNOSTIC_VFS_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
+
+#define VFS_SEED 0x6C75726473325666ULL
+#define VFS_MAX_NAME 1024
+#define VFS_MAX_PREFIXES 16
+#define VFS_MAX_PREFIX_LENGTH 32
+#define VFS_STRING_BLOCK_SIZE (64 * 1024)
+
+typedef struct VfsMount {
+  wchar_t* dirPath; // (directory mounts) with a trailing separator
+  char* prefix; // (directory mounts)
+  Pak pak; // (archive mounts)
+} VfsMount;
+
+typedef struct VfsEntry {
+  const char* name; // normalized, e.g. "lords2/base01.256"
+  int32_t nameLength;
+  int32_t nextSameHash; // next entry in the index with the same hash (-1 ends it)
+  VfsFile file;
+} VfsEntry;
+
+static VfsMount gVfsMounts[VFS_MAX_MOUNTS + 1]; // (mount ids start at 1)
+static int32_t gVfsMountCount;
+static VfsEntry* gVfsEntries;
+static int32_t gVfsEntryCount;
+static int32_t gVfsEntryCapacity;
+static HashMap gVfsIndex; // name hash -> first entry index
+static Arena gVfsStrings; // names and relative paths, all released together
+static char gVfsPrefixes[VFS_MAX_PREFIXES][VFS_MAX_PREFIX_LENGTH]; // what's mounted, e.g. "res/"
+static int32_t gVfsPrefixCount;
+
+static int Vfs_Init()
+{
+  if (gVfsIndex != 0) return 1;
+
+  gVfsIndex = HashMap_Create(sizeof(uint64_t), sizeof(int32_t));
+  if (gVfsIndex == 0) return 0;
+
+  gVfsStrings = Arena_Create(VFS_STRING_BLOCK_SIZE);
+  if (gVfsStrings == 0)
+  {
+    HashMap_Release(gVfsIndex);
+    gVfsIndex = 0;
+    return 0;
+  }
+  return 1;
+}
+
+static void Vfs_AddPrefix(const char* name)
+{
+  int length = 0;
+  while (name[length] != 0 && name[length] != '/') length++;
+  if (name[length] != '/' || length + 2 > VFS_MAX_PREFIX_LENGTH) return;
+
+  int32_t i;
+  for (i = 0; i < gVfsPrefixCount; i++)
+  {
+    if (strncmp(gVfsPrefixes[i], name, length + 1) == 0 && gVfsPrefixes[i][length + 1] == 0) return;
+  }
+  if (gVfsPrefixCount == VFS_MAX_PREFIXES)
+  {
+    DIAGNOSTIC_VFS_ERROR("too many different vfs prefixes");
+    return;
+  }
+  memcpy(gVfsPrefixes[gVfsPrefixCount], name, length + 1);
+  gVfsPrefixes[gVfsPrefixCount][length + 1] = 0;
+  gVfsPrefixCount++;
+}
+
+// indexes 'name' (already normalized) as 'file', replacing whatever an earlier (or the same) mount had under that name
+static int Vfs_Add(const char* name, int nameLength, const VfsFile* file)
+{
+  Vfs_AddPrefix(name);
+
+  uint64_t hash = Hash_Bytes(name, nameLength, VFS_SEED);
+  int wasAdded;
+  int32_t* first = HashMap_GetOrAdd(gVfsIndex, &hash, &wasAdded);
+  if (first == 0) return 0;
+
+  if (!wasAdded)
+  {
+    int32_t i;
+    for (i = *first; i != -1; i = gVfsEntries[i].nextSameHash)
+    {
+      if (gVfsEntries[i].nameLength == nameLength && memcmp(gVfsEntries[i].name, name, nameLength) == 0)
+      {
+        if (file->mount >= gVfsEntries[i].file.mount) gVfsEntries[i].file = *file;
+        return 1;
+      }
+    }
+  }
+
+  if (gVfsEntryCount == gVfsEntryCapacity)
+  {
+    int32_t newCapacity = gVfsEntryCapacity ? gVfsEntryCapacity * 2 : 1024;
+    VfsEntry* newEntries = realloc(gVfsEntries, sizeof(VfsEntry) * newCapacity);
+    if (newEntries == 0)
+    {
+      DIAGNOSTIC_VFS_ERROR("failed to allocate memory for vfs entries");
+      if (wasAdded) HashMap_Remove(gVfsIndex, &hash);
+      return 0;
+    }
+    gVfsEntries = newEntries;
+    gVfsEntryCapacity = newCapacity;
+  }
+
+  char* nameCopy = Arena_Push(gVfsStrings, nameLength + 1);
+  if (nameCopy == 0)
+  {
+    if (wasAdded) HashMap_Remove(gVfsIndex, &hash);
+    return 0;
+  }
+  memcpy(nameCopy, name, nameLength + 1);
+
+  VfsEntry* entry = &gVfsEntries[gVfsEntryCount];
+  entry->name = nameCopy;
+  entry->nameLength = nameLength;
+  entry->nextSameHash = wasAdded ? -1 : *first;
+  entry->file = *file;
+  *first = gVfsEntryCount++;
+  return 1;
+}
+
+static int32_t Vfs_AddMount(const wchar_t* dirPath, const char* prefix, Pak pak)
+{
+  if (gVfsMountCount == VFS_MAX_MOUNTS)
+  {
+    DIAGNOSTIC_VFS_ERROR("too many vfs mounts");
+    return 0;
+  }
+
+  VfsMount* mount = &gVfsMounts[++gVfsMountCount];
+  mount->dirPath = 0;
+  mount->prefix = 0;
+  mount->pak = pak;
+  if (dirPath != 0)
+  {
+    mount->prefix = Arena_Push(gVfsStrings, strlen(prefix) + 1);
+    if (mount->prefix == 0)
+    {
+      gVfsMountCount--;
+      return 0;
+    }
+    strcpy(mount->prefix, prefix);
+
+    // keep it with a trailing separator, ready for relative paths
+    int length = wcslen(dirPath);
+    mount->dirPath = Arena_Push(gVfsStrings, (length + 2) * sizeof(wchar_t));
+    if (mount->dirPath == 0)
+    {
+      gVfsMountCount--;
+      return 0;
+    }
+    wcscpy(mount->dirPath, dirPath);
+    if (length > 0 && dirPath[length - 1] != '\\' && dirPath[length - 1] != '/')
+    {
+#ifdef _WIN32
+      wcscat(mount->dirPath, L"\\");
+#else
+      wcscat(mount->dirPath, L"/");
+#endif
+    }
+  }
+  return gVfsMountCount;
+}
+
+// indexes the file at mount dir + relativePath
+static int Vfs_AddDirectoryFile(int32_t mount, const char* prefix, const wchar_t* relativePath)
+{
+  char name[VFS_MAX_NAME];
+  int nameLength = Pak_NormalizeName(name, VFS_MAX_NAME, prefix, relativePath);
+  if (nameLength == 0) return 1; // (not ASCII, so nobody can ask for it; skip it)
+
+  int relativeLength = wcslen(relativePath);
+  wchar_t* relativeCopy = Arena_Push(gVfsStrings, (relativeLength + 1) * sizeof(wchar_t));
+  if (relativeCopy == 0) return 0;
+  wcscpy(relativeCopy, relativePath);
+
+  VfsFile file;
+  file.pakView = 0;
+  file.pakSize = 0;
+  file.mount = mount;
+  file.relativePath = relativeCopy;
+  return Vfs_Add(name, nameLength, &file);
+}
+
+// indexes every file under mount dir + relativeDir (relativeDir is "" or ends with a separator)
+static int Vfs_ScanDirectory(int32_t mount, const char* prefix, const wchar_t* relativeDir)
+{
+  wchar_t path[VFS_MAX_NAME];
+  wchar_t relativePath[VFS_MAX_NAME];
+  int ok = 1;
+  const wchar_t* dirPath = gVfsMounts[mount].dirPath;
+  if (wcslen(dirPath) + wcslen(relativeDir) + 2 > VFS_MAX_NAME)
+  {
+    DIAGNOSTIC_VFS_ERROR("path too long to scan");
+    return 0;
+  }
+
+#ifdef _WIN32
+  WIN32_FIND_DATAW found;
+  wcscpy(path, dirPath);
+  wcscat(path, relativeDir);
+  wcscat(path, L"*");
+  HANDLE find = FindFirstFileW(path, &found);
+  if (find == INVALID_HANDLE_VALUE)
+  {
+    return 1; // (nothing there)
+  }
+  do
+  {
+    const wchar_t* entry = found.cFileName;
+    int isDirectory = (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+  wcscpy(path, dirPath);
+  wcscat(path, relativeDir);
+  char* nPath = StringUtils_MakeNarrowString(path);
+  DIR* d = nPath ? opendir(nPath) : 0;
+  free(nPath);
+  if (d == 0)
+  {
+    return 1; // (nothing there)
+  }
+  struct dirent* found;
+  while ((found = readdir(d)) != 0)
+  {
+    wchar_t* entry = StringUtils_MakeWideString(found->d_name);
+    if (entry == 0) continue;
+#endif
+    if (wcscmp(entry, L".") != 0 && wcscmp(entry, L"..") != 0)
+    {
+      if (wcslen(relativeDir) + wcslen(entry) + 2 > VFS_MAX_NAME) ok = 0;
+      else
+      {
+        wcscpy(relativePath, relativeDir);
+        wcscat(relativePath, entry);
+#ifndef _WIN32
+        struct stat info;
+        wcscpy(path, dirPath);
+        wcscat(path, relativePath);
+        nPath = StringUtils_MakeNarrowString(path);
+        int isDirectory = nPath != 0 && stat(nPath, &info) == 0 && S_ISDIR(info.st_mode);
+        free(nPath);
+#endif
+        if (isDirectory)
+        {
+#ifdef _WIN32
+          wcscat(relativePath, L"\\");
+#else
+          wcscat(relativePath, L"/");
+#endif
+          ok = Vfs_ScanDirectory(mount, prefix, relativePath);
+        }
+        else
+        {
+          ok = Vfs_AddDirectoryFile(mount, prefix, relativePath);
+        }
+      }
+    }
+#ifdef _WIN32
+    if (!ok) break;
+  } while (FindNextFileW(find, &found));
+  FindClose(find);
+  return ok;
+#else
+    free(entry);
+    if (!ok) break;
+  }
+  closedir(d);
+  return ok;
+#endif
+}
+
+int32_t Vfs_MountDirectory(const char* prefix, const wchar_t* dirPath)
+{
+  if (prefix == 0 || dirPath == 0)
+  {
+    DIAGNOSTIC_VFS_ERROR("invalid null prefix/dirPath arg");
+    return 0;
+  }
+
+  if (!Vfs_Init()) return 0;
+
+  int32_t mount = Vfs_AddMount(dirPath, prefix, 0);
+  if (mount == 0) return 0;
+
+  Vfs_AddPrefix(prefix);
+  if (!Vfs_ScanDirectory(mount, prefix, L""))
+  {
+    char* nDirPath = StringUtils_MakeNarrowString(dirPath);
+    DIAGNOSTIC_VFS_ERROR2("failed to index all files in ", nDirPath ? nDirPath : "(out of memory)");
+    free(nDirPath);
+  }
+  return mount;
+}
+
+static int Vfs_CompareNames(const void* a, const void* b)
+{
+  return wcscmp(*(const wchar_t* const*)a, *(const wchar_t* const*)b);
+}
+
+int Vfs_MountEachDirectory(const char* prefix, const wchar_t* parentDir)
+{
+  if (prefix == 0 || parentDir == 0)
+  {
+    DIAGNOSTIC_VFS_ERROR("invalid null prefix/parentDir arg");
+    return 0;
+  }
+
+  // collect the subdirectory names first, so they mount in a predictable order
+  wchar_t path[VFS_MAX_NAME];
+  wchar_t** names = 0;
+  int32_t count = 0;
+  int32_t capacity = 0;
+  int parentLength = wcslen(parentDir);
+  if (parentLength + 3 > VFS_MAX_NAME)
+  {
+    DIAGNOSTIC_VFS_ERROR("path too long to scan");
+    return 0;
+  }
+
+#ifdef _WIN32
+  WIN32_FIND_DATAW found;
+  wcscpy(path, parentDir);
+  wcscat(path, L"\\*");
+  HANDLE find = FindFirstFileW(path, &found);
+  if (find == INVALID_HANDLE_VALUE)
+  {
+    return 0; // (nothing there)
+  }
+  do
+  {
+    if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) continue;
+    wchar_t* name = _wcsdup(found.cFileName);
+#else
+  char* nPath = StringUtils_MakeNarrowString(parentDir);
+  DIR* d = nPath ? opendir(nPath) : 0;
+  free(nPath);
+  if (d == 0)
+  {
+    return 0; // (nothing there)
+  }
+  struct dirent* found;
+  while ((found = readdir(d)) != 0)
+  {
+    wchar_t* name = StringUtils_MakeWideString(found->d_name);
+#endif
+    if (name == 0) continue;
+    if (wcscmp(name, L".") == 0 || wcscmp(name, L"..") == 0 || parentLength + wcslen(name) + 2 > VFS_MAX_NAME)
+    {
+      free(name);
+      continue;
+    }
+    if (count == capacity)
+    {
+      capacity = capacity ? capacity * 2 : 16;
+      wchar_t** newNames = realloc(names, sizeof(wchar_t*) * capacity);
+      if (newNames == 0)
+      {
+        free(name);
+        break;
+      }
+      names = newNames;
+    }
+    names[count++] = name;
+#ifdef _WIN32
+  } while (FindNextFileW(find, &found));
+  FindClose(find);
+#else
+  }
+  closedir(d);
+#endif
+  if (count > 0) qsort(names, count, sizeof(wchar_t*), Vfs_CompareNames);
+
+  int mounted = 0;
+  int32_t i;
+  for (i = 0; i < count; i++)
+  {
+    wcscpy(path, parentDir);
+#ifdef _WIN32
+    wcscat(path, L"\\");
+#else
+    wcscat(path, L"/");
+    struct stat info;
+#endif
+    wcscat(path, names[i]);
+    free(names[i]);
+#ifndef _WIN32
+    nPath = StringUtils_MakeNarrowString(path);
+    int isDirectory = nPath != 0 && stat(nPath, &info) == 0 && S_ISDIR(info.st_mode);
+    free(nPath);
+    if (!isDirectory) continue;
+#endif
+    if (Vfs_MountDirectory(prefix, path)) mounted++;
+  }
+  free(names);
+  return mounted;
+}
+
+int32_t Vfs_MountPak(const wchar_t* pakPath)
+{
+  if (pakPath == 0)
+  {
+    DIAGNOSTIC_VFS_ERROR("invalid null pakPath arg");
+    return 0;
+  }
+
+  if (!Vfs_Init()) return 0;
+
+  Pak pak = Pak_Open(pakPath);
+  if (pak == 0) return 0;
+
+  int32_t mount = Vfs_AddMount(0, 0, pak);
+  if (mount == 0)
+  {
+    Pak_Close(pak);
+    return 0;
+  }
+
+  int32_t count = Pak_GetCount(pak);
+  int32_t i;
+  for (i = 0; i < count; i++)
+  {
+    VfsFile file;
+    file.mount = mount;
+    file.relativePath = 0;
+    const char* name = Pak_GetEntry(pak, i, &file.pakView, &file.pakSize);
+    if (!Vfs_Add(name, strlen(name), &file)) break;
+  }
+  return mount;
+}
+
+void Vfs_UnmountAll()
+{
+  int32_t i;
+  for (i = 1; i <= gVfsMountCount; i++)
+  {
+    if (gVfsMounts[i].pak != 0) Pak_Close(gVfsMounts[i].pak);
+  }
+  memset(gVfsMounts, 0, sizeof(gVfsMounts));
+  gVfsMountCount = 0;
+
+  free(gVfsEntries);
+  gVfsEntries = 0;
+  gVfsEntryCount = 0;
+  gVfsEntryCapacity = 0;
+  gVfsPrefixCount = 0;
+  if (gVfsIndex != 0)
+  {
+    HashMap_Release(gVfsIndex);
+    gVfsIndex = 0;
+    Arena_Release(gVfsStrings);
+    gVfsStrings = 0;
+  }
+}
+
+int Vfs_IsMounted(const char* prefix)
+{
+  int32_t i;
+  for (i = 0; i < gVfsPrefixCount; i++)
+  {
+    if (strcmp(gVfsPrefixes[i], prefix) == 0) return 1;
+  }
+  return 0;
+}
+
+int Vfs_Find(const char* prefix, const wchar_t* name, VfsFile* file)
+{
+  if (name == 0)
+  {
+    DIAGNOSTIC_VFS_ERROR("invalid null name arg");
+    return 0;
+  }
+
+  if (gVfsIndex == 0) return 0;
+
+  char normalized[VFS_MAX_NAME];
+  int length = Pak_NormalizeName(normalized, VFS_MAX_NAME, prefix, name);
+  if (length == 0) return 0;
+
+  uint64_t hash = Hash_Bytes(normalized, length, VFS_SEED);
+  int32_t* first = HashMap_Get(gVfsIndex, &hash);
+  if (first == 0) return 0;
+
+  int32_t i;
+  for (i = *first; i != -1; i = gVfsEntries[i].nextSameHash)
+  {
+    if (gVfsEntries[i].nameLength == length && memcmp(gVfsEntries[i].name, normalized, length) == 0)
+    {
+      if (file) *file = gVfsEntries[i].file;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int Vfs_GetPath(const VfsFile* file, wchar_t* buffer, int bufferSize)
+{
+  if (file == 0 || buffer == 0 || file->mount <= 0 || file->mount > gVfsMountCount || gVfsMounts[file->mount].dirPath == 0)
+  {
+    DIAGNOSTIC_VFS_ERROR("invalid file/buffer arg (or not a directory file)");
+    return 0;
+  }
+
+  const wchar_t* dirPath = gVfsMounts[file->mount].dirPath;
+  int length = wcslen(dirPath) + wcslen(file->relativePath);
+  if (length + 1 > bufferSize)
+  {
+    DIAGNOSTIC_VFS_ERROR("insufficient buffer size to hold full file path");
+    return 0;
+  }
+
+  wcscpy(buffer, dirPath);
+  wcscat(buffer, file->relativePath);
+  return length;
+}
+
+int Vfs_ContainsView(const void* view)
+{
+  int32_t i;
+  for (i = 1; i <= gVfsMountCount; i++)
+  {
+    if (gVfsMounts[i].pak != 0 && Pak_Contains(gVfsMounts[i].pak, view)) return 1;
+  }
+  return 0;
+}
+
+int Vfs_AddFile(int32_t mount, const char* prefix, const wchar_t* name)
+{
+  if (mount <= 0 || mount > gVfsMountCount || gVfsMounts[mount].dirPath == 0 || prefix == 0 || name == 0)
+  {
+    DIAGNOSTIC_VFS_ERROR("invalid mount/prefix/name arg");
+    return 0;
+  }
+
+  return Vfs_AddDirectoryFile(mount, prefix, name);
+}
+
+int32_t Vfs_GetFileCount()
+{
+  return gVfsEntryCount;
+}
+
+const char* Vfs_GetFileName(int32_t index)
+{
+  if (index < 0 || index >= gVfsEntryCount)
+  {
+    DIAGNOSTIC_VFS_ERROR("index out of range");
+    return 0;
+  }
+
+  return gVfsEntries[index].name;
+}
+
+int32_t Vfs_GetMountCount()
+{
+  return gVfsMountCount;
+}
+
+const wchar_t* Vfs_GetMountDirectory(int32_t mount, const char** prefix)
+{
+  if (mount <= 0 || mount > gVfsMountCount)
+  {
+    DIAGNOSTIC_VFS_ERROR("invalid mount arg");
+    return 0;
+  }
+
+  if (prefix) *prefix = gVfsMounts[mount].prefix;
+  return gVfsMounts[mount].dirPath;
+}
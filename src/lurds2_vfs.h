@@ -0,0 +1,60 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_VFS
+#define LURDS2_VFS
+
+#include "lurds2_pak.h"
+
+// The VFS indexes every file in its mount points once, when they're mounted, so looking a file up afterwards
+// is a hash lookup that never touches the OS (and files that aren't there are known to be missing for free).
+// A directory mount lists its files under a prefix ("res/...", "lords2/..."); an .lpak archive mount lists its
+// entries as they're named in the archive. When several mounts have the same name, the latest mount wins,
+// so mods are mounted last. Names are looked up like pak names (case-insensitive, '\' or '/').
+// Mount, unmount and look things up from the main thread only. (Other threads stick to ResourceFile_MapPath()
+// and ResourceFile_UnmapPath(), which never look at the mounts.)
+
+#define VFS_MAX_MOUNTS 64
+
+// a located file: either a view into a mounted archive, or a file in a mounted directory
+typedef struct VfsFile {
+  const void* pakView; // (0 for directory files)
+  int pakSize;
+  int32_t mount;
+  const wchar_t* relativePath; // (directory files) relative to the mount's directory, as found on disk
+} VfsFile;
+
+// scans 'dirPath' (recursively) and indexes its files as prefix/relative/path; returns a mount id, or 0 on failure
+int32_t Vfs_MountDirectory(const char* prefix, const wchar_t* dirPath);
+// mounts each subdirectory of 'parentDir' (in name order, so later names win) like Vfs_MountDirectory();
+// returns how many were mounted
+int     Vfs_MountEachDirectory(const char* prefix, const wchar_t* parentDir);
+// opens the archive and indexes its entries; returns a mount id, or 0 on failure
+int32_t Vfs_MountPak(const wchar_t* pakPath);
+// unmounts everything (after everything mapped from archives has been unmapped)
+void    Vfs_UnmountAll();
+
+// returns 1 if anything is mounted under 'prefix' (e.g. "res/"), so callers know whether to trust a miss
+int     Vfs_IsMounted(const char* prefix);
+// looks prefix + name (e.g. "res/", L"old_timey_font.json") up in the index; returns 0 when it isn't there
+int     Vfs_Find(const char* prefix, const wchar_t* name, VfsFile* file);
+// writes the full path of a directory file to 'buffer'; returns its length, or 0 on failure
+int     Vfs_GetPath(const VfsFile* file, wchar_t* buffer, int bufferSize);
+// returns 1 if 'view' points into a mounted archive
+int     Vfs_ContainsView(const void* view);
+// indexes a file just created in a directory mount (named like it would be looked up), unless a later mount
+// has a file with the same name; returns 0 on failure
+int     Vfs_AddFile(int32_t mount, const char* prefix, const wchar_t* name);
+int32_t Vfs_GetFileCount();
+// returns the normalized name of the index'th indexed file (e.g. "lords2/base01.256"), or 0 when out of range
+const char* Vfs_GetFileName(int32_t index);
+
+// mount ids go from 1 to Vfs_GetMountCount(), in mount order
+int32_t Vfs_GetMountCount();
+// returns a directory mount's path (with a trailing separator) and its prefix, or 0 for an archive mount
+const wchar_t* Vfs_GetMountDirectory(int32_t mount, const char** prefix);
+
+#endif
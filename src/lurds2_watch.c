@@ -0,0 +1,477 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#include "lurds2_watch.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include <wchar.h>
+#include "lurds2_errors.h"
+#include "lurds2_stringutils.h"
+
+#define DIAGNOSTIC_WATCH_ERROR(message) DIAGNOSTIC_ERROR(message);
+#define DIAGNOSTIC_WATCH_ERROR2(m1, m2) DIAGNOSTIC_ERROR2((m1), (m2));
+#define DIAGNOSTIC_WATCH_ERROR3(m1, m2, m3) DIAGNOSTIC_ERROR3((m1), (m2), (m3));
+#define DIAGNOSTIC_WATCH_ERROR4(m1, m2, m3, m4) DIAGNOSTIC_ERROR4((m1), (m2), (m3), (m4));
+
+#define WATCH_MAX_PATH 1024
+#define WATCH_BUFFER_SIZE (16 * 1024)
+
+#ifdef _WIN32
+#ifndef FILE_LIST_DIRECTORY
+#define FILE_LIST_DIRECTORY 0x0001
+#endif
+#define WATCH_FILTER (FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE)
+#else
+// a directory being watched, so events (which only say which directory) can be turned back into paths
+typedef struct WatchDirectory {
+  int wd;
+  wchar_t* relativeDir; // "" or ending with '/'
+} WatchDirectory;
+#endif
+
+typedef struct WatchChange {
+  wchar_t* path; // relative to the watched directory
+  uint32_t lastChangeMs;
+} WatchChange;
+
+typedef struct WatchData {
+  wchar_t* dirPath;
+  WatchChange* changes; // in the order they first changed
+  int32_t changeCount;
+  int32_t changeCapacity;
+  wchar_t* current; // what Watch_Next() returned last
+#ifdef _WIN32
+  CRITICAL_SECTION lock; // guards 'changes', which the thread adds to
+  HANDLE directory;
+  HANDLE thread;
+  HANDLE stopEvent;
+  OVERLAPPED overlapped;
+  DWORD ownerThreadId;
+  DWORD buffer[WATCH_BUFFER_SIZE / sizeof(DWORD)]; // (FILE_NOTIFY_INFORMATION has to be DWORD aligned)
+#else
+  int fd;
+  WatchDirectory* directories;
+  int32_t directoryCount;
+  int32_t directoryCapacity;
+#endif
+} WatchData;
+
+static uint32_t Watch_NowMs()
+{
+#ifdef _WIN32
+  return GetTickCount();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+#endif
+}
+
+// notes that the file at 'path' (not null terminated) changed just now; returns 0 on failure
+static int Watch_Record(WatchData* data, const wchar_t* path, int length)
+{
+  uint32_t now = Watch_NowMs();
+  int32_t i;
+  for (i = 0; i < data->changeCount; i++)
+  {
+    if (wcsncmp(data->changes[i].path, path, length) == 0 && data->changes[i].path[length] == 0)
+    {
+      data->changes[i].lastChangeMs = now;
+      return 1;
+    }
+  }
+
+  if (data->changeCount == data->changeCapacity)
+  {
+    int32_t newCapacity = data->changeCapacity ? data->changeCapacity * 2 : 16;
+    WatchChange* newChanges = realloc(data->changes, sizeof(WatchChange) * newCapacity);
+    if (newChanges == 0)
+    {
+      DIAGNOSTIC_WATCH_ERROR("failed to allocate memory for changes");
+      return 0;
+    }
+    data->changes = newChanges;
+    data->changeCapacity = newCapacity;
+  }
+
+  wchar_t* copy = malloc((length + 1) * sizeof(wchar_t));
+  if (copy == 0)
+  {
+    DIAGNOSTIC_WATCH_ERROR("failed to allocate memory for changed path");
+    return 0;
+  }
+  wcsncpy(copy, path, length);
+  copy[length] = 0;
+  data->changes[data->changeCount].path = copy;
+  data->changes[data->changeCount].lastChangeMs = now;
+  data->changeCount++;
+  return 1;
+}
+
+static void Watch_Free(WatchData* data)
+{
+  int32_t i;
+  for (i = 0; i < data->changeCount; i++) free(data->changes[i].path);
+  free(data->changes);
+  free(data->current);
+  free(data->dirPath);
+  free(data);
+}
+
+#ifdef _WIN32
+// records the files in the thread's buffer; returns 1 if there were any
+static int Watch_Parse(WatchData* data, DWORD size)
+{
+  wchar_t fullPath[WATCH_MAX_PATH];
+  int dirPathLength = wcslen(data->dirPath);
+  int recorded = 0;
+  if (size == 0) return 0; // (the buffer overflowed, so what changed is unknown)
+
+  const uint8_t* position = (const uint8_t*)data->buffer;
+  for (;;)
+  {
+    const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)position;
+    int length = info->FileNameLength / sizeof(wchar_t);
+    if ((info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+      && dirPathLength + length + 1 < WATCH_MAX_PATH)
+    {
+      // (folders get "modified" whenever their files do; only files are interesting)
+      wcscpy(fullPath, data->dirPath);
+      wcsncat(fullPath, info->FileName, length);
+      DWORD attributes = GetFileAttributesW(fullPath);
+      if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+      {
+        EnterCriticalSection(&data->lock);
+        recorded |= Watch_Record(data, info->FileName, length);
+        LeaveCriticalSection(&data->lock);
+      }
+    }
+    if (info->NextEntryOffset == 0) break;
+    position += info->NextEntryOffset;
+  }
+  return recorded;
+}
+
+static DWORD WINAPI Watch_Worker(LPVOID arg)
+{
+  WatchData* data = arg;
+  HANDLE events[2] = { data->overlapped.hEvent, data->stopEvent };
+  int unsettled = 0;
+  for (;;)
+  {
+    if (!ReadDirectoryChangesW(data->directory, data->buffer, sizeof(data->buffer), TRUE, WATCH_FILTER, 0, &data->overlapped, 0))
+    {
+      DIAGNOSTIC_WATCH_ERROR2("ReadDirectoryChangesW(): ", GetLastErrorMessage());
+      return 0;
+    }
+
+    // (a little longer than the settle time, for the tick count's granularity)
+    DWORD result;
+    while ((result = WaitForMultipleObjects(2, events, FALSE, unsettled ? WATCH_SETTLE_MS + 32 : INFINITE)) == WAIT_TIMEOUT)
+    {
+      unsettled = 0;
+      PostThreadMessage(data->ownerThreadId, WM_NULL, 0, 0);
+    }
+    if (result != WAIT_OBJECT_0) break; // (stopping)
+
+    DWORD size;
+    if (!GetOverlappedResult(data->directory, &data->overlapped, &size, FALSE))
+    {
+      DIAGNOSTIC_WATCH_ERROR2("GetOverlappedResult(): ", GetLastErrorMessage());
+      return 0;
+    }
+    if (Watch_Parse(data, size)) unsettled = 1;
+  }
+
+  DWORD ignored;
+  CancelIo(data->directory);
+  GetOverlappedResult(data->directory, &data->overlapped, &ignored, TRUE);
+  return 0;
+}
+#else
+// starts watching the directory at dirPath + relativeDir, and every directory under it; returns 0 on failure.
+// With 'isNew', the files already in it are recorded too (they may have been written before it was watched).
+static int Watch_AddDirectory(WatchData* data, const wchar_t* relativeDir, int isNew)
+{
+  wchar_t path[WATCH_MAX_PATH];
+  if (wcslen(data->dirPath) + wcslen(relativeDir) + 1 > WATCH_MAX_PATH) return 0;
+  wcscpy(path, data->dirPath);
+  wcscat(path, relativeDir);
+
+  char* nPath = StringUtils_MakeNarrowString(path);
+  if (nPath == 0) return 0;
+  int wd = inotify_add_watch(data->fd, nPath, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+  DIR* d = wd >= 0 ? opendir(nPath) : 0;
+  free(nPath);
+  if (wd < 0 || d == 0)
+  {
+    if (d != 0) closedir(d);
+    DIAGNOSTIC_WATCH_ERROR2("inotify_add_watch(): ", GetLastErrorMessage());
+    return 0;
+  }
+
+  if (data->directoryCount == data->directoryCapacity)
+  {
+    int32_t newCapacity = data->directoryCapacity ? data->directoryCapacity * 2 : 16;
+    WatchDirectory* newDirectories = realloc(data->directories, sizeof(WatchDirectory) * newCapacity);
+    if (newDirectories == 0)
+    {
+      DIAGNOSTIC_WATCH_ERROR("failed to allocate memory for watched directories");
+      closedir(d);
+      return 0;
+    }
+    data->directories = newDirectories;
+    data->directoryCapacity = newCapacity;
+  }
+  WatchDirectory* directory = &data->directories[data->directoryCount];
+  directory->wd = wd;
+  directory->relativeDir = malloc((wcslen(relativeDir) + 1) * sizeof(wchar_t));
+  if (directory->relativeDir == 0)
+  {
+    closedir(d);
+    return 0;
+  }
+  wcscpy(directory->relativeDir, relativeDir);
+  data->directoryCount++;
+
+  // (inotify doesn't watch subdirectories by itself)
+  int ok = 1;
+  struct dirent* found;
+  while (ok && (found = readdir(d)) != 0)
+  {
+    if (strcmp(found->d_name, ".") == 0 || strcmp(found->d_name, "..") == 0) continue;
+    wchar_t* entry = StringUtils_MakeWideString(found->d_name);
+    if (entry == 0) continue;
+    if (wcslen(relativeDir) + wcslen(entry) + 2 <= WATCH_MAX_PATH)
+    {
+      struct stat info;
+      wcscpy(path, relativeDir);
+      wcscat(path, entry);
+      wchar_t fullPath[WATCH_MAX_PATH];
+      char* nFullPath = 0;
+      if (wcslen(data->dirPath) + wcslen(path) + 1 <= WATCH_MAX_PATH)
+      {
+        wcscpy(fullPath, data->dirPath);
+        wcscat(fullPath, path);
+        nFullPath = StringUtils_MakeNarrowString(fullPath);
+      }
+      if (nFullPath != 0 && stat(nFullPath, &info) == 0)
+      {
+        if (S_ISDIR(info.st_mode))
+        {
+          wcscat(path, L"/");
+          ok = Watch_AddDirectory(data, path, isNew);
+        }
+        else if (isNew)
+        {
+          Watch_Record(data, path, wcslen(path));
+        }
+      }
+      free(nFullPath);
+    }
+    free(entry);
+  }
+  closedir(d);
+  return ok;
+}
+
+// records whatever inotify has queued up
+static void Watch_ReadEvents(WatchData* data)
+{
+  wchar_t path[WATCH_MAX_PATH];
+  uint64_t buffer[WATCH_BUFFER_SIZE / sizeof(uint64_t)]; // (aligned for struct inotify_event)
+  ssize_t size;
+  while ((size = read(data->fd, buffer, sizeof(buffer))) > 0)
+  {
+    const char* position = (const char*)buffer;
+    while (position < (const char*)buffer + size)
+    {
+      const struct inotify_event* event = (const struct inotify_event*)position;
+      position += sizeof(struct inotify_event) + event->len;
+      if (event->len == 0) continue;
+
+      const wchar_t* relativeDir = 0;
+      int32_t i;
+      for (i = 0; i < data->directoryCount; i++)
+      {
+        if (data->directories[i].wd == event->wd) relativeDir = data->directories[i].relativeDir;
+      }
+      wchar_t* name = StringUtils_MakeWideString(event->name);
+      if (relativeDir != 0 && name != 0 && wcslen(relativeDir) + wcslen(name) + 2 <= WATCH_MAX_PATH)
+      {
+        wcscpy(path, relativeDir);
+        wcscat(path, name);
+        if (event->mask & IN_ISDIR)
+        {
+          if (event->mask & (IN_CREATE | IN_MOVED_TO))
+          {
+            wcscat(path, L"/");
+            Watch_AddDirectory(data, path, 1);
+          }
+        }
+        else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+        {
+          Watch_Record(data, path, wcslen(path));
+        }
+      }
+      free(name);
+    }
+  }
+}
+#endif
+
+Watch Watch_Start(const wchar_t* dirPath)
+{
+  if (dirPath == 0)
+  {
+    DIAGNOSTIC_WATCH_ERROR("invalid null dirPath arg");
+    return 0;
+  }
+
+  WatchData* data = malloc(sizeof(WatchData));
+  if (data == 0)
+  {
+    DIAGNOSTIC_WATCH_ERROR("failed to allocate memory for WatchData");
+    return 0;
+  }
+  memset(data, 0, sizeof(WatchData));
+
+  // kept with a trailing separator, ready for relative paths
+  int length = wcslen(dirPath);
+  data->dirPath = malloc((length + 2) * sizeof(wchar_t));
+  if (data->dirPath == 0)
+  {
+    DIAGNOSTIC_WATCH_ERROR("failed to allocate memory for dirPath");
+    free(data);
+    return 0;
+  }
+  wcscpy(data->dirPath, dirPath);
+  if (length > 0 && dirPath[length - 1] != '\\' && dirPath[length - 1] != '/')
+  {
+#ifdef _WIN32
+    wcscat(data->dirPath, L"\\");
+#else
+    wcscat(data->dirPath, L"/");
+#endif
+  }
+
+#ifdef _WIN32
+  InitializeCriticalSection(&data->lock);
+  data->ownerThreadId = GetCurrentThreadId();
+  data->directory = CreateFileW(dirPath, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+    OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0);
+  if (data->directory == INVALID_HANDLE_VALUE)
+  {
+    DIAGNOSTIC_WATCH_ERROR2("CreateFileW(): ", GetLastErrorMessage());
+    goto error;
+  }
+  data->overlapped.hEvent = CreateEvent(0, TRUE, FALSE, 0);
+  data->stopEvent = CreateEvent(0, TRUE, FALSE, 0);
+  if (data->overlapped.hEvent == 0 || data->stopEvent == 0)
+  {
+    DIAGNOSTIC_WATCH_ERROR2("CreateEvent(): ", GetLastErrorMessage());
+    goto error;
+  }
+  data->thread = CreateThread(0, 0, Watch_Worker, data, 0, 0);
+  if (data->thread == 0)
+  {
+    DIAGNOSTIC_WATCH_ERROR2("CreateThread(): ", GetLastErrorMessage());
+    goto error;
+  }
+  return data;
+
+error:
+  if (data->stopEvent != 0) CloseHandle(data->stopEvent);
+  if (data->overlapped.hEvent != 0) CloseHandle(data->overlapped.hEvent);
+  if (data->directory != INVALID_HANDLE_VALUE) CloseHandle(data->directory);
+  DeleteCriticalSection(&data->lock);
+  Watch_Free(data);
+  return 0;
+#else
+  data->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (data->fd < 0)
+  {
+    DIAGNOSTIC_WATCH_ERROR2("inotify_init1(): ", GetLastErrorMessage());
+    Watch_Free(data);
+    return 0;
+  }
+  if (!Watch_AddDirectory(data, L"", 0))
+  {
+    Watch_Stop(data);
+    return 0;
+  }
+  return data;
+#endif
+}
+
+void Watch_Stop(Watch watch)
+{
+  WatchData* data = watch;
+  if (data == 0)
+  {
+    DIAGNOSTIC_WATCH_ERROR("invalid null watch arg");
+    return;
+  }
+
+#ifdef _WIN32
+  SetEvent(data->stopEvent);
+  WaitForSingleObject(data->thread, INFINITE);
+  CloseHandle(data->thread);
+  CloseHandle(data->stopEvent);
+  CloseHandle(data->overlapped.hEvent);
+  CloseHandle(data->directory);
+  DeleteCriticalSection(&data->lock);
+#else
+  close(data->fd);
+  int32_t i;
+  for (i = 0; i < data->directoryCount; i++) free(data->directories[i].relativeDir);
+  free(data->directories);
+#endif
+  Watch_Free(data);
+}
+
+const wchar_t* Watch_Next(Watch watch)
+{
+  WatchData* data = watch;
+  if (data == 0)
+  {
+    DIAGNOSTIC_WATCH_ERROR("invalid null watch arg");
+    return 0;
+  }
+
+  free(data->current);
+  data->current = 0;
+
+#ifdef _WIN32
+  EnterCriticalSection(&data->lock);
+#else
+  Watch_ReadEvents(data);
+#endif
+  uint32_t now = Watch_NowMs();
+  int32_t i;
+  for (i = 0; i < data->changeCount; i++)
+  {
+    if (now - data->changes[i].lastChangeMs >= WATCH_SETTLE_MS)
+    {
+      data->current = data->changes[i].path;
+      memmove(&data->changes[i], &data->changes[i + 1], sizeof(WatchChange) * (data->changeCount - i - 1));
+      data->changeCount--;
+      break;
+    }
+  }
+#ifdef _WIN32
+  LeaveCriticalSection(&data->lock);
+#endif
+  return data->current;
+}
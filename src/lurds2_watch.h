@@ -0,0 +1,28 @@
+/*
+This is free and unencumbered software released into the public domain under The Unlicense.
+You have complete freedom to do anything you want with the software, for any purpose.
+Please refer to <http://unlicense.org/>
+*/
+
+#ifndef LURDS2_WATCH
+#define LURDS2_WATCH
+
+typedef void* Watch;
+
+// A Watch reports files that were created, written or renamed into a directory (or any folder under it),
+// via ReadDirectoryChangesW() on a small thread on Windows, and inotify elsewhere.
+// Editors tend to write a file in several goes, so a file is only reported once it has been left alone for
+// WATCH_SETTLE_MS, and only once however many times it changed meanwhile.
+// Start, stop and poll a Watch from the main thread.
+#define WATCH_SETTLE_MS 150
+
+// starts watching 'dirPath' recursively; returns 0 on failure (e.g. when the directory doesn't exist)
+Watch          Watch_Start(const wchar_t* dirPath);
+void           Watch_Stop(Watch watch);
+
+// returns the path (relative to the watched directory) of the next settled change, or 0 when there's none yet.
+// The path is valid until the next call. (On Windows, the thread that started the watch is sent a WM_NULL
+// when there are changes to pick up, so a GetMessage() loop wakes up for them.)
+const wchar_t* Watch_Next(Watch watch);
+
+#endif